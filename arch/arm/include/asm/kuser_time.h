@@ -0,0 +1,60 @@
+/*
+ *  arch/arm/include/asm/kuser_time.h
+ *
+ *  Time data published in the vector page for the __kuser_clock_gettime
+ *  helper (see entry-armv.S).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_KUSER_TIME_H
+#define __ASM_ARM_KUSER_TIME_H
+
+/*
+ * The time data lives in the vector page, below the kuser helpers, and
+ * the clocksource counter register, if user readable, is mapped into the
+ * page following it.  Both addresses are part of the user ABI.
+ */
+#define KUSER_TIMEDATA		0xffff0e00
+#define KUSER_COUNTER_BASE	0xffff1000
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+/*
+ * Layout of the time data.  While the kernel updates it, seq is odd;
+ * a reader must retry if seq was odd or changed while it read.  counter
+ * is the user address of the 32-bit counter register of the current
+ * clocksource, or 0 if there is none and the system call has to be used.
+ */
+struct kuser_timedata {
+	u32	seq;		/* 0x00 */
+	u32	counter;	/* 0x04 */
+	u32	cycle_last;	/* 0x08 */
+	u32	mask;		/* 0x0c */
+	u32	mult;		/* 0x10 */
+	u32	shift;		/* 0x14 */
+	u32	wall_sec;	/* 0x18 */
+	u32	wall_nsec;	/* 0x1c */
+	u32	wtm_sec;	/* 0x20 */
+	u32	wtm_nsec;	/* 0x24 */
+	s32	tz_minuteswest;	/* 0x28 */
+	s32	tz_dsttime;	/* 0x2c */
+};
+
+struct clocksource;
+
+#ifdef CONFIG_KUSER_TIME
+extern void kuser_time_set_counter(struct clocksource *cs, unsigned long phys);
+#else
+static inline void kuser_time_set_counter(struct clocksource *cs,
+					  unsigned long phys)
+{
+}
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_KUSER_TIME_H */
@@ -387,6 +387,11 @@
 #define __NR_dup3			(__NR_SYSCALL_BASE+358)
 #define __NR_pipe2			(__NR_SYSCALL_BASE+359)
 #define __NR_inotify_init1		(__NR_SYSCALL_BASE+360)
+					/* 361 - 363 reserved */
+#define __NR_perf_counter_open		(__NR_SYSCALL_BASE+364)
+#define __NR_recvmmsg			(__NR_SYSCALL_BASE+365)
+					/* 366 - 373 reserved */
+#define __NR_sendmmsg			(__NR_SYSCALL_BASE+374)
 
 /*
  * The following SWIs are ARM private.
@@ -0,0 +1,112 @@
+/*
+ *  linux/arch/arm/kernel/kuser_time.c
+ *
+ *  Publish the timekeeping state in the vector page, so that the
+ *  __kuser_clock_gettime helper can compute CLOCK_REALTIME and
+ *  CLOCK_MONOTONIC from user space without entering the kernel.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/time.h>
+#include <linux/clocksource.h>
+#include <linux/spinlock.h>
+
+#include <asm/kuser_time.h>
+#include <asm/pgtable.h>
+#include <asm/tlbflush.h>
+
+static struct kuser_timedata *const kuser_timedata =
+	(struct kuser_timedata *)KUSER_TIMEDATA;
+
+/* Serializes the writers: the timer tick and settimeofday(). */
+static DEFINE_SPINLOCK(kuser_time_lock);
+
+static struct clocksource *kuser_clocksource;
+static u32 kuser_counter;
+
+static inline void kuser_time_write_begin(struct kuser_timedata *td)
+{
+	td->seq++;
+	smp_wmb();
+}
+
+static inline void kuser_time_write_end(struct kuser_timedata *td)
+{
+	smp_wmb();
+	td->seq++;
+}
+
+/*
+ * Map the page holding the counter register of @cs, at physical address
+ * @phys, user read-only at KUSER_COUNTER_BASE.  Only a 32-bit (or
+ * narrower) free running counter can be read by the helper.
+ */
+void __init kuser_time_set_counter(struct clocksource *cs, unsigned long phys)
+{
+	unsigned long addr = KUSER_COUNTER_BASE;
+	pmd_t *pmd = pmd_offset(pgd_offset_k(addr), addr);
+	pte_t *pte;
+
+	if (cs->mask > 0xffffffffULL || cs->shift > 31)
+		return;
+
+	/*
+	 * The second level table of the vector page covers this address
+	 * too; it was set up by devicemaps_init().
+	 */
+	if (pmd_none(*pmd))
+		return;
+
+	pte = pte_offset_kernel(pmd, addr);
+	set_pte_ext(pte, pfn_pte(__phys_to_pfn(phys),
+				 __pgprot(L_PTE_PRESENT | L_PTE_YOUNG |
+					  L_PTE_USER | L_PTE_MT_DEV_SHARED)), 0);
+	flush_tlb_kernel_page(addr);
+
+	kuser_clocksource = cs;
+	kuser_counter = addr + (phys & ~PAGE_MASK);
+}
+
+/* Called with xtime_lock held for writing. */
+void update_vsyscall(struct timespec *ts, struct clocksource *c)
+{
+	struct kuser_timedata *td = kuser_timedata;
+	unsigned long flags;
+
+	spin_lock_irqsave(&kuser_time_lock, flags);
+	kuser_time_write_begin(td);
+
+	if (c == kuser_clocksource) {
+		td->counter = kuser_counter;
+		td->cycle_last = c->cycle_last;
+		td->mask = c->mask;
+		td->mult = c->mult;
+		td->shift = c->shift;
+	} else
+		td->counter = 0;
+
+	td->wall_sec = ts->tv_sec;
+	td->wall_nsec = ts->tv_nsec;
+	td->wtm_sec = wall_to_monotonic.tv_sec;
+	td->wtm_nsec = wall_to_monotonic.tv_nsec;
+
+	kuser_time_write_end(td);
+	spin_unlock_irqrestore(&kuser_time_lock, flags);
+}
+
+void update_vsyscall_tz(void)
+{
+	struct kuser_timedata *td = kuser_timedata;
+	unsigned long flags;
+
+	spin_lock_irqsave(&kuser_time_lock, flags);
+	kuser_time_write_begin(td);
+	td->tz_minuteswest = sys_tz.tz_minuteswest;
+	td->tz_dsttime = sys_tz.tz_dsttime;
+	kuser_time_write_end(td);
+	spin_unlock_irqrestore(&kuser_time_lock, flags);
+}
@@ -0,0 +1,467 @@
+/*
+ *  linux/arch/arm/kernel/perf_counter.c
+ *
+ *  Performance counter support for the ARMv7 (Cortex-A8) performance
+ *  monitor unit: the cycle counter CCNT plus four event counters, all
+ *  32 bits wide, sharing one overflow interrupt.
+ *
+ *  The cp15 register accessors follow the oprofile driver in
+ *  arch/arm/oprofile/op_model_v7.c.  Both use the same hardware, so
+ *  whichever starts first gets it and the other one fails with -EBUSY.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/perf_counter.h>
+
+#include <asm/cputype.h>
+#include <asm/irq_regs.h>
+#include <asm/system.h>
+
+/*
+ * PMNC: control register
+ */
+#define ARMV7_PMNC_E		(1 << 0)	/* Enable all counters */
+#define ARMV7_PMNC_P		(1 << 1)	/* Reset all event counters */
+#define ARMV7_PMNC_C		(1 << 2)	/* Cycle counter reset */
+#define ARMV7_PMNC_D		(1 << 3)	/* CCNT counts every 64th cycle */
+#define ARMV7_PMNC_MASK		0x3f		/* Mask for writable bits */
+
+/*
+ * Counter indices: CCNT and PMN0-3.  In the enable, interrupt enable and
+ * overflow flag registers CCNT is bit 31 and PMNx is bit x.
+ */
+#define ARMV7_IDX_CYCLE_COUNTER	0
+#define ARMV7_IDX_COUNTER0	1
+#define ARMV7_MAX_COUNTERS	5
+
+#define ARMV7_CNT_MASK		0x8000000f
+
+/* Counters are 32-bit; keep well away from the sign bit. */
+#define ARMV7_MAX_PERIOD	0x7fffffffULL
+
+/*
+ * Event numbers.  ARMV7_PERFCTR_CPU_CYCLES is not a hardware event: it
+ * selects the dedicated cycle counter.
+ */
+#define ARMV7_PERFCTR_DCACHE_REFILL	0x03
+#define ARMV7_PERFCTR_DCACHE_ACCESS	0x04
+#define ARMV7_PERFCTR_INSTR_EXECUTED	0x08
+#define ARMV7_PERFCTR_PC_WRITE		0x0c
+#define ARMV7_PERFCTR_PC_BRANCH_MIS_PRED 0x10
+#define ARMV7_PERFCTR_CLOCK_CYCLES	0x11
+#define ARMV7_PERFCTR_CPU_CYCLES	0xff
+#define ARMV7_PERFCTR_UNSUPPORTED	0x100
+
+static const unsigned armv7_a8_perf_map[PERF_COUNT_HW_MAX] = {
+	[PERF_COUNT_HW_CPU_CYCLES]	    = ARMV7_PERFCTR_CPU_CYCLES,
+	[PERF_COUNT_HW_INSTRUCTIONS]	    = ARMV7_PERFCTR_INSTR_EXECUTED,
+	[PERF_COUNT_HW_CACHE_REFERENCES]    = ARMV7_PERFCTR_DCACHE_ACCESS,
+	[PERF_COUNT_HW_CACHE_MISSES]	    = ARMV7_PERFCTR_DCACHE_REFILL,
+	[PERF_COUNT_HW_BRANCH_INSTRUCTIONS] = ARMV7_PERFCTR_PC_WRITE,
+	[PERF_COUNT_HW_BRANCH_MISSES]	    = ARMV7_PERFCTR_PC_BRANCH_MIS_PRED,
+	[PERF_COUNT_HW_BUS_CYCLES]	    = ARMV7_PERFCTR_UNSUPPORTED,
+};
+
+struct cpu_hw_counters {
+	struct perf_counter	*counters[ARMV7_MAX_COUNTERS];
+	unsigned long		used_mask;
+};
+
+static DEFINE_PER_CPU(struct cpu_hw_counters, cpu_hw_counters);
+
+static int armv7pmu_supported;
+
+static int armv7pmu_irqs[] = {
+#ifdef CONFIG_ARCH_OMAP3
+	INT_34XX_BENCH_MPU_EMUL,
+#endif
+};
+
+static atomic_t active_counters;
+static DEFINE_MUTEX(pmu_reserve_mutex);
+
+static inline u32 armv7_pmnc_read(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	return val;
+}
+
+static inline void armv7_pmnc_write(u32 val)
+{
+	val &= ARMV7_PMNC_MASK;
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val));
+}
+
+static inline u32 armv7_counter_bit(int idx)
+{
+	if (idx == ARMV7_IDX_CYCLE_COUNTER)
+		return 1U << 31;
+	return 1U << (idx - ARMV7_IDX_COUNTER0);
+}
+
+static inline void armv7_pmnc_enable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 1"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_disable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 2"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_enable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 1"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_disable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 2"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_pmnc_clear_flag(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 3"
+		     : : "r" (armv7_counter_bit(idx)));
+}
+
+static inline u32 armv7_pmnc_getreset_flags(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (val));
+	val &= ARMV7_CNT_MASK;
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+
+	return val;
+}
+
+static inline void armv7_pmnc_select_counter(int idx)
+{
+	u32 val = idx - ARMV7_IDX_COUNTER0;
+
+	asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (val));
+}
+
+static inline void armv7_pmnc_write_evtsel(int idx, u32 val)
+{
+	armv7_pmnc_select_counter(idx);
+	asm volatile("mcr p15, 0, %0, c9, c13, 1" : : "r" (val & 0xff));
+}
+
+static inline u32 armv7pmu_read_counter(int idx)
+{
+	u32 val;
+
+	if (idx == ARMV7_IDX_CYCLE_COUNTER) {
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+	} else {
+		armv7_pmnc_select_counter(idx);
+		asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (val));
+	}
+
+	return val;
+}
+
+static inline void armv7pmu_write_counter(int idx, u32 val)
+{
+	if (idx == ARMV7_IDX_CYCLE_COUNTER) {
+		asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (val));
+	} else {
+		armv7_pmnc_select_counter(idx);
+		asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (val));
+	}
+}
+
+/*
+ * Fold the hardware counter into the 64-bit count.  Always called on the
+ * counter's cpu with interrupts disabled.
+ */
+static void armv7pmu_counter_update(struct perf_counter *counter,
+				    struct hw_perf_counter *hwc, int idx)
+{
+	u32 prev_raw_count = hwc->prev_count;
+	u32 new_raw_count = armv7pmu_read_counter(idx);
+	u32 delta = new_raw_count - prev_raw_count;
+
+	hwc->prev_count = new_raw_count;
+	counter->count += delta;
+	hwc->period_left -= delta;
+}
+
+/*
+ * Program the counter to overflow when the rest of the period has
+ * elapsed.  Counters that only count overflow every ARMV7_MAX_PERIOD
+ * events, just so that the 32-bit value is folded in often enough.
+ * Returns 1 when a sampling period was completed.
+ */
+static int armv7pmu_set_period(struct perf_counter *counter,
+			       struct hw_perf_counter *hwc, int idx)
+{
+	s64 left = hwc->period_left;
+	s64 period = hwc->sample_period;
+	int ret = 0;
+
+	if (!period) {
+		left = ARMV7_MAX_PERIOD;
+	} else if (unlikely(left <= -period)) {
+		left = period;
+		hwc->period_left = left;
+		ret = 1;
+	} else if (unlikely(left <= 0)) {
+		left += period;
+		hwc->period_left = left;
+		ret = 1;
+	}
+
+	if (left > ARMV7_MAX_PERIOD)
+		left = ARMV7_MAX_PERIOD;
+
+	hwc->prev_count = (u32)-left;
+	armv7pmu_write_counter(idx, (u32)-left);
+
+	return ret;
+}
+
+static int armv7pmu_enable(struct perf_counter *counter)
+{
+	struct cpu_hw_counters *cpuc = &__get_cpu_var(cpu_hw_counters);
+	struct hw_perf_counter *hwc = &counter->hw;
+	u32 event = hwc->config;
+	int idx;
+
+	/*
+	 * Cycles go to CCNT if it is free, and to an event counter
+	 * otherwise; everything else needs an event counter.
+	 */
+	if (event == ARMV7_PERFCTR_CPU_CYCLES) {
+		if (!test_and_set_bit(ARMV7_IDX_CYCLE_COUNTER,
+				      &cpuc->used_mask)) {
+			idx = ARMV7_IDX_CYCLE_COUNTER;
+			goto found;
+		}
+		event = ARMV7_PERFCTR_CLOCK_CYCLES;
+	}
+
+	idx = find_next_zero_bit(&cpuc->used_mask, ARMV7_MAX_COUNTERS,
+				 ARMV7_IDX_COUNTER0);
+	if (idx == ARMV7_MAX_COUNTERS)
+		return -EAGAIN;
+	set_bit(idx, &cpuc->used_mask);
+
+found:
+	hwc->idx = idx;
+	cpuc->counters[idx] = counter;
+
+	armv7_pmnc_disable_counter(idx);
+	if (idx != ARMV7_IDX_CYCLE_COUNTER)
+		armv7_pmnc_write_evtsel(idx, event);
+	armv7pmu_set_period(counter, hwc, idx);
+	armv7_pmnc_enable_intens(idx);
+	armv7_pmnc_enable_counter(idx);
+
+	return 0;
+}
+
+static void armv7pmu_disable(struct perf_counter *counter)
+{
+	struct cpu_hw_counters *cpuc = &__get_cpu_var(cpu_hw_counters);
+	struct hw_perf_counter *hwc = &counter->hw;
+	int idx = hwc->idx;
+
+	armv7_pmnc_disable_counter(idx);
+	armv7_pmnc_disable_intens(idx);
+	armv7_pmnc_clear_flag(idx);
+
+	armv7pmu_counter_update(counter, hwc, idx);
+
+	cpuc->counters[idx] = NULL;
+	clear_bit(idx, &cpuc->used_mask);
+}
+
+static void armv7pmu_read(struct perf_counter *counter)
+{
+	armv7pmu_counter_update(counter, &counter->hw, counter->hw.idx);
+}
+
+static const struct pmu armv7pmu = {
+	.enable		= armv7pmu_enable,
+	.disable	= armv7pmu_disable,
+	.read		= armv7pmu_read,
+};
+
+void hw_perf_disable(void)
+{
+	if (!armv7pmu_supported || !atomic_read(&active_counters))
+		return;
+
+	armv7_pmnc_write(armv7_pmnc_read() & ~ARMV7_PMNC_E);
+}
+
+void hw_perf_enable(void)
+{
+	if (!armv7pmu_supported || !atomic_read(&active_counters))
+		return;
+
+	armv7_pmnc_write(armv7_pmnc_read() | ARMV7_PMNC_E);
+}
+
+static irqreturn_t armv7pmu_handle_irq(int irq, void *dev)
+{
+	struct cpu_hw_counters *cpuc = &__get_cpu_var(cpu_hw_counters);
+	struct pt_regs *regs = get_irq_regs();
+	u32 pmnc, flags;
+	int idx;
+
+	flags = armv7_pmnc_getreset_flags();
+	if (!flags)
+		return IRQ_NONE;
+
+	pmnc = armv7_pmnc_read();
+	armv7_pmnc_write(pmnc & ~ARMV7_PMNC_E);
+
+	for (idx = 0; idx < ARMV7_MAX_COUNTERS; idx++) {
+		struct perf_counter *counter = cpuc->counters[idx];
+		struct hw_perf_counter *hwc;
+
+		if (!counter || !(flags & armv7_counter_bit(idx)))
+			continue;
+
+		hwc = &counter->hw;
+		armv7pmu_counter_update(counter, hwc, idx);
+		if (armv7pmu_set_period(counter, hwc, idx))
+			perf_counter_overflow(counter, regs, 0);
+	}
+
+	armv7_pmnc_write(pmnc);
+
+	return IRQ_HANDLED;
+}
+
+static void armv7pmu_reset(void *info)
+{
+	int idx;
+
+	for (idx = 0; idx < ARMV7_MAX_COUNTERS; idx++) {
+		armv7_pmnc_disable_counter(idx);
+		armv7_pmnc_disable_intens(idx);
+	}
+	armv7_pmnc_getreset_flags();
+
+	/* Reset all counters; CCNT counts every cycle. */
+	armv7_pmnc_write(ARMV7_PMNC_P | ARMV7_PMNC_C);
+}
+
+static int armv7pmu_reserve_hardware(void)
+{
+	int i, err;
+
+	if (!ARRAY_SIZE(armv7pmu_irqs))
+		return -ENODEV;
+
+	if (armv7_pmnc_read() & ARMV7_PMNC_E)
+		return -EBUSY;
+
+	on_each_cpu(armv7pmu_reset, NULL, 1);
+
+	for (i = 0; i < ARRAY_SIZE(armv7pmu_irqs); i++) {
+		err = request_irq(armv7pmu_irqs[i], armv7pmu_handle_irq,
+				  IRQF_DISABLED, "perf counters", NULL);
+		if (err) {
+			printk(KERN_ERR "perf counters: unable to request "
+			       "IRQ%d\n", armv7pmu_irqs[i]);
+			while (i-- != 0)
+				free_irq(armv7pmu_irqs[i], NULL);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+static void armv7pmu_release_hardware(void)
+{
+	int i;
+
+	on_each_cpu(armv7pmu_reset, NULL, 1);
+
+	for (i = 0; i < ARRAY_SIZE(armv7pmu_irqs); i++)
+		free_irq(armv7pmu_irqs[i], NULL);
+}
+
+static void hw_perf_counter_destroy(struct perf_counter *counter)
+{
+	mutex_lock(&pmu_reserve_mutex);
+	if (atomic_dec_and_test(&active_counters))
+		armv7pmu_release_hardware();
+	mutex_unlock(&pmu_reserve_mutex);
+}
+
+const struct pmu *hw_perf_counter_init(struct perf_counter *counter)
+{
+	struct perf_counter_attr *attr = &counter->attr;
+	struct hw_perf_counter *hwc = &counter->hw;
+	int err = 0;
+
+	if (!armv7pmu_supported)
+		return ERR_PTR(-ENODEV);
+
+	/* The Cortex-A8 PMU counts in all modes alike. */
+	if (attr->exclude_user || attr->exclude_kernel)
+		return ERR_PTR(-EOPNOTSUPP);
+
+	if (attr->type == PERF_TYPE_RAW) {
+		hwc->config = attr->config & 0xff;
+	} else {
+		if (attr->config >= PERF_COUNT_HW_MAX)
+			return ERR_PTR(-EINVAL);
+		hwc->config = armv7_a8_perf_map[attr->config];
+		if (hwc->config == ARMV7_PERFCTR_UNSUPPORTED)
+			return ERR_PTR(-EOPNOTSUPP);
+	}
+	hwc->idx = -1;
+
+	mutex_lock(&pmu_reserve_mutex);
+	if (atomic_inc_return(&active_counters) == 1) {
+		err = armv7pmu_reserve_hardware();
+		if (err)
+			atomic_dec(&active_counters);
+	}
+	mutex_unlock(&pmu_reserve_mutex);
+
+	if (err)
+		return ERR_PTR(err);
+
+	counter->destroy = hw_perf_counter_destroy;
+
+	return &armv7pmu;
+}
+
+static int __init init_hw_perf_counters(void)
+{
+	if (cpu_architecture() != CPU_ARCH_ARMv7 ||
+	    (read_cpuid_id() & 0xff0ffff0) != 0x410fc080)
+		return 0;
+
+	armv7pmu_supported = 1;
+	printk(KERN_INFO "perf counters: ARMv7 Cortex-A8 PMU, %d counters\n",
+	       ARMV7_MAX_COUNTERS);
+
+	return 0;
+}
+arch_initcall(init_hw_perf_counters);
@@ -24,6 +24,7 @@
 
 #include <linux/sched.h>
 #include <linux/cpuidle.h>
+#include <linux/spinlock.h>
 #include <mach/prcm.h>
 #include <mach/powerdomain.h>
 #include <mach/clockdomain.h>
@@ -59,6 +60,19 @@ struct omap3_processor_cx omap3_power_states[OMAP3_MAX_STATES];
 struct omap3_processor_cx current_cx_state;
 struct powerdomain *mpu_pd, *core_pd, *per_pd;
 
+/*
+ * Wakeup latency constraints in us, one per source, as aggregated over
+ * all requesting devices by the shared resource framework.  Whenever one
+ * changes, the deepest state honouring all of them is recomputed for
+ * every C state into omap3_idle_limit[], so that the idle path only has
+ * to do a table lookup.
+ */
+static u32 omap3_idle_lat[OMAP3_IDLE_LAT_MAX] = {
+	[0 ... OMAP3_IDLE_LAT_MAX - 1] = UINT_MAX,
+};
+static int omap3_idle_limit[CPUIDLE_STATE_MAX];
+static DEFINE_SPINLOCK(omap3_idle_lat_lock);
+
 static int omap3_idle_bm_check(void)
 {
 	if (!omap3_can_sleep())
@@ -140,20 +154,26 @@ return_sleep_time:
 }
 
 /**
- * omap3_enter_idle_bm - Checks for any bus activity
+ * omap3_enter_idle_bm - Checks latency constraints and bus activity
  * @dev: cpuidle device
  * @state: The target state to be programmed
  *
- * Called from the CPUidle framework for C states with CPUIDLE_FLAG_CHECK_BM
- * flag set. This function checks for any pending bus activity and then
- * programs the device to the specified or a lower possible state
+ * Called from the CPUidle framework for all C states. This function
+ * demotes the state to the deepest one allowed by the current wakeup
+ * latency constraints, checks for any pending bus activity if that state
+ * has CPUIDLE_FLAG_CHECK_BM set and then programs the device to the
+ * resulting state
  */
 static int omap3_enter_idle_bm(struct cpuidle_device *dev,
 			       struct cpuidle_state *state)
 {
-	struct cpuidle_state *new_state = state;
+	struct cpuidle_state *new_state;
+
+	/* Demote to the deepest state the latency constraints allow */
+	new_state = &dev->states[omap3_idle_limit[state - dev->states]];
 
-	if ((state->flags & CPUIDLE_FLAG_CHECK_BM) && omap3_idle_bm_check()) {
+	if ((new_state->flags & CPUIDLE_FLAG_CHECK_BM) &&
+	    omap3_idle_bm_check()) {
 		BUG_ON(!dev->safe_state);
 		new_state = dev->safe_state;
 	}
@@ -164,6 +184,55 @@ static int omap3_enter_idle_bm(struct cpuidle_device *dev,
 
 DEFINE_PER_CPU(struct cpuidle_device, omap3_idle_dev);
 
+/*
+ * omap3_idle_update_limits - recompute the per-state demotion table.
+ *
+ * An MPU constraint applies to the full exit latency of every state.  A
+ * CORE constraint only applies to states that take the CORE power domain
+ * to RET or OFF, so e.g. an MMC or audio DMA constraint keeps MPU OFF with
+ * CORE inactive available.  OMAP3 has a single MPU, hence CPU 0.
+ */
+static void omap3_idle_update_limits(void)
+{
+	struct cpuidle_device *dev = &per_cpu(omap3_idle_dev, 0);
+	u32 mpu_lat = omap3_idle_lat[OMAP3_IDLE_LAT_MPU];
+	u32 core_lat = min(omap3_idle_lat[OMAP3_IDLE_LAT_CORE],
+			   omap3_idle_lat[OMAP3_IDLE_LAT_CORE_PWRDM]);
+	int i, allowed = 0;
+
+	for (i = 0; i < dev->state_count; i++) {
+		struct cpuidle_state *state = &dev->states[i];
+		struct omap3_processor_cx *cx = cpuidle_get_statedata(state);
+
+		if (state->exit_latency <= mpu_lat &&
+		    (cx->core_state >= PWRDM_POWER_INACTIVE ||
+		     state->exit_latency <= core_lat))
+			allowed = i;
+		omap3_idle_limit[i] = allowed;
+	}
+}
+
+/**
+ * omap3_idle_set_latency - update a wakeup latency constraint
+ * @src: constraint source, one of OMAP3_IDLE_LAT_*
+ * @latency: aggregated latency in us, RES_DEFAULTLEVEL (0) for none
+ *
+ * Called by the latency resources in resource34xx.c whenever the
+ * aggregated level of a resource changes.
+ */
+void omap3_idle_set_latency(int src, u32 latency)
+{
+	unsigned long flags;
+
+	if (src < 0 || src >= OMAP3_IDLE_LAT_MAX)
+		return;
+
+	spin_lock_irqsave(&omap3_idle_lat_lock, flags);
+	omap3_idle_lat[src] = latency ? latency : UINT_MAX;
+	omap3_idle_update_limits();
+	spin_unlock_irqrestore(&omap3_idle_lat_lock, flags);
+}
+
 /* omap3_init_power_states - Initialises the OMAP3 specific C states.
  *
  * Below is the desciption of each C state.
@@ -290,8 +359,7 @@ int omap3_idle_init(void)
 		state->exit_latency = cx->sleep_latency + cx->wakeup_latency;
 		state->target_residency = cx->threshold;
 		state->flags = cx->flags;
-		state->enter = (state->flags & CPUIDLE_FLAG_CHECK_BM) ?
-			omap3_enter_idle_bm : omap3_enter_idle;
+		state->enter = omap3_enter_idle_bm;
 		if (cx->type == OMAP3_STATE_C1)
 			dev->safe_state = state;
 		sprintf(state->name, "C%d", count+1);
@@ -302,6 +370,10 @@ int omap3_idle_init(void)
 		return -EINVAL;
 	dev->state_count = count;
 
+	spin_lock_irq(&omap3_idle_lat_lock);
+	omap3_idle_update_limits();
+	spin_unlock_irq(&omap3_idle_lat_lock);
+
 	if (cpuidle_register_device(dev)) {
 		printk(KERN_ERR "%s: CPUidle register device failed\n",
 		       __func__);
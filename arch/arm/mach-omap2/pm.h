@@ -17,10 +17,18 @@
 extern int omap2_pm_init(void);
 extern int omap3_pm_init(void);
 
+/* Sources of wakeup latency constraints consulted by the OMAP3 idle path */
+#define OMAP3_IDLE_LAT_MPU		0	/* mpu_latency */
+#define OMAP3_IDLE_LAT_CORE		1	/* core_latency (sDMA) */
+#define OMAP3_IDLE_LAT_CORE_PWRDM	2	/* core_pwrdm_latency */
+#define OMAP3_IDLE_LAT_MAX		3
+
 #ifdef CONFIG_CPU_IDLE
 int omap3_idle_init(void);
+void omap3_idle_set_latency(int src, u32 latency);
 #else
 static inline int omap3_idle_init(void) { return 0; }
+static inline void omap3_idle_set_latency(int src, u32 latency) { }
 #endif
 
 extern unsigned short enable_dyn_sleep;
@@ -37,22 +37,29 @@
  */
 void init_latency(struct shared_resource *resp)
 {
+	struct latency_res_db *lat_db = resp->resource_data;
+
 	resp->no_of_users = 0;
 	resp->curr_level = RES_DEFAULTLEVEL;
-	*((u8 *)resp->resource_data) = 0;
+	lat_db->pm_qos_req_added = 0;
 	return;
 }
 
 /**
- * set_latency - Adds/Updates and removes the CPU_DMA_LATENCY in *pm_qos_params.
+ * set_latency - Updates the idle constraint cache and CPU_DMA_LATENCY.
  * @resp: resource pointer
  * @latency: target latency to be set
  *
+ * Hands the aggregated latency to the OMAP3 idle code and, for resources
+ * mirrored into pm_qos, adds/updates/removes the CPU_DMA_LATENCY
+ * requirement.
+ *
  * Returns 0 on success, or error values as returned by
  * pm_qos_update_requirement/pm_qos_add_requirement.
  */
 int set_latency(struct shared_resource *resp, u32 latency)
 {
+	struct latency_res_db *lat_db = resp->resource_data;
 	u8 *pm_qos_req_added;
 
 	if (resp->curr_level == latency)
@@ -61,7 +68,11 @@ int set_latency(struct shared_resource *resp, u32 latency)
 		/* Update the resources current level */
 		resp->curr_level = latency;
 
-	pm_qos_req_added = resp->resource_data;
+	omap3_idle_set_latency(lat_db->idle_src, latency);
+	if (!lat_db->use_pm_qos)
+		return 0;
+
+	pm_qos_req_added = &lat_db->pm_qos_req_added;
 	if (latency == RES_DEFAULTLEVEL)
 		/* No more users left, remove the pm_qos_req if present */
 		if (*pm_qos_req_added) {
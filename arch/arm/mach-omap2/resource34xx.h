@@ -27,6 +27,7 @@
 #include <mach/powerdomain.h>
 #include <mach/omap-pm.h>
 #include <mach/omap34xx.h>
+#include "pm.h"
 
 extern int sr_voltagescale_vcbypass(u32 t_opp, u32 c_opp, u8 t_vsel, u8 c_vsel);
 extern void lock_scratchpad_sem();
@@ -34,12 +35,33 @@ extern void unlock_scratchpad_sem();
 
 /*
  * mpu_latency/core_latency are used to control the cpuidle C state.
+ * The aggregated level of each is handed to the OMAP3 idle code, which
+ * only restricts the C states the constraint actually applies to: an
+ * MPU constraint limits every state, a CORE constraint only those that
+ * put the CORE domain in RET or OFF.  mpu_latency is additionally
+ * mirrored into PM_QOS_CPU_DMA_LATENCY so the governor sees it.
  */
 void init_latency(struct shared_resource *resp);
 int set_latency(struct shared_resource *resp, u32 target_level);
 
-static u8 mpu_qos_req_added;
-static u8 core_qos_req_added;
+struct latency_res_db {
+	int idle_src;		/* OMAP3_IDLE_LAT_* */
+	u8 use_pm_qos;
+	u8 pm_qos_req_added;
+};
+
+static struct latency_res_db mpu_lat_db = {
+	.idle_src	= OMAP3_IDLE_LAT_MPU,
+	.use_pm_qos	= 1,
+};
+
+static struct latency_res_db core_lat_db = {
+	.idle_src	= OMAP3_IDLE_LAT_CORE,
+};
+
+static struct latency_res_db core_pwrdm_lat_db = {
+	.idle_src	= OMAP3_IDLE_LAT_CORE_PWRDM,
+};
 
 static struct shared_resource_ops lat_res_ops = {
 	.init 		= init_latency,
@@ -49,14 +71,14 @@ static struct shared_resource_ops lat_res_ops = {
 static struct shared_resource mpu_latency = {
 	.name 		= "mpu_latency",
 	.omap_chip	= OMAP_CHIP_INIT(CHIP_IS_OMAP3430),
-	.resource_data  = &mpu_qos_req_added,
+	.resource_data  = &mpu_lat_db,
 	.ops 		= &lat_res_ops,
 };
 
 static struct shared_resource core_latency = {
 	.name 		= "core_latency",
 	.omap_chip	= OMAP_CHIP_INIT(CHIP_IS_OMAP3430),
-	.resource_data	= &core_qos_req_added,
+	.resource_data	= &core_lat_db,
 	.ops 		= &lat_res_ops,
 };
 
@@ -91,7 +113,7 @@ static struct shared_resource_ops pd_lat_res_ops = {
 static struct shared_resource core_pwrdm_latency = {
 	.name		= "core_pwrdm_latency",
 	.omap_chip	= OMAP_CHIP_INIT(CHIP_IS_OMAP3430),
-	.resource_data	= &core_qos_req_added,
+	.resource_data	= &core_pwrdm_lat_db,
 	.ops		= &lat_res_ops,
 };
 
@@ -209,6 +209,7 @@ console_initcall(omap_add_serial_console);
 #ifdef	TIMER_32K_SYNCHRONIZED
 
 #include <linux/clocksource.h>
+#include <asm/kuser_time.h>
 
 static cycle_t omap_32k_read(void)
 {
@@ -254,6 +255,9 @@ static int __init omap_init_clocksource_32k(void)
 
 		if (clocksource_register(&clocksource_32k))
 			printk(err, clocksource_32k.name);
+		else
+			kuser_time_set_counter(&clocksource_32k,
+					       TIMER_32K_SYNCHRONIZED);
 	}
 	return 0;
 }
@@ -19,6 +19,8 @@
 #include <linux/kobject.h>
 #include <linux/spinlock.h>
 #include <linux/notifier.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -40,11 +42,81 @@ struct cpufreq_stats {
 	unsigned int *freq_table;
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	unsigned int *trans_table;
+	ktime_t trans_start;
+	unsigned int *lat_table;
+	unsigned int *lat_max;
 #endif
 };
 
 static DEFINE_PER_CPU(struct cpufreq_stats *, cpufreq_stats_table);
 
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+/*
+ * Transition latencies are kept as a log2 histogram per from/to pair:
+ * bucket 0 counts transitions shorter than 2^CPUFREQ_LAT_SHIFT us, each
+ * following bucket doubles the upper bound and the last one is open ended.
+ */
+#define CPUFREQ_LAT_BUCKETS	10
+#define CPUFREQ_LAT_SHIFT	5
+
+static unsigned int cpufreq_lat_bucket(s64 us)
+{
+	if (us < (1 << CPUFREQ_LAT_SHIFT))
+		return 0;
+	if (us >= (1 << (CPUFREQ_LAT_SHIFT + CPUFREQ_LAT_BUCKETS - 2)))
+		return CPUFREQ_LAT_BUCKETS - 1;
+	return fls((unsigned int)us >> CPUFREQ_LAT_SHIFT);
+}
+#endif
+
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+/*
+ * Per-task residency is indexed by a system-wide list of frequencies, the
+ * union of all policy tables, so that tasks migrating between CPUs with
+ * different tables still account into a single array.
+ */
+static unsigned int cpufreq_task_freqs[CPUFREQ_TASK_STATS_MAX];
+static unsigned int cpufreq_task_nfreqs;
+static DEFINE_PER_CPU(int, cpufreq_task_index);
+
+/* Must be called with cpufreq_stats_lock held */
+static int cpufreq_task_freq_index(unsigned int freq, int add)
+{
+	int i;
+
+	for (i = 0; i < cpufreq_task_nfreqs; i++)
+		if (cpufreq_task_freqs[i] == freq)
+			return i;
+	if (!add || cpufreq_task_nfreqs >= CPUFREQ_TASK_STATS_MAX)
+		return -1;
+	cpufreq_task_freqs[cpufreq_task_nfreqs] = freq;
+	return cpufreq_task_nfreqs++;
+}
+
+void cpufreq_task_stats_account(struct task_struct *p, cputime_t cputime)
+{
+	int index = __get_cpu_var(cpufreq_task_index);
+
+	if (index < 0)
+		return;
+	p->cpufreq_stats.time_in_state[index] =
+		cputime64_add(p->cpufreq_stats.time_in_state[index],
+			      cputime_to_cputime64(cputime));
+}
+
+int cpufreq_task_stats_show(struct task_cpufreq_stats *st, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < cpufreq_task_nfreqs; i++)
+		len += sprintf(buf + len, "%u %llu\n", cpufreq_task_freqs[i],
+			(unsigned long long)
+			cputime64_to_clock_t(st->time_in_state[i]));
+	return len;
+}
+#endif
+
 struct cpufreq_stats_attribute {
 	struct attribute attr;
 	ssize_t(*show) (struct cpufreq_stats *, char *);
@@ -140,6 +212,51 @@ show_trans_table(struct cpufreq_policy *policy, char *buf)
 	return len;
 }
 CPUFREQ_STATDEVICE_ATTR(trans_table,0444,show_trans_table);
+
+static ssize_t
+show_trans_latency(struct cpufreq_policy *policy, char *buf)
+{
+	ssize_t len = 0;
+	int i, j, k;
+
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	len += snprintf(buf + len, PAGE_SIZE - len,
+			"     From        To    Max(us)");
+	for (k = 0; k < CPUFREQ_LAT_BUCKETS - 1; k++)
+		len += snprintf(buf + len, PAGE_SIZE - len, " %7s%-4u", "<",
+				1 << (CPUFREQ_LAT_SHIFT + k));
+	len += snprintf(buf + len, PAGE_SIZE - len, " %7s%-4u\n", ">=",
+			1 << (CPUFREQ_LAT_SHIFT + k - 1));
+
+	for (i = 0; i < stat->state_num; i++) {
+		for (j = 0; j < stat->state_num; j++) {
+			unsigned int *hist = stat->lat_table +
+				(i * stat->max_state + j) * CPUFREQ_LAT_BUCKETS;
+			unsigned int total = 0;
+
+			if (len >= PAGE_SIZE)
+				return PAGE_SIZE;
+			for (k = 0; k < CPUFREQ_LAT_BUCKETS; k++)
+				total += hist[k];
+			if (!total)
+				continue;
+			len += snprintf(buf + len, PAGE_SIZE - len,
+					"%9u %9u %10u", stat->freq_table[i],
+					stat->freq_table[j],
+					stat->lat_max[i * stat->max_state + j]);
+			for (k = 0; k < CPUFREQ_LAT_BUCKETS; k++)
+				len += snprintf(buf + len, PAGE_SIZE - len,
+						" %11u", hist[k]);
+			len += snprintf(buf + len, PAGE_SIZE - len, "\n");
+		}
+	}
+	if (len >= PAGE_SIZE)
+		return PAGE_SIZE;
+	return len;
+}
+CPUFREQ_STATDEVICE_ATTR(trans_latency,0444,show_trans_latency);
 #endif
 
 CPUFREQ_STATDEVICE_ATTR(total_trans,0444,show_total_trans);
@@ -150,6 +267,7 @@ static struct attribute *default_attrs[] = {
 	&_attr_time_in_state.attr,
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&_attr_trans_table.attr,
+	&_attr_trans_latency.attr,
 #endif
 	NULL
 };
@@ -220,6 +338,8 @@ cpufreq_stats_create_table (struct cpufreq_policy *policy,
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	alloc_size += count * count * sizeof(int);
+	alloc_size += count * count * CPUFREQ_LAT_BUCKETS * sizeof(int);
+	alloc_size += count * count * sizeof(int);
 #endif
 	stat->max_state = count;
 	stat->time_in_state = kzalloc(alloc_size, GFP_KERNEL);
@@ -231,6 +351,8 @@ cpufreq_stats_create_table (struct cpufreq_policy *policy,
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	stat->trans_table = stat->freq_table + count;
+	stat->lat_table = stat->trans_table + count * count;
+	stat->lat_max = stat->lat_table + count * count * CPUFREQ_LAT_BUCKETS;
 #endif
 	j = 0;
 	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
@@ -244,6 +366,13 @@ cpufreq_stats_create_table (struct cpufreq_policy *policy,
 	spin_lock(&cpufreq_stats_lock);
 	stat->last_time = get_jiffies_64();
 	stat->last_index = freq_table_get_index(stat, policy->cur);
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	for (i = 0; i < stat->state_num; i++)
+		cpufreq_task_freq_index(stat->freq_table[i], 1);
+	for_each_cpu(i, policy->cpus)
+		per_cpu(cpufreq_task_index, i) =
+			cpufreq_task_freq_index(policy->cur, 0);
+#endif
 	spin_unlock(&cpufreq_stats_lock);
 	cpufreq_cpu_put(data);
 	return 0;
@@ -280,7 +409,19 @@ cpufreq_stat_notifier_trans (struct notifier_block *nb, unsigned long val,
 	struct cpufreq_freqs *freq = data;
 	struct cpufreq_stats *stat;
 	int old_index, new_index;
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	ktime_t now = ktime_get();
+	s64 lat_us;
+#endif
 
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	if (val == CPUFREQ_PRECHANGE) {
+		stat = per_cpu(cpufreq_stats_table, freq->cpu);
+		if (stat)
+			stat->trans_start = now;
+		return 0;
+	}
+#endif
 	if (val != CPUFREQ_POSTCHANGE)
 		return 0;
 
@@ -292,6 +433,32 @@ cpufreq_stat_notifier_trans (struct notifier_block *nb, unsigned long val,
 	new_index = freq_table_get_index(stat, freq->new);
 
 	cpufreq_stats_update(freq->cpu);
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	spin_lock(&cpufreq_stats_lock);
+	per_cpu(cpufreq_task_index, freq->cpu) =
+		cpufreq_task_freq_index(freq->new, 0);
+	spin_unlock(&cpufreq_stats_lock);
+#endif
+#ifdef CONFIG_CPU_FREQ_STAT_DETAILS
+	/*
+	 * PRECHANGE and POSTCHANGE bracket the driver's target() call, so
+	 * the delta is the time the hardware transition took.  Same-index
+	 * transitions (e.g. voltage-only OPP changes) are recorded too.
+	 */
+	if (old_index != -1 && new_index != -1 &&
+	    stat->trans_start.tv64 != 0) {
+		unsigned int pair = old_index * stat->max_state + new_index;
+
+		lat_us = ktime_to_us(ktime_sub(now, stat->trans_start));
+		spin_lock(&cpufreq_stats_lock);
+		stat->lat_table[pair * CPUFREQ_LAT_BUCKETS +
+				cpufreq_lat_bucket(lat_us)]++;
+		if (lat_us > stat->lat_max[pair])
+			stat->lat_max[pair] = (unsigned int)lat_us;
+		spin_unlock(&cpufreq_stats_lock);
+	}
+	stat->trans_start.tv64 = 0;
+#endif
 	if (old_index == new_index)
 		return 0;
 
@@ -347,6 +514,10 @@ __init cpufreq_stats_init(void)
 	unsigned int cpu;
 
 	spin_lock_init(&cpufreq_stats_lock);
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	for_each_possible_cpu(cpu)
+		per_cpu(cpufreq_task_index, cpu) = -1;
+#endif
 	if ((ret = cpufreq_register_notifier(&notifier_policy_block,
 				CPUFREQ_POLICY_NOTIFIER)))
 		return ret;
@@ -656,6 +656,7 @@ static int ld_lm3530_probe(struct i2c_client *client,
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	als_data->early_suspend.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN + 1;
+	als_data->early_suspend.group = EARLY_SUSPEND_GROUP_BACKLIGHT;
 	als_data->early_suspend.suspend = lm3530_early_suspend;
 	als_data->early_suspend.resume = lm3530_late_resume;
 	register_early_suspend(&als_data->early_suspend);
@@ -1456,7 +1456,7 @@ static int __init dm_snapshot_init(void)
 		goto bad5;
 	}
 
-	ksnapd = create_singlethread_workqueue("ksnapd");
+	ksnapd = create_singlethread_dedicated_workqueue("ksnapd");
 	if (!ksnapd) {
 		DMERR("Failed to create ksnapd workqueue.");
 		r = -ENOMEM;
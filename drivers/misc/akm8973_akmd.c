@@ -778,6 +778,7 @@ int akm8973_probe(struct i2c_client *client, const struct i2c_device_id *devid)
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	akm->early_suspend.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN + 1;
+	akm->early_suspend.group = EARLY_SUSPEND_GROUP_SENSORS;
 	akm->early_suspend.suspend = akm8973_early_suspend;
 	akm->early_suspend.resume = akm8973_late_resume;
 	register_early_suspend(&akm->early_suspend);
@@ -685,6 +685,7 @@ static int lis331dlh_probe(struct i2c_client *client,
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	lis->early_suspend.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN + 1;
+	lis->early_suspend.group = EARLY_SUSPEND_GROUP_SENSORS;
 	lis->early_suspend.suspend = lis331dlh_early_suspend;
 	lis->early_suspend.resume = lis331dlh_late_resume;
 	register_early_suspend(&lis->early_suspend);
@@ -33,6 +33,8 @@
 #include <linux/bitops.h>
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -45,15 +47,20 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
+ * 3) ep->rdl[cpu].lock (spinlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
+ * We need spinlocks for the ready lists because we manipulate them
  * from inside the poll callback, that might be triggered from
  * a wake_up() that in turn might be called from IRQ context.
  * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
- * user space) we could end up sleeping due a copy_to_user(), so
+ * a spinlock. There is one ready list per CPU, and the poll callback
+ * only ever takes the lock of the list of the CPU it runs on, so that
+ * events arriving on different CPUs do not bounce a shared lock around;
+ * ep_send_events() merges the lists. An item sits on at most one list,
+ * owned by whoever set its EPI_QUEUED bit. During the event transfer
+ * loop (from kernel to user space) we could end up sleeping due a
+ * copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
  * during epoll_ctl(EPOLL_CTL_DEL) and during eventpoll_release_file().
@@ -64,7 +71,7 @@
  * if a file has been pushed inside an epoll set and it is then
  * close()d without a previous call toepoll_ctl(EPOLL_CTL_DEL).
  * It is possible to drop the "ep->mtx" and to use the global
- * mutex "epmutex" (together with "ep->lock") to have it working,
+ * mutex "epmutex" (together with the ready list locks) to have it working,
  * but having "ep->mtx" will make the interface more scalable.
  * Events that require holding "epmutex" are very rare, while for
  * normal operations the epoll private "ep->mtx" will guarantee
@@ -90,7 +97,10 @@
 #endif /* #if DEBUG_EPI != 0 */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Bits in "struct epitem"->state */
+#define EPI_QUEUED	0	/* linked to a ready list through rdllink */
 
 /* Maximum number of poll wake up nests we are allowing */
 #define EP_MAX_POLLWAKE_NESTS 4
@@ -100,8 +110,6 @@
 
 #define EP_MAX_EVENTS (INT_MAX / sizeof(struct epoll_event))
 
-#define EP_UNACTIVE_PTR ((void *) -1L)
-
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
 struct epoll_filefd {
@@ -142,11 +150,9 @@ struct epitem {
 	/* List header used to link this structure to the eventpoll ready list */
 	struct list_head rdllink;
 
-	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
-	 */
-	struct epitem *next;
+	/* EPI_QUEUED, and the CPU whose ready list "rdllink" is on */
+	unsigned long state;
+	int rdcpu;
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -167,15 +173,18 @@ struct epitem {
 	struct epoll_event event;
 };
 
+/* Per-CPU list of ready file descriptors */
+struct ep_rdlist {
+	spinlock_t lock;
+	struct list_head list;
+};
+
 /*
  * This structure is stored inside the "private_data" member of the file
  * structure and rapresent the main data sructure for the eventpoll
  * interface.
  */
 struct eventpoll {
-	/* Protect the this structure access */
-	spinlock_t lock;
-
 	/*
 	 * This mutex is used to ensure that files are not removed
 	 * while epoll is using them. This is held during the event
@@ -184,25 +193,22 @@ struct eventpoll {
 	 */
 	struct mutex mtx;
 
-	/* Wait queue used by sys_epoll_wait() */
+	/*
+	 * Wait queue used by sys_epoll_wait(). Waiters are exclusive and
+	 * queue at the tail, so each newly ready item wakes one thread, in
+	 * round-robin order.
+	 */
 	wait_queue_head_t wq;
 
 	/* Wait queue used by file->poll() */
 	wait_queue_head_t poll_wait;
 
-	/* List of ready file descriptors */
-	struct list_head rdllist;
+	/* Per-CPU lists of ready file descriptors */
+	struct ep_rdlist *rdl;
 
 	/* RB tree root used to store monitored fd structs */
 	struct rb_root rbr;
 
-	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transfering ready events to userspace w/out
-	 * holding ->lock.
-	 */
-	struct epitem *ovflist;
-
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
 };
@@ -311,6 +317,65 @@ static inline int ep_op_has_event(int op)
 	return op != EPOLL_CTL_DEL;
 }
 
+/* Tells if any of the per-CPU ready lists has items on it */
+static int ep_events_available(struct eventpoll *ep)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		if (!list_empty(&per_cpu_ptr(ep->rdl, cpu)->list))
+			return 1;
+	return 0;
+}
+
+/*
+ * Queue the item on the ready list of the current CPU, unless it already
+ * is on a ready list (or in the transfer list of ep_send_events()).
+ * Returns 1 if we queued it, in which case waiters need a wake up.
+ */
+static int ep_rdl_add(struct eventpoll *ep, struct epitem *epi)
+{
+	struct ep_rdlist *rdl;
+	unsigned long flags;
+	int cpu;
+
+	if (test_and_set_bit(EPI_QUEUED, &epi->state))
+		return 0;
+
+	local_irq_save(flags);
+	cpu = smp_processor_id();
+	rdl = per_cpu_ptr(ep->rdl, cpu);
+	spin_lock(&rdl->lock);
+	epi->rdcpu = cpu;
+	list_add_tail(&epi->rdllink, &rdl->list);
+	spin_unlock(&rdl->lock);
+	local_irq_restore(flags);
+
+	/* Pairs with set_current_state() in ep_poll() */
+	smp_mb();
+
+	return 1;
+}
+
+/*
+ * Unlink the item from its ready list. Must be called with "mtx" held and
+ * after the poll callbacks have been unregistered.
+ */
+static void ep_rdl_del(struct eventpoll *ep, struct epitem *epi)
+{
+	struct ep_rdlist *rdl;
+	unsigned long flags;
+
+	if (!test_bit(EPI_QUEUED, &epi->state))
+		return;
+
+	rdl = per_cpu_ptr(ep->rdl, epi->rdcpu);
+	spin_lock_irqsave(&rdl->lock, flags);
+	list_del_init(&epi->rdllink);
+	spin_unlock_irqrestore(&rdl->lock, flags);
+	clear_bit(EPI_QUEUED, &epi->state);
+}
+
 /* Initialize the poll safe wake up structure */
 static void ep_poll_safewake_init(struct poll_safewake *psw)
 {
@@ -372,9 +437,29 @@ static void ep_poll_safewake(struct poll_safewake *psw, wait_queue_head_t *wq)
 	spin_unlock_irqrestore(&psw->lock, flags);
 }
 
+/*
+ * Notify waiting tasks that events are available: one sys_epoll_wait()
+ * caller, and everybody polling the epoll file. Returns 1 if there was
+ * anybody to wake up.
+ */
+static int ep_wake(struct eventpoll *ep)
+{
+	int woken = 0;
+
+	if (waitqueue_active(&ep->wq)) {
+		wake_up(&ep->wq);
+		woken = 1;
+	}
+	if (waitqueue_active(&ep->poll_wait)) {
+		ep_poll_safewake(&psw, &ep->poll_wait);
+		woken = 1;
+	}
+	return woken;
+}
+
 /*
  * This function unregister poll callbacks from the associated file descriptor.
- * Since this must be called without holding "ep->lock" the atomic exchange trick
+ * Since this must be called without holding a ready list lock the atomic exchange trick
  * will protect us from multiple unregister.
  */
 static void ep_unregister_pollwait(struct eventpoll *ep, struct epitem *epi)
@@ -403,16 +488,15 @@ static void ep_unregister_pollwait(struct eventpoll *ep, struct epitem *epi)
  */
 static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 {
-	unsigned long flags;
 	struct file *file = epi->ffd.file;
 
 	/*
 	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * a ready list lock otherwise a deadlock might occur. This because of the
+	 * sequence of the lock acquisition. Here we would take the ready list
+	 * lock then the wait queue head lock when unregistering the wait queue.
+	 * The wakeup callback will run by holding the wait queue head lock and
+	 * will call our callback that will try to get the ready list lock.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -424,10 +508,7 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
-	if (ep_is_linked(&epi->rdllink))
-		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	ep_rdl_del(ep, epi);
 
 	/* At this point it is safe to free the eventpoll item */
 	kmem_cache_free(epi_cache, epi);
@@ -472,7 +553,7 @@ static void ep_free(struct eventpoll *ep)
 	 * Walks through the whole tree by freeing each "struct epitem". At this
 	 * point we are sure no poll callbacks will be lingering around, and also by
 	 * holding "epmutex" we can be sure that no file cleanup code will hit
-	 * us during this operation. So we can avoid the lock on "ep->lock".
+	 * us during this operation. So we can avoid the ready list locks.
 	 */
 	while ((rbp = rb_first(&ep->rbr)) != NULL) {
 		epi = rb_entry(rbp, struct epitem, rbn);
@@ -481,6 +562,7 @@ static void ep_free(struct eventpoll *ep)
 
 	mutex_unlock(&epmutex);
 	mutex_destroy(&ep->mtx);
+	free_percpu(ep->rdl);
 	free_uid(ep->user);
 	kfree(ep);
 }
@@ -499,17 +581,14 @@ static int ep_eventpoll_release(struct inode *inode, struct file *file)
 static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
 {
 	unsigned int pollflags = 0;
-	unsigned long flags;
 	struct eventpoll *ep = file->private_data;
 
 	/* Insert inside our poll wait queue */
 	poll_wait(file, &ep->poll_wait, wait);
 
 	/* Check our condition */
-	spin_lock_irqsave(&ep->lock, flags);
-	if (!list_empty(&ep->rdllist))
+	if (ep_events_available(ep))
 		pollflags = POLLIN | POLLRDNORM;
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	return pollflags;
 }
@@ -565,7 +644,7 @@ void eventpoll_release_file(struct file *file)
 
 static int ep_alloc(struct eventpoll **pep)
 {
-	int error;
+	int error, cpu;
 	struct user_struct *user;
 	struct eventpoll *ep;
 
@@ -574,14 +653,20 @@ static int ep_alloc(struct eventpoll **pep)
 	ep = kzalloc(sizeof(*ep), GFP_KERNEL);
 	if (unlikely(!ep))
 		goto free_uid;
+	ep->rdl = alloc_percpu(struct ep_rdlist);
+	if (unlikely(!ep->rdl))
+		goto free_ep;
+
+	for_each_possible_cpu(cpu) {
+		struct ep_rdlist *rdl = per_cpu_ptr(ep->rdl, cpu);
 
-	spin_lock_init(&ep->lock);
+		spin_lock_init(&rdl->lock);
+		INIT_LIST_HEAD(&rdl->list);
+	}
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
-	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
 
 	*pep = ep;
@@ -590,6 +675,8 @@ static int ep_alloc(struct eventpoll **pep)
 		     current, ep));
 	return 0;
 
+free_ep:
+	kfree(ep);
 free_uid:
 	free_uid(user);
 	return error;
@@ -634,16 +721,13 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
+	int woken = 0;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
 	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: poll_callback(%p) epi=%p ep=%p\n",
 		     current, epi->ffd.file, epi, ep));
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
 	 * descriptor to be disabled. This condition is likely the effect of the
@@ -651,45 +735,24 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		goto out;
 
 	/*
-	 * If we are trasfering events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happens during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * If this file is already queued, somebody has been woken up for it
+	 * already, or ep_send_events() is about to poll it. Otherwise wake
+	 * up ( if active ) one eventpoll waiter and the ->poll() wait list.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
-		goto out_unlock;
-	}
-
-	/* If this file is already in the ready list we exit soon */
-	if (ep_is_linked(&epi->rdllink))
-		goto is_linked;
+	if (ep_rdl_add(ep, epi))
+		woken = ep_wake(ep);
 
-	list_add_tail(&epi->rdllink, &ep->rdllist);
-
-is_linked:
+out:
 	/*
-	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * With EPOLLEXCLUSIVE our wait queue entry is an exclusive one: tell
+	 * the waker whether this wake up was consumed, or whether it has to
+	 * go on to the next epoll set watching the file.
 	 */
-	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
-	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&psw, &ep->poll_wait);
-
+	if (epi->event.events & EPOLLEXCLUSIVE)
+		return woken;
 	return 1;
 }
 
@@ -707,7 +770,10 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
-		add_wait_queue(whead, &pwq->wait);
+		if (epi->event.events & EPOLLEXCLUSIVE)
+			add_wait_queue_exclusive(whead, &pwq->wait);
+		else
+			add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
 	} else {
@@ -741,8 +807,7 @@ static void ep_rbtree_insert(struct eventpoll *ep, struct epitem *epi)
 static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		     struct file *tfile, int fd)
 {
-	int error, revents, pwake = 0;
-	unsigned long flags;
+	int error, revents;
 	struct epitem *epi;
 	struct ep_pqueue epq;
 
@@ -760,7 +825,8 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
-	epi->next = EP_UNACTIVE_PTR;
+	epi->state = 0;
+	epi->rdcpu = 0;
 
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
@@ -795,27 +861,12 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	 */
 	ep_rbtree_insert(ep, epi);
 
-	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
+	atomic_inc(&ep->user->epoll_watches);
 
 	/* If the file is already "ready" we drop it inside the ready list */
-	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
-
+	if ((revents & event->events) && ep_rdl_add(ep, epi))
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
-	}
-
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	atomic_inc(&ep->user->epoll_watches);
-
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&psw, &ep->poll_wait);
+		ep_wake(ep);
 
 	DNPRINTK(3, (KERN_INFO "[%p] eventpoll: ep_insert(%p, %p, %d)\n",
 		     current, ep, tfile, fd));
@@ -827,14 +878,9 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
-	if (ep_is_linked(&epi->rdllink))
-		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	ep_rdl_del(ep, epi);
 
 	kmem_cache_free(epi_cache, epi);
 
@@ -847,9 +893,7 @@ error_unregister:
  */
 static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_event *event)
 {
-	int pwake = 0;
 	unsigned int revents;
-	unsigned long flags;
 
 	/*
 	 * Set the new event interest mask before calling f_op->poll(), otherwise
@@ -865,31 +909,19 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 */
 	revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL);
 
-	spin_lock_irqsave(&ep->lock, flags);
-
-	/* Copy the data member from inside the lock */
+	/*
+	 * The data member is only read by ep_send_events(), that is kept
+	 * out by "mtx".
+	 */
 	epi->event.data = event->data;
 
 	/*
 	 * If the item is "hot" and it is not registered inside the ready
 	 * list, push it inside.
 	 */
-	if (revents & event->events) {
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-
-			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
-			if (waitqueue_active(&ep->poll_wait))
-				pwake++;
-		}
-	}
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&psw, &ep->poll_wait);
+	if ((revents & event->events) && ep_rdl_add(ep, epi))
+		/* Notify waiting tasks that events are available */
+		ep_wake(ep);
 
 	return 0;
 }
@@ -897,10 +929,11 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *events,
 			  int maxevents)
 {
-	int eventcnt, error = -EFAULT, pwake = 0;
+	int eventcnt, error = -EFAULT, cpu;
 	unsigned int revents;
 	unsigned long flags;
-	struct epitem *epi, *nepi;
+	struct ep_rdlist *rdl;
+	struct epitem *epi;
 	struct list_head txlist;
 
 	INIT_LIST_HEAD(&txlist);
@@ -912,21 +945,21 @@ static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *event
 	mutex_lock(&ep->mtx);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we are doing it in the loop below, in a lockless way.
+	 * Steal the ready lists of all CPUs, oldest first. The items keep
+	 * their EPI_QUEUED bit while they sit on "txlist", so the poll
+	 * callback leaves them alone: they get polled below anyway.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
-	list_splice(&ep->rdllist, &txlist);
-	INIT_LIST_HEAD(&ep->rdllist);
-	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
+	for_each_possible_cpu(cpu) {
+		rdl = per_cpu_ptr(ep->rdl, cpu);
+		if (list_empty(&rdl->list))
+			continue;
+		spin_lock_irqsave(&rdl->lock, flags);
+		list_splice_tail_init(&rdl->list, &txlist);
+		spin_unlock_irqrestore(&rdl->lock, flags);
+	}
 
 	/*
 	 * We can loop without lock because this is a task private list.
-	 * We just splice'd out the ep->rdllist in ep_collect_ready_items().
 	 * Items cannot vanish during the loop because we are holding "mtx".
 	 */
 	for (eventcnt = 0; !list_empty(&txlist) && eventcnt < maxevents;) {
@@ -934,6 +967,13 @@ static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *event
 
 		list_del_init(&epi->rdllink);
 
+		/*
+		 * From here on the poll callback queues the item again, so
+		 * that an event arriving after the poll below is not lost.
+		 */
+		clear_bit(EPI_QUEUED, &epi->state);
+		smp_mb__after_clear_bit();
+
 		/*
 		 * Get the ready file event set. We can safely use the file
 		 * because we are holding the "mtx" and this will guarantee
@@ -959,65 +999,44 @@ static int ep_send_events(struct eventpoll *ep, struct epoll_event __user *event
 			eventcnt++;
 		}
 		/*
-		 * At this point, noone can insert into ep->rdllist besides
-		 * us. The epoll_ctl() callers are locked out by us holding
-		 * "mtx" and the poll callback will queue them in ep->ovflist.
+		 * Level triggered items go back to the tail of a ready list,
+		 * unless the poll callback beat us to it. The epoll_ctl()
+		 * callers are locked out by us holding "mtx".
 		 */
 		if (!(epi->event.events & EPOLLET) &&
 		    (revents & epi->event.events))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_rdl_add(ep, epi);
 	}
 	error = 0;
 
 errxit:
-
-	spin_lock_irqsave(&ep->lock, flags);
-	/*
-	 * During the time we spent in the loop above, some other events
-	 * might have been queued by the poll callback. We re-insert them
-	 * inside the main ready-list here.
-	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * If the above loop quit with errors, the epoll item might still
-		 * be linked to "txlist", and the list_splice() done below will
-		 * take care of those cases.
-		 */
-		if (!ep_is_linked(&epi->rdllink))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
-
 	/*
 	 * In case of error in the event-send loop, or in case the number of
-	 * ready events exceeds the userspace limit, we need to splice the
-	 * "txlist" back inside ep->rdllist.
+	 * ready events exceeds the userspace limit, we need to put the
+	 * "txlist" back, in front of what got queued in the meantime. These
+	 * items still own their EPI_QUEUED bit.
 	 */
-	list_splice(&txlist, &ep->rdllist);
-
-	if (!list_empty(&ep->rdllist)) {
-		/*
-		 * Wake up (if active) both the eventpoll wait list and the ->poll()
-		 * wait list (delayed after we release the lock).
-		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
-		if (waitqueue_active(&ep->poll_wait))
-			pwake++;
+	if (!list_empty(&txlist)) {
+		local_irq_save(flags);
+		cpu = smp_processor_id();
+		list_for_each_entry(epi, &txlist, rdllink)
+			epi->rdcpu = cpu;
+		rdl = per_cpu_ptr(ep->rdl, cpu);
+		spin_lock(&rdl->lock);
+		list_splice(&txlist, &rdl->list);
+		spin_unlock(&rdl->lock);
+		local_irq_restore(flags);
 	}
-	spin_unlock_irqrestore(&ep->lock, flags);
 
 	mutex_unlock(&ep->mtx);
 
-	/* We have to call this outside the lock */
-	if (pwake)
-		ep_poll_safewake(&psw, &ep->poll_wait);
+	/*
+	 * Events left over, or queued while we held them on "txlist", need
+	 * somebody else to pick them up.
+	 */
+	smp_mb();
+	if (ep_events_available(ep))
+		ep_wake(ep);
 
 	return eventcnt == 0 ? error: eventcnt;
 }
@@ -1026,7 +1045,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res, eavail;
-	unsigned long flags;
 	long jtimeout;
 	wait_queue_t wait;
 
@@ -1039,18 +1057,17 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		MAX_SCHEDULE_TIMEOUT : (timeout * HZ + 999) / 1000;
 
 retry:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	res = 0;
-	if (list_empty(&ep->rdllist)) {
+	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * Waiters are exclusive and queued at the tail, so each newly
+		 * ready item wakes a single thread, round-robin.
 		 */
 		init_waitqueue_entry(&wait, current);
-		wait.flags |= WQ_FLAG_EXCLUSIVE;
-		__add_wait_queue(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1059,26 +1076,22 @@ retry:
 			 * to TASK_INTERRUPTIBLE before doing the checks.
 			 */
 			set_current_state(TASK_INTERRUPTIBLE);
-			if (!list_empty(&ep->rdllist) || !jtimeout)
+			if (ep_events_available(ep) || !jtimeout)
 				break;
 			if (signal_pending(current)) {
 				res = -EINTR;
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			jtimeout = schedule_timeout(jtimeout);
-			spin_lock_irqsave(&ep->lock, flags);
 		}
-		__remove_wait_queue(&ep->wq, &wait);
+		remove_wait_queue(&ep->wq, &wait);
 
 		set_current_state(TASK_RUNNING);
 	}
 
 	/* Is it worth to try to dig for events ? */
-	eavail = !list_empty(&ep->rdllist);
-
-	spin_unlock_irqrestore(&ep->lock, flags);
+	eavail = ep_events_available(ep);
 
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
@@ -1189,6 +1202,15 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (file == tfile || !is_file_epoll(file))
 		goto error_tgt_fput;
 
+	/*
+	 * EPOLLEXCLUSIVE decides how the item hooks into the wait queues of
+	 * the target file, so it can only be given at EPOLL_CTL_ADD time; and
+	 * a one shot item would swallow wake ups meant for other epoll sets.
+	 */
+	if (ep_op_has_event(op) && (epds.events & EPOLLEXCLUSIVE) &&
+	    (op == EPOLL_CTL_MOD || (epds.events & EPOLLONESHOT)))
+		goto error_tgt_fput;
+
 	/*
 	 * At this point it is safe to assume that the "private_data" contains
 	 * our own data structure.
@@ -1222,6 +1244,8 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 		break;
 	case EPOLL_CTL_MOD:
 		if (epi) {
+			if (epi->event.events & EPOLLEXCLUSIVE)
+				break;
 			epds.events |= POLLERR | POLLHUP;
 			error = ep_modify(ep, epi, &epds);
 		} else
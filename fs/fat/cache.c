@@ -10,13 +10,22 @@
 
 #include <linux/fs.h>
 #include <linux/buffer_head.h>
+#include <linux/rbtree.h>
 #include "fat.h"
 
-/* this must be > 0. */
-#define FAT_MAX_CACHE	8
+/*
+ * Each fat_cache is an extent of contiguous clusters in the chain of the
+ * inode.  They are kept in an rbtree keyed by fcluster for lookup, and in
+ * an LRU list for reclaim.  Every fragment walked by fat_get_cluster() is
+ * added, so the tree can describe the whole chain of a large file.
+ *
+ * this must be > 0.
+ */
+#define FAT_MAX_CACHE	1024
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node rb_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -41,6 +50,7 @@ static void init_once(void *foo)
 	struct fat_cache *cache = (struct fat_cache *)foo;
 
 	INIT_LIST_HEAD(&cache->cache_list);
+	RB_CLEAR_NODE(&cache->rb_node);
 }
 
 int __init fat_cache_init(void)
@@ -81,25 +91,29 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct rb_node *n;
+	struct fat_cache *hit = NULL, *p;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
+	/* Find the cache of "fclus" or nearest cache before it. */
+	n = MSDOS_I(inode)->cache_tree.rb_node;
+	while (n) {
+		p = rb_entry(n, struct fat_cache, rb_node);
+		if (p->fcluster > fclus)
+			n = n->rb_left;
+		else {
 			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
+			if (p->fcluster == fclus)
 				break;
-			}
+			n = n->rb_right;
 		}
 	}
-	if (hit != &nohit) {
+	if (hit != NULL) {
+		if ((hit->fcluster + hit->nr_contig) < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -117,11 +131,17 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 static struct fat_cache *fat_cache_merge(struct inode *inode,
 					 struct fat_cache_id *new)
 {
+	struct rb_node *n = MSDOS_I(inode)->cache_tree.rb_node;
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
+	while (n) {
+		p = rb_entry(n, struct fat_cache, rb_node);
 		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
+		if (p->fcluster > new->fcluster)
+			n = n->rb_left;
+		else if (p->fcluster < new->fcluster)
+			n = n->rb_right;
+		else {
 			BUG_ON(p->dcluster != new->dcluster);
 			if (new->nr_contig > p->nr_contig)
 				p->nr_contig = new->nr_contig;
@@ -131,13 +151,28 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 	return NULL;
 }
 
+static void fat_cache_insert(struct inode *inode, struct fat_cache *cache)
+{
+	struct rb_node **p = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct fat_cache *c;
+
+	while (*p) {
+		parent = *p;
+		c = rb_entry(parent, struct fat_cache, rb_node);
+		if (cache->fcluster < c->fcluster)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&cache->rb_node, parent, p);
+	rb_insert_color(&cache->rb_node, &MSDOS_I(inode)->cache_tree);
+}
+
 static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 {
 	struct fat_cache *cache, *tmp;
 
-	if (new->fcluster == -1) /* dummy cache */
-		return;
-
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
 	if (new->id != FAT_CACHE_VALID &&
 	    new->id != MSDOS_I(inode)->cache_valid_id)
@@ -161,10 +196,12 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 		} else {
 			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
 			cache = list_entry(p, struct fat_cache, cache_list);
+			rb_erase(&cache->rb_node, &MSDOS_I(inode)->cache_tree);
 		}
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		fat_cache_insert(inode, cache);
 	}
 out_update_lru:
 	fat_cache_update_lru(inode, cache);
@@ -184,9 +221,11 @@ static void __fat_cache_inval_inode(struct inode *inode)
 	while (!list_empty(&i->cache_lru)) {
 		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
 		list_del_init(&cache->cache_list);
+		RB_CLEAR_NODE(&cache->rb_node);
 		i->nr_caches--;
 		fat_cache_free(cache);
 	}
+	i->cache_tree = RB_ROOT;
 	/* Update. The copy of caches before this id is discarded. */
 	i->cache_valid_id++;
 	if (i->cache_valid_id == FAT_CACHE_VALID)
@@ -229,13 +268,8 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 	if (cluster == 0)
 		return 0;
 
-	if (fat_cache_lookup(inode, cluster, &cid, fclus, dclus) < 0) {
-		/*
-		 * dummy, always not contiguous
-		 * This is reinitialized by cache_init(), later.
-		 */
-		cache_init(&cid, -1, -1);
-	}
+	if (fat_cache_lookup(inode, cluster, &cid, fclus, dclus) < 0)
+		cache_init(&cid, 0, *dclus);
 
 	fatent_init(&fatent);
 	while (*fclus < cluster) {
@@ -263,8 +297,12 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 		(*fclus)++;
 		*dclus = nr;
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/* Remember the finished extent, then start a new one */
+			cid.nr_contig--;
+			fat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 	nr = 0;
 	fat_cache_add(inode, &cid);
@@ -6,6 +6,9 @@
 #include <linux/nls.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/rbtree.h>
 #include <linux/msdos_fs.h>
 
 /*
@@ -44,7 +47,8 @@ struct fat_mount_options {
 		 nocase:1,	  /* Does this need case conversion? 0=need case conversion*/
 		 usefree:1,	  /* Use free_clusters for FAT32 */
 		 tz_utc:1,	  /* Filesystem timestamps are in UTC */
-		 rodir:1;	  /* allow ATTR_RO for directory */
+		 rodir:1,	  /* allow ATTR_RO for directory */
+		 freemap:1;	  /* keep an in-memory bitmap of used clusters */
 };
 
 #define FAT_HASH_BITS	8
@@ -70,6 +74,11 @@ struct msdos_sb_info {
 	unsigned int prev_free;      /* previously allocated cluster number */
 	unsigned int free_clusters;  /* -1 if undefined */
 	unsigned int free_clus_valid; /* is free_clusters valid? */
+	unsigned long *free_map;     /* used-cluster bitmap, or NULL */
+	unsigned int free_map_scanned; /* free_map is valid below this entry */
+	struct work_struct free_map_work;
+	struct completion free_map_done;
+	struct super_block *sb;
 	struct fat_mount_options options;
 	struct nls_table *nls_disk;  /* Codepage used on disk */
 	struct nls_table *nls_io;    /* Charset used for input and display */
@@ -93,6 +102,7 @@ struct msdos_sb_info {
 struct msdos_inode_info {
 	spinlock_t cache_lru_lock;
 	struct list_head cache_lru;
+	struct rb_root cache_tree;
 	int nr_caches;
 	/* for avoiding the race between fat_free() and fat_get_cluster() */
 	unsigned int cache_valid_id;
@@ -292,6 +302,8 @@ extern int fat_alloc_clusters(struct inode *inode, int *cluster,
 			      int nr_cluster);
 extern int fat_free_clusters(struct inode *inode, int cluster);
 extern int fat_count_free_clusters(struct super_block *sb);
+extern void fat_free_map_init(struct super_block *sb);
+extern void fat_free_map_destroy(struct super_block *sb);
 
 /* fat/file.c */
 extern int fat_generic_ioctl(struct inode *inode, struct file *filp,
@@ -328,6 +340,8 @@ extern int fat_sync_bhs(struct buffer_head **bhs, int nr_bhs);
 
 int fat_cache_init(void);
 void fat_cache_destroy(void);
+int fat_ent_init(void);
+void fat_ent_destroy(void);
 
 /* helper for printk */
 typedef unsigned long long	llu;
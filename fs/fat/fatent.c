@@ -7,6 +7,9 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/bitops.h>
+#include <linux/bitmap.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -283,6 +286,28 @@ static inline void unlock_fat(struct msdos_sb_info *sbi)
 	mutex_unlock(&sbi->fat_lock);
 }
 
+/*
+ * The free map has one bit per FAT entry, set if the entry is in use.  It
+ * is built in the background after mount; entries below free_map_scanned
+ * have been read and are kept current by fat_alloc_clusters() and
+ * fat_free_clusters().  All of it is protected by fat_lock.
+ */
+static inline int fat_free_map_ready(struct msdos_sb_info *sbi)
+{
+	return sbi->free_map && sbi->free_map_scanned >= sbi->max_cluster;
+}
+
+static inline void fat_free_map_update(struct msdos_sb_info *sbi,
+				       int entry, int used)
+{
+	if (!sbi->free_map || entry >= sbi->free_map_scanned)
+		return;
+	if (used)
+		__set_bit(entry, sbi->free_map);
+	else
+		__clear_bit(entry, sbi->free_map);
+}
+
 void fat_ent_access_init(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
@@ -475,6 +500,18 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
 			fatent.entry = FAT_START_ENT;
+		if (fat_free_map_ready(sbi)) {
+			/* Skip the FAT blocks without free entries */
+			int next = find_next_zero_bit(sbi->free_map,
+						      sbi->max_cluster,
+						      fatent.entry);
+			count += next - fatent.entry;
+			fatent.entry = next;
+			if (count >= sbi->max_cluster)
+				break;
+			if (next >= sbi->max_cluster)
+				continue;
+		}
 		fatent_set_entry(&fatent, fatent.entry);
 		err = fat_ent_read_block(sb, &fatent);
 		if (err)
@@ -491,6 +528,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 					ops->ent_put(&prev_ent, entry);
 
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
+				fat_free_map_update(sbi, entry, 1);
 
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
@@ -576,6 +614,7 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		fat_free_map_update(sbi, fatent.entry, 0);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -638,6 +677,13 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
+	/* The free map scan is already counting, wait for it instead */
+	if (sbi->free_map) {
+		err = wait_for_completion_killable(&sbi->free_map_done);
+		if (err)
+			return err;
+	}
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
@@ -674,3 +720,111 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+static struct workqueue_struct *fat_free_map_wq;
+
+/*
+ * Scan one readahead window of the FAT into the free map, then requeue
+ * ourselves, so fat_lock is only held for one FAT block at a time.
+ */
+static void fat_free_map_scan(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, free_map_work);
+	struct super_block *sb = sbi->sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, *map;
+	sector_t blocknr;
+	int i, offset, err = 0, done = 0;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, sbi->free_map_scanned);
+	ops->ent_blocknr(sb, fatent.entry, &offset, &blocknr);
+	fat_ent_reada(sb, &fatent, min_t(unsigned long, reada_blocks,
+			sbi->fat_start + sbi->fat_length - blocknr));
+
+	for (i = 0; i < reada_blocks && !done; i++) {
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+		do {
+			if (ops->ent_get(&fatent) != FAT_ENT_FREE)
+				__set_bit(fatent.entry, sbi->free_map);
+		} while (fat_ent_next(sbi, &fatent));
+		sbi->free_map_scanned = fatent.entry;
+
+		if (fatent.entry >= sbi->max_cluster) {
+			sbi->free_clusters = sbi->max_cluster -
+				bitmap_weight(sbi->free_map, sbi->max_cluster);
+			sbi->free_clus_valid = 1;
+			sb->s_dirt = 1;
+			done = 1;
+		}
+		unlock_fat(sbi);
+	}
+	fatent_brelse(&fatent);
+
+	if (err) {
+		lock_fat(sbi);
+		map = sbi->free_map;
+		sbi->free_map = NULL;
+		unlock_fat(sbi);
+		vfree(map);
+		complete_all(&sbi->free_map_done);
+	} else if (done)
+		complete_all(&sbi->free_map_done);
+	else
+		queue_work(fat_free_map_wq, &sbi->free_map_work);
+}
+
+void fat_free_map_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long size;
+	int i;
+
+	size = BITS_TO_LONGS(sbi->max_cluster) * sizeof(unsigned long);
+	sbi->free_map = vmalloc(size);
+	if (!sbi->free_map) {
+		printk(KERN_WARNING "FAT: can't allocate free map (%lu bytes)"
+		       ", disabled\n", size);
+		return;
+	}
+	memset(sbi->free_map, 0, size);
+	for (i = 0; i < FAT_START_ENT; i++)
+		__set_bit(i, sbi->free_map);
+	sbi->free_map_scanned = FAT_START_ENT;
+	sbi->sb = sb;
+	init_completion(&sbi->free_map_done);
+	INIT_WORK(&sbi->free_map_work, fat_free_map_scan);
+	queue_work(fat_free_map_wq, &sbi->free_map_work);
+}
+
+void fat_free_map_destroy(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (!sbi->free_map)
+		return;
+	cancel_work_sync(&sbi->free_map_work);
+	vfree(sbi->free_map);
+	sbi->free_map = NULL;
+}
+
+int __init fat_ent_init(void)
+{
+	fat_free_map_wq = create_singlethread_workqueue("fat_freemap");
+	if (!fat_free_map_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void fat_ent_destroy(void)
+{
+	destroy_workqueue(fat_free_map_wq);
+}
@@ -451,6 +451,8 @@ static void fat_put_super(struct super_block *sb)
 {
 	struct msdos_sb_info *sbi = MSDOS_SB(sb);
 
+	fat_free_map_destroy(sb);
+
 	if (sbi->nls_disk) {
 		unload_nls(sbi->nls_disk);
 		sbi->nls_disk = NULL;
@@ -493,6 +495,7 @@ static void init_once(void *foo)
 	ei->nr_caches = 0;
 	ei->cache_valid_id = FAT_CACHE_VALID + 1;
 	INIT_LIST_HEAD(&ei->cache_lru);
+	ei->cache_tree = RB_ROOT;
 	INIT_HLIST_NODE(&ei->i_fat_hash);
 	inode_init_once(&ei->vfs_inode);
 }
@@ -509,7 +512,7 @@ static int __init fat_init_inodecache(void)
 	return 0;
 }
 
-static void __exit fat_destroy_inodecache(void)
+static void fat_destroy_inodecache(void)
 {
 	kmem_cache_destroy(fat_inode_cachep);
 }
@@ -805,6 +808,8 @@ static int fat_show_options(struct seq_file *m, struct vfsmount *mnt)
 		seq_printf(m, ",check=%c", opts->name_check);
 	if (opts->usefree)
 		seq_puts(m, ",usefree");
+	if (opts->freemap)
+		seq_puts(m, ",freemap");
 	if (opts->quiet)
 		seq_puts(m, ",quiet");
 	if (opts->showexec)
@@ -843,7 +848,7 @@ static int fat_show_options(struct seq_file *m, struct vfsmount *mnt)
 enum {
 	Opt_check_n, Opt_check_r, Opt_check_s, Opt_uid, Opt_gid,
 	Opt_umask, Opt_dmask, Opt_fmask, Opt_allow_utime, Opt_codepage,
-	Opt_usefree, Opt_nocase, Opt_quiet, Opt_showexec, Opt_debug,
+	Opt_usefree, Opt_freemap, Opt_nocase, Opt_quiet, Opt_showexec, Opt_debug,
 	Opt_immutable, Opt_dots, Opt_nodots,
 	Opt_charset, Opt_shortname_lower, Opt_shortname_win95,
 	Opt_shortname_winnt, Opt_shortname_mixed, Opt_utf8_no, Opt_utf8_yes,
@@ -867,6 +872,7 @@ static const match_table_t fat_tokens = {
 	{Opt_allow_utime, "allow_utime=%o"},
 	{Opt_codepage, "codepage=%u"},
 	{Opt_usefree, "usefree"},
+	{Opt_freemap, "freemap"},
 	{Opt_nocase, "nocase"},
 	{Opt_quiet, "quiet"},
 	{Opt_showexec, "showexec"},
@@ -955,7 +961,7 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 	opts->quiet = opts->showexec = opts->sys_immutable = opts->dotsOK =  0;
 	opts->utf8 = opts->unicode_xlate = 0;
 	opts->numtail = 1;
-	opts->usefree = opts->nocase = 0;
+	opts->usefree = opts->freemap = opts->nocase = 0;
 	opts->tz_utc = 0;
 	opts->errors = FAT_ERRORS_RO;
 	*debug = 0;
@@ -988,6 +994,9 @@ static int parse_options(char *options, int is_vfat, int silent, int *debug,
 		case Opt_usefree:
 			opts->usefree = 1;
 			break;
+		case Opt_freemap:
+			opts->freemap = 1;
+			break;
 		case Opt_nocase:
 			if (!is_vfat)
 				opts->nocase = 1;
@@ -1455,6 +1464,9 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	if (sbi->options.freemap)
+		fat_free_map_init(sb);
+
 	return 0;
 
 out_invalid:
@@ -1541,8 +1553,14 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	err = fat_ent_init();
+	if (err)
+		goto failed_inodecache;
+
 	return 0;
 
+failed_inodecache:
+	fat_destroy_inodecache();
 failed:
 	fat_cache_destroy();
 	return err;
@@ -1552,6 +1570,7 @@ static void __exit exit_fat_fs(void)
 {
 	fat_cache_destroy();
 	fat_destroy_inodecache();
+	fat_ent_destroy();
 }
 
 module_init(init_fat_fs)
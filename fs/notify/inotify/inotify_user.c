@@ -29,6 +29,8 @@
 #include <linux/poll.h>
 #include <linux/init.h>
 #include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/timer.h>
 #include <linux/inotify.h>
 #include <linux/syscalls.h>
 #include <linux/magic.h>
@@ -44,6 +46,15 @@ static struct vfsmount *inotify_mnt __read_mostly;
 static int inotify_max_user_instances __read_mostly;
 static int inotify_max_user_watches __read_mostly;
 static int inotify_max_queued_events __read_mostly;
+static int inotify_max_queued_bytes __read_mostly;
+
+/* Events that may be merged with an earlier one, see inotify_dev_coalesce() */
+#define IN_COALESCE_EVENTS	(IN_ACCESS | IN_MODIFY | IN_ATTRIB | \
+				 IN_CLOSE_WRITE | IN_CLOSE_NOWRITE | IN_OPEN | \
+				 IN_CREATE | IN_ISDIR)
+
+#define INOTIFY_COALESCE_HASH_BITS	6
+#define INOTIFY_COALESCE_HASH_SIZE	(1 << INOTIFY_COALESCE_HASH_BITS)
 
 /*
  * Lock ordering:
@@ -83,6 +94,12 @@ struct inotify_device {
 	unsigned int		queue_size;	/* size of the queue (bytes) */
 	unsigned int		event_count;	/* number of pending events */
 	unsigned int		max_events;	/* maximum number of events */
+	unsigned int		queue_mem;	/* kernel memory used by the queue */
+	unsigned int		max_mem;	/* maximum queue_mem */
+	struct hlist_head	*coalesce_hash;	/* mergeable events */
+	unsigned long		coalesce_window; /* in jiffies, 0 if off */
+	unsigned long		wake_delay;	/* in jiffies, 0 if off */
+	struct timer_list	wake_timer;	/* delayed wake up */
 };
 
 /*
@@ -96,9 +113,14 @@ struct inotify_device {
 struct inotify_kernel_event {
 	struct inotify_event	event;	/* the user-space event */
 	struct list_head        list;	/* entry in inotify_device's list */
+	struct hlist_node	hnode;	/* entry in dev->coalesce_hash */
+	unsigned long		stamp;	/* jiffies when queued */
 	char			*name;	/* filename, if any */
 };
 
+/* kernel memory charged to the queue for an event with a name of size len */
+#define kevent_mem(len)	(sizeof(struct inotify_kernel_event) + (len))
+
 /*
  * struct inotify_user_watch - our version of an inotify_watch, we add
  * a reference to the associated inotify_device.
@@ -145,6 +167,15 @@ ctl_table inotify_table[] = {
 		.strategy	= &sysctl_intvec,
 		.extra1		= &zero
 	},
+	{
+		.ctl_name	= CTL_UNNUMBERED,
+		.procname	= "max_queued_bytes",
+		.data		= &inotify_max_queued_bytes,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.extra1		= &zero
+	},
 	{ .ctl_name = 0 }
 };
 #endif /* CONFIG_SYSCTL */
@@ -159,6 +190,7 @@ static inline void put_inotify_dev(struct inotify_device *dev)
 	if (atomic_dec_and_test(&dev->count)) {
 		atomic_dec(&dev->user->inotify_devs);
 		free_uid(dev->user);
+		kfree(dev->coalesce_hash);
 		kfree(dev);
 	}
 }
@@ -179,6 +211,34 @@ static void free_inotify_user_watch(struct inotify_watch *w)
 	kmem_cache_free(watch_cachep, watch);
 }
 
+/*
+ * name_size - size of the given filename once padded for user-space, see
+ * kernel_event()
+ */
+static size_t name_size(const char *name)
+{
+	size_t len, rem, event_size = sizeof(struct inotify_event);
+
+	if (!name)
+		return 0;
+
+	/*
+	 * We need to pad the filename so as to properly align an
+	 * array of inotify_event structures.  Because the structure is
+	 * small and the common case is a small filename, we just round
+	 * up to the next multiple of the structure's sizeof.  This is
+	 * simple and safe for all architectures.
+	 */
+	len = strlen(name) + 1;
+	rem = event_size - len;
+	if (len > event_size) {
+		rem = event_size - (len % event_size);
+		if (len % event_size == 0)
+			rem = 0;
+	}
+	return len + rem;
+}
+
 /*
  * kernel_event - create a new kernel event with the given parameters
  *
@@ -201,34 +261,21 @@ static struct inotify_kernel_event * kernel_event(s32 wd, u32 mask, u32 cookie,
 	kevent->event.cookie = cookie;
 
 	INIT_LIST_HEAD(&kevent->list);
+	INIT_HLIST_NODE(&kevent->hnode);
+	kevent->stamp = jiffies;
 
 	if (name) {
-		size_t len, rem, event_size = sizeof(struct inotify_event);
-
-		/*
-		 * We need to pad the filename so as to properly align an
-		 * array of inotify_event structures.  Because the structure is
-		 * small and the common case is a small filename, we just round
-		 * up to the next multiple of the structure's sizeof.  This is
-		 * simple and safe for all architectures.
-		 */
-		len = strlen(name) + 1;
-		rem = event_size - len;
-		if (len > event_size) {
-			rem = event_size - (len % event_size);
-			if (len % event_size == 0)
-				rem = 0;
-		}
+		size_t len = strlen(name) + 1, size = name_size(name);
 
-		kevent->name = kmalloc(len + rem, GFP_KERNEL);
+		kevent->name = kmalloc(size, GFP_KERNEL);
 		if (unlikely(!kevent->name)) {
 			kmem_cache_free(event_cachep, kevent);
 			return NULL;
 		}
 		memcpy(kevent->name, name, len);
-		if (rem)
-			memset(kevent->name + len, 0, rem);
-		kevent->event.len = len + rem;
+		if (size > len)
+			memset(kevent->name + len, 0, size - len);
+		kevent->event.len = size;
 	} else {
 		kevent->event.len = 0;
 		kevent->name = NULL;
@@ -261,6 +308,73 @@ inotify_dev_get_last_event(struct inotify_device *dev)
 	return list_entry(dev->events.prev, struct inotify_kernel_event, list);
 }
 
+static struct hlist_head *coalesce_bucket(struct inotify_device *dev,
+					   s32 wd, const char *name)
+{
+	unsigned long hash = wd;
+
+	if (name)
+		hash ^= full_name_hash(name, strlen(name));
+	return &dev->coalesce_hash[hash_long(hash, INOTIFY_COALESCE_HASH_BITS)];
+}
+
+/*
+ * inotify_dev_coalesce - merge the event into the queued one for the same
+ * watch and filename, if that was queued less than the coalescing window
+ * ago.  Returns 1 if the event was merged.  An event that cannot be merged
+ * retires the queued one instead, so that no merged mask ever moves an
+ * event across a delete or a rename of the same name.
+ *
+ * Caller must hold dev->ev_mutex.
+ */
+static int inotify_dev_coalesce(struct inotify_device *dev, s32 wd, u32 mask,
+				u32 cookie, const char *name)
+{
+	struct inotify_kernel_event *kevent;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(kevent, pos, coalesce_bucket(dev, wd, name),
+			     hnode) {
+		if (kevent->event.wd != wd)
+			continue;
+		if (name ? !kevent->name || strcmp(kevent->name, name) :
+		    kevent->name != NULL)
+			continue;
+
+		if (!(mask & ~IN_COALESCE_EVENTS) && !cookie &&
+		    time_before(jiffies, kevent->stamp + dev->coalesce_window)) {
+			kevent->event.mask |= mask;
+			return 1;
+		}
+		hlist_del_init(&kevent->hnode);
+		break;
+	}
+	return 0;
+}
+
+/*
+ * inotify_dev_wake - let readers know about new events, now if @now is set
+ * or no wake up delay is configured, else when the delay runs out.
+ *
+ * Caller must hold dev->ev_mutex.
+ */
+static void inotify_dev_wake(struct inotify_device *dev, int now)
+{
+	if (now || !dev->wake_delay) {
+		wake_up_interruptible(&dev->wq);
+		kill_fasync(&dev->fa, SIGIO, POLL_IN);
+	} else if (!timer_pending(&dev->wake_timer))
+		mod_timer(&dev->wake_timer, jiffies + dev->wake_delay);
+}
+
+static void inotify_dev_wake_timer(unsigned long data)
+{
+	struct inotify_device *dev = (struct inotify_device *) data;
+
+	wake_up_interruptible(&dev->wq);
+	kill_fasync(&dev->fa, SIGIO, POLL_IN);
+}
+
 /*
  * inotify_dev_queue_event - event handler registered with core inotify, adds
  * a new event to the given device
@@ -299,11 +413,17 @@ static void inotify_dev_queue_event(struct inotify_watch *w, u32 wd, u32 mask,
 	}
 
 	/* the queue overflowed and we already sent the Q_OVERFLOW event */
-	if (unlikely(dev->event_count > dev->max_events))
+	if (unlikely(last && last->event.mask == IN_Q_OVERFLOW))
+		goto out;
+
+	if (dev->coalesce_window &&
+	    inotify_dev_coalesce(dev, wd, mask, cookie, name))
 		goto out;
 
 	/* if the queue overflows, we need to notify user space */
-	if (unlikely(dev->event_count == dev->max_events))
+	if (unlikely(dev->event_count == dev->max_events ||
+		     dev->queue_mem + kevent_mem(name_size(name)) >
+		     dev->max_mem))
 		kevent = kernel_event(-1, IN_Q_OVERFLOW, cookie, NULL);
 	else
 		kevent = kernel_event(wd, mask, cookie, name);
@@ -314,9 +434,15 @@ static void inotify_dev_queue_event(struct inotify_watch *w, u32 wd, u32 mask,
 	/* queue the event and wake up anyone waiting */
 	dev->event_count++;
 	dev->queue_size += sizeof(struct inotify_event) + kevent->event.len;
+	dev->queue_mem += kevent_mem(kevent->event.len);
 	list_add_tail(&kevent->list, &dev->events);
-	wake_up_interruptible(&dev->wq);
-	kill_fasync(&dev->fa, SIGIO, POLL_IN);
+	if (dev->coalesce_window && kevent->event.wd == wd &&
+	    !(mask & ~IN_COALESCE_EVENTS) && !cookie)
+		hlist_add_head(&kevent->hnode, coalesce_bucket(dev, wd, name));
+
+	/* don't let a delayed wake up run the queue into overflow */
+	inotify_dev_wake(dev, kevent->event.mask == IN_Q_OVERFLOW ||
+			 dev->event_count >= dev->max_events / 2);
 
 out:
 	mutex_unlock(&dev->ev_mutex);
@@ -331,9 +457,11 @@ static void remove_kevent(struct inotify_device *dev,
 			  struct inotify_kernel_event *kevent)
 {
 	list_del(&kevent->list);
+	hlist_del_init(&kevent->hnode);
 
 	dev->event_count--;
 	dev->queue_size -= sizeof(struct inotify_event) + kevent->event.len;
+	dev->queue_mem -= kevent_mem(kevent->event.len);
 }
 
 /*
@@ -543,6 +671,7 @@ static int inotify_release(struct inode *ignored, struct file *file)
 	struct inotify_device *dev = file->private_data;
 
 	inotify_destroy(dev->ih);
+	del_timer_sync(&dev->wake_timer);
 
 	/* destroy all of the events on this device */
 	mutex_lock(&dev->ev_mutex);
@@ -556,12 +685,43 @@ static int inotify_release(struct inode *ignored, struct file *file)
 	return 0;
 }
 
+/*
+ * inotify_set_coalesce - set the coalescing window of the device, in
+ * milliseconds.  Zero turns coalescing off.
+ */
+static int inotify_set_coalesce(struct inotify_device *dev, u32 msecs)
+{
+	struct hlist_head *hash = NULL;
+	int i;
+
+	if (msecs && !dev->coalesce_hash) {
+		hash = kmalloc(INOTIFY_COALESCE_HASH_SIZE * sizeof(*hash),
+			       GFP_KERNEL);
+		if (unlikely(!hash))
+			return -ENOMEM;
+		for (i = 0; i < INOTIFY_COALESCE_HASH_SIZE; i++)
+			INIT_HLIST_HEAD(&hash[i]);
+	}
+
+	mutex_lock(&dev->ev_mutex);
+	if (hash && !dev->coalesce_hash) {
+		dev->coalesce_hash = hash;
+		hash = NULL;
+	}
+	dev->coalesce_window = msecs_to_jiffies(msecs);
+	mutex_unlock(&dev->ev_mutex);
+
+	kfree(hash);
+	return 0;
+}
+
 static long inotify_ioctl(struct file *file, unsigned int cmd,
 			  unsigned long arg)
 {
 	struct inotify_device *dev;
 	void __user *p;
 	int ret = -ENOTTY;
+	u32 val;
 
 	dev = file->private_data;
 	p = (void __user *) arg;
@@ -570,6 +730,19 @@ static long inotify_ioctl(struct file *file, unsigned int cmd,
 	case FIONREAD:
 		ret = put_user(dev->queue_size, (int __user *) p);
 		break;
+	case INOTIFY_IOC_SETCOALESCE:
+		ret = get_user(val, (u32 __user *) p);
+		if (!ret)
+			ret = inotify_set_coalesce(dev, val);
+		break;
+	case INOTIFY_IOC_SETWAKEDELAY:
+		ret = get_user(val, (u32 __user *) p);
+		if (ret)
+			break;
+		mutex_lock(&dev->ev_mutex);
+		dev->wake_delay = msecs_to_jiffies(val);
+		mutex_unlock(&dev->ev_mutex);
+		break;
 	}
 
 	return ret;
@@ -621,7 +794,7 @@ SYSCALL_DEFINE1(inotify_init1, int, flags)
 		goto out_free_uid;
 	}
 
-	dev = kmalloc(sizeof(struct inotify_device), GFP_KERNEL);
+	dev = kzalloc(sizeof(struct inotify_device), GFP_KERNEL);
 	if (unlikely(!dev)) {
 		ret = -ENOMEM;
 		goto out_free_uid;
@@ -650,6 +823,9 @@ SYSCALL_DEFINE1(inotify_init1, int, flags)
 	dev->event_count = 0;
 	dev->queue_size = 0;
 	dev->max_events = inotify_max_queued_events;
+	dev->max_mem = inotify_max_queued_bytes;
+	setup_timer(&dev->wake_timer, inotify_dev_wake_timer,
+		    (unsigned long) dev);
 	dev->user = user;
 	atomic_set(&dev->count, 0);
 
@@ -776,6 +952,7 @@ static int __init inotify_user_setup(void)
 		panic("inotify: kern_mount ret %ld!\n", PTR_ERR(inotify_mnt));
 
 	inotify_max_queued_events = 16384;
+	inotify_max_queued_bytes = 2 * 1024 * 1024;
 	inotify_max_user_instances = 128;
 	inotify_max_user_watches = 8192;
 
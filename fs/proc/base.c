@@ -2504,6 +2504,36 @@ static int proc_tgid_io_accounting(struct task_struct *task, char *buffer)
 }
 #endif /* CONFIG_TASK_IO_ACCOUNTING */
 
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+static int do_cpufreq_time_in_state(struct task_struct *task, char *buffer,
+				    int whole)
+{
+	struct task_cpufreq_stats st = task->cpufreq_stats;
+	unsigned long flags;
+
+	if (whole && lock_task_sighand(task, &flags)) {
+		struct task_struct *t = task;
+
+		task_cpufreq_stats_add(&st, &task->signal->cpufreq_stats);
+		while_each_thread(task, t)
+			task_cpufreq_stats_add(&st, &t->cpufreq_stats);
+
+		unlock_task_sighand(task, &flags);
+	}
+	return cpufreq_task_stats_show(&st, buffer);
+}
+
+static int proc_tid_time_in_state(struct task_struct *task, char *buffer)
+{
+	return do_cpufreq_time_in_state(task, buffer, 0);
+}
+
+static int proc_tgid_time_in_state(struct task_struct *task, char *buffer)
+{
+	return do_cpufreq_time_in_state(task, buffer, 1);
+}
+#endif /* CONFIG_CPU_FREQ_STAT_TASK */
+
 static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 				struct pid *pid, struct task_struct *task)
 {
@@ -2590,6 +2620,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	INF("io",	S_IRUGO, proc_tgid_io_accounting),
 #endif
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	INF("time_in_state", S_IRUGO, proc_tgid_time_in_state),
+#endif
 };
 
 static int proc_tgid_base_readdir(struct file * filp,
@@ -2925,6 +2958,9 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	INF("io",	S_IRUGO, proc_tid_io_accounting),
 #endif
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	INF("time_in_state", S_IRUGO, proc_tid_time_in_state),
+#endif
 };
 
 static int proc_tid_base_readdir(struct file * filp,
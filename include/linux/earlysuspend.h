@@ -29,16 +29,32 @@
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
+ *
+ * Handlers in group 0 (the default) are called one at a time and act as a
+ * barrier: all handlers before them in the call order have returned before
+ * they are called, and they return before any later handler is called.
+ * Handlers with a non-zero group are called from a per-group thread, so
+ * consecutive non-zero groups run concurrently with each other, while the
+ * handlers within one group still run one after another in level order.
+ * Only put a handler in a group if it does not depend on any other handler
+ * between the surrounding group 0 handlers.
  */
 enum {
 	EARLY_SUSPEND_LEVEL_BLANK_SCREEN = 50,
 	EARLY_SUSPEND_LEVEL_STOP_DRAWING = 100,
 	EARLY_SUSPEND_LEVEL_DISABLE_FB = 150,
 };
+enum {
+	EARLY_SUSPEND_GROUP_SERIAL = 0,
+	EARLY_SUSPEND_GROUP_INPUT,
+	EARLY_SUSPEND_GROUP_SENSORS,
+	EARLY_SUSPEND_GROUP_BACKLIGHT,
+};
 struct early_suspend {
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	struct list_head link;
 	int level;
+	int group;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
 #endif
@@ -87,6 +87,9 @@ struct inodes_stat_t {
  */
 #define FMODE_NOCMTIME		((__force fmode_t)2048)
 
+/* File is read in by /proc/readahead/replay, don't record its readahead */
+#define FMODE_RA_REPLAY		((__force fmode_t)4096)
+
 #define RW_MASK		1
 #define RWA_MASK	2
 #define READ 0
@@ -46,6 +46,8 @@ struct sockaddr_ll
 #define PACKET_VERSION			10
 #define PACKET_HDRLEN			11
 #define PACKET_RESERVE			12
+#define PACKET_TX_RING			13
+#define PACKET_LOSS			14
 
 struct tpacket_stats
 {
@@ -66,11 +68,17 @@ struct tpacket_auxdata
 struct tpacket_hdr
 {
 	unsigned long	tp_status;
+/* Rx ring - header status */
 #define TP_STATUS_KERNEL	0
 #define TP_STATUS_USER		1
 #define TP_STATUS_COPY		2
 #define TP_STATUS_LOSING	4
 #define TP_STATUS_CSUMNOTREADY	8
+/* Tx ring - header status */
+#define TP_STATUS_AVAILABLE	0
+#define TP_STATUS_SEND_REQUEST	1
+#define TP_STATUS_SENDING	2
+#define TP_STATUS_WRONG_FORMAT	4
 	unsigned int	tp_len;
 	unsigned int	tp_snaplen;
 	unsigned short	tp_mac;
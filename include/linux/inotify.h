@@ -10,6 +10,7 @@
 /* For O_CLOEXEC and O_NONBLOCK */
 #include <linux/fcntl.h>
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 /*
  * struct inotify_event - structure read from the inotify device for each event
@@ -69,6 +70,10 @@ struct inotify_event {
 #define IN_CLOEXEC O_CLOEXEC
 #define IN_NONBLOCK O_NONBLOCK
 
+/* ioctls on an inotify instance, taking a __u32 in milliseconds */
+#define INOTIFY_IOC_SETCOALESCE		_IOW('I', 1, __u32)	/* merge window */
+#define INOTIFY_IOC_SETWAKEDELAY	_IOW('I', 2, __u32)	/* batch wake ups */
+
 #ifdef __KERNEL__
 
 #include <linux/dcache.h>
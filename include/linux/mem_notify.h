@@ -0,0 +1,28 @@
+#ifndef _LINUX_MEM_NOTIFY_H
+#define _LINUX_MEM_NOTIFY_H
+/*
+ * Memory pressure notification for user space: /dev/mem_notify
+ * See Documentation/vm/mem_notify.txt
+ */
+
+/*
+ * Pressure levels, as reported by read() on /dev/mem_notify.
+ */
+enum mem_notify_level {
+	MEM_NOTIFY_NONE,	/* not reclaiming */
+	MEM_NOTIFY_LOW,		/* reclaiming, and it is going well */
+	MEM_NOTIFY_MEDIUM,	/* reclaim is getting hard: drop caches now */
+	MEM_NOTIFY_CRITICAL,	/* about to kill: drop everything you can */
+	MEM_NOTIFY_NR_LEVELS,
+};
+
+#ifdef CONFIG_MEM_NOTIFY
+extern void mem_notify_vmscan(unsigned long scanned, unsigned long reclaimed);
+#else
+static inline void mem_notify_vmscan(unsigned long scanned,
+				     unsigned long reclaimed)
+{
+}
+#endif
+
+#endif /* _LINUX_MEM_NOTIFY_H */
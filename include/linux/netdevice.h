@@ -185,6 +185,7 @@ struct netif_rx_stats
 	unsigned dropped;
 	unsigned time_squeeze;
 	unsigned cpu_collision;
+	unsigned received_rps;
 };
 
 DECLARE_PER_CPU(struct netif_rx_stats, netdev_rx_stat);
@@ -584,6 +585,19 @@ struct net_device_ops {
 #endif
 };
 
+#ifdef CONFIG_RPS
+/*
+ * The CPUs packets received on a device are steered to.  Replaced as a
+ * whole under RCU when /sys/class/net/<dev>/rps_cpus is written.
+ */
+struct rps_map {
+	unsigned int len;
+	struct rcu_head rcu;
+	u16 cpus[0];
+};
+#define RPS_MAP_SIZE(_num) (sizeof(struct rps_map) + ((_num) * sizeof(u16)))
+#endif
+
 /*
  *	The DEVICE structure.
  *	Actually, this whole structure is a big mistake.  It mixes I/O
@@ -760,6 +774,11 @@ struct net_device
 
 	struct netdev_queue	rx_queue;
 
+#ifdef CONFIG_RPS
+	/* CPUs to steer received packets to, see get_rps_cpu() */
+	struct rps_map		*rps_map;
+#endif
+
 	struct netdev_queue	*_tx ____cacheline_aligned_in_smp;
 
 	/* Number of TX queues allocated at alloc_netdev_mq() time  */
@@ -1129,6 +1148,16 @@ struct softnet_data
 	struct sk_buff		*completion_queue;
 
 	struct napi_struct	backlog;
+
+#ifdef CONFIG_RPS
+	/* CPUs whose backlog this CPU has to kick at the end of net_rx_action */
+	struct softnet_data	*rps_ipi_list;
+
+	/* Elements below can be accessed between CPUs for RPS */
+	struct call_single_data	csd ____cacheline_aligned_in_smp;
+	struct softnet_data	*rps_ipi_next;
+	unsigned int		cpu;
+#endif
 };
 
 DECLARE_PER_CPU(struct softnet_data,softnet_data);
@@ -0,0 +1,54 @@
+#ifndef _NFNETLINK_SET_H
+#define _NFNETLINK_SET_H
+
+/* This file describes the netlink messages (i.e. 'protocol packets'),
+ * and not any kind of function definitions.  It is shared between kernel and
+ * userspace.  Don't put kernel specific stuff in here */
+
+#include <linux/types.h>
+#include <linux/netfilter/nfnetlink.h>
+
+#define NFSET_MAXNAMELEN	32
+
+enum nfset_msg_types {
+	NFSET_MSG_CREATE,		/* create a set: NAME, TYPE [, parms] */
+	NFSET_MSG_DESTROY,		/* destroy an unreferenced set: NAME */
+	NFSET_MSG_FLUSH,		/* remove all elements: NAME */
+	NFSET_MSG_ADD,			/* add an element: NAME, element */
+	NFSET_MSG_DEL,			/* delete an element: NAME, element */
+	NFSET_MSG_LIST,			/* dump one set, or all set headers */
+	NFSET_MSG_SWAP,			/* exchange contents: NAME, NAME2 */
+
+	NFSET_MSG_MAX
+};
+
+/* Set types, as passed in NFSET_ATTR_TYPE:
+ *
+ *  "hash:ip"	 IPv4 host addresses		element: IP
+ *  "hash:net"	 IPv4 networks			element: IP, CIDR
+ *  "bitmap:port" TCP/UDP/SCTP/DCCP ports	element: PORT
+ *		  create parms: PORT_FROM, PORT_TO
+ *
+ * The hash types take the optional create parms HASHSIZE (initial number
+ * of buckets, rounded up to a power of two) and MAXELEM.
+ */
+enum nfset_attr_type {
+	NFSET_ATTR_UNSPEC,
+	NFSET_ATTR_NAME,		/* string, set name */
+	NFSET_ATTR_NAME2,		/* string, second set name for SWAP */
+	NFSET_ATTR_TYPE,		/* string, set type name */
+	NFSET_ATTR_HASHSIZE,		/* u_int32_t */
+	NFSET_ATTR_MAXELEM,		/* u_int32_t */
+	NFSET_ATTR_IP,			/* __be32 IPv4 address */
+	NFSET_ATTR_CIDR,		/* u_int8_t prefix length */
+	NFSET_ATTR_PORT,		/* __be16 */
+	NFSET_ATTR_PORT_FROM,		/* __be16 */
+	NFSET_ATTR_PORT_TO,		/* __be16 */
+	NFSET_ATTR_ELEMENTS,		/* u_int32_t, LIST only */
+	NFSET_ATTR_REFERENCES,		/* u_int32_t, LIST only */
+
+	__NFSET_ATTR_MAX
+};
+#define NFSET_ATTR_MAX (__NFSET_ATTR_MAX - 1)
+
+#endif /* _NFNETLINK_SET_H */
@@ -0,0 +1,21 @@
+#ifndef _XT_SET_H
+#define _XT_SET_H
+
+#include <linux/types.h>
+#include <linux/netfilter/nfnetlink_set.h>
+
+enum xt_set_flags {
+	XT_SET_SRC	= 1 << 0,	/* look up the source address/port */
+	XT_SET_DST	= 1 << 1,	/* look up the destination address/port */
+	XT_SET_INV	= 1 << 2,
+};
+
+struct xt_set_info {
+	char			name[NFSET_MAXNAMELEN];
+	u_int8_t		flags;
+
+	/* Used internally by the kernel */
+	u_int16_t		index;
+};
+
+#endif /* _XT_SET_H */
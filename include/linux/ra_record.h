@@ -0,0 +1,32 @@
+#ifndef _LINUX_RA_RECORD_H
+#define _LINUX_RA_RECORD_H
+/*
+ * Readahead recording and replay: /proc/readahead/
+ * See Documentation/vm/ra_record.txt
+ */
+
+#include <linux/types.h>
+
+struct file;
+
+#ifdef CONFIG_READAHEAD_RECORD
+extern int ra_recording;
+extern void __ra_record(struct file *filp, pgoff_t start, unsigned long nr);
+
+/*
+ * Called for every range of pages readahead actually has to read.
+ */
+static inline void ra_record(struct file *filp, pgoff_t start,
+			     unsigned long nr)
+{
+	if (unlikely(ra_recording))
+		__ra_record(filp, start, nr);
+}
+#else
+static inline void ra_record(struct file *filp, pgoff_t start,
+			     unsigned long nr)
+{
+}
+#endif
+
+#endif /* _LINUX_RA_RECORD_H */
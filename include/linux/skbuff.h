@@ -150,6 +150,10 @@ struct skb_shared_info {
 	unsigned int	num_dma_maps;
 #endif
 	struct sk_buff	*frag_list;
+	/* Owner data for skb->destructor, e.g. the AF_PACKET TX ring frame.
+	 * Kept ahead of frags[] so pskb_expand_head() copies it along.
+	 */
+	void		*destructor_arg;
 	skb_frag_t	frags[MAX_SKB_FRAGS];
 #ifdef CONFIG_HAS_DMA
 	dma_addr_t	dma_maps[MAX_SKB_FRAGS + 1];
@@ -123,6 +123,7 @@ enum {
 	SWP_DISCARDABLE = (1 << 2),	/* blkdev supports discard */
 	SWP_DISCARDING	= (1 << 3),	/* now discarding a free cluster */
 	SWP_SOLIDSTATE	= (1 << 4),	/* blkdev seeks are cheap */
+	SWP_COMPCACHE	= (1 << 5),	/* no backing store: compressed cache */
 					/* add others here before... */
 	SWP_SCANNING	= (1 << 8),	/* refcount in scan_swap_map */
 };
@@ -311,8 +312,33 @@ extern sector_t swapdev_block(int, pgoff_t);
 extern struct swap_info_struct *get_swap_info_struct(unsigned);
 extern int reuse_swap_page(struct page *);
 extern int try_to_free_swap(struct page *);
+extern int swapon_compcache(unsigned long, int);
 struct backing_dev_info;
 
+/* linux/mm/compcache.c */
+#ifdef CONFIG_COMPCACHE
+extern int compcache_writepage(struct page *, struct writeback_control *);
+extern int compcache_readpage(struct page *);
+extern void compcache_free(pgoff_t);
+#else
+static inline int compcache_writepage(struct page *page,
+				      struct writeback_control *wbc)
+{
+	BUG();
+	return 0;
+}
+
+static inline int compcache_readpage(struct page *page)
+{
+	BUG();
+	return 0;
+}
+
+static inline void compcache_free(pgoff_t offset)
+{
+}
+#endif
+
 /* linux/mm/thrash.c */
 extern struct mm_struct * swap_token_mm;
 extern void grab_swap_token(void);
@@ -0,0 +1,55 @@
+/*
+ * task_cpufreq_stats: a structure which is used for recording the cpu time
+ * a single task has spent at each CPU frequency.
+ *
+ * The array is indexed by the system-wide frequency list maintained by
+ * drivers/cpufreq/cpufreq_stats.c and is updated from the scheduler tick.
+ *
+ * Don't include this header file directly - it is designed to be dragged in via
+ * sched.h.
+ */
+
+#define CPUFREQ_TASK_STATS_MAX	16
+
+struct task_struct;
+
+struct task_cpufreq_stats {
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+	cputime64_t time_in_state[CPUFREQ_TASK_STATS_MAX];
+#endif
+};
+
+#ifdef CONFIG_CPU_FREQ_STAT_TASK
+static inline void task_cpufreq_stats_init(struct task_cpufreq_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+static inline void task_cpufreq_stats_add(struct task_cpufreq_stats *dst,
+					  struct task_cpufreq_stats *src)
+{
+	int i;
+
+	for (i = 0; i < CPUFREQ_TASK_STATS_MAX; i++)
+		dst->time_in_state[i] = cputime64_add(dst->time_in_state[i],
+						      src->time_in_state[i]);
+}
+
+extern void cpufreq_task_stats_account(struct task_struct *p,
+				       cputime_t cputime);
+extern int cpufreq_task_stats_show(struct task_cpufreq_stats *st, char *buf);
+#else
+static inline void task_cpufreq_stats_init(struct task_cpufreq_stats *st)
+{
+}
+
+static inline void task_cpufreq_stats_add(struct task_cpufreq_stats *dst,
+					  struct task_cpufreq_stats *src)
+{
+}
+
+static inline void cpufreq_task_stats_account(struct task_struct *p,
+					      cputime_t cputime)
+{
+}
+#endif /* CONFIG_CPU_FREQ_STAT_TASK */
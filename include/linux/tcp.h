@@ -96,6 +96,7 @@ enum {
 #define TCP_QUICKACK		12	/* Block/reenable quick acks */
 #define TCP_CONGESTION		13	/* Congestion control algorithm */
 #define TCP_MD5SIG		14	/* TCP MD5 Signature (RFC2385) */
+#define TCP_FASTOPEN		23	/* Enable Fast Open (data in SYN) */
 
 #define TCPI_OPT_TIMESTAMPS	1
 #define TCPI_OPT_SACK		2
@@ -230,6 +231,16 @@ struct tcp_options_received {
  * only four options will fit in a standard TCP header */
 #define TCP_NUM_SACKS 4
 
+/* TCP Fast Open cookies, carried in the experimental option. */
+#define TCP_FASTOPEN_COOKIE_MIN	4	/* Min Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_MAX	16	/* Max Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_SIZE 8	/* the size employed by this impl. */
+
+struct tcp_fastopen_cookie {
+	s8	len;	/* -1: no option, 0: cookie request */
+	u8	val[TCP_FASTOPEN_COOKIE_MAX];
+};
+
 struct tcp_request_sock {
 	struct inet_request_sock 	req;
 #ifdef CONFIG_TCP_MD5SIG
@@ -238,6 +249,9 @@ struct tcp_request_sock {
 #endif
 	u32			 	rcv_isn;
 	u32			 	snt_isn;
+	u16				syn_data_acked;	/* data in SYN is accepted */
+	u8				fastopen_cookie_len;
+	u8				fastopen_cookie[TCP_FASTOPEN_COOKIE_SIZE];
 };
 
 static inline struct tcp_request_sock *tcp_rsk(const struct request_sock *req)
@@ -317,6 +331,10 @@ struct tcp_sock {
 	u32	snd_up;		/* Urgent pointer		*/
 
 	u8	keepalive_probes; /* num of allowed keep alive probes	*/
+	u8	syn_fastopen:1,	/* SYN includes Fast Open option	*/
+		syn_data:1,	/* SYN includes data			*/
+		fastopen_child:1; /* accepted on Fast Open, in SYN_RECV	*/
+	u16	fastopen_qlen;	/* TCP_FASTOPEN: accept queue limit for it */
 /*
  *      Options received (usually on last packet, some only on SYN packets).
  */
@@ -380,6 +398,8 @@ struct tcp_sock {
 
 	unsigned long last_synq_overflow; 
 
+	struct tcp_fastopen_request *fastopen_req; /* sendto() data for the SYN */
+
 /* Receiver side RTT estimation */
 	struct {
 		u32	rtt;
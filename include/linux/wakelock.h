@@ -18,6 +18,7 @@
 
 #include <linux/list.h>
 #include <linux/ktime.h>
+#include <linux/types.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
  * states when active. If the type is set to WAKE_LOCK_SUSPEND, the wake_lock
@@ -32,6 +33,8 @@ enum {
 	WAKE_LOCK_TYPE_COUNT
 };
 
+struct wake_lock_uid_stat;
+
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
@@ -47,6 +50,7 @@ struct wake_lock {
 		ktime_t         prevent_suspend_time;
 		ktime_t         max_time;
 		ktime_t         last_time;
+		struct wake_lock_uid_stat *uid_stat;
 	} stat;
 #endif
 #endif
@@ -73,6 +77,16 @@ int wake_lock_active(struct wake_lock *lock);
  */
 long has_wake_lock(int type);
 
+#ifdef CONFIG_WAKELOCK_STAT
+/* wake_lock_set_uid attributes the hold time of the wake_lock to uid in
+ * /proc/wakelocks_uid and in the wakelock tracepoints, until it is changed
+ * again. It may sleep, so it must not be called from atomic context.
+ */
+void wake_lock_set_uid(struct wake_lock *lock, uid_t uid);
+#else
+static inline void wake_lock_set_uid(struct wake_lock *lock, uid_t uid) {}
+#endif
+
 #else
 
 static inline void wake_lock_init(struct wake_lock *lock, int type,
@@ -84,6 +98,7 @@ static inline void wake_unlock(struct wake_lock *lock) {}
 
 static inline int wake_lock_active(struct wake_lock *lock) { return 0; }
 static inline long has_wake_lock(int type) { return 0; }
+static inline void wake_lock_set_uid(struct wake_lock *lock, uid_t uid) {}
 
 #endif
 
@@ -22,10 +22,23 @@ typedef void (*work_func_t)(struct work_struct *work);
  */
 #define work_data_bits(work) ((unsigned long *)(&(work)->data))
 
+/*
+ * A work item is accounted to one of two flush colors while it is
+ * queued or running, see flush_workqueue().  Barrier work items carry
+ * no color.
+ */
+#define WORK_NR_COLORS		2
+#define WORK_NO_COLOR		3
+
 struct work_struct {
 	atomic_long_t data;
 #define WORK_STRUCT_PENDING 0		/* T if work item pending execution */
-#define WORK_STRUCT_FLAG_MASK (3UL)
+#define WORK_STRUCT_DELAYED 1		/* T if waiting for max_active */
+#define WORK_STRUCT_LINKED 2		/* T if the next work is linked to it */
+#define WORK_STRUCT_COLOR_SHIFT 3	/* flush color */
+#define WORK_STRUCT_COLOR_BITS 2
+#define WORK_STRUCT_FLAG_BITS (WORK_STRUCT_COLOR_SHIFT + WORK_STRUCT_COLOR_BITS)
+#define WORK_STRUCT_FLAG_MASK ((1UL << WORK_STRUCT_FLAG_BITS) - 1)
 #define WORK_STRUCT_WQ_DATA_MASK (~WORK_STRUCT_FLAG_MASK)
 	struct list_head entry;
 	work_func_t func;
@@ -159,13 +172,31 @@ struct execute_work {
 	clear_bit(WORK_STRUCT_PENDING, work_data_bits(work))
 
 
+/*
+ * Workqueue flags.  Work items are executed by pools of worker threads
+ * shared by all workqueues, which keep one worker per cpu running and
+ * start another one when it blocks.  WQ_DEDICATED workqueues instead
+ * keep threads of their own, one per cpu, as freezeable and real time
+ * ones always do: use it for work items which memory reclaim may wait
+ * on, so that they never depend on a new worker being created.
+ */
+enum {
+	WQ_SINGLE_THREAD	= 1 << 0, /* one thread, not bound to a cpu */
+	WQ_FREEZEABLE		= 1 << 1, /* freeze during suspend */
+	WQ_RT			= 1 << 2, /* SCHED_FIFO threads */
+	WQ_DEDICATED		= 1 << 3, /* threads of its own */
+};
+
+/*
+ * @max_active is the number of work items of the workqueue which may
+ * be executing at the same time on each cpu, the rest wait in order.
+ */
 extern struct workqueue_struct *
-__create_workqueue_key(const char *name, int singlethread,
-		       int freezeable, int rt, struct lock_class_key *key,
-		       const char *lock_name);
+__create_workqueue_key(const char *name, unsigned int flags, int max_active,
+		       struct lock_class_key *key, const char *lock_name);
 
 #ifdef CONFIG_LOCKDEP
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
+#define __create_workqueue(name, flags, max_active)		\
 ({								\
 	static struct lock_class_key __key;			\
 	const char *__lock_name;				\
@@ -175,20 +206,24 @@ __create_workqueue_key(const char *name, int singlethread,
 	else							\
 		__lock_name = #name;				\
 								\
-	__create_workqueue_key((name), (singlethread),		\
-			       (freezeable), (rt), &__key,	\
-			       __lock_name);			\
+	__create_workqueue_key((name), (flags), (max_active),	\
+			       &__key, __lock_name);		\
 })
 #else
-#define __create_workqueue(name, singlethread, freezeable, rt)	\
-	__create_workqueue_key((name), (singlethread), (freezeable), (rt), \
-			       NULL, NULL)
+#define __create_workqueue(name, flags, max_active)		\
+	__create_workqueue_key((name), (flags), (max_active), NULL, NULL)
 #endif
 
-#define create_workqueue(name) __create_workqueue((name), 0, 0, 0)
-#define create_rt_workqueue(name) __create_workqueue((name), 0, 0, 1)
-#define create_freezeable_workqueue(name) __create_workqueue((name), 1, 1, 0)
-#define create_singlethread_workqueue(name) __create_workqueue((name), 1, 0, 0)
+#define create_workqueue(name) __create_workqueue((name), 0, 1)
+#define create_rt_workqueue(name) __create_workqueue((name), WQ_RT, 1)
+#define create_freezeable_workqueue(name) \
+	__create_workqueue((name), WQ_SINGLE_THREAD | WQ_FREEZEABLE, 1)
+#define create_singlethread_workqueue(name) \
+	__create_workqueue((name), WQ_SINGLE_THREAD, 1)
+#define create_dedicated_workqueue(name) \
+	__create_workqueue((name), WQ_DEDICATED, 1)
+#define create_singlethread_dedicated_workqueue(name) \
+	__create_workqueue((name), WQ_SINGLE_THREAD | WQ_DEDICATED, 1)
 
 extern void destroy_workqueue(struct workqueue_struct *wq);
 
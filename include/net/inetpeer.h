@@ -27,6 +27,12 @@ struct inet_peer
 	atomic_t		rid;		/* Frag reception counter */
 	__u32			tcp_ts;
 	unsigned long		tcp_ts_stamp;
+	/* TCP Fast Open cookie and MSS the peer gave us, under
+	 * tcp_fastopen_cache_lock.
+	 */
+	__u16			tcp_fastopen_mss;
+	__s8			tcp_fastopen_len;
+	__u8			tcp_fastopen_cookie[16];
 };
 
 void			inet_initpeers(void) __init;
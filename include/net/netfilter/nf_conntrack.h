@@ -104,6 +104,9 @@ struct nf_conn
 	/* Have we seen traffic both ways yet? (bitset) */
 	unsigned long status;
 
+	/* CPU whose unconfirmed list holds us until we are confirmed */
+	u_int16_t cpu;
+
 	/* If we were expected by an expectation, this will be it */
 	struct nf_conn *master;
 
@@ -197,7 +200,7 @@ extern void nf_ct_free_hashtable(struct hlist_head *hash, int vmalloced,
 extern struct nf_conntrack_tuple_hash *
 __nf_conntrack_find(struct net *net, const struct nf_conntrack_tuple *tuple);
 
-extern void nf_conntrack_hash_insert(struct nf_conn *ct);
+extern int nf_conntrack_hash_check_insert(struct nf_conn *ct);
 
 extern void nf_conntrack_flush(struct net *net, u32 pid, int report);
 
@@ -73,6 +73,17 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
             const struct nf_conntrack_l3proto *l3proto,
             const struct nf_conntrack_l4proto *proto);
 
+/* nf_conntrack_lock protects expectations, helpers and the other
+ * global state.  The hash chains are protected by nf_conntrack_locks[],
+ * picked by bucket, and the unconfirmed lists by their per-cpu lock.
+ * Lock order: nf_conntrack_lock, bucket locks, per-cpu lock.
+ */
 extern spinlock_t nf_conntrack_lock ;
 
+#define NF_CONNTRACK_LOCKS 256
+extern spinlock_t nf_conntrack_locks[NF_CONNTRACK_LOCKS];
+
+extern void nf_conntrack_all_lock(void);
+extern void nf_conntrack_all_unlock(void);
+
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -0,0 +1,29 @@
+#ifndef _NF_SET_H
+#define _NF_SET_H
+
+#include <linux/skbuff.h>
+#include <linux/netfilter/nfnetlink_set.h>
+
+#define NFSET_MAX_SETS		256
+#define NFSET_INVALID_INDEX	0xffff
+
+/* Lookup direction for nf_set_test() */
+#define NFSET_SRC		0x1
+#define NFSET_DST		0x2
+
+/* nf_set_get_byname takes a reference on the named set, which keeps it from
+ * being destroyed, and returns its index or NFSET_INVALID_INDEX.  The index
+ * stays valid until the matching nf_set_put(); a SWAP exchanges the
+ * contents behind two indices but never the indices themselves.
+ */
+extern u_int16_t nf_set_get_byname(const char *name);
+extern void nf_set_put(u_int16_t index);
+
+/* nf_set_test checks whether the packet's source or destination (according
+ * to flags) is a member of the set.  Callable from softirq context; the
+ * caller must hold a reference on the set.
+ */
+extern bool nf_set_test(u_int16_t index, const struct sk_buff *skb,
+			unsigned int flags);
+
+#endif /* _NF_SET_H */
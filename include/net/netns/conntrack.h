@@ -2,17 +2,24 @@
 #define __NETNS_CONNTRACK_H
 
 #include <linux/list.h>
+#include <linux/spinlock.h>
 #include <asm/atomic.h>
 
 struct ctl_table_header;
 struct nf_conntrack_ecache;
 
+/* Per-cpu list of conntracks that are not in the hash table yet */
+struct ct_pcpu {
+	spinlock_t		lock;
+	struct hlist_head	unconfirmed;
+};
+
 struct netns_ct {
 	atomic_t		count;
 	unsigned int		expect_count;
 	struct hlist_head	*hash;
 	struct hlist_head	*expect_hash;
-	struct hlist_head	unconfirmed;
+	struct ct_pcpu		*pcpu_lists;
 	struct ip_conntrack_stat *stat;
 #ifdef CONFIG_NF_CONNTRACK_EVENTS
 	struct nf_conntrack_ecache *ecache;
@@ -166,6 +166,11 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define TCPOPT_SACK             5       /* SACK Block */
 #define TCPOPT_TIMESTAMP	8	/* Better RTT estimations/PAWS */
 #define TCPOPT_MD5SIG		19	/* MD5 Signature (RFC2385) */
+#define TCPOPT_EXP		254	/* Experimental */
+/* Magic number to be after the option value for sharing TCP
+ * experimental options. See draft-ietf-tcpm-experimental-options-00.txt
+ */
+#define TCPOPT_FASTOPEN_MAGIC	0xF989
 
 /*
  *     TCP option lengths
@@ -176,6 +181,7 @@ extern void tcp_time_wait(struct sock *sk, int state, int timeo);
 #define TCPOLEN_SACK_PERM      2
 #define TCPOLEN_TIMESTAMP      10
 #define TCPOLEN_MD5SIG         18
+#define TCPOLEN_EXP_FASTOPEN_BASE  4
 
 /* But this is what stacks really send out. */
 #define TCPOLEN_TSTAMP_ALIGNED		12
@@ -236,6 +242,7 @@ extern int sysctl_tcp_base_mss;
 extern int sysctl_tcp_workaround_signed_windows;
 extern int sysctl_tcp_slow_start_after_idle;
 extern int sysctl_tcp_max_ssthresh;
+extern int sysctl_tcp_fastopen;
 
 extern atomic_t tcp_memory_allocated;
 extern struct percpu_counter tcp_sockets_allocated;
@@ -368,6 +375,8 @@ extern int			tcp_use_frto(struct sock *sk);
 extern void			tcp_enter_frto(struct sock *sk);
 extern void			tcp_enter_loss(struct sock *sk, int how);
 extern void			tcp_clear_retrans(struct tcp_sock *tp);
+extern void			tcp_init_metrics(struct sock *sk);
+extern void			tcp_init_buffer_space(struct sock *sk);
 extern void			tcp_update_metrics(struct sock *sk);
 
 extern void			tcp_close(struct sock *sk, 
@@ -395,7 +404,8 @@ extern int			tcp_recvmsg(struct kiocb *iocb, struct sock *sk,
 
 extern void			tcp_parse_options(struct sk_buff *skb,
 						  struct tcp_options_received *opt_rx,
-						  int estab);
+						  int estab,
+						  struct tcp_fastopen_cookie *foc);
 
 extern u8			*tcp_parse_md5sig_option(struct tcphdr *th);
 
@@ -449,6 +459,27 @@ extern struct sock *cookie_v6_check(struct sock *sk, struct sk_buff *skb);
 extern __u32 cookie_v6_init_sequence(struct sock *sk, struct sk_buff *skb,
 				     __u16 *mss);
 
+/* From tcp_fastopen.c */
+#define	TFO_CLIENT_ENABLE	1	/* sysctl_tcp_fastopen bits */
+#define	TFO_SERVER_ENABLE	2
+
+struct tcp_fastopen_request {
+	/* Fast Open cookie. Size 0 means a cookie request */
+	struct tcp_fastopen_cookie	cookie;
+	struct msghdr			*data;  /* data in MSG_FASTOPEN */
+	int				copied;	/* queued in tcp_connect() */
+};
+
+extern void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+				    struct tcp_fastopen_cookie *foc);
+extern u16 tcp_fastopen_cache_get(struct sock *sk,
+				  struct tcp_fastopen_cookie *foc);
+extern void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+				   struct tcp_fastopen_cookie *foc);
+extern int tcp_fastopen_create_child(struct sock *sk, struct sk_buff *skb,
+				     struct request_sock *req,
+				     struct dst_entry *dst);
+
 /* tcp_output.c */
 
 extern void __tcp_push_pending_frames(struct sock *sk, unsigned int cur_mss,
@@ -460,6 +491,10 @@ extern void tcp_simple_retransmit(struct sock *);
 extern int tcp_trim_head(struct sock *, struct sk_buff *, u32);
 extern int tcp_fragment(struct sock *, struct sk_buff *, u32, unsigned int);
 
+extern void tcp_openreq_init_rwin(struct request_sock *req, struct sock *sk,
+				  struct dst_entry *dst);
+extern void tcp_fastopen_queue_synack(struct sock *child, struct sk_buff *skb);
+
 extern void tcp_send_probe0(struct sock *);
 extern void tcp_send_partial(struct sock *);
 extern int  tcp_write_wakeup(struct sock *);
@@ -972,6 +1007,8 @@ static inline void tcp_openreq_init(struct request_sock *req,
 	ireq->ecn_ok = 0;
 	ireq->rmt_port = tcp_hdr(skb)->source;
 	ireq->loc_port = tcp_hdr(skb)->dest;
+	tcp_rsk(req)->syn_data_acked = 0;
+	tcp_rsk(req)->fastopen_cookie_len = 0;
 }
 
 extern void tcp_enter_memory_pressure(struct sock *sk);
@@ -0,0 +1,19 @@
+#ifndef _TRACE_WAKELOCK_H
+#define _TRACE_WAKELOCK_H
+
+#include <linux/wakelock.h>
+#include <linux/tracepoint.h>
+
+/*
+ * uid is the last user space acquirer of the lock, as set by
+ * wake_lock_set_uid(), or -1 for locks taken by the kernel.
+ */
+DECLARE_TRACE(wake_lock_acquire,
+	TPPROTO(struct wake_lock *lock, long timeout, uid_t uid),
+		TPARGS(lock, timeout, uid));
+
+DECLARE_TRACE(wake_lock_release,
+	TPPROTO(struct wake_lock *lock, s64 held_ns, int expired, uid_t uid),
+		TPARGS(lock, held_ns, expired, uid));
+
+#endif
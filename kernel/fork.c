@@ -60,6 +60,8 @@
 #include <linux/tty.h>
 #include <linux/proc_fs.h>
 #include <linux/blkdev.h>
+#include <linux/ksm.h>
+#include <linux/perf_counter.h>
 #include <trace/sched.h>
 
 #include <asm/pgtable.h>
@@ -284,6 +286,9 @@ static int dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
 	rb_link = &mm->mm_rb.rb_node;
 	rb_parent = NULL;
 	pprev = &mm->mmap;
+	retval = ksm_fork(mm, oldmm);
+	if (retval)
+		goto out;
 
 	for (mpnt = oldmm->mmap; mpnt; mpnt = mpnt->vm_next) {
 		struct file *file;
@@ -421,6 +426,8 @@ static struct mm_struct * mm_init(struct mm_struct * mm, struct task_struct *p)
 	init_rwsem(&mm->mmap_sem);
 	INIT_LIST_HEAD(&mm->mmlist);
 	mm->flags = (current->mm) ? current->mm->flags : default_dump_filter;
+	/* ksm_fork() registers the mm with KSM if it has to */
+	__clear_bit(MMF_VM_MERGEABLE, &mm->flags);
 	mm->core_state = NULL;
 	mm->nr_ptes = 0;
 	set_mm_counter(mm, file_rss, 0);
@@ -481,6 +488,7 @@ void mmput(struct mm_struct *mm)
 
 	if (atomic_dec_and_test(&mm->mm_users)) {
 		exit_aio(mm);
+		ksm_exit(mm);
 		exit_mmap(mm);
 		set_mm_exe_file(mm, NULL);
 		if (!list_empty(&mm->mmlist)) {
@@ -858,6 +866,7 @@ static int copy_signal(unsigned long clone_flags, struct task_struct *tsk)
 	sig->min_flt = sig->maj_flt = sig->cmin_flt = sig->cmaj_flt = 0;
 	sig->inblock = sig->oublock = sig->cinblock = sig->coublock = 0;
 	task_io_accounting_init(&sig->ioac);
+	task_cpufreq_stats_init(&sig->cpufreq_stats);
 	sig->sum_sched_runtime = 0;
 	taskstats_tgid_init(sig);
 
@@ -1047,6 +1056,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 #endif
 
 	task_io_accounting_init(&p->ioac);
+	task_cpufreq_stats_init(&p->cpufreq_stats);
 	acct_clear_integrals(p);
 
 	posix_cpu_timers_init(p);
@@ -1101,8 +1111,13 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	/* Perform scheduler related setup. Assign this task to a CPU. */
 	sched_fork(p, clone_flags);
 
+	/* A partially inherited context is torn down by the cleanup path. */
+	retval = perf_counter_init_task(p);
+	if (retval)
+		goto bad_fork_cleanup_perf;
+
 	if ((retval = audit_alloc(p)))
-		goto bad_fork_cleanup_policy;
+		goto bad_fork_cleanup_perf;
 	/* copy all the process information */
 	if ((retval = copy_semundo(clone_flags, p)))
 		goto bad_fork_cleanup_audit;
@@ -1300,7 +1315,8 @@ bad_fork_cleanup_semundo:
 	exit_sem(p);
 bad_fork_cleanup_audit:
 	audit_free(p);
-bad_fork_cleanup_policy:
+bad_fork_cleanup_perf:
+	perf_counter_free_task(p);
 #ifdef CONFIG_NUMA
 	mpol_put(p->mempolicy);
 bad_fork_cleanup_cgroup:
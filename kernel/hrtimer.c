@@ -1365,8 +1365,12 @@ void hrtimer_run_queues(void)
 			struct hrtimer *timer;
 
 			timer = rb_entry(node, struct hrtimer, node);
-			if (base->softirq_time.tv64 <=
-					hrtimer_get_expires_tv64(timer))
+			/*
+			 * Like hrtimer_interrupt() run everything whose
+			 * soft expiry has passed, the tick is there anyway.
+			 */
+			if (base->softirq_time.tv64 <
+					hrtimer_get_softexpires_tv64(timer))
 				break;
 
 			__run_hrtimer(timer);
@@ -1420,6 +1424,17 @@ static int __sched do_nanosleep(struct hrtimer_sleeper *t, enum hrtimer_mode mod
 	return t->task == NULL;
 }
 
+/*
+ * The slack the current task allows on its sleeps, none for real time
+ * tasks.
+ */
+static unsigned long current_timer_slack(void)
+{
+	if (rt_task(current))
+		return 0;
+	return current->timer_slack_ns;
+}
+
 static int update_rmtp(struct hrtimer *timer, struct timespec __user *rmtp)
 {
 	struct timespec rmt;
@@ -1440,11 +1455,14 @@ long __sched hrtimer_nanosleep_restart(struct restart_block *restart)
 {
 	struct hrtimer_sleeper t;
 	struct timespec __user  *rmtp;
+	ktime_t expires;
 	int ret = 0;
 
 	hrtimer_init_on_stack(&t.timer, restart->nanosleep.index,
 				HRTIMER_MODE_ABS);
-	hrtimer_set_expires_tv64(&t.timer, restart->nanosleep.expires);
+	/* the saved expiry is the soft one, the slack is applied again */
+	expires.tv64 = restart->nanosleep.expires;
+	hrtimer_set_expires_range_ns(&t.timer, expires, current_timer_slack());
 
 	if (do_nanosleep(&t, HRTIMER_MODE_ABS))
 		goto out;
@@ -1469,14 +1487,10 @@ long hrtimer_nanosleep(struct timespec *rqtp, struct timespec __user *rmtp,
 	struct restart_block *restart;
 	struct hrtimer_sleeper t;
 	int ret = 0;
-	unsigned long slack;
-
-	slack = current->timer_slack_ns;
-	if (rt_task(current))
-		slack = 0;
 
 	hrtimer_init_on_stack(&t.timer, clockid, mode);
-	hrtimer_set_expires_range_ns(&t.timer, timespec_to_ktime(*rqtp), slack);
+	hrtimer_set_expires_range_ns(&t.timer, timespec_to_ktime(*rqtp),
+				     current_timer_slack());
 	if (do_nanosleep(&t, mode))
 		goto out;
 
@@ -1496,7 +1510,7 @@ long hrtimer_nanosleep(struct timespec *rqtp, struct timespec __user *rmtp,
 	restart->fn = hrtimer_nanosleep_restart;
 	restart->nanosleep.index = t.timer.base->index;
 	restart->nanosleep.rmtp = rmtp;
-	restart->nanosleep.expires = hrtimer_get_expires_tv64(&t.timer);
+	restart->nanosleep.expires = hrtimer_get_softexpires_tv64(&t.timer);
 
 	ret = -ERESTART_RESTARTBLOCK;
 out:
@@ -1730,6 +1744,10 @@ EXPORT_SYMBOL_GPL(schedule_hrtimeout_range);
  * elapsed. The routine will return immediately unless
  * the current task state has been set (see set_current_state()).
  *
+ * The wakeup may be delayed by the timer slack of the current task
+ * (see PR_SET_TIMERSLACK), so that it can share an interrupt with
+ * other timers.  Real time tasks get no slack.
+ *
  * You can set the task state as follows -
  *
  * %TASK_UNINTERRUPTIBLE - at least @timeout time is guaranteed to
@@ -1746,6 +1764,6 @@ EXPORT_SYMBOL_GPL(schedule_hrtimeout_range);
 int __sched schedule_hrtimeout(ktime_t *expires,
 			       const enum hrtimer_mode mode)
 {
-	return schedule_hrtimeout_range(expires, 0, mode);
+	return schedule_hrtimeout_range(expires, current_timer_slack(), mode);
 }
 EXPORT_SYMBOL_GPL(schedule_hrtimeout);
@@ -38,6 +38,18 @@ struct kthread_create_info
 	struct list_head list;
 };
 
+/*
+ * Kept on the stack of a running kthread, found through ->vfork_done
+ * which is not used by kernel threads otherwise.
+ */
+struct kthread {
+	void *data;
+	struct completion exited;
+};
+
+#define to_kthread(tsk)	\
+	container_of((tsk)->vfork_done, struct kthread, exited)
+
 struct kthread_stop_info
 {
 	struct task_struct *k;
@@ -63,16 +75,33 @@ int kthread_should_stop(void)
 }
 EXPORT_SYMBOL(kthread_should_stop);
 
+/**
+ * kthread_data - return data value specified on kthread creation
+ * @task: kthread task in question
+ *
+ * Return the data value specified when kthread @task was created.
+ * The caller is responsible for ensuring the validity of @task when
+ * calling this function.
+ */
+void *kthread_data(struct task_struct *task)
+{
+	return to_kthread(task)->data;
+}
+
 static int kthread(void *_create)
 {
 	struct kthread_create_info *create = _create;
 	int (*threadfn)(void *data);
+	struct kthread self;
 	void *data;
 	int ret = -EINTR;
 
 	/* Copy data: it's on kthread's stack */
 	threadfn = create->threadfn;
 	data = create->data;
+	self.data = data;
+	init_completion(&self.exited);
+	current->vfork_done = &self.exited;
 
 	/* OK, tell user we're spawned, wait for stop or wakeup */
 	__set_current_state(TASK_UNINTERRUPTIBLE);
@@ -87,6 +116,8 @@ static int kthread(void *_create)
 		kthread_stop_info.err = ret;
 		complete(&kthread_stop_info.done);
 	}
+	/* self goes away with this frame, do_exit() must not complete it */
+	current->vfork_done = NULL;
 	return 0;
 }
 
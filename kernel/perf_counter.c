@@ -0,0 +1,2533 @@
+/*
+ * Performance counter core code
+ *
+ * Counters are attached either to a task, and then follow it across
+ * context switches and into its children, or to a CPU.  Each counter is
+ * driven by a pmu: the architecture provides the hardware one through
+ * hw_perf_counter_init(), the software ones (clocks, faults, context
+ * switches, migrations) live here.  Sampling counters write records into
+ * a ring buffer that user space maps through the counter's file descriptor.
+ *
+ * For licencing details see kernel-base/COPYING
+ */
+
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/cpu.h>
+#include <linux/smp.h>
+#include <linux/file.h>
+#include <linux/poll.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/ptrace.h>
+#include <linux/percpu.h>
+#include <linux/hardirq.h>
+#include <linux/uaccess.h>
+#include <linux/syscalls.h>
+#include <linux/capability.h>
+#include <linux/anon_inodes.h>
+#include <linux/perf_counter.h>
+
+#include <asm/irq_regs.h>
+
+/*
+ * Each CPU has a list of per CPU counters:
+ */
+DEFINE_PER_CPU(struct perf_cpu_context, perf_cpu_context);
+
+/*
+ * Number of existing software counters, checked by perf_swcounter_event()
+ * before it does any real work:
+ */
+atomic_t perf_swcounter_nr __read_mostly;
+
+/*
+ * Size of the counter mmap() buffers, in kB per online cpu, a user may
+ * have pinned on top of RLIMIT_MEMLOCK:
+ */
+int sysctl_perf_counter_mlock __read_mostly = 512;
+
+/*
+ * Smallest sample period of a hardware counter for users without
+ * CAP_SYS_ADMIN.  A hardware counter interrupts every period events, so
+ * with much shorter periods the overflow interrupt alone can keep a cpu
+ * busy, and there is no interrupt throttling.
+ */
+#define PERF_COUNTER_MIN_HW_PERIOD	10000
+
+static atomic_t perf_counter_id;
+
+/*
+ * Architecture provided APIs - weak aliases:
+ */
+const struct pmu * __weak hw_perf_counter_init(struct perf_counter *counter)
+{
+	return NULL;
+}
+
+void __weak hw_perf_disable(void)		{ barrier(); }
+void __weak hw_perf_enable(void)		{ barrier(); }
+
+static void get_ctx(struct perf_counter_context *ctx)
+{
+	atomic_inc(&ctx->refcount);
+}
+
+static void put_ctx(struct perf_counter_context *ctx)
+{
+	if (atomic_dec_and_test(&ctx->refcount)) {
+		if (ctx->task)
+			put_task_struct(ctx->task);
+		kfree(ctx);
+	}
+}
+
+static inline int is_software_counter(struct perf_counter *counter)
+{
+	return counter->attr.type == PERF_TYPE_SOFTWARE;
+}
+
+/*
+ * Add a counter to the lists for its context.
+ * Must be called with ctx->mutex and ctx->lock held.
+ */
+static void
+list_add_counter(struct perf_counter *counter, struct perf_counter_context *ctx)
+{
+	struct perf_counter *group_leader = counter->group_leader;
+
+	/*
+	 * Depending on whether it is a standalone or sibling counter,
+	 * add it straight to the context's counter list, or to the group
+	 * leader's sibling list:
+	 */
+	if (group_leader == counter)
+		list_add_tail(&counter->list_entry, &ctx->counter_list);
+	else
+		list_add_tail(&counter->list_entry, &group_leader->sibling_list);
+
+	ctx->nr_counters++;
+}
+
+/*
+ * Remove a counter from the lists for its context.
+ * Must be called with ctx->mutex and ctx->lock held.
+ */
+static void
+list_del_counter(struct perf_counter *counter, struct perf_counter_context *ctx)
+{
+	struct perf_counter *sibling, *tmp;
+
+	if (list_empty(&counter->list_entry))
+		return;
+	ctx->nr_counters--;
+
+	list_del_init(&counter->list_entry);
+
+	/*
+	 * If this was a group counter with sibling counters then
+	 * upgrade the siblings to singleton counters by adding them
+	 * to the context list directly:
+	 */
+	list_for_each_entry_safe(sibling, tmp, &counter->sibling_list,
+				 list_entry) {
+		list_move_tail(&sibling->list_entry, &ctx->counter_list);
+		sibling->group_leader = sibling;
+	}
+}
+
+static inline u64 perf_clock(void)
+{
+	return cpu_clock(raw_smp_processor_id());
+}
+
+/*
+ * Update the record of the current time in a context.
+ */
+static void update_context_time(struct perf_counter_context *ctx)
+{
+	u64 now = perf_clock();
+
+	ctx->time += now - ctx->timestamp;
+	ctx->timestamp = now;
+}
+
+/*
+ * Update the total_time_enabled and total_time_running fields for a counter.
+ */
+static void update_counter_times(struct perf_counter *counter)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	u64 run_end;
+
+	if (counter->state < PERF_COUNTER_STATE_INACTIVE)
+		return;
+
+	counter->total_time_enabled = ctx->time - counter->tstamp_enabled;
+
+	if (counter->state == PERF_COUNTER_STATE_INACTIVE)
+		run_end = counter->tstamp_stopped;
+	else
+		run_end = ctx->time;
+
+	counter->total_time_running = run_end - counter->tstamp_running;
+}
+
+/*
+ * Update total_time_enabled and total_time_running for all counters in a group.
+ */
+static void update_group_times(struct perf_counter *leader)
+{
+	struct perf_counter *counter;
+
+	update_counter_times(leader);
+	list_for_each_entry(counter, &leader->sibling_list, list_entry)
+		update_counter_times(counter);
+}
+
+static void
+counter_sched_out(struct perf_counter *counter,
+		  struct perf_cpu_context *cpuctx,
+		  struct perf_counter_context *ctx)
+{
+	if (counter->state != PERF_COUNTER_STATE_ACTIVE)
+		return;
+
+	counter->state = PERF_COUNTER_STATE_INACTIVE;
+	counter->tstamp_stopped = ctx->time;
+	counter->pmu->disable(counter);
+	counter->oncpu = -1;
+
+	ctx->nr_active--;
+}
+
+static void
+group_sched_out(struct perf_counter *group_counter,
+		struct perf_cpu_context *cpuctx,
+		struct perf_counter_context *ctx)
+{
+	struct perf_counter *counter;
+
+	if (group_counter->state != PERF_COUNTER_STATE_ACTIVE)
+		return;
+
+	counter_sched_out(group_counter, cpuctx, ctx);
+
+	/*
+	 * Schedule out siblings (if any):
+	 */
+	list_for_each_entry(counter, &group_counter->sibling_list, list_entry)
+		counter_sched_out(counter, cpuctx, ctx);
+}
+
+static int
+counter_sched_in(struct perf_counter *counter,
+		 struct perf_cpu_context *cpuctx,
+		 struct perf_counter_context *ctx,
+		 int cpu)
+{
+	if (counter->state <= PERF_COUNTER_STATE_OFF)
+		return 0;
+
+	counter->state = PERF_COUNTER_STATE_ACTIVE;
+	counter->oncpu = cpu;
+	/*
+	 * The new state must be visible before we turn it on in the hardware:
+	 */
+	smp_wmb();
+
+	if (counter->pmu->enable(counter)) {
+		counter->state = PERF_COUNTER_STATE_INACTIVE;
+		counter->oncpu = -1;
+		return -EAGAIN;
+	}
+
+	counter->tstamp_running += ctx->time - counter->tstamp_stopped;
+	ctx->nr_active++;
+
+	return 0;
+}
+
+static int
+group_sched_in(struct perf_counter *group_counter,
+	       struct perf_cpu_context *cpuctx,
+	       struct perf_counter_context *ctx,
+	       int cpu)
+{
+	struct perf_counter *counter, *partial_group;
+
+	if (group_counter->state == PERF_COUNTER_STATE_OFF)
+		return 0;
+
+	if (counter_sched_in(group_counter, cpuctx, ctx, cpu))
+		return -EAGAIN;
+
+	/*
+	 * Schedule in siblings as one group (if any):
+	 */
+	list_for_each_entry(counter, &group_counter->sibling_list, list_entry) {
+		if (counter_sched_in(counter, cpuctx, ctx, cpu)) {
+			partial_group = counter;
+			goto group_error;
+		}
+	}
+
+	return 0;
+
+group_error:
+	/*
+	 * Groups can be scheduled in as one unit only, so undo any
+	 * partial group before returning:
+	 */
+	list_for_each_entry(counter, &group_counter->sibling_list, list_entry) {
+		if (counter == partial_group)
+			break;
+		counter_sched_out(counter, cpuctx, ctx);
+	}
+	counter_sched_out(group_counter, cpuctx, ctx);
+
+	return -EAGAIN;
+}
+
+/*
+ * Return 1 for a group consisting entirely of software counters,
+ * 0 if the group contains any hardware counters.
+ */
+static int is_software_only_group(struct perf_counter *leader)
+{
+	struct perf_counter *counter;
+
+	if (!is_software_counter(leader))
+		return 0;
+
+	list_for_each_entry(counter, &leader->sibling_list, list_entry)
+		if (!is_software_counter(counter))
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Work out whether we can put this counter group on the CPU now.
+ */
+static int group_can_go_on(struct perf_counter *counter, int can_add_hw)
+{
+	/*
+	 * Groups consisting entirely of software counters can always go on.
+	 */
+	if (is_software_only_group(counter))
+		return 1;
+
+	/*
+	 * Otherwise, try to add it if all previous groups were able
+	 * to go on.
+	 */
+	return can_add_hw;
+}
+
+static void add_counter_to_ctx(struct perf_counter *counter,
+			       struct perf_counter_context *ctx)
+{
+	list_add_counter(counter, ctx);
+	counter->tstamp_enabled = ctx->time;
+	counter->tstamp_running = ctx->time;
+	counter->tstamp_stopped = ctx->time;
+}
+
+/*
+ * Cross CPU call to remove a performance counter
+ *
+ * We disable the counter on the hardware level first. After that we
+ * remove it from the context list.
+ */
+static void __perf_counter_remove_from_context(void *info)
+{
+	struct perf_cpu_context *cpuctx = &__get_cpu_var(perf_cpu_context);
+	struct perf_counter *counter = info;
+	struct perf_counter_context *ctx = counter->ctx;
+
+	/*
+	 * If this is a task context, we need to check whether it is
+	 * the current task context of this cpu. If not it has been
+	 * scheduled out before the smp call arrived.
+	 */
+	if (ctx->task && cpuctx->task_ctx != ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+
+	update_context_time(ctx);
+	hw_perf_disable();
+	counter_sched_out(counter, cpuctx, ctx);
+	update_counter_times(counter);
+	list_del_counter(counter, ctx);
+	hw_perf_enable();
+
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Remove the counter from a task's (or a CPU's) list of counters.
+ *
+ * Must be called with ctx->mutex held.
+ *
+ * CPU counters are removed with a smp call. For task counters we only
+ * call when the task is on a CPU.
+ */
+static void perf_counter_remove_from_context(struct perf_counter *counter)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	struct task_struct *task = ctx->task;
+
+	if (!task) {
+		/*
+		 * Per cpu counters are removed via an smp call and
+		 * the removal is always sucessful.
+		 */
+		smp_call_function_single(counter->cpu,
+					 __perf_counter_remove_from_context,
+					 counter, 1);
+		return;
+	}
+
+retry:
+	task_oncpu_function_call(task, __perf_counter_remove_from_context,
+				 counter);
+
+	spin_lock_irq(&ctx->lock);
+	/*
+	 * If the context is active we need to retry the smp call.
+	 */
+	if (ctx->nr_active && !list_empty(&counter->list_entry)) {
+		spin_unlock_irq(&ctx->lock);
+		goto retry;
+	}
+
+	/*
+	 * The lock prevents that this context is scheduled in so we
+	 * can remove the counter safely, if the call above did not
+	 * succeed.
+	 */
+	if (!list_empty(&counter->list_entry)) {
+		update_counter_times(counter);
+		list_del_counter(counter, ctx);
+	}
+	spin_unlock_irq(&ctx->lock);
+}
+
+/*
+ * Cross CPU call to install and enable a performance counter
+ */
+static void __perf_install_in_context(void *info)
+{
+	struct perf_cpu_context *cpuctx = &__get_cpu_var(perf_cpu_context);
+	struct perf_counter *counter = info;
+	struct perf_counter_context *ctx = counter->ctx;
+	struct perf_counter *leader = counter->group_leader;
+	int cpu = smp_processor_id();
+	int err;
+
+	/*
+	 * If this is a task context, we need to check whether it is
+	 * the current task context of this cpu. If not it has been
+	 * scheduled out before the smp call arrived.
+	 */
+	if (ctx->task && cpuctx->task_ctx != ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+	ctx->is_active = 1;
+	update_context_time(ctx);
+
+	hw_perf_disable();
+
+	add_counter_to_ctx(counter, ctx);
+
+	/*
+	 * Don't put the counter on if it is disabled or if
+	 * it is in a group and the group isn't on.
+	 */
+	if (counter->state != PERF_COUNTER_STATE_INACTIVE ||
+	    (leader != counter && leader->state != PERF_COUNTER_STATE_ACTIVE))
+		goto unlock;
+
+	if (counter->cpu != -1 && counter->cpu != cpu)
+		goto unlock;
+
+	if (!group_can_go_on(counter, 1))
+		err = -EEXIST;
+	else
+		err = counter_sched_in(counter, cpuctx, ctx, cpu);
+
+	if (err) {
+		/*
+		 * This counter couldn't go on.  If it is in a group
+		 * then we have to pull the whole group off.
+		 * If the counter group is pinned then put it in error state.
+		 */
+		if (leader != counter)
+			group_sched_out(leader, cpuctx, ctx);
+		if (leader->attr.pinned) {
+			update_group_times(leader);
+			leader->state = PERF_COUNTER_STATE_ERROR;
+		}
+	}
+
+unlock:
+	hw_perf_enable();
+
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Attach a performance counter to a context
+ *
+ * First we add the counter to the list with the hardware enable bit
+ * in counter->hw_config cleared.
+ *
+ * If the counter is attached to a task which is on a CPU we use a smp
+ * call to enable it in the task context. The task might have been
+ * scheduled away, but we check this in the smp call again.
+ *
+ * Must be called with ctx->mutex held.
+ */
+static void
+perf_install_in_context(struct perf_counter_context *ctx,
+			struct perf_counter *counter,
+			int cpu)
+{
+	struct task_struct *task = ctx->task;
+
+	if (!task) {
+		/*
+		 * Per cpu counters are installed via an smp call and
+		 * the install is always sucessful.
+		 */
+		smp_call_function_single(cpu, __perf_install_in_context,
+					 counter, 1);
+		return;
+	}
+
+retry:
+	task_oncpu_function_call(task, __perf_install_in_context,
+				 counter);
+
+	spin_lock_irq(&ctx->lock);
+	/*
+	 * we need to retry the smp call.
+	 */
+	if (ctx->is_active && list_empty(&counter->list_entry)) {
+		spin_unlock_irq(&ctx->lock);
+		goto retry;
+	}
+
+	/*
+	 * The lock prevents that this context is scheduled in so we
+	 * can add the counter safely, if it the call above did not
+	 * succeed.
+	 */
+	if (list_empty(&counter->list_entry))
+		add_counter_to_ctx(counter, ctx);
+	spin_unlock_irq(&ctx->lock);
+}
+
+/*
+ * Cross CPU call to disable a performance counter
+ */
+static void __perf_counter_disable(void *info)
+{
+	struct perf_counter *counter = info;
+	struct perf_cpu_context *cpuctx = &__get_cpu_var(perf_cpu_context);
+	struct perf_counter_context *ctx = counter->ctx;
+
+	/*
+	 * If this is a per-task counter, need to check whether this
+	 * counter's task is the current task on this cpu.
+	 */
+	if (ctx->task && cpuctx->task_ctx != ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+
+	/*
+	 * If the counter is on, turn it off.
+	 * If it is in error state, leave it in error state.
+	 */
+	if (counter->state >= PERF_COUNTER_STATE_INACTIVE) {
+		update_context_time(ctx);
+		update_counter_times(counter);
+		if (counter == counter->group_leader)
+			group_sched_out(counter, cpuctx, ctx);
+		else
+			counter_sched_out(counter, cpuctx, ctx);
+		counter->state = PERF_COUNTER_STATE_OFF;
+	}
+
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Disable a counter.
+ */
+static void perf_counter_disable(struct perf_counter *counter)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	struct task_struct *task = ctx->task;
+
+	if (!task) {
+		/*
+		 * Disable the counter on the cpu that it's on
+		 */
+		smp_call_function_single(counter->cpu, __perf_counter_disable,
+					 counter, 1);
+		return;
+	}
+
+retry:
+	task_oncpu_function_call(task, __perf_counter_disable, counter);
+
+	spin_lock_irq(&ctx->lock);
+	/*
+	 * If the counter is still active, we need to retry the cross-call.
+	 */
+	if (counter->state == PERF_COUNTER_STATE_ACTIVE) {
+		spin_unlock_irq(&ctx->lock);
+		goto retry;
+	}
+
+	/*
+	 * Since we have the lock this context can't be scheduled
+	 * in, so we can change the state safely.
+	 */
+	if (counter->state == PERF_COUNTER_STATE_INACTIVE) {
+		update_counter_times(counter);
+		counter->state = PERF_COUNTER_STATE_OFF;
+	}
+
+	spin_unlock_irq(&ctx->lock);
+}
+
+static void __perf_counter_mark_enabled(struct perf_counter *counter,
+					struct perf_counter_context *ctx)
+{
+	struct perf_counter *sub;
+
+	counter->state = PERF_COUNTER_STATE_INACTIVE;
+	counter->tstamp_enabled = ctx->time - counter->total_time_enabled;
+	list_for_each_entry(sub, &counter->sibling_list, list_entry)
+		if (sub->state >= PERF_COUNTER_STATE_INACTIVE)
+			sub->tstamp_enabled =
+				ctx->time - sub->total_time_enabled;
+}
+
+/*
+ * Cross CPU call to enable a performance counter
+ */
+static void __perf_counter_enable(void *info)
+{
+	struct perf_counter *counter = info;
+	struct perf_cpu_context *cpuctx = &__get_cpu_var(perf_cpu_context);
+	struct perf_counter_context *ctx = counter->ctx;
+	struct perf_counter *leader = counter->group_leader;
+	int cpu = smp_processor_id();
+	int err;
+
+	/*
+	 * If this is a per-task counter, need to check whether this
+	 * counter's task is the current task on this cpu.
+	 */
+	if (ctx->task && cpuctx->task_ctx != ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+	ctx->is_active = 1;
+	update_context_time(ctx);
+
+	if (counter->state >= PERF_COUNTER_STATE_INACTIVE ||
+	    list_empty(&counter->list_entry))
+		goto unlock;
+	__perf_counter_mark_enabled(counter, ctx);
+
+	if (counter->cpu != -1 && counter->cpu != cpu)
+		goto unlock;
+
+	/*
+	 * If the counter is in a group and isn't the group leader,
+	 * then don't put it on unless the group is on.
+	 */
+	if (leader != counter && leader->state != PERF_COUNTER_STATE_ACTIVE)
+		goto unlock;
+
+	if (!group_can_go_on(counter, 1)) {
+		err = -EEXIST;
+	} else {
+		hw_perf_disable();
+		if (counter == leader)
+			err = group_sched_in(counter, cpuctx, ctx, cpu);
+		else
+			err = counter_sched_in(counter, cpuctx, ctx, cpu);
+		hw_perf_enable();
+	}
+
+	if (err) {
+		/*
+		 * If this counter can't go on and it's part of a
+		 * group, then the whole group has to come off.
+		 */
+		if (leader != counter)
+			group_sched_out(leader, cpuctx, ctx);
+		if (leader->attr.pinned) {
+			update_group_times(leader);
+			leader->state = PERF_COUNTER_STATE_ERROR;
+		}
+	}
+
+unlock:
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Enable a counter.
+ */
+static void perf_counter_enable(struct perf_counter *counter)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	struct task_struct *task = ctx->task;
+
+	if (!task) {
+		/*
+		 * Enable the counter on the cpu that it's on
+		 */
+		smp_call_function_single(counter->cpu, __perf_counter_enable,
+					 counter, 1);
+		return;
+	}
+
+	spin_lock_irq(&ctx->lock);
+	if (counter->state >= PERF_COUNTER_STATE_INACTIVE ||
+	    list_empty(&counter->list_entry))
+		goto out;
+
+	/*
+	 * If the counter is in error state, clear that first.
+	 * That way, if we see the counter in error state below, we
+	 * know that it has gone back into error state, as distinct
+	 * from the task having been scheduled away before the
+	 * cross-call arrived.
+	 */
+	if (counter->state == PERF_COUNTER_STATE_ERROR)
+		counter->state = PERF_COUNTER_STATE_OFF;
+
+retry:
+	spin_unlock_irq(&ctx->lock);
+	task_oncpu_function_call(task, __perf_counter_enable, counter);
+
+	spin_lock_irq(&ctx->lock);
+
+	/*
+	 * If the context is active and the counter is still off,
+	 * we need to retry the cross-call.
+	 */
+	if (ctx->is_active && counter->state == PERF_COUNTER_STATE_OFF)
+		goto retry;
+
+	/*
+	 * Since we have the lock this context can't be scheduled
+	 * in, so we can change the state safely.
+	 */
+	if (counter->state == PERF_COUNTER_STATE_OFF)
+		__perf_counter_mark_enabled(counter, ctx);
+
+out:
+	spin_unlock_irq(&ctx->lock);
+}
+
+static void __perf_counter_sched_out(struct perf_counter_context *ctx,
+				     struct perf_cpu_context *cpuctx)
+{
+	struct perf_counter *counter;
+
+	spin_lock(&ctx->lock);
+	ctx->is_active = 0;
+	if (likely(!ctx->nr_counters))
+		goto out;
+	update_context_time(ctx);
+
+	hw_perf_disable();
+	if (ctx->nr_active) {
+		list_for_each_entry(counter, &ctx->counter_list, list_entry)
+			group_sched_out(counter, cpuctx, ctx);
+	}
+	hw_perf_enable();
+ out:
+	spin_unlock(&ctx->lock);
+}
+
+static void
+__perf_counter_sched_in(struct perf_counter_context *ctx,
+			struct perf_cpu_context *cpuctx, int cpu)
+{
+	struct perf_counter *counter;
+	int can_add_hw = 1;
+	int pass, i;
+
+	spin_lock(&ctx->lock);
+	ctx->is_active = 1;
+	ctx->timestamp = perf_clock();
+	if (likely(!ctx->nr_counters))
+		goto out;
+
+	hw_perf_disable();
+
+	/*
+	 * First go through the list and put on any pinned groups
+	 * in order to give them the best chance of going on.
+	 */
+	list_for_each_entry(counter, &ctx->counter_list, list_entry) {
+		if (counter->state <= PERF_COUNTER_STATE_OFF ||
+		    !counter->attr.pinned)
+			continue;
+		if (counter->cpu != -1 && counter->cpu != cpu)
+			continue;
+
+		if (group_can_go_on(counter, 1))
+			group_sched_in(counter, cpuctx, ctx, cpu);
+
+		/*
+		 * If this pinned group hasn't been scheduled,
+		 * put it in error state.
+		 */
+		if (counter->state == PERF_COUNTER_STATE_INACTIVE) {
+			update_group_times(counter);
+			counter->state = PERF_COUNTER_STATE_ERROR;
+		}
+	}
+
+	/*
+	 * Then the flexible groups, as many as fit, starting at the
+	 * ctx->rotate'th group and wrapping around, so that the tick can
+	 * multiplex them without touching the list (which fork may be
+	 * walking under ctx->mutex only).
+	 */
+	for (pass = 0; pass < 2; pass++) {
+		i = 0;
+		list_for_each_entry(counter, &ctx->counter_list, list_entry) {
+			if ((i++ < ctx->rotate) != pass)
+				continue;
+
+			/*
+			 * Ignore counters in OFF or ERROR state, and
+			 * ignore pinned counters since we did them already.
+			 */
+			if (counter->state <= PERF_COUNTER_STATE_OFF ||
+			    counter->attr.pinned)
+				continue;
+
+			/*
+			 * Listen to the 'cpu' scheduling filter constraint
+			 * of counters:
+			 */
+			if (counter->cpu != -1 && counter->cpu != cpu)
+				continue;
+
+			if (group_can_go_on(counter, can_add_hw))
+				if (group_sched_in(counter, cpuctx, ctx, cpu))
+					can_add_hw = 0;
+		}
+	}
+	hw_perf_enable();
+ out:
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Called from scheduler to remove the counters of the current task,
+ * with interrupts disabled.
+ *
+ * We stop each counter and update the counter value in counter->count.
+ */
+void perf_counter_task_sched_out(struct task_struct *task, int cpu)
+{
+	struct perf_cpu_context *cpuctx = &per_cpu(perf_cpu_context, cpu);
+	struct perf_counter_context *ctx = task->perf_counter_ctxp;
+
+	perf_swcounter_event(PERF_COUNT_SW_CONTEXT_SWITCHES, 1, NULL, 0);
+
+	if (likely(!ctx || cpuctx->task_ctx != ctx))
+		return;
+
+	__perf_counter_sched_out(ctx, cpuctx);
+	cpuctx->task_ctx = NULL;
+}
+
+/*
+ * Called from scheduler to add the counters of the current task, after
+ * the switch; interrupts may be enabled there on some architectures.
+ *
+ * We restore the counter value and then enable it.  Migrations are
+ * counted here too.
+ */
+void perf_counter_task_sched_in(struct task_struct *task, int cpu)
+{
+	struct perf_cpu_context *cpuctx = &per_cpu(perf_cpu_context, cpu);
+	struct perf_counter_context *ctx = task->perf_counter_ctxp;
+	unsigned long flags;
+
+	if (likely(!ctx) && likely(task->perf_counter_cpu == cpu))
+		return;
+
+	local_irq_save(flags);
+	if (ctx) {
+		__perf_counter_sched_in(ctx, cpuctx, cpu);
+		cpuctx->task_ctx = ctx;
+	}
+	if (task->perf_counter_cpu != cpu) {
+		if (task->perf_counter_cpu != -1)
+			perf_swcounter_event(PERF_COUNT_SW_CPU_MIGRATIONS,
+					     1, NULL, 0);
+		task->perf_counter_cpu = cpu;
+	}
+	local_irq_restore(flags);
+}
+
+static void rotate_ctx(struct perf_counter_context *ctx)
+{
+	if (!ctx->nr_counters)
+		return;
+
+	spin_lock(&ctx->lock);
+	if (++ctx->rotate >= ctx->nr_counters)
+		ctx->rotate = 0;
+	spin_unlock(&ctx->lock);
+}
+
+/*
+ * Called from the scheduler tick: if some counters did not fit on the
+ * PMU, rotate the groups so that every one of them gets to run.
+ */
+void perf_counter_task_tick(struct task_struct *curr, int cpu)
+{
+	struct perf_cpu_context *cpuctx = &per_cpu(perf_cpu_context, cpu);
+	struct perf_counter_context *ctx = cpuctx->task_ctx;
+
+	if (cpuctx->ctx.nr_active == cpuctx->ctx.nr_counters &&
+	    (!ctx || ctx->nr_active == ctx->nr_counters))
+		return;
+
+	__perf_counter_sched_out(&cpuctx->ctx, cpuctx);
+	if (ctx)
+		__perf_counter_sched_out(ctx, cpuctx);
+
+	rotate_ctx(&cpuctx->ctx);
+	if (ctx)
+		rotate_ctx(ctx);
+
+	__perf_counter_sched_in(&cpuctx->ctx, cpuctx, cpu);
+	if (ctx)
+		__perf_counter_sched_in(ctx, cpuctx, cpu);
+}
+
+/*
+ * Reading (and resetting) a counter: an active counter is read on the
+ * CPU it runs on, which is the only place its value can change; any
+ * other counter is stable under ctx->lock.
+ */
+struct perf_read_data {
+	struct perf_counter	*counter;
+	int			reset;
+	int			done;
+	u64			value;
+};
+
+static void __perf_counter_read(void *info)
+{
+	struct perf_cpu_context *cpuctx = &__get_cpu_var(perf_cpu_context);
+	struct perf_read_data *rd = info;
+	struct perf_counter *counter = rd->counter;
+	struct perf_counter_context *ctx = counter->ctx;
+
+	if (ctx->task && cpuctx->task_ctx != ctx)
+		return;
+
+	spin_lock(&ctx->lock);
+	if (counter->state == PERF_COUNTER_STATE_ACTIVE &&
+	    counter->oncpu == smp_processor_id()) {
+		update_context_time(ctx);
+		counter->pmu->read(counter);
+		update_counter_times(counter);
+		rd->value = counter->count;
+		if (rd->reset)
+			counter->count = 0;
+		rd->done = 1;
+	}
+	spin_unlock(&ctx->lock);
+}
+
+static u64 __perf_counter_read_value(struct perf_counter *counter, int reset)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	struct perf_read_data rd = {
+		.counter	= counter,
+		.reset		= reset,
+	};
+	unsigned long flags;
+	int cpu;
+
+	for (;;) {
+		cpu = counter->oncpu;
+		smp_rmb();
+		if (counter->state == PERF_COUNTER_STATE_ACTIVE && cpu >= 0) {
+			smp_call_function_single(cpu, __perf_counter_read,
+						 &rd, 1);
+			if (rd.done)
+				return rd.value;
+		}
+
+		spin_lock_irqsave(&ctx->lock, flags);
+		if (counter->state != PERF_COUNTER_STATE_ACTIVE) {
+			if (ctx->is_active)
+				update_context_time(ctx);
+			update_counter_times(counter);
+			rd.value = counter->count;
+			if (reset)
+				counter->count = 0;
+			spin_unlock_irqrestore(&ctx->lock, flags);
+			return rd.value;
+		}
+		spin_unlock_irqrestore(&ctx->lock, flags);
+	}
+}
+
+/*
+ * Total of the counter and its inherited children; the times of
+ * children that have exited already were folded in by
+ * sync_child_counter().  Called with counter->child_mutex held.
+ */
+static u64 perf_counter_read(struct perf_counter *counter,
+			     u64 *enabled, u64 *running)
+{
+	struct perf_counter *child;
+	u64 total;
+
+	total = __perf_counter_read_value(counter, 0) + counter->child_count;
+	*enabled = counter->total_time_enabled +
+		   counter->child_total_time_enabled;
+	*running = counter->total_time_running +
+		   counter->child_total_time_running;
+
+	list_for_each_entry(child, &counter->child_list, child_entry) {
+		total += __perf_counter_read_value(child, 0);
+		*enabled += child->total_time_enabled;
+		*running += child->total_time_running;
+	}
+
+	return total;
+}
+
+static void perf_counter_reset(struct perf_counter *counter)
+{
+	__perf_counter_read_value(counter, 1);
+	counter->child_count = 0;
+}
+
+/*
+ * Delayed wakeups.  Counters overflow from interrupt context and from
+ * inside the scheduler, where waking up the reader directly could
+ * deadlock on the runqueue lock; the wakeup is queued on a per-cpu list
+ * instead and done from the timer softirq, see perf_counter_do_pending().
+ */
+struct perf_pending {
+	spinlock_t		lock;
+	struct list_head	list;
+	struct perf_counter	*running;
+	int			nr;
+};
+
+static DEFINE_PER_CPU(struct perf_pending, perf_pending);
+
+static void perf_counter_wakeup(struct perf_counter *counter)
+{
+	atomic_set(&counter->poll, POLLIN);
+	wake_up_all(&counter->waitq);
+	kill_fasync(&counter->fasync, SIGIO, POLL_IN);
+}
+
+/* Called with interrupts disabled. */
+static void perf_pending_queue(struct perf_counter *counter)
+{
+	int cpu = smp_processor_id();
+	struct perf_pending *pending = &per_cpu(perf_pending, cpu);
+
+	spin_lock(&pending->lock);
+	if (list_empty(&counter->pending_entry)) {
+		list_add_tail(&counter->pending_entry, &pending->list);
+		counter->pending_cpu = cpu;
+		pending->nr++;
+	}
+	spin_unlock(&pending->lock);
+}
+
+void perf_counter_do_pending(void)
+{
+	struct perf_pending *pending = &__get_cpu_var(perf_pending);
+	struct perf_counter *counter;
+
+	if (likely(!pending->nr))
+		return;
+
+	spin_lock_irq(&pending->lock);
+	while (!list_empty(&pending->list)) {
+		counter = list_first_entry(&pending->list,
+					   struct perf_counter, pending_entry);
+		list_del_init(&counter->pending_entry);
+		pending->nr--;
+		pending->running = counter;
+		spin_unlock_irq(&pending->lock);
+
+		perf_counter_wakeup(counter);
+
+		spin_lock_irq(&pending->lock);
+		pending->running = NULL;
+	}
+	spin_unlock_irq(&pending->lock);
+}
+
+/*
+ * Make sure no wakeup of @counter is queued or running any more, before
+ * it is freed.
+ */
+static void perf_pending_sync(struct perf_counter *counter)
+{
+	struct perf_pending *pending;
+
+	if (counter->pending_cpu < 0)
+		return;
+
+	pending = &per_cpu(perf_pending, counter->pending_cpu);
+	spin_lock_irq(&pending->lock);
+	if (!list_empty(&counter->pending_entry)) {
+		list_del_init(&counter->pending_entry);
+		pending->nr--;
+	}
+	while (pending->running == counter) {
+		spin_unlock_irq(&pending->lock);
+		cpu_relax();
+		spin_lock_irq(&pending->lock);
+	}
+	spin_unlock_irq(&pending->lock);
+}
+
+/*
+ * Keep the tick going while wakeups are pending on this cpu.
+ */
+int perf_counter_needs_cpu(int cpu)
+{
+	return per_cpu(perf_pending, cpu).nr != 0;
+}
+
+/*
+ * Output: the counter's ring buffer.
+ */
+struct perf_output_handle {
+	struct perf_counter	*counter;
+	struct perf_mmap_data	*data;
+	unsigned long		head;
+	unsigned long		offset;
+	unsigned long		flags;
+};
+
+/*
+ * If the buffer is mapped writable, user space tells us where it has
+ * read up to in data_tail, and we must not write over unread records.
+ */
+static int perf_output_space(struct perf_mmap_data *data,
+			     unsigned long offset, unsigned int size)
+{
+	unsigned long tail;
+
+	if (!data->writable)
+		return 1;
+
+	tail = ACCESS_ONCE(data->user_page->data_tail);
+	smp_mb();
+
+	return offset - tail + size <= (data->nr_pages << PAGE_SHIFT);
+}
+
+static void perf_output_copy(struct perf_output_handle *handle,
+			     const void *buf, unsigned int len)
+{
+	unsigned int pages_mask = handle->data->nr_pages - 1;
+	void **pages = handle->data->data_pages;
+	unsigned long offset = handle->offset;
+
+	do {
+		unsigned int page_offset = offset & (PAGE_SIZE - 1);
+		unsigned int size = min_t(unsigned int,
+					  PAGE_SIZE - page_offset, len);
+		int nr = (offset >> PAGE_SHIFT) & pages_mask;
+
+		memcpy(pages[nr] + page_offset, buf, size);
+
+		len -= size;
+		buf += size;
+		offset += size;
+	} while (len);
+
+	handle->offset = offset;
+}
+
+#define perf_output_put(handle, x) \
+	perf_output_copy((handle), &(x), sizeof(x))
+
+static int perf_output_begin(struct perf_output_handle *handle,
+			     struct perf_counter *counter, unsigned int size)
+{
+	struct perf_mmap_data *data;
+	struct {
+		struct perf_event_header	header;
+		u64				id;
+		u64				lost;
+	} lost_event;
+	unsigned int lost_size;
+
+	/*
+	 * Inherited counters write into the buffer of the counter they
+	 * were inherited from.
+	 */
+	if (counter->parent)
+		counter = counter->parent;
+
+	rcu_read_lock();
+	data = rcu_dereference(counter->data);
+	if (!data || !data->nr_pages)
+		goto out;
+
+	handle->counter	= counter;
+	handle->data	= data;
+
+	spin_lock_irqsave(&data->lock, handle->flags);
+
+	lost_size = data->lost ? sizeof(lost_event) : 0;
+	if (!perf_output_space(data, data->head, size + lost_size)) {
+		data->lost++;
+		spin_unlock_irqrestore(&data->lock, handle->flags);
+		goto out;
+	}
+
+	handle->head	= data->head;
+	handle->offset	= data->head;
+	data->head	+= size + lost_size;
+
+	if (lost_size) {
+		lost_event.header.type = PERF_EVENT_LOST;
+		lost_event.header.misc = 0;
+		lost_event.header.size = sizeof(lost_event);
+		lost_event.id          = counter->id;
+		lost_event.lost        = data->lost;
+
+		perf_output_put(handle, lost_event);
+		data->lost = 0;
+	}
+
+	return 0;
+
+out:
+	rcu_read_unlock();
+
+	return -ENOSPC;
+}
+
+static void perf_output_end(struct perf_output_handle *handle)
+{
+	struct perf_counter *counter = handle->counter;
+	struct perf_mmap_data *data = handle->data;
+	int wakeup_events = counter->attr.wakeup_events;
+	int wakeup;
+
+	/*
+	 * Make the records visible before the new head; user space pairs
+	 * this with an rmb() after reading data_head.
+	 */
+	smp_wmb();
+	data->user_page->data_head = data->head;
+
+	/*
+	 * Wake up the reader every wakeup_events records, or else each
+	 * time the head moves on to a new page.
+	 */
+	if (wakeup_events)
+		wakeup = ++data->events >= wakeup_events;
+	else
+		wakeup = (handle->head ^ data->head) & PAGE_MASK;
+	if (wakeup) {
+		data->events = 0;
+		perf_pending_queue(counter);
+	}
+
+	spin_unlock_irqrestore(&data->lock, handle->flags);
+	rcu_read_unlock();
+}
+
+static void perf_counter_output(struct perf_counter *counter,
+				struct pt_regs *regs, u64 addr)
+{
+	u64 sample_type = counter->attr.sample_type;
+	struct perf_output_handle handle;
+	struct perf_event_header header;
+	struct {
+		u32 pid, tid;
+	} tid_entry;
+	struct {
+		u32 cpu, reserved;
+	} cpu_entry;
+	u64 ip = 0, time = 0, id = 0, period = 0;
+
+	header.type = PERF_EVENT_SAMPLE;
+	header.size = sizeof(header);
+	header.misc = PERF_EVENT_MISC_KERNEL;
+	if (regs && user_mode(regs))
+		header.misc = PERF_EVENT_MISC_USER;
+
+	if (sample_type & PERF_SAMPLE_IP) {
+		if (regs)
+			ip = instruction_pointer(regs);
+		header.size += sizeof(ip);
+	}
+
+	if (sample_type & PERF_SAMPLE_TID) {
+		tid_entry.pid = task_tgid_nr(current);
+		tid_entry.tid = task_pid_nr(current);
+		header.size += sizeof(tid_entry);
+	}
+
+	if (sample_type & PERF_SAMPLE_TIME) {
+		time = perf_clock();
+		header.size += sizeof(time);
+	}
+
+	if (sample_type & PERF_SAMPLE_ADDR)
+		header.size += sizeof(addr);
+
+	if (sample_type & PERF_SAMPLE_ID) {
+		id = counter->parent ? counter->parent->id : counter->id;
+		header.size += sizeof(id);
+	}
+
+	if (sample_type & PERF_SAMPLE_CPU) {
+		cpu_entry.cpu = raw_smp_processor_id();
+		cpu_entry.reserved = 0;
+		header.size += sizeof(cpu_entry);
+	}
+
+	if (sample_type & PERF_SAMPLE_PERIOD) {
+		period = counter->hw.sample_period;
+		header.size += sizeof(period);
+	}
+
+	if (perf_output_begin(&handle, counter, header.size))
+		return;
+
+	perf_output_put(&handle, header);
+
+	if (sample_type & PERF_SAMPLE_IP)
+		perf_output_put(&handle, ip);
+
+	if (sample_type & PERF_SAMPLE_TID)
+		perf_output_put(&handle, tid_entry);
+
+	if (sample_type & PERF_SAMPLE_TIME)
+		perf_output_put(&handle, time);
+
+	if (sample_type & PERF_SAMPLE_ADDR)
+		perf_output_put(&handle, addr);
+
+	if (sample_type & PERF_SAMPLE_ID)
+		perf_output_put(&handle, id);
+
+	if (sample_type & PERF_SAMPLE_CPU)
+		perf_output_put(&handle, cpu_entry);
+
+	if (sample_type & PERF_SAMPLE_PERIOD)
+		perf_output_put(&handle, period);
+
+	perf_output_end(&handle);
+}
+
+/*
+ * Generic counter overflow handling: called by the pmus, with interrupts
+ * disabled, when a sampling counter's period has elapsed.
+ */
+void perf_counter_overflow(struct perf_counter *counter,
+			   struct pt_regs *regs, u64 addr)
+{
+	perf_counter_output(counter, regs, addr);
+}
+
+/*
+ * Generic software counter infrastructure
+ */
+
+static void perf_swcounter_add(struct perf_counter *counter, u64 nr,
+			       struct pt_regs *regs, u64 addr)
+{
+	struct hw_perf_counter *hwc = &counter->hw;
+
+	counter->count += nr;
+
+	if (!hwc->sample_period)
+		return;
+
+	hwc->period_left -= nr;
+	while (hwc->period_left <= 0) {
+		hwc->period_left += hwc->sample_period;
+		perf_counter_overflow(counter, regs, addr);
+	}
+}
+
+static int perf_swcounter_match(struct perf_counter *counter, u32 event,
+				struct pt_regs *regs)
+{
+	if (counter->state != PERF_COUNTER_STATE_ACTIVE)
+		return 0;
+
+	if (counter->attr.type != PERF_TYPE_SOFTWARE ||
+	    counter->attr.config != event)
+		return 0;
+
+	if (regs) {
+		if (counter->attr.exclude_user && user_mode(regs))
+			return 0;
+
+		if (counter->attr.exclude_kernel && !user_mode(regs))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void perf_swcounter_ctx_event(struct perf_counter_context *ctx,
+				     u32 event, u64 nr,
+				     struct pt_regs *regs, u64 addr)
+{
+	struct perf_counter *counter, *sub;
+
+	if (!ctx->nr_active)
+		return;
+
+	spin_lock(&ctx->lock);
+	list_for_each_entry(counter, &ctx->counter_list, list_entry) {
+		if (perf_swcounter_match(counter, event, regs))
+			perf_swcounter_add(counter, nr, regs, addr);
+		list_for_each_entry(sub, &counter->sibling_list, list_entry)
+			if (perf_swcounter_match(sub, event, regs))
+				perf_swcounter_add(sub, nr, regs, addr);
+	}
+	spin_unlock(&ctx->lock);
+}
+
+void __perf_swcounter_event(u32 event, u64 nr,
+			    struct pt_regs *regs, u64 addr)
+{
+	struct perf_cpu_context *cpuctx;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	cpuctx = &__get_cpu_var(perf_cpu_context);
+
+	perf_swcounter_ctx_event(&cpuctx->ctx, event, nr, regs, addr);
+	if (cpuctx->task_ctx)
+		perf_swcounter_ctx_event(cpuctx->task_ctx, event, nr,
+					 regs, addr);
+	local_irq_restore(flags);
+}
+
+static int perf_swcounter_enable(struct perf_counter *counter)
+{
+	return 0;
+}
+
+static void perf_swcounter_disable(struct perf_counter *counter)
+{
+}
+
+static void perf_swcounter_read(struct perf_counter *counter)
+{
+}
+
+static const struct pmu perf_ops_generic = {
+	.enable		= perf_swcounter_enable,
+	.disable	= perf_swcounter_disable,
+	.read		= perf_swcounter_read,
+};
+
+/*
+ * Software clock: counts the nanoseconds the counter is scheduled in,
+ * which is the CPU time for a CPU counter and the task time for a task
+ * counter, and samples from an hrtimer.
+ */
+
+static void perf_swcounter_clock_update(struct perf_counter *counter)
+{
+	u64 now = perf_clock();
+
+	counter->count += now - counter->hw.prev_count;
+	counter->hw.prev_count = now;
+}
+
+static enum hrtimer_restart perf_swcounter_hrtimer(struct hrtimer *hrtimer)
+{
+	struct perf_counter *counter;
+	u64 period;
+
+	counter = container_of(hrtimer, struct perf_counter, hw.hrtimer);
+	counter->pmu->read(counter);
+	perf_counter_overflow(counter, get_irq_regs(), 0);
+
+	period = max_t(u64, 10000, counter->hw.sample_period);
+	hrtimer_forward_now(hrtimer, ns_to_ktime(period));
+
+	return HRTIMER_RESTART;
+}
+
+static int perf_swcounter_clock_enable(struct perf_counter *counter)
+{
+	struct hw_perf_counter *hwc = &counter->hw;
+
+	hwc->prev_count = perf_clock();
+	if (hwc->sample_period) {
+		u64 period = max_t(u64, 10000, hwc->sample_period);
+
+		hrtimer_start(&hwc->hrtimer, ns_to_ktime(period),
+			      HRTIMER_MODE_REL);
+	}
+
+	return 0;
+}
+
+static void perf_swcounter_clock_disable(struct perf_counter *counter)
+{
+	if (counter->hw.sample_period)
+		hrtimer_cancel(&counter->hw.hrtimer);
+	perf_swcounter_clock_update(counter);
+}
+
+static const struct pmu perf_ops_clock = {
+	.enable		= perf_swcounter_clock_enable,
+	.disable	= perf_swcounter_clock_disable,
+	.read		= perf_swcounter_clock_update,
+};
+
+static void sw_perf_counter_destroy(struct perf_counter *counter)
+{
+	atomic_dec(&perf_swcounter_nr);
+}
+
+static const struct pmu *sw_perf_counter_init(struct perf_counter *counter)
+{
+	struct hw_perf_counter *hwc = &counter->hw;
+
+	switch (counter->attr.config) {
+	case PERF_COUNT_SW_CPU_CLOCK:
+	case PERF_COUNT_SW_TASK_CLOCK:
+		hrtimer_init(&hwc->hrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		hwc->hrtimer.function = perf_swcounter_hrtimer;
+		return &perf_ops_clock;
+
+	case PERF_COUNT_SW_PAGE_FAULTS:
+	case PERF_COUNT_SW_PAGE_FAULTS_MIN:
+	case PERF_COUNT_SW_PAGE_FAULTS_MAJ:
+	case PERF_COUNT_SW_CONTEXT_SWITCHES:
+	case PERF_COUNT_SW_CPU_MIGRATIONS:
+		atomic_inc(&perf_swcounter_nr);
+		counter->destroy = sw_perf_counter_destroy;
+		return &perf_ops_generic;
+	}
+
+	return NULL;
+}
+
+static int perf_counter_check_period(struct perf_counter_attr *attr,
+				     u64 period)
+{
+	if (attr->type != PERF_TYPE_HARDWARE && attr->type != PERF_TYPE_RAW)
+		return 0;
+
+	if (period && period < PERF_COUNTER_MIN_HW_PERIOD &&
+	    !capable(CAP_SYS_ADMIN))
+		return -EACCES;
+
+	return 0;
+}
+
+/*
+ * Allocate and initialize a counter structure
+ */
+static struct perf_counter *
+perf_counter_alloc(struct perf_counter_attr *attr,
+		   int cpu,
+		   struct perf_counter_context *ctx,
+		   struct perf_counter *group_leader,
+		   struct perf_counter *parent_counter,
+		   gfp_t gfpflags)
+{
+	const struct pmu *pmu;
+	struct perf_counter *counter;
+	struct hw_perf_counter *hwc;
+	long err;
+
+	/* inherited counters were checked when the parent was opened */
+	if (!parent_counter) {
+		err = perf_counter_check_period(attr, attr->sample_period);
+		if (err)
+			return ERR_PTR(err);
+	}
+
+	counter = kzalloc(sizeof(*counter), gfpflags);
+	if (!counter)
+		return ERR_PTR(-ENOMEM);
+
+	/*
+	 * Single counters are their own group leaders, with an
+	 * empty sibling list:
+	 */
+	if (!group_leader)
+		group_leader = counter;
+
+	mutex_init(&counter->child_mutex);
+	INIT_LIST_HEAD(&counter->child_list);
+	INIT_LIST_HEAD(&counter->child_entry);
+
+	INIT_LIST_HEAD(&counter->list_entry);
+	INIT_LIST_HEAD(&counter->sibling_list);
+	init_waitqueue_head(&counter->waitq);
+
+	mutex_init(&counter->mmap_mutex);
+
+	INIT_LIST_HEAD(&counter->pending_entry);
+	counter->pending_cpu	= -1;
+
+	counter->cpu		= cpu;
+	counter->attr		= *attr;
+	counter->group_leader	= group_leader;
+	counter->ctx		= ctx;
+	counter->oncpu		= -1;
+	counter->parent		= parent_counter;
+	counter->id		= atomic_inc_return(&perf_counter_id);
+
+	counter->state		= PERF_COUNTER_STATE_INACTIVE;
+	if (attr->disabled)
+		counter->state = PERF_COUNTER_STATE_OFF;
+
+	hwc = &counter->hw;
+	hwc->sample_period = attr->sample_period;
+	hwc->period_left = hwc->sample_period;
+
+	pmu = NULL;
+	switch (attr->type) {
+	case PERF_TYPE_RAW:
+	case PERF_TYPE_HARDWARE:
+		pmu = hw_perf_counter_init(counter);
+		break;
+
+	case PERF_TYPE_SOFTWARE:
+		pmu = sw_perf_counter_init(counter);
+		break;
+	}
+
+	err = 0;
+	if (!pmu)
+		err = -EINVAL;
+	else if (IS_ERR(pmu))
+		err = PTR_ERR(pmu);
+
+	if (err) {
+		kfree(counter);
+		return ERR_PTR(err);
+	}
+
+	counter->pmu = pmu;
+
+	return counter;
+}
+
+static void free_counter(struct perf_counter *counter)
+{
+	perf_pending_sync(counter);
+
+	if (counter->destroy)
+		counter->destroy(counter);
+
+	put_ctx(counter->ctx);
+	kfree(counter);
+}
+
+static void perf_counter_for_each_child(struct perf_counter *counter,
+					void (*func)(struct perf_counter *))
+{
+	struct perf_counter *child;
+
+	mutex_lock(&counter->child_mutex);
+	func(counter);
+	list_for_each_entry(child, &counter->child_list, child_entry)
+		func(child);
+	mutex_unlock(&counter->child_mutex);
+}
+
+/*
+ * Called when the last reference to the file is gone.
+ */
+static int perf_release(struct inode *inode, struct file *file)
+{
+	struct perf_counter *counter = file->private_data;
+	struct perf_counter_context *ctx = counter->ctx;
+
+	file->private_data = NULL;
+
+	mutex_lock(&ctx->mutex);
+	perf_counter_remove_from_context(counter);
+	mutex_unlock(&ctx->mutex);
+
+	free_counter(counter);
+
+	return 0;
+}
+
+/*
+ * Read the performance counter - simple non blocking version for now
+ */
+static ssize_t
+perf_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct perf_counter *counter = file->private_data;
+	u64 read_format = counter->attr.read_format;
+	u64 values[4], enabled, running;
+	int n;
+
+	/*
+	 * Return end-of-file for a read on a counter that is in
+	 * error state (i.e. because it was pinned but it couldn't be
+	 * scheduled on to the CPU at some point).
+	 */
+	if (counter->state == PERF_COUNTER_STATE_ERROR)
+		return 0;
+
+	mutex_lock(&counter->child_mutex);
+	values[0] = perf_counter_read(counter, &enabled, &running);
+	mutex_unlock(&counter->child_mutex);
+
+	n = 1;
+	if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED)
+		values[n++] = enabled;
+	if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING)
+		values[n++] = running;
+	if (read_format & PERF_FORMAT_ID)
+		values[n++] = counter->id;
+
+	if (count < n * sizeof(u64))
+		return -EINVAL;
+
+	if (copy_to_user(buf, values, n * sizeof(u64)))
+		return -EFAULT;
+
+	return n * sizeof(u64);
+}
+
+static unsigned int perf_poll(struct file *file, poll_table *wait)
+{
+	struct perf_counter *counter = file->private_data;
+
+	poll_wait(file, &counter->waitq, wait);
+
+	return atomic_xchg(&counter->poll, 0);
+}
+
+static int perf_counter_period(struct perf_counter *counter, u64 __user *arg)
+{
+	struct perf_counter_context *ctx = counter->ctx;
+	u64 value;
+	int ret;
+
+	if (!counter->attr.sample_period)
+		return -EINVAL;
+
+	if (copy_from_user(&value, arg, sizeof(value)))
+		return -EFAULT;
+
+	if (!value)
+		return -EINVAL;
+
+	ret = perf_counter_check_period(&counter->attr, value);
+	if (ret)
+		return ret;
+
+	spin_lock_irq(&ctx->lock);
+	counter->attr.sample_period = value;
+	counter->hw.sample_period = value;
+	spin_unlock_irq(&ctx->lock);
+
+	return 0;
+}
+
+static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct perf_counter *counter = file->private_data;
+
+	switch (cmd) {
+	case PERF_COUNTER_IOC_ENABLE:
+		perf_counter_for_each_child(counter, perf_counter_enable);
+		break;
+	case PERF_COUNTER_IOC_DISABLE:
+		perf_counter_for_each_child(counter, perf_counter_disable);
+		break;
+	case PERF_COUNTER_IOC_RESET:
+		perf_counter_for_each_child(counter, perf_counter_reset);
+		break;
+	case PERF_COUNTER_IOC_PERIOD:
+		return perf_counter_period(counter, (u64 __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+
+	return 0;
+}
+
+static int perf_mmap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct perf_counter *counter = vma->vm_file->private_data;
+	struct perf_mmap_data *data;
+	int ret = VM_FAULT_SIGBUS;
+
+	rcu_read_lock();
+	data = rcu_dereference(counter->data);
+	if (!data)
+		goto unlock;
+
+	if (vmf->pgoff == 0) {
+		vmf->page = virt_to_page(data->user_page);
+	} else {
+		unsigned long nr = vmf->pgoff - 1;
+
+		if (nr >= data->nr_pages)
+			goto unlock;
+
+		vmf->page = virt_to_page(data->data_pages[nr]);
+	}
+	get_page(vmf->page);
+	ret = 0;
+unlock:
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static int perf_mmap_data_alloc(struct perf_counter *counter, int nr_pages)
+{
+	struct perf_mmap_data *data;
+	unsigned long size;
+	int i;
+
+	size = sizeof(struct perf_mmap_data);
+	size += nr_pages * sizeof(void *);
+
+	data = kzalloc(size, GFP_KERNEL);
+	if (!data)
+		goto fail;
+
+	data->user_page = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!data->user_page)
+		goto fail_user_page;
+
+	for (i = 0; i < nr_pages; i++) {
+		data->data_pages[i] = (void *)get_zeroed_page(GFP_KERNEL);
+		if (!data->data_pages[i])
+			goto fail_data_pages;
+	}
+
+	data->nr_pages = nr_pages;
+	spin_lock_init(&data->lock);
+	data->user_page->version = 1;
+	data->user_page->compat_version = 1;
+
+	rcu_assign_pointer(counter->data, data);
+
+	return 0;
+
+fail_data_pages:
+	for (i--; i >= 0; i--)
+		free_page((unsigned long)data->data_pages[i]);
+
+	free_page((unsigned long)data->user_page);
+
+fail_user_page:
+	kfree(data);
+
+fail:
+	return -ENOMEM;
+}
+
+static void __perf_mmap_data_free(struct rcu_head *rcu_head)
+{
+	struct perf_mmap_data *data;
+	int i;
+
+	data = container_of(rcu_head, struct perf_mmap_data, rcu_head);
+
+	free_page((unsigned long)data->user_page);
+	for (i = 0; i < data->nr_pages; i++)
+		free_page((unsigned long)data->data_pages[i]);
+	kfree(data);
+}
+
+static void perf_mmap_data_free(struct perf_counter *counter)
+{
+	struct perf_mmap_data *data = counter->data;
+
+	WARN_ON(atomic_read(&counter->mmap_count));
+
+	rcu_assign_pointer(counter->data, NULL);
+	call_rcu(&data->rcu_head, __perf_mmap_data_free);
+}
+
+static void perf_mmap_open(struct vm_area_struct *vma)
+{
+	struct perf_counter *counter = vma->vm_file->private_data;
+
+	atomic_inc(&counter->mmap_count);
+}
+
+static void perf_mmap_close(struct vm_area_struct *vma)
+{
+	struct perf_counter *counter = vma->vm_file->private_data;
+	struct perf_mmap_data *data;
+
+	mutex_lock(&counter->mmap_mutex);
+	if (atomic_dec_and_test(&counter->mmap_count)) {
+		data = counter->data;
+		atomic_long_sub(data->nr_pages + 1, &data->user->locked_vm);
+		vma->vm_mm->locked_vm -= data->nr_locked;
+		free_uid(data->user);
+		perf_mmap_data_free(counter);
+	}
+	mutex_unlock(&counter->mmap_mutex);
+}
+
+static struct vm_operations_struct perf_mmap_vmops = {
+	.open		= perf_mmap_open,
+	.close		= perf_mmap_close,
+	.fault		= perf_mmap_fault,
+};
+
+/*
+ * The buffer is one control page followed by 2^n data pages.  Its pages
+ * are pinned and charged to the user; what goes beyond the user's
+ * perf_counter_mlock_kb allowance is charged to the mm against
+ * RLIMIT_MEMLOCK, unless the user has CAP_IPC_LOCK.
+ */
+static int perf_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct perf_counter *counter = file->private_data;
+	struct user_struct *user = current_user();
+	unsigned long vma_size;
+	unsigned long nr_pages;
+	unsigned long user_extra, user_locked, user_lock_limit;
+	unsigned long locked, lock_limit, extra;
+	int ret = 0;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	vma_size = vma->vm_end - vma->vm_start;
+	nr_pages = (vma_size / PAGE_SIZE) - 1;
+
+	/*
+	 * If we have data pages ensure they're a power-of-two number, so we
+	 * can do bitmasks instead of modulo.
+	 */
+	if (nr_pages != 0 && !is_power_of_2(nr_pages))
+		return -EINVAL;
+
+	if (vma_size != PAGE_SIZE * (1 + nr_pages))
+		return -EINVAL;
+
+	if (vma->vm_pgoff != 0)
+		return -EINVAL;
+
+	mutex_lock(&counter->mmap_mutex);
+	if (counter->data) {
+		if (counter->data->nr_pages == nr_pages)
+			atomic_inc(&counter->mmap_count);
+		else
+			ret = -EINVAL;
+		goto unlock;
+	}
+
+	user_extra = nr_pages + 1;
+	user_lock_limit = sysctl_perf_counter_mlock >> (PAGE_SHIFT - 10);
+	user_lock_limit *= num_online_cpus();
+
+	user_locked = atomic_long_read(&user->locked_vm) + user_extra;
+
+	extra = 0;
+	if (user_locked > user_lock_limit)
+		extra = user_locked - user_lock_limit;
+
+	lock_limit = current->signal->rlim[RLIMIT_MEMLOCK].rlim_cur;
+	lock_limit >>= PAGE_SHIFT;
+	locked = vma->vm_mm->locked_vm + extra;
+
+	if (locked > lock_limit && !capable(CAP_IPC_LOCK)) {
+		ret = -EPERM;
+		goto unlock;
+	}
+
+	ret = perf_mmap_data_alloc(counter, nr_pages);
+	if (ret)
+		goto unlock;
+
+	atomic_long_add(user_extra, &user->locked_vm);
+	vma->vm_mm->locked_vm += extra;
+	counter->data->nr_locked = extra;
+	counter->data->user = get_uid(user);
+
+	atomic_set(&counter->mmap_count, 1);
+	if (vma->vm_flags & VM_WRITE)
+		counter->data->writable = 1;
+
+unlock:
+	mutex_unlock(&counter->mmap_mutex);
+
+	if (ret)
+		return ret;
+
+	/* the charge stays with this mm */
+	vma->vm_flags |= VM_RESERVED | VM_DONTCOPY | VM_DONTEXPAND;
+	vma->vm_ops = &perf_mmap_vmops;
+
+	return 0;
+}
+
+static int perf_fasync(int fd, struct file *filp, int on)
+{
+	struct perf_counter *counter = filp->private_data;
+
+	return fasync_helper(fd, filp, on, &counter->fasync);
+}
+
+static const struct file_operations perf_fops = {
+	.release		= perf_release,
+	.read			= perf_read,
+	.poll			= perf_poll,
+	.unlocked_ioctl		= perf_ioctl,
+	.compat_ioctl		= perf_ioctl,
+	.mmap			= perf_mmap,
+	.fasync			= perf_fasync,
+};
+
+static void
+__perf_counter_init_context(struct perf_counter_context *ctx,
+			    struct task_struct *task)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	spin_lock_init(&ctx->lock);
+	mutex_init(&ctx->mutex);
+	INIT_LIST_HEAD(&ctx->counter_list);
+	atomic_set(&ctx->refcount, 1);
+	ctx->task = task;
+}
+
+/*
+ * Return a referenced context for the given task or cpu, allocating
+ * the task's context on first use.
+ */
+static struct perf_counter_context *find_get_context(pid_t pid, int cpu)
+{
+	struct perf_counter_context *ctx, *new;
+	struct task_struct *task;
+	int err;
+
+	/*
+	 * If cpu is not a wildcard then this is a percpu counter:
+	 */
+	if (pid == -1 && cpu != -1) {
+		/* Must be root to operate on a CPU counter: */
+		if (!capable(CAP_SYS_ADMIN))
+			return ERR_PTR(-EACCES);
+
+		if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+			return ERR_PTR(-EINVAL);
+
+		ctx = &per_cpu(perf_cpu_context, cpu).ctx;
+		get_ctx(ctx);
+
+		return ctx;
+	}
+
+	rcu_read_lock();
+	if (!pid)
+		task = current;
+	else
+		task = find_task_by_vpid(pid);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+
+	if (!task)
+		return ERR_PTR(-ESRCH);
+
+	/* Reuse ptrace permission checks for now. */
+	err = -EACCES;
+	if (!ptrace_may_access(task, PTRACE_MODE_READ))
+		goto errout;
+
+	err = -ESRCH;
+	task_lock(task);
+	if (task->flags & PF_EXITING) {
+		task_unlock(task);
+		goto errout;
+	}
+	ctx = task->perf_counter_ctxp;
+	if (ctx)
+		get_ctx(ctx);
+	task_unlock(task);
+
+	if (!ctx) {
+		err = -ENOMEM;
+		new = kmalloc(sizeof(*new), GFP_KERNEL);
+		if (!new)
+			goto errout;
+		get_task_struct(task);
+		__perf_counter_init_context(new, task);
+
+		/*
+		 * The task's reference is the one __perf_counter_init_context()
+		 * set up, the caller gets another one.
+		 */
+		err = -ESRCH;
+		task_lock(task);
+		if (task->flags & PF_EXITING) {
+			task_unlock(task);
+			put_ctx(new);
+			goto errout;
+		}
+		ctx = task->perf_counter_ctxp;
+		if (!ctx) {
+			ctx = new;
+			task->perf_counter_ctxp = ctx;
+		}
+		get_ctx(ctx);
+		task_unlock(task);
+
+		if (ctx != new)
+			put_ctx(new);
+	}
+
+	put_task_struct(task);
+	return ctx;
+
+errout:
+	put_task_struct(task);
+	return ERR_PTR(err);
+}
+
+static int perf_copy_attr(struct perf_counter_attr __user *uattr,
+			  struct perf_counter_attr *attr)
+{
+	u32 size;
+
+	if (get_user(size, &uattr->size))
+		return -EFAULT;
+
+	if (!size)
+		size = PERF_ATTR_SIZE_VER0;
+
+	if (size != sizeof(*attr))
+		return -E2BIG;
+
+	if (copy_from_user(attr, uattr, sizeof(*attr)))
+		return -EFAULT;
+
+	attr->size = size;
+
+	if (attr->__reserved_1 || attr->__reserved_2 || attr->__reserved_3)
+		return -EINVAL;
+
+	if (attr->sample_type & ~PERF_SAMPLE_MASK)
+		return -EINVAL;
+
+	if (attr->read_format & ~PERF_FORMAT_MASK)
+		return -EINVAL;
+
+	/* Exclusive groups are not supported (yet). */
+	if (attr->exclusive)
+		return -EOPNOTSUPP;
+
+	return 0;
+}
+
+/**
+ * sys_perf_counter_open - open a performance counter, associate it to a task/cpu
+ *
+ * @attr_uptr:	event type attributes for monitoring/sampling
+ * @pid:		target pid
+ * @cpu:		target cpu
+ * @group_fd:		group leader counter fd
+ */
+SYSCALL_DEFINE5(perf_counter_open,
+		struct perf_counter_attr __user *, attr_uptr,
+		pid_t, pid, int, cpu, int, group_fd, unsigned long, flags)
+{
+	struct perf_counter *counter, *group_leader;
+	struct perf_counter_attr attr;
+	struct perf_counter_context *ctx;
+	struct file *counter_file = NULL;
+	struct file *group_file = NULL;
+	int fput_needed = 0;
+	int ret, fd;
+
+	/* for future expandability... */
+	if (flags)
+		return -EINVAL;
+
+	ret = perf_copy_attr(attr_uptr, &attr);
+	if (ret)
+		return ret;
+
+	/*
+	 * Get the target context (task or percpu):
+	 */
+	ctx = find_get_context(pid, cpu);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	/*
+	 * Look up the group leader (we will attach this counter to it):
+	 */
+	group_leader = NULL;
+	if (group_fd != -1) {
+		ret = -EINVAL;
+		group_file = fget_light(group_fd, &fput_needed);
+		if (!group_file)
+			goto err_put_context;
+		if (group_file->f_op != &perf_fops)
+			goto err_put_context;
+
+		group_leader = group_file->private_data;
+		/*
+		 * Do not allow a recursive hierarchy (this new sibling
+		 * becoming part of another group-sibling):
+		 */
+		if (group_leader->group_leader != group_leader)
+			goto err_put_context;
+		/*
+		 * Do not allow to attach to a group in a different
+		 * task or CPU context:
+		 */
+		if (group_leader->ctx != ctx)
+			goto err_put_context;
+		/*
+		 * Only a group leader can be pinned
+		 */
+		if (attr.pinned)
+			goto err_put_context;
+	}
+
+	counter = perf_counter_alloc(&attr, cpu, ctx, group_leader,
+				     NULL, GFP_KERNEL);
+	ret = PTR_ERR(counter);
+	if (IS_ERR(counter))
+		goto err_put_context;
+
+	ret = get_unused_fd_flags(O_RDWR);
+	if (ret < 0)
+		goto err_free_put_context;
+	fd = ret;
+
+	counter_file = anon_inode_getfile("[perf_counter]", &perf_fops,
+					  counter, 0);
+	if (IS_ERR(counter_file)) {
+		ret = PTR_ERR(counter_file);
+		put_unused_fd(fd);
+		goto err_free_put_context;
+	}
+
+	counter->filp = counter_file;
+	mutex_lock(&ctx->mutex);
+	perf_install_in_context(ctx, counter, cpu);
+	mutex_unlock(&ctx->mutex);
+
+	/*
+	 * Only now that the counter is installed may user space get at
+	 * it, and close it.
+	 */
+	fd_install(fd, counter_file);
+	ret = fd;
+
+out_fput:
+	fput_light(group_file, fput_needed);
+
+	return ret;
+
+err_free_put_context:
+	if (counter->destroy)
+		counter->destroy(counter);
+	kfree(counter);
+
+err_put_context:
+	put_ctx(ctx);
+
+	goto out_fput;
+}
+
+/*
+ * inherit a counter from parent task to child task:
+ */
+static struct perf_counter *
+inherit_counter(struct perf_counter *parent_counter,
+		struct task_struct *child,
+		struct perf_counter *group_leader,
+		struct perf_counter_context *child_ctx)
+{
+	struct perf_counter *child_counter;
+
+	/*
+	 * Instead of creating recursive hierarchies of counters,
+	 * we link inherited counters back to the original parent,
+	 * which has a filp for sure, which we use as the reference
+	 * count:
+	 */
+	if (parent_counter->parent)
+		parent_counter = parent_counter->parent;
+
+	child_counter = perf_counter_alloc(&parent_counter->attr,
+					   parent_counter->cpu, child_ctx,
+					   group_leader, parent_counter,
+					   GFP_KERNEL);
+	if (IS_ERR(child_counter))
+		return child_counter;
+	get_ctx(child_ctx);
+
+	/*
+	 * Make the child state follow the state of the parent counter,
+	 * not its attr.disabled bit.
+	 */
+	if (parent_counter->state >= PERF_COUNTER_STATE_INACTIVE)
+		child_counter->state = PERF_COUNTER_STATE_INACTIVE;
+	else
+		child_counter->state = PERF_COUNTER_STATE_OFF;
+
+	/*
+	 * Link it up in the child's context; the child is not running
+	 * yet, so no locking is needed:
+	 */
+	add_counter_to_ctx(child_counter, child_ctx);
+
+	/*
+	 * Get a reference to the parent filp - we will fput it
+	 * when the child counter exits. This is safe to do because
+	 * we are in the parent and we know that the filp still
+	 * exists and has a nonzero count:
+	 */
+	atomic_long_inc(&parent_counter->filp->f_count);
+
+	/*
+	 * Link this into the parent counter's child list
+	 */
+	mutex_lock(&parent_counter->child_mutex);
+	list_add_tail(&child_counter->child_entry, &parent_counter->child_list);
+	mutex_unlock(&parent_counter->child_mutex);
+
+	return child_counter;
+}
+
+static int inherit_group(struct perf_counter *parent_counter,
+			 struct task_struct *child,
+			 struct perf_counter_context *child_ctx)
+{
+	struct perf_counter *leader;
+	struct perf_counter *sub;
+	struct perf_counter *child_ctr;
+
+	leader = inherit_counter(parent_counter, child, NULL, child_ctx);
+	if (IS_ERR(leader))
+		return PTR_ERR(leader);
+	list_for_each_entry(sub, &parent_counter->sibling_list, list_entry) {
+		child_ctr = inherit_counter(sub, child, leader, child_ctx);
+		if (IS_ERR(child_ctr))
+			return PTR_ERR(child_ctr);
+	}
+	return 0;
+}
+
+/*
+ * Fold the count and times of an exiting child counter into the
+ * counter it was inherited from, and drop the child's reference on it.
+ */
+static void sync_child_counter(struct perf_counter *child_counter,
+			       struct perf_counter *parent_counter)
+{
+	mutex_lock(&parent_counter->child_mutex);
+	parent_counter->child_count += child_counter->count;
+	parent_counter->child_total_time_enabled +=
+		child_counter->total_time_enabled;
+	parent_counter->child_total_time_running +=
+		child_counter->total_time_running;
+	list_del_init(&child_counter->child_entry);
+	mutex_unlock(&parent_counter->child_mutex);
+
+	/*
+	 * Release the parent counter, if this was the last
+	 * reference to it.
+	 */
+	fput(parent_counter->filp);
+}
+
+/*
+ * Take all counters off a context that is no longer attached to its
+ * task.  Counters opened by user space stay around, detached, until
+ * their fd is closed; inherited ones are folded back into their parent
+ * and freed.  The fput() in sync_child_counter() may release the parent
+ * and take its context's mutex, so that happens after ctx->mutex is
+ * dropped.
+ */
+static void perf_counter_release_ctx(struct perf_counter_context *ctx)
+{
+	struct perf_counter *counter, *tmp;
+	LIST_HEAD(exited);
+
+	mutex_lock(&ctx->mutex);
+	while (!list_empty(&ctx->counter_list)) {
+		counter = list_first_entry(&ctx->counter_list,
+					   struct perf_counter, list_entry);
+
+		spin_lock_irq(&ctx->lock);
+		update_counter_times(counter);
+		list_del_counter(counter, ctx);
+		spin_unlock_irq(&ctx->lock);
+
+		if (counter->parent)
+			list_add_tail(&counter->list_entry, &exited);
+	}
+	mutex_unlock(&ctx->mutex);
+
+	list_for_each_entry_safe(counter, tmp, &exited, list_entry) {
+		list_del(&counter->list_entry);
+		sync_child_counter(counter, counter->parent);
+		free_counter(counter);
+	}
+
+	put_ctx(ctx);
+}
+
+/*
+ * When a child task exits, feed back counter values to parent counters.
+ */
+void perf_counter_exit_task(struct task_struct *child)
+{
+	struct perf_cpu_context *cpuctx;
+	struct perf_counter_context *ctx;
+	unsigned long flags;
+
+	ctx = child->perf_counter_ctxp;
+	if (likely(!ctx))
+		return;
+
+	local_irq_save(flags);
+	cpuctx = &__get_cpu_var(perf_cpu_context);
+	if (cpuctx->task_ctx == ctx) {
+		__perf_counter_sched_out(ctx, cpuctx);
+		cpuctx->task_ctx = NULL;
+	}
+
+	/*
+	 * No new counters can be attached from now on: find_get_context()
+	 * checks PF_EXITING under the same lock.
+	 */
+	task_lock(child);
+	child->perf_counter_ctxp = NULL;
+	task_unlock(child);
+	local_irq_restore(flags);
+
+	perf_counter_release_ctx(ctx);
+}
+
+/*
+ * Free the counters of a task that failed to fork.
+ */
+void perf_counter_free_task(struct task_struct *task)
+{
+	struct perf_counter_context *ctx = task->perf_counter_ctxp;
+
+	if (!ctx)
+		return;
+
+	task->perf_counter_ctxp = NULL;
+	perf_counter_release_ctx(ctx);
+}
+
+/*
+ * Initialize the perf_counter context in task_struct
+ */
+int perf_counter_init_task(struct task_struct *child)
+{
+	struct perf_counter_context *child_ctx = NULL, *parent_ctx;
+	struct perf_counter *counter;
+	struct task_struct *parent = current;
+	int ret = 0;
+
+	child->perf_counter_ctxp = NULL;
+	child->perf_counter_cpu = -1;
+
+	parent_ctx = parent->perf_counter_ctxp;
+	if (likely(!parent_ctx || !parent_ctx->nr_counters))
+		return 0;
+
+	/*
+	 * Lock the parent list. No need to lock the child - not PID
+	 * hashed yet and not running, so nobody can access it.
+	 */
+	mutex_lock(&parent_ctx->mutex);
+
+	list_for_each_entry(counter, &parent_ctx->counter_list, list_entry) {
+		if (!counter->attr.inherit)
+			continue;
+
+		if (!child_ctx) {
+			child_ctx = kmalloc(sizeof(*child_ctx), GFP_KERNEL);
+			if (!child_ctx) {
+				ret = -ENOMEM;
+				break;
+			}
+			get_task_struct(child);
+			__perf_counter_init_context(child_ctx, child);
+			child->perf_counter_ctxp = child_ctx;
+		}
+
+		ret = inherit_group(counter, child, child_ctx);
+		if (ret)
+			break;
+	}
+
+	mutex_unlock(&parent_ctx->mutex);
+
+	return ret;
+}
+
+static int __init perf_counter_init(void)
+{
+	struct perf_pending *pending;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		__perf_counter_init_context(&per_cpu(perf_cpu_context, cpu).ctx,
+					    NULL);
+
+		pending = &per_cpu(perf_pending, cpu);
+		spin_lock_init(&pending->lock);
+		INIT_LIST_HEAD(&pending->list);
+	}
+
+	return 0;
+}
+early_initcall(perf_counter_init);
@@ -17,6 +17,7 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/slab.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
@@ -26,6 +27,7 @@
 enum {
 	DEBUG_USER_STATE = 1U << 0,
 	DEBUG_SUSPEND = 1U << 2,
+	DEBUG_HANDLER_TIME = 1U << 3,
 };
 static int debug_mask = DEBUG_USER_STATE;
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
@@ -44,11 +46,161 @@ enum {
 };
 static int state;
 
+/* Handlers with a non-zero group are run from a single threaded workqueue
+ * owned by that group. All fields except link, id and wq are protected by
+ * early_suspend_lock.
+ */
+struct early_suspend_group {
+	struct list_head link;
+	int id;
+	struct workqueue_struct *wq;
+	struct work_struct work;
+	struct early_suspend *first;
+	int resume;
+	int queued;
+	char name[16];
+};
+static LIST_HEAD(early_suspend_groups);
+
+static struct early_suspend_group *early_suspend_find_group(int id)
+{
+	struct early_suspend_group *g;
+
+	list_for_each_entry(g, &early_suspend_groups, link)
+		if (g->id == id)
+			return g;
+	return NULL;
+}
+
+static void early_suspend_call(struct early_suspend *handler, int resume)
+{
+	void (*func)(struct early_suspend *h);
+	ktime_t start;
+
+	func = resume ? handler->resume : handler->suspend;
+	if (func == NULL)
+		return;
+	start = ktime_get();
+	func(handler);
+	if (debug_mask & DEBUG_HANDLER_TIME)
+		pr_info("%s: %pF, group %d, took %lld us\n",
+			resume ? "late_resume" : "early_suspend", func,
+			handler->group,
+			ktime_us_delta(ktime_get(), start));
+}
+
+/* Suspend handlers are called in list order, resume handlers in reverse */
+static struct early_suspend *early_suspend_next(struct early_suspend *pos,
+						int resume)
+{
+	return list_entry(resume ? pos->link.prev : pos->link.next,
+			  struct early_suspend, link);
+}
+
+/* Call the handlers of one group, starting at g->first and walking in call
+ * order, until the next group 0 handler or the end of the list.
+ */
+static void early_suspend_group_work(struct work_struct *work)
+{
+	struct early_suspend_group *g =
+		container_of(work, struct early_suspend_group, work);
+	struct early_suspend *pos;
+
+	for (pos = g->first; &pos->link != &early_suspend_handlers;
+	     pos = early_suspend_next(pos, g->resume)) {
+		if (!pos->group)
+			break;
+		if (pos->group == g->id)
+			early_suspend_call(pos, g->resume);
+	}
+}
+
+static void early_suspend_flush_groups(void)
+{
+	struct early_suspend_group *g;
+
+	list_for_each_entry(g, &early_suspend_groups, link) {
+		if (g->queued) {
+			flush_workqueue(g->wq);
+			g->queued = 0;
+		}
+	}
+}
+
+static void early_suspend_queue_group(struct early_suspend *handler,
+				      int resume)
+{
+	struct early_suspend_group *g = early_suspend_find_group(handler->group);
+
+	if (g->queued)
+		return;
+	g->first = handler;
+	g->resume = resume;
+	g->queued = 1;
+	queue_work(g->wq, &g->work);
+}
+
+static void early_suspend_call_handlers(int resume)
+{
+	struct early_suspend *pos;
+	int queued = 0;
+	ktime_t start = ktime_get();
+
+	pos = list_entry(&early_suspend_handlers, struct early_suspend, link);
+	pos = early_suspend_next(pos, resume);
+	for (; &pos->link != &early_suspend_handlers;
+	     pos = early_suspend_next(pos, resume)) {
+		if (pos->group) {
+			early_suspend_queue_group(pos, resume);
+			queued = 1;
+		} else {
+			if (queued) {
+				early_suspend_flush_groups();
+				queued = 0;
+			}
+			early_suspend_call(pos, resume);
+		}
+	}
+	if (queued)
+		early_suspend_flush_groups();
+
+	if (debug_mask & DEBUG_HANDLER_TIME)
+		pr_info("%s: handlers took %lld us\n",
+			resume ? "late_resume" : "early_suspend",
+			ktime_us_delta(ktime_get(), start));
+}
+
+static struct early_suspend_group *early_suspend_add_group(int id)
+{
+	struct early_suspend_group *g;
+
+	g = kzalloc(sizeof(*g), GFP_KERNEL);
+	if (g == NULL)
+		return NULL;
+	g->id = id;
+	snprintf(g->name, sizeof(g->name), "esuspend/%d", id);
+	g->wq = create_singlethread_workqueue(g->name);
+	if (g->wq == NULL) {
+		kfree(g);
+		return NULL;
+	}
+	INIT_WORK(&g->work, early_suspend_group_work);
+	list_add_tail(&g->link, &early_suspend_groups);
+	return g;
+}
+
 void register_early_suspend(struct early_suspend *handler)
 {
 	struct list_head *pos;
 
 	mutex_lock(&early_suspend_lock);
+	if (handler->group && !early_suspend_find_group(handler->group) &&
+	    !early_suspend_add_group(handler->group)) {
+		pr_err("register_early_suspend: failed to create group %d, "
+		       "%pF will run serially\n", handler->group,
+		       handler->suspend);
+		handler->group = 0;
+	}
 	list_for_each(pos, &early_suspend_handlers) {
 		struct early_suspend *e;
 		e = list_entry(pos, struct early_suspend, link);
@@ -72,7 +224,6 @@ EXPORT_SYMBOL(unregister_early_suspend);
 
 static void early_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -93,10 +244,7 @@ static void early_suspend(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL)
-			pos->suspend(pos);
-	}
+	early_suspend_call_handlers(0);
 	mutex_unlock(&early_suspend_lock);
 
 	if (debug_mask & DEBUG_SUSPEND)
@@ -112,7 +260,6 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
 
@@ -131,9 +278,7 @@ static void late_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
-		if (pos->resume != NULL)
-			pos->resume(pos);
+	early_suspend_call_handlers(1);
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: done\n");
 abort:
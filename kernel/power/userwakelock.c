@@ -15,6 +15,7 @@
 
 #include <linux/ctype.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 #include <linux/wakelock.h>
 
 #include "power.h"
@@ -163,6 +164,7 @@ ssize_t wake_lock_store(
 	if (debug_mask & DEBUG_ACCESS)
 		pr_info("wake_lock_store: %s, timeout %ld\n", l->name, timeout);
 
+	wake_lock_set_uid(&l->wake_lock, current_uid());
 	if (timeout)
 		wake_lock_timeout(&l->wake_lock, timeout);
 	else
@@ -21,6 +21,8 @@
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
+#include <linux/mutex.h>
+#include <trace/wakelock.h>
 #endif
 #include "power.h"
 
@@ -56,6 +58,84 @@ static struct wake_lock deleted_wake_locks;
 static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+DEFINE_TRACE(wake_lock_acquire);
+DEFINE_TRACE(wake_lock_release);
+
+/*
+ * Per-uid rollup of completed wake lock holds.  Entries are never freed,
+ * so a lock may keep a pointer to its entry and update it without taking
+ * list_lock; each entry has its own spinlock instead.
+ */
+struct wake_lock_uid_stat {
+	struct list_head link;
+	spinlock_t lock;
+	uid_t uid;
+	int count;
+	int expire_count;
+	ktime_t total_time;
+	ktime_t max_time;
+};
+static LIST_HEAD(uid_stats);
+static DEFINE_MUTEX(uid_stats_mutex);
+
+void wake_lock_set_uid(struct wake_lock *lock, uid_t uid)
+{
+	struct wake_lock_uid_stat *us = lock->stat.uid_stat;
+
+	if (us && us->uid == uid)
+		return;
+
+	mutex_lock(&uid_stats_mutex);
+	list_for_each_entry(us, &uid_stats, link)
+		if (us->uid == uid)
+			goto found;
+	us = kzalloc(sizeof(*us), GFP_KERNEL);
+	if (!us) {
+		pr_err("wake_lock_set_uid: failed to allocate uid stat\n");
+		goto out;
+	}
+	spin_lock_init(&us->lock);
+	us->uid = uid;
+	list_add_tail(&us->link, &uid_stats);
+found:
+	/* publish an initialized entry to lockless readers */
+	smp_wmb();
+	lock->stat.uid_stat = us;
+out:
+	mutex_unlock(&uid_stats_mutex);
+}
+EXPORT_SYMBOL(wake_lock_set_uid);
+
+static uid_t wake_lock_uid(struct wake_lock *lock)
+{
+	struct wake_lock_uid_stat *us = lock->stat.uid_stat;
+
+	return us ? us->uid : (uid_t)-1;
+}
+
+/* Account a completed hold; must not be called with list_lock held
+ * except from the expire path.
+ */
+static void wake_lock_stat_release(struct wake_lock *lock, ktime_t held,
+				   int expired)
+{
+	struct wake_lock_uid_stat *us = lock->stat.uid_stat;
+	unsigned long irqflags;
+
+	trace_wake_lock_release(lock, ktime_to_ns(held), expired,
+				wake_lock_uid(lock));
+	if (!us)
+		return;
+	spin_lock_irqsave(&us->lock, irqflags);
+	us->count++;
+	if (expired)
+		us->expire_count++;
+	us->total_time = ktime_add(us->total_time, held);
+	if (held.tv64 > us->max_time.tv64)
+		us->max_time = held;
+	spin_unlock_irqrestore(&us->lock, irqflags);
+}
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -156,39 +236,76 @@ static int wakelocks_read_proc(char *page, char **start, off_t off,
 	return len;
 }
 
-static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
+static int wakelocks_uid_read_proc(char *page, char **start, off_t off,
+				   int count, int *eof, void *data)
+{
+	unsigned long irqflags;
+	struct wake_lock_uid_stat *us, snap;
+	int len = 0;
+	int n;
+
+	mutex_lock(&uid_stats_mutex);
+
+	len += snprintf(page + len, count - len,
+			"uid\tcount\texpire_count\ttotal_time\tmax_time\n");
+	list_for_each_entry(us, &uid_stats, link) {
+		spin_lock_irqsave(&us->lock, irqflags);
+		snap = *us;
+		spin_unlock_irqrestore(&us->lock, irqflags);
+		n = snprintf(page + len, count - len, "%u\t%d\t%d\t%lld\t%lld\n",
+			     snap.uid, snap.count, snap.expire_count,
+			     ktime_to_ns(snap.total_time),
+			     ktime_to_ns(snap.max_time));
+		len += n > count - len ? count - len : n;
+	}
+	mutex_unlock(&uid_stats_mutex);
+
+	*eof = 1;
+
+	return len;
+}
+
+/*
+ * Ends the stats of an active hold.  @now is sampled by the caller before
+ * list_lock is taken; it is overridden by the expiry time if the lock has
+ * timed out.  Returns the hold time, or a negative value if the lock was
+ * not active, and sets *expired if the hold ended by timeout.
+ */
+static ktime_t wake_unlock_stat_locked(struct wake_lock *lock, int *expired,
+				       ktime_t now)
 {
 	ktime_t duration;
-	ktime_t now;
+	ktime_t end;
+	ktime_t held;
 	if (!(lock->flags & WAKE_LOCK_ACTIVE))
-		return;
-	if (get_expired_time(lock, &now))
-		expired = 1;
+		return ktime_set(-1, 0);
+	if (get_expired_time(lock, &end))
+		*expired = 1;
 	else
-		now = ktime_get();
+		end = now;
 	lock->stat.count++;
-	if (expired)
+	if (*expired)
 		lock->stat.expire_count++;
-	duration = ktime_sub(now, lock->stat.last_time);
-	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
-	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
-		lock->stat.max_time = duration;
-	lock->stat.last_time = ktime_get();
+	held = ktime_sub(end, lock->stat.last_time);
+	lock->stat.total_time = ktime_add(lock->stat.total_time, held);
+	if (ktime_to_ns(held) > ktime_to_ns(lock->stat.max_time))
+		lock->stat.max_time = held;
+	lock->stat.last_time = now;
 	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
+		duration = ktime_sub(end, last_sleep_time_update);
 		lock->stat.prevent_suspend_time = ktime_add(
 			lock->stat.prevent_suspend_time, duration);
 		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
 	}
+	return held;
 }
 
-static void update_sleep_wait_stats_locked(int done)
+static void update_sleep_wait_stats_locked(int done, ktime_t now)
 {
 	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
+	ktime_t etime, elapsed, add;
 	int expired;
 
-	now = ktime_get();
 	elapsed = ktime_sub(now, last_sleep_time_update);
 	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
 		expired = get_expired_time(lock, &etime);
@@ -213,7 +330,10 @@ static void update_sleep_wait_stats_locked(int done)
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 1);
+	int expired = 1;
+	ktime_t held = wake_unlock_stat_locked(lock, &expired, ktime_get());
+	if (held.tv64 >= 0)
+		wake_lock_stat_release(lock, held, 1);
 #endif
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
@@ -360,6 +480,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
+	lock->stat.uid_stat = NULL;
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
@@ -403,6 +524,11 @@ static void wake_lock_internal(
 	int type;
 	unsigned long irqflags;
 	long expire_in;
+#ifdef CONFIG_WAKELOCK_STAT
+	ktime_t now = ktime_get();
+	ktime_t held = ktime_set(-1, 0);
+	int expired = 0;
+#endif
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
@@ -417,14 +543,14 @@ static void wake_lock_internal(
 	}
 	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
 	    (long)(lock->expires - jiffies) <= 0) {
-		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
+		held = wake_unlock_stat_locked(lock, &expired, now);
+		lock->stat.last_time = now;
 	}
 #endif
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
-		lock->stat.last_time = ktime_get();
+		lock->stat.last_time = now;
 #endif
 	}
 	list_del(&lock->link);
@@ -447,9 +573,9 @@ static void wake_lock_internal(
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
-			update_sleep_wait_stats_locked(1);
+			update_sleep_wait_stats_locked(1, now);
 		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
+			update_sleep_wait_stats_locked(0, now);
 #endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
@@ -470,6 +596,12 @@ static void wake_lock_internal(
 		}
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
+#ifdef CONFIG_WAKELOCK_STAT
+	if (held.tv64 >= 0)
+		wake_lock_stat_release(lock, held, expired);
+	trace_wake_lock_acquire(lock, has_timeout ? timeout : 0,
+				wake_lock_uid(lock));
+#endif
 }
 
 void wake_lock(struct wake_lock *lock)
@@ -488,10 +620,15 @@ void wake_unlock(struct wake_lock *lock)
 {
 	int type;
 	unsigned long irqflags;
+#ifdef CONFIG_WAKELOCK_STAT
+	ktime_t now = ktime_get();
+	ktime_t held;
+	int expired = 0;
+#endif
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 #ifdef CONFIG_WAKELOCK_STAT
-	wake_unlock_stat_locked(lock, 0);
+	held = wake_unlock_stat_locked(lock, &expired, now);
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
@@ -517,11 +654,15 @@ void wake_unlock(struct wake_lock *lock)
 			if (debug_mask & DEBUG_SUSPEND)
 				print_active_locks(WAKE_LOCK_SUSPEND);
 #ifdef CONFIG_WAKELOCK_STAT
-			update_sleep_wait_stats_locked(0);
+			update_sleep_wait_stats_locked(0, now);
 #endif
 		}
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
+#ifdef CONFIG_WAKELOCK_STAT
+	if (held.tv64 >= 0)
+		wake_lock_stat_release(lock, held, expired);
+#endif
 }
 EXPORT_SYMBOL(wake_unlock);
 
@@ -567,6 +708,8 @@ static int __init wakelocks_init(void)
 #ifdef CONFIG_WAKELOCK_STAT
 	create_proc_read_entry("wakelocks", S_IRUGO, NULL,
 				wakelocks_read_proc, NULL);
+	create_proc_read_entry("wakelocks_uid", S_IRUGO, NULL,
+				wakelocks_uid_read_proc, NULL);
 #endif
 
 	return 0;
@@ -587,6 +730,7 @@ err_platform_device_register:
 static void  __exit wakelocks_exit(void)
 {
 #ifdef CONFIG_WAKELOCK_STAT
+	remove_proc_entry("wakelocks_uid", NULL);
 	remove_proc_entry("wakelocks", NULL);
 #endif
 	destroy_workqueue(suspend_work_queue);
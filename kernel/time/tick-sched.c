@@ -21,6 +21,7 @@
 #include <linux/sched.h>
 #include <linux/tick.h>
 #include <linux/module.h>
+#include <linux/perf_counter.h>
 
 #include <asm/irq_regs.h>
 
@@ -270,7 +271,8 @@ void tick_nohz_stop_sched_tick(int inidle)
 	next_jiffies = get_next_timer_interrupt(last_jiffies);
 	delta_jiffies = next_jiffies - last_jiffies;
 
-	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu))
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
+	    perf_counter_needs_cpu(cpu))
 		delta_jiffies = 1;
 	/*
 	 * Do not stop the tick, if we are only one off
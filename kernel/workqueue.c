@@ -14,6 +14,22 @@
  *   Theodore Ts'o <tytso@mit.edu>
  *
  * Made to use alloc_percpu by Christoph Lameter.
+ *
+ * Workqueues no longer own their threads.  Work items are executed by
+ * pools of workers shared by all workqueues: one pool per cpu, whose
+ * workers are bound to it, and one unbound pool for the single threaded
+ * workqueues.  The scheduler tells a per-cpu pool when one of its
+ * workers goes to sleep; if no other worker is left running and there
+ * is work pending, an idle worker is woken up to keep the cpu busy.  A
+ * pool keeps at least one idle worker around so that this never has to
+ * wait for a thread to be created, creates more when they are used up,
+ * and lets idle workers exit after IDLE_WORKER_TIMEOUT.
+ *
+ * Creating a worker may need memory, so a workqueue which memory reclaim
+ * waits on can't be served by the pools.  Those are WQ_DEDICATED and get
+ * a private pool with a single thread per cpu, as every workqueue used
+ * to.  Freezeable and real time workqueues are dedicated too, their
+ * threads have to be frozen or run at real time priority.
  */
 
 #include <linux/module.h>
@@ -33,38 +49,147 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/mutex.h>
+#include <linux/idr.h>
+#include <linux/hash.h>
+#include <linux/jiffies.h>
+
+#include "workqueue_sched.h"
+
+enum {
+	/* global_cwq flags */
+	GCWQ_MANAGE_WORKERS	= 1 << 0,	/* need to manage workers */
+	GCWQ_MANAGING_WORKERS	= 1 << 1,	/* managing workers */
+	GCWQ_DISASSOCIATED	= 1 << 2,	/* cpu can't serve workers */
+	GCWQ_PRIVATE		= 1 << 3,	/* a dedicated workqueue's */
+	GCWQ_UNBOUND		= 1 << 4,	/* not tied to a cpu */
+
+	/* worker flags */
+	WORKER_STARTED		= 1 << 0,	/* started */
+	WORKER_DIE		= 1 << 1,	/* die die die */
+	WORKER_IDLE		= 1 << 2,	/* is idle */
+	WORKER_PREP		= 1 << 3,	/* preparing to run works */
+	WORKER_UNBOUND		= 1 << 4,	/* not bound to the gcwq's cpu */
+	WORKER_REBIND		= 1 << 5,	/* bind to the gcwq's cpu */
+
+	/* workers with any of these set don't count in nr_running */
+	WORKER_NOT_RUNNING	= WORKER_IDLE | WORKER_PREP | WORKER_UNBOUND,
+
+	BUSY_WORKER_HASH_ORDER	= 4,		/* 16 pointers */
+	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
+
+	MAX_IDLE_WORKERS_RATIO	= 4,		/* 1/4 of busy can be idle */
+	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* keep idle ones for 5 mins */
+	CREATE_COOLDOWN		= HZ,		/* time to breath after fail */
+
+	WQ_DFL_ACTIVE		= 256,		/* keventd's max_active */
+};
 
 /*
- * The per-CPU workqueue (if single thread, we always use the first
- * possible cpu).
+ * Structure fields follow one of the following exclusion rules.
+ *
+ * I: Set during initialization and read-only afterwards.
+ *
+ * L: gcwq->lock protected.  Access with gcwq->lock held.
+ *
+ * X: During normal operation, modification requires gcwq->lock and
+ *    should be done only from local cpu.  Either disabling preemption
+ *    on local cpu or grabbing gcwq->lock is enough for read access.
+ *
+ * F: wq->flush_mutex protected.
+ *
+ * W: workqueue_lock protected.
  */
-struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+struct global_cwq;
+
+/*
+ * The poor guys doing the actual heavy lifting.  All on-duty workers
+ * are either serving the manager role, on idle list or on busy hash.
+ */
+struct worker {
+	/* on idle list while idle, on busy hash table while busy */
+	struct list_head	entry;		/* L: while idle */
+	struct hlist_node	hentry;		/* L: while busy */
+
+	struct work_struct	*current_work;	/* L: work being processed */
+	struct cpu_workqueue_struct *current_cwq; /* L: current_work's cwq */
+	int			current_color;	/* L: current_work's color */
+	struct list_head	scheduled;	/* L: scheduled works */
+	struct task_struct	*task;		/* I: worker task */
+	struct global_cwq	*gcwq;		/* I: the associated gcwq */
+	struct list_head	node;		/* L: on gcwq->workers */
+	unsigned long		last_active;	/* L: last active timestamp */
+	unsigned int		flags;		/* X: flags */
+	int			id;		/* I: worker id */
+};
+
+/*
+ * A pool of workers and the work items waiting for them.  There is one
+ * for each cpu, one for the single threaded workqueues, and private ones
+ * for the dedicated workqueues.
+ */
+struct global_cwq {
+	spinlock_t		lock;		/* the gcwq lock */
+	struct list_head	worklist;	/* L: list of pending works */
+	unsigned int		cpu;		/* I: the associated cpu */
+	unsigned int		flags;		/* L: GCWQ_* flags */
+
+	/* workers running and not blocked, updated by the scheduler too */
+	atomic_t		nr_running;
 
-	struct list_head worklist;
-	wait_queue_head_t more_work;
-	struct work_struct *current_work;
+	int			nr_workers;	/* L: total number of workers */
+	int			nr_idle;	/* L: currently idle ones */
 
-	struct workqueue_struct *wq;
-	struct task_struct *thread;
+	/* workers are chained either in the idle_list or busy_hash */
+	struct list_head	idle_list;	/* X: list of idle workers */
+	struct hlist_head	busy_hash[BUSY_WORKER_HASH_SIZE];
+						/* L: hash of busy workers */
+	struct list_head	workers;	/* L: all workers */
+	struct worker		*first_worker;	/* L: created at CPU_UP_PREPARE */
 
-	int run_depth;		/* Detect run_workqueue() recursion depth */
-} ____cacheline_aligned;
+	struct timer_list	idle_timer;	/* L: worker idle timeout */
+	wait_queue_head_t	idle_wait;	/* woken when a worker idles */
+
+	struct ida		worker_ida;	/* L: for worker IDs */
+	struct workqueue_struct	*wq;		/* I: owner of a private gcwq */
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The per-cpu part of a workqueue, linking it to the gcwq which serves
+ * it on that cpu.  The lower WORK_STRUCT_FLAG_BITS of work->data are
+ * used for flags, so it has to be aligned to twice that.
+ */
+struct cpu_workqueue_struct {
+	struct global_cwq	*gcwq;		/* I: the associated gcwq */
+	struct workqueue_struct *wq;		/* I: the owning workqueue */
+	int			work_color;	/* L: current color */
+	int			flush_color;	/* L: flushing color */
+	int			nr_in_flight[WORK_NR_COLORS];
+						/* L: nr of in_flight works */
+	int			nr_active;	/* L: nr of active works */
+	int			max_active;	/* I: max active works */
+	struct list_head	delayed_works;	/* L: delayed works */
+} __attribute__((aligned(1 << WORK_STRUCT_FLAG_BITS)));
 
 /*
  * The externally visible workqueue abstraction is an array of
  * per-CPU workqueues:
  */
 struct workqueue_struct {
-	struct cpu_workqueue_struct *cpu_wq;
-	struct list_head list;
-	const char *name;
-	int singlethread;
-	int freezeable;		/* Freeze threads during suspend */
-	int rt;
+	unsigned int		flags;		/* I: WQ_* flags */
+	struct cpu_workqueue_struct *cpu_wq;	/* I: cwq's, one per cpu */
+	void			*cpu_wq_mem;	/* I: what cpu_wq sits in */
+	struct global_cwq	*private_gcwq;	/* I: dedicated only */
+	struct list_head	list;		/* W: list of all workqueues */
+
+	struct mutex		flush_mutex;	/* protects wq flushing */
+	atomic_t		nr_cwqs_to_flush; /* F: flush in progress */
+	struct completion	flush_done;	/* F: flush completion */
+
+	const char		*name;		/* I: workqueue name */
 #ifdef CONFIG_LOCKDEP
-	struct lockdep_map lockdep_map;
+	struct lockdep_map	lockdep_map;
 #endif
 };
 
@@ -74,33 +199,50 @@ static LIST_HEAD(workqueues);
 
 static int singlethread_cpu __read_mostly;
 static const struct cpumask *cpu_singlethread_map __read_mostly;
-/*
- * _cpu_down() first removes CPU from cpu_online_map, then CPU_DEAD
- * flushes cwq->worklist. This means that flush_workqueue/wait_on_work
- * which comes in between can't use for_each_online_cpu(). We could
- * use cpu_possible_map, the cpumask below is more a documentation
- * than optimization.
- */
-static cpumask_var_t cpu_populated_map __read_mostly;
 
-/* If it's single threaded, it isn't in the list of workqueues. */
+/* the shared pools */
+static DEFINE_PER_CPU(struct global_cwq, global_cwq);
+static struct global_cwq unbound_global_cwq;
+
+static int worker_thread(void *__worker);
+
 static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 {
-	return wq->singlethread;
+	return wq->flags & WQ_SINGLE_THREAD;
 }
 
+/*
+ * Single threaded workqueues have their only cwq indexed by
+ * singlethread_cpu, the others have one for each possible cpu.
+ */
 static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
 {
 	return is_wq_single_threaded(wq)
-		? cpu_singlethread_map : cpu_populated_map;
+		? cpu_singlethread_map : cpu_possible_mask;
 }
 
-static
-struct cpu_workqueue_struct *wq_per_cpu(struct workqueue_struct *wq, int cpu)
+static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
+					    struct workqueue_struct *wq)
 {
 	if (unlikely(is_wq_single_threaded(wq)))
-		cpu = singlethread_cpu;
-	return per_cpu_ptr(wq->cpu_wq, cpu);
+		return wq->cpu_wq;
+	return wq->cpu_wq + cpu;
+}
+
+static unsigned int work_color_to_flags(int color)
+{
+	return color << WORK_STRUCT_COLOR_SHIFT;
+}
+
+static int get_work_color(struct work_struct *work)
+{
+	return (*work_data_bits(work) >> WORK_STRUCT_COLOR_SHIFT) &
+		((1 << WORK_STRUCT_COLOR_BITS) - 1);
+}
+
+static int work_next_color(int color)
+{
+	return (color + 1) % WORK_NR_COLORS;
 }
 
 /*
@@ -108,15 +250,13 @@ struct cpu_workqueue_struct *wq_per_cpu(struct workqueue_struct *wq, int cpu)
  * - Must *only* be called if the pending flag is set
  */
 static inline void set_wq_data(struct work_struct *work,
-				struct cpu_workqueue_struct *cwq)
+			       struct cpu_workqueue_struct *cwq,
+			       unsigned long extra_flags)
 {
-	unsigned long new;
-
 	BUG_ON(!work_pending(work));
 
-	new = (unsigned long) cwq | (1UL << WORK_STRUCT_PENDING);
-	new |= WORK_STRUCT_FLAG_MASK & *work_data_bits(work);
-	atomic_long_set(&work->data, new);
+	atomic_long_set(&work->data, (unsigned long)cwq |
+			(1UL << WORK_STRUCT_PENDING) | extra_flags);
 }
 
 static inline
@@ -125,27 +265,325 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+/*
+ * Policy functions.  These define the policies on how the global
+ * worker pool is managed.  Unless noted otherwise, these functions
+ * assume that they're being called with gcwq->lock held.
+ */
+
+/*
+ * Only a pool whose workers all run on its cpu can tell from nr_running
+ * whether the cpu is kept busy.  The others wake up a worker for every
+ * work item and let it run.
+ */
+static bool gcwq_managed(struct global_cwq *gcwq)
+{
+	return !(gcwq->flags & (GCWQ_DISASSOCIATED | GCWQ_PRIVATE));
+}
+
+static bool __need_more_worker(struct global_cwq *gcwq)
+{
+	return !atomic_read(&gcwq->nr_running) || !gcwq_managed(gcwq);
+}
+
+/*
+ * Need to wake up a worker?  Called from anything but currently
+ * running workers.
+ */
+static bool need_more_worker(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->worklist) && __need_more_worker(gcwq);
+}
+
+/* Can I start working?  Called from busy but !running workers. */
+static bool may_start_working(struct global_cwq *gcwq)
+{
+	return gcwq->nr_idle || (gcwq->flags & GCWQ_PRIVATE);
+}
+
+/* Do I need to keep working?  Called from currently running workers. */
+static bool keep_working(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->worklist) &&
+		(atomic_read(&gcwq->nr_running) <= 1 || !gcwq_managed(gcwq));
+}
+
+/* Do we need a new worker?  Called from manager. */
+static bool need_to_create_worker(struct global_cwq *gcwq)
+{
+	return need_more_worker(gcwq) && !may_start_working(gcwq);
+}
+
+/* Do I need to be the manager? */
+static bool need_to_manage_workers(struct global_cwq *gcwq)
+{
+	return need_to_create_worker(gcwq) ||
+		(gcwq->flags & GCWQ_MANAGE_WORKERS);
+}
+
+/* Do we have too many workers and should some go away? */
+static bool too_many_workers(struct global_cwq *gcwq)
+{
+	bool managing = gcwq->flags & GCWQ_MANAGING_WORKERS;
+	int nr_idle = gcwq->nr_idle + managing; /* manager is considered idle */
+	int nr_busy = gcwq->nr_workers - nr_idle;
+
+	return nr_idle > 2 && (nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
+}
+
+/*
+ * Wake up functions.
+ */
+
+/* Return the first worker.  Safe with preemption disabled */
+static struct worker *first_worker(struct global_cwq *gcwq)
+{
+	if (unlikely(list_empty(&gcwq->idle_list)))
+		return NULL;
+
+	return list_first_entry(&gcwq->idle_list, struct worker, entry);
+}
+
+/**
+ * wake_up_worker - wake up an idle worker
+ * @gcwq: gcwq to wake worker for
+ *
+ * Wake up the first idle worker of @gcwq.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void wake_up_worker(struct global_cwq *gcwq)
+{
+	struct worker *worker = first_worker(gcwq);
+
+	if (likely(worker))
+		wake_up_process(worker->task);
+}
+
+/**
+ * wq_worker_waking_up - a worker is waking up
+ * @task: task waking up
+ * @cpu: CPU @task is waking up to
+ *
+ * This function is called during try_to_wake_up() when a worker is
+ * being awoken.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ */
+void wq_worker_waking_up(struct task_struct *task, unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task);
+
+	if (!(worker->flags & WORKER_NOT_RUNNING))
+		atomic_inc(&worker->gcwq->nr_running);
+}
+
+/**
+ * wq_worker_sleeping - a worker is going to sleep
+ * @task: task going to sleep
+ * @cpu: CPU in question, must be the current CPU number
+ *
+ * This function is called during schedule() when a busy worker is
+ * going to sleep.  Worker on the same cpu can be woken up by
+ * returning pointer to its task.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * RETURNS:
+ * Worker task on @cpu to wake up, %NULL if none.
+ */
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task), *to_wakeup = NULL;
+	struct global_cwq *gcwq = worker->gcwq;
+
+	if (worker->flags & WORKER_NOT_RUNNING)
+		return NULL;
+
+	/*
+	 * The counterpart of the following dec_and_test, implied mb,
+	 * worklist not empty test sequence is in insert_work().
+	 * Please read comment there.
+	 *
+	 * NOT_RUNNING is clear.  This means that the gcwq is bound to
+	 * this cpu and we're running on it w/ rq lock held and
+	 * preemption disabled, which in turn means that none else
+	 * could be manipulating idle_list, so dereferencing idle_list
+	 * without gcwq lock is safe.
+	 */
+	if (atomic_dec_and_test(&gcwq->nr_running) &&
+	    !list_empty(&gcwq->worklist))
+		to_wakeup = first_worker(gcwq);
+
+	/* one which has yet to bind itself can't be woken up locally */
+	if (!to_wakeup || task_cpu(to_wakeup->task) != cpu)
+		return NULL;
+	return to_wakeup->task;
+}
+
+/**
+ * worker_set_flags - set worker flags
+ * @worker: self
+ * @flags: flags to set
+ *
+ * Set @flags in @worker->flags and adjust nr_running accordingly.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock)
+ */
+static inline void worker_set_flags(struct worker *worker, unsigned int flags)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	WARN_ON_ONCE(worker->task != current);
+
+	/* if transitioning into NOT_RUNNING, adjust nr_running */
+	if ((flags & WORKER_NOT_RUNNING) &&
+	    !(worker->flags & WORKER_NOT_RUNNING))
+		atomic_dec(&gcwq->nr_running);
+
+	worker->flags |= flags;
+}
+
+/**
+ * worker_clr_flags - clear worker flags
+ * @worker: self
+ * @flags: flags to clear
+ *
+ * Clear @flags in @worker->flags and adjust nr_running accordingly.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock)
+ */
+static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	unsigned int oflags = worker->flags;
+
+	WARN_ON_ONCE(worker->task != current);
+
+	worker->flags &= ~flags;
+
+	/* if transitioning out of NOT_RUNNING, increment nr_running */
+	if ((flags & WORKER_NOT_RUNNING) && (oflags & WORKER_NOT_RUNNING))
+		if (!(worker->flags & WORKER_NOT_RUNNING))
+			atomic_inc(&gcwq->nr_running);
+}
+
+/**
+ * busy_worker_head - return the busy hash head for a work
+ * @gcwq: gcwq of interest
+ * @work: work to be hashed
+ *
+ * Return hash head of @gcwq for @work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static struct hlist_head *busy_worker_head(struct global_cwq *gcwq,
+					   struct work_struct *work)
+{
+	return &gcwq->busy_hash[hash_ptr(work, BUSY_WORKER_HASH_ORDER)];
+}
+
+/**
+ * find_worker_executing_work - find worker which is executing a work
+ * @gcwq: gcwq of interest
+ * @work: work to find worker for
+ *
+ * Find a worker which is executing @work on @gcwq.  A work item is
+ * never executed by two workers of the same gcwq at once: one which
+ * is queued while it is still running is handed over to the worker
+ * running it, see process_one_work().
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ *
+ * RETURNS:
+ * Pointer to worker which is executing @work if found, NULL
+ * otherwise.
+ */
+static struct worker *find_worker_executing_work(struct global_cwq *gcwq,
+						 struct work_struct *work)
+{
+	struct hlist_head *bwh = busy_worker_head(gcwq, work);
+	struct hlist_node *tmp;
+	struct worker *worker;
+
+	hlist_for_each_entry(worker, tmp, bwh, hentry)
+		if (worker->current_work == work)
+			return worker;
+	return NULL;
+}
+
+/**
+ * insert_work - insert a work into gcwq
+ * @cwq: cwq @work belongs to
+ * @work: work to insert
+ * @head: insertion point
+ * @extra_flags: extra WORK_STRUCT_* flags to set
+ *
+ * Insert @work which belongs to @cwq into @gcwq after @head.
+ * @extra_flags is or'd to work_struct flags.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
 static void insert_work(struct cpu_workqueue_struct *cwq,
-			struct work_struct *work, struct list_head *head)
+			struct work_struct *work, struct list_head *head,
+			unsigned int extra_flags)
 {
-	set_wq_data(work, cwq);
+	struct global_cwq *gcwq = cwq->gcwq;
+
+	set_wq_data(work, cwq, extra_flags);
 	/*
 	 * Ensure that we get the right work->data if we see the
 	 * result of list_add() below, see try_to_grab_pending().
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+
+	/*
+	 * Ensure either wq_worker_sleeping() sees the above
+	 * list_add_tail() or we see zero nr_running to avoid workers
+	 * lying around lazily while there are works to be processed.
+	 */
+	smp_mb();
+
+	if (__need_more_worker(gcwq))
+		wake_up_worker(gcwq);
 }
 
-static void __queue_work(struct cpu_workqueue_struct *cwq,
+static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
+	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct list_head *worklist;
+	unsigned int work_flags;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
-	insert_work(cwq, work, &cwq->worklist);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	spin_lock_irqsave(&gcwq->lock, flags);
+	BUG_ON(!list_empty(&work->entry));
+
+	cwq->nr_in_flight[cwq->work_color]++;
+	work_flags = work_color_to_flags(cwq->work_color);
+
+	if (likely(cwq->nr_active < cwq->max_active)) {
+		cwq->nr_active++;
+		worklist = &gcwq->worklist;
+	} else {
+		work_flags |= 1UL << WORK_STRUCT_DELAYED;
+		worklist = &cwq->delayed_works;
+	}
+
+	insert_work(cwq, work, worklist, work_flags);
+
+	spin_unlock_irqrestore(&gcwq->lock, flags);
 }
 
 /**
@@ -186,162 +624,807 @@ queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work)
 	int ret = 0;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work))) {
+		__queue_work(cpu, wq, work);
+		ret = 1;
+	}
+	return ret;
+}
+EXPORT_SYMBOL_GPL(queue_work_on);
+
+static void delayed_work_timer_fn(unsigned long __data)
+{
+	struct delayed_work *dwork = (struct delayed_work *)__data;
+	struct cpu_workqueue_struct *cwq = get_wq_data(&dwork->work);
+
+	__queue_work(smp_processor_id(), cwq->wq, &dwork->work);
+}
+
+/**
+ * queue_delayed_work - queue work on a workqueue after delay
+ * @wq: workqueue to use
+ * @dwork: delayable work to queue
+ * @delay: number of jiffies to wait before queueing
+ *
+ * Returns 0 if @work was already on a queue, non-zero otherwise.
+ */
+int queue_delayed_work(struct workqueue_struct *wq,
+			struct delayed_work *dwork, unsigned long delay)
+{
+	if (delay == 0)
+		return queue_work(wq, &dwork->work);
+
+	return queue_delayed_work_on(-1, wq, dwork, delay);
+}
+EXPORT_SYMBOL_GPL(queue_delayed_work);
+
+/**
+ * queue_delayed_work_on - queue work on specific CPU after delay
+ * @cpu: CPU number to execute work on
+ * @wq: workqueue to use
+ * @dwork: work to queue
+ * @delay: number of jiffies to wait before queueing
+ *
+ * Returns 0 if @work was already on a queue, non-zero otherwise.
+ */
+int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
+			struct delayed_work *dwork, unsigned long delay)
+{
+	int ret = 0;
+	struct timer_list *timer = &dwork->timer;
+	struct work_struct *work = &dwork->work;
+
+	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work))) {
+		BUG_ON(timer_pending(timer));
 		BUG_ON(!list_empty(&work->entry));
-		__queue_work(wq_per_cpu(wq, cpu), work);
+
+		timer_stats_timer_set_start_info(&dwork->timer);
+
+		/* This stores cwq for the moment, for the timer_fn */
+		set_wq_data(work, get_cwq(raw_smp_processor_id(), wq), 0);
+		timer->expires = jiffies + delay;
+		timer->data = (unsigned long)dwork;
+		timer->function = delayed_work_timer_fn;
+
+		if (unlikely(cpu >= 0))
+			add_timer_on(timer, cpu);
+		else
+			add_timer(timer);
 		ret = 1;
 	}
 	return ret;
 }
-EXPORT_SYMBOL_GPL(queue_work_on);
+EXPORT_SYMBOL_GPL(queue_delayed_work_on);
+
+/**
+ * worker_enter_idle - enter idle state
+ * @worker: worker which is entering idle state
+ *
+ * @worker is entering idle state.  Update stats and idle timer if
+ * necessary.
+ *
+ * LOCKING:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void worker_enter_idle(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	BUG_ON(worker->flags & WORKER_IDLE);
+	BUG_ON(!list_empty(&worker->entry));
+
+	/* can't use worker_set_flags(), also called from start_worker() */
+	worker->flags |= WORKER_IDLE;
+	gcwq->nr_idle++;
+	worker->last_active = jiffies;
+
+	/* idle_list is LIFO */
+	list_add(&worker->entry, &gcwq->idle_list);
+
+	if (too_many_workers(gcwq) && !timer_pending(&gcwq->idle_timer))
+		mod_timer(&gcwq->idle_timer, jiffies + IDLE_WORKER_TIMEOUT);
+
+	/* CPU_POST_DEAD and destroy_workqueue() wait for the pool to drain */
+	if (unlikely(waitqueue_active(&gcwq->idle_wait)))
+		wake_up_all(&gcwq->idle_wait);
+}
+
+/**
+ * worker_leave_idle - leave idle state
+ * @worker: worker which is leaving idle state
+ *
+ * @worker is leaving idle state.  Update stats.
+ *
+ * LOCKING:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void worker_leave_idle(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	BUG_ON(!(worker->flags & WORKER_IDLE));
+	worker_clr_flags(worker, WORKER_IDLE);
+	gcwq->nr_idle--;
+	list_del_init(&worker->entry);
+}
+
+/**
+ * worker_rebind - bind a worker to the cpu of its gcwq
+ * @worker: self
+ *
+ * Workers bind themselves, the cpu may have gone offline meanwhile and
+ * they stay unbound if it has.  A worker of a shared per-cpu gcwq is
+ * counted in nr_running from then on.
+ *
+ * LOCKING:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed.
+ */
+static void worker_rebind(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	int ret;
+
+	worker->flags &= ~WORKER_REBIND;
+	spin_unlock_irq(&gcwq->lock);
+
+	ret = set_cpus_allowed_ptr(current, cpumask_of(gcwq->cpu));
+	if (!ret)
+		current->flags |= PF_THREAD_BOUND;
+
+	spin_lock_irq(&gcwq->lock);
+	if (!ret && gcwq_managed(gcwq))
+		worker_clr_flags(worker, WORKER_UNBOUND);
+}
+
+static struct worker *alloc_worker(void)
+{
+	struct worker *worker;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (worker) {
+		INIT_LIST_HEAD(&worker->entry);
+		INIT_LIST_HEAD(&worker->scheduled);
+		INIT_LIST_HEAD(&worker->node);
+	}
+	return worker;
+}
+
+/**
+ * create_worker - create a new workqueue worker
+ * @gcwq: gcwq the new worker will belong to
+ *
+ * Create a new worker which is attached to @gcwq.  The new worker
+ * must be started by start_worker().  Until it first runs it does not
+ * count in nr_running, it then binds itself to the cpu of @gcwq.
+ *
+ * CONTEXT:
+ * Might sleep.  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * Pointer to the newly created worker.
+ */
+static struct worker *create_worker(struct global_cwq *gcwq)
+{
+	struct workqueue_struct *wq = gcwq->wq;
+	struct worker *worker = NULL;
+	int id = -1;
+
+	spin_lock_irq(&gcwq->lock);
+	while (ida_get_new(&gcwq->worker_ida, &id)) {
+		spin_unlock_irq(&gcwq->lock);
+		if (!ida_pre_get(&gcwq->worker_ida, GFP_KERNEL))
+			goto fail;
+		spin_lock_irq(&gcwq->lock);
+	}
+	spin_unlock_irq(&gcwq->lock);
+
+	worker = alloc_worker();
+	if (!worker)
+		goto fail;
+
+	worker->gcwq = gcwq;
+	worker->id = id;
+
+	/* dedicated threads keep the names workqueue threads always had */
+	if (wq && (gcwq->flags & GCWQ_UNBOUND))
+		worker->task = kthread_create(worker_thread, worker, "%s",
+					      wq->name);
+	else if (wq)
+		worker->task = kthread_create(worker_thread, worker, "%s/%d",
+					      wq->name, gcwq->cpu);
+	else if (gcwq->flags & GCWQ_UNBOUND)
+		worker->task = kthread_create(worker_thread, worker,
+					      "kworker/u:%d", id);
+	else
+		worker->task = kthread_create(worker_thread, worker,
+					      "kworker/%u:%d", gcwq->cpu, id);
+	/*
+	 * Nobody can queue a work item for this worker before it is
+	 * started, so we can abort safely.
+	 */
+	if (IS_ERR(worker->task))
+		goto fail;
+
+	if (wq && (wq->flags & WQ_RT)) {
+		struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+
+		sched_setscheduler_nocheck(worker->task, SCHED_FIFO, &param);
+	}
+
+	worker->flags = WORKER_PREP | WORKER_UNBOUND;
+	if (!(gcwq->flags & GCWQ_UNBOUND))
+		worker->flags |= WORKER_REBIND;
+
+	spin_lock_irq(&gcwq->lock);
+	list_add_tail(&worker->node, &gcwq->workers);
+	spin_unlock_irq(&gcwq->lock);
+
+	return worker;
+fail:
+	if (id >= 0) {
+		spin_lock_irq(&gcwq->lock);
+		ida_remove(&gcwq->worker_ida, id);
+		spin_unlock_irq(&gcwq->lock);
+	}
+	kfree(worker);
+	return NULL;
+}
+
+/**
+ * start_worker - start a newly created worker
+ * @worker: worker to start
+ *
+ * Make the gcwq aware of @worker and start it.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void start_worker(struct worker *worker)
+{
+	worker->flags |= WORKER_STARTED;
+	worker->gcwq->nr_workers++;
+	worker_enter_idle(worker);
+	wake_up_process(worker->task);
+}
+
+/**
+ * destroy_worker - destroy a workqueue worker
+ * @worker: worker to be destroyed
+ *
+ * Destroy @worker and adjust @gcwq stats accordingly.  @worker must be
+ * idle or not started yet.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which is released and regrabbed.
+ */
+static void destroy_worker(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	int id = worker->id;
+
+	/* sanity check frenzy */
+	BUG_ON(worker->current_work);
+	BUG_ON(!list_empty(&worker->scheduled));
+
+	if (worker->flags & WORKER_STARTED)
+		gcwq->nr_workers--;
+	if (worker->flags & WORKER_IDLE)
+		gcwq->nr_idle--;
+
+	list_del_init(&worker->entry);
+	list_del_init(&worker->node);
+	worker->flags |= WORKER_DIE;
+
+	spin_unlock_irq(&gcwq->lock);
+
+	kthread_stop(worker->task);
+	kfree(worker);
+
+	spin_lock_irq(&gcwq->lock);
+	ida_remove(&gcwq->worker_ida, id);
+}
+
+static void idle_worker_timeout(unsigned long __gcwq)
+{
+	struct global_cwq *gcwq = (void *)__gcwq;
+
+	spin_lock_irq(&gcwq->lock);
+
+	if (too_many_workers(gcwq)) {
+		struct worker *worker;
+		unsigned long expires;
+
+		/* idle_list is kept in LIFO order, check the last one */
+		worker = list_entry(gcwq->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+
+		if (time_before(jiffies, expires))
+			mod_timer(&gcwq->idle_timer, expires);
+		else {
+			/* it's been idle for too long, wake up manager */
+			gcwq->flags |= GCWQ_MANAGE_WORKERS;
+			wake_up_worker(gcwq);
+		}
+	}
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/**
+ * maybe_create_worker - create a new worker if necessary
+ * @gcwq: gcwq to create a new worker for
+ *
+ * Create a new worker for @gcwq if necessary.  @gcwq is guaranteed to
+ * have at least one idle worker on return from this function.  If
+ * creating a new worker fails, it is retried every CREATE_COOLDOWN
+ * for as long as the new worker is needed.
+ *
+ * LOCKING:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Called only from manager.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true
+ * otherwise.
+ */
+static bool maybe_create_worker(struct global_cwq *gcwq)
+{
+	if (!need_to_create_worker(gcwq))
+		return false;
+
+	while (true) {
+		struct worker *worker;
+
+		spin_unlock_irq(&gcwq->lock);
+
+		worker = create_worker(gcwq);
+		if (worker) {
+			spin_lock_irq(&gcwq->lock);
+			start_worker(worker);
+			return true;
+		}
+
+		if (!need_to_create_worker(gcwq))
+			break;
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+		schedule_timeout(CREATE_COOLDOWN);
+
+		if (!need_to_create_worker(gcwq))
+			break;
+	}
+
+	spin_lock_irq(&gcwq->lock);
+	return true;
+}
+
+/**
+ * maybe_destroy_worker - destroy workers which have been idle for a while
+ * @gcwq: gcwq to destroy workers for
+ *
+ * Destroy @gcwq workers which have been idle for longer than
+ * IDLE_WORKER_TIMEOUT.
+ *
+ * LOCKING:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Called only from manager.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true
+ * otherwise.
+ */
+static bool maybe_destroy_workers(struct global_cwq *gcwq)
+{
+	bool ret = false;
+
+	while (too_many_workers(gcwq)) {
+		struct worker *worker;
+		unsigned long expires;
+
+		worker = list_entry(gcwq->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+
+		if (time_before(jiffies, expires)) {
+			mod_timer(&gcwq->idle_timer, expires);
+			break;
+		}
+
+		destroy_worker(worker);
+		ret = true;
+	}
+
+	return ret;
+}
+
+/**
+ * manage_workers - manage worker pool
+ * @worker: self
+ *
+ * Assume the manager role and manage gcwq worker pool @worker belongs
+ * to.  At any given time, there can be only zero or one manager per
+ * gcwq.  The exclusion is handled automatically by this function.
+ *
+ * The caller can safely start processing works on false return.  On
+ * true return, it's guaranteed that need_to_create_worker() is false
+ * and may_start_working() is true.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true if
+ * some action was taken.
+ */
+static bool manage_workers(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	bool ret = false;
+
+	if (gcwq->flags & GCWQ_MANAGING_WORKERS)
+		return ret;
+
+	gcwq->flags &= ~GCWQ_MANAGE_WORKERS;
+	gcwq->flags |= GCWQ_MANAGING_WORKERS;
+
+	/*
+	 * Destroy and then create so that may_start_working() is true
+	 * on return.
+	 */
+	ret |= maybe_destroy_workers(gcwq);
+	ret |= maybe_create_worker(gcwq);
+
+	gcwq->flags &= ~GCWQ_MANAGING_WORKERS;
+
+	return ret;
+}
+
+/**
+ * move_linked_works - move linked works to a list
+ * @work: start of series of works to be scheduled
+ * @head: target list to append @work to
+ *
+ * Schedule linked works starting from @work to @head.  Work series to
+ * be scheduled starts at @work and includes any consecutive work with
+ * WORK_STRUCT_LINKED set in its predecessor.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void move_linked_works(struct work_struct *work, struct list_head *head)
+{
+	struct work_struct *n;
+
+	/*
+	 * Linked worklist will always end before the end of the list,
+	 * use NULL for list head.
+	 */
+	list_for_each_entry_safe_from(work, n, NULL, entry) {
+		list_move_tail(&work->entry, head);
+		if (!(*work_data_bits(work) & (1UL << WORK_STRUCT_LINKED)))
+			break;
+	}
+}
 
-static void delayed_work_timer_fn(unsigned long __data)
+static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 {
-	struct delayed_work *dwork = (struct delayed_work *)__data;
-	struct cpu_workqueue_struct *cwq = get_wq_data(&dwork->work);
-	struct workqueue_struct *wq = cwq->wq;
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct work_struct *work = list_first_entry(&cwq->delayed_works,
+						    struct work_struct, entry);
+
+	move_linked_works(work, &gcwq->worklist);
+	__clear_bit(WORK_STRUCT_DELAYED, work_data_bits(work));
+	cwq->nr_active++;
 
-	__queue_work(wq_per_cpu(wq, smp_processor_id()), &dwork->work);
+	if (need_more_worker(gcwq))
+		wake_up_worker(gcwq);
 }
 
 /**
- * queue_delayed_work - queue work on a workqueue after delay
- * @wq: workqueue to use
- * @dwork: delayable work to queue
- * @delay: number of jiffies to wait before queueing
+ * cwq_dec_nr_in_flight - decrement cwq's nr_in_flight
+ * @cwq: cwq of interest
+ * @color: color of work which left the queue
+ * @delayed: for a delayed work
  *
- * Returns 0 if @work was already on a queue, non-zero otherwise.
+ * A work either has completed or is removed from pending queue,
+ * decrement nr_in_flight of its cwq and handle workqueue flushing.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
  */
-int queue_delayed_work(struct workqueue_struct *wq,
-			struct delayed_work *dwork, unsigned long delay)
+static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
+				 bool delayed)
 {
-	if (delay == 0)
-		return queue_work(wq, &dwork->work);
+	struct workqueue_struct *wq = cwq->wq;
 
-	return queue_delayed_work_on(-1, wq, dwork, delay);
+	/* ignore uncolored works */
+	if (color == WORK_NO_COLOR)
+		return;
+
+	cwq->nr_in_flight[color]--;
+
+	if (!delayed) {
+		cwq->nr_active--;
+		if (!list_empty(&cwq->delayed_works) &&
+		    cwq->nr_active < cwq->max_active)
+			cwq_activate_first_delayed(cwq);
+	}
+
+	/* is flush in progress and are we at the flushing tip? */
+	if (likely(cwq->flush_color != color))
+		return;
+
+	/* are there still in-flight works? */
+	if (cwq->nr_in_flight[color])
+		return;
+
+	/* this cwq is done, clear flush_color */
+	cwq->flush_color = -1;
+
+	/*
+	 * If this was the last cwq, wake up the first flusher.  It
+	 * will handle the rest.
+	 */
+	if (atomic_dec_and_test(&wq->nr_cwqs_to_flush))
+		complete(&wq->flush_done);
 }
-EXPORT_SYMBOL_GPL(queue_delayed_work);
 
 /**
- * queue_delayed_work_on - queue work on specific CPU after delay
- * @cpu: CPU number to execute work on
- * @wq: workqueue to use
- * @dwork: work to queue
- * @delay: number of jiffies to wait before queueing
+ * process_one_work - process single work
+ * @worker: self
+ * @work: work to process
  *
- * Returns 0 if @work was already on a queue, non-zero otherwise.
+ * Process @work.  This function contains all the logics necessary to
+ * process a single work including synchronization against and
+ * interaction with other workers on the same cpu, queueing and
+ * flushing.  As long as context requirement is met, any worker can
+ * call this function to process a work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which is released and regrabbed.
  */
-int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
-			struct delayed_work *dwork, unsigned long delay)
+static void process_one_work(struct worker *worker, struct work_struct *work)
 {
-	int ret = 0;
-	struct timer_list *timer = &dwork->timer;
-	struct work_struct *work = &dwork->work;
+	struct cpu_workqueue_struct *cwq = get_wq_data(work);
+	struct global_cwq *gcwq = cwq->gcwq;
+	work_func_t f = work->func;
+	struct worker *collision;
+#ifdef CONFIG_LOCKDEP
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
+#endif
+	/*
+	 * A single work shouldn't be executed concurrently by
+	 * multiple workers on a single cpu.  Check whether anyone is
+	 * already processing the work.  If so, defer the work to the
+	 * currently executing one.
+	 */
+	collision = find_worker_executing_work(gcwq, work);
+	if (unlikely(collision)) {
+		move_linked_works(work, &collision->scheduled);
+		return;
+	}
 
-	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work))) {
-		BUG_ON(timer_pending(timer));
-		BUG_ON(!list_empty(&work->entry));
+	/* claim and process */
+	hlist_add_head(&worker->hentry, busy_worker_head(gcwq, work));
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	worker->current_color = get_work_color(work);
 
-		timer_stats_timer_set_start_info(&dwork->timer);
+	list_del_init(&work->entry);
+	spin_unlock_irq(&gcwq->lock);
 
-		/* This stores cwq for the moment, for the timer_fn */
-		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id()));
-		timer->expires = jiffies + delay;
-		timer->data = (unsigned long)dwork;
-		timer->function = delayed_work_timer_fn;
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
 
-		if (unlikely(cpu >= 0))
-			add_timer_on(timer, cpu);
-		else
-			add_timer(timer);
-		ret = 1;
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
 	}
-	return ret;
+
+	spin_lock_irq(&gcwq->lock);
+
+	/* we're done with it, release */
+	hlist_del_init(&worker->hentry);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	cwq_dec_nr_in_flight(cwq, worker->current_color, false);
 }
-EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/**
+ * process_scheduled_works - process scheduled works
+ * @worker: self
+ *
+ * Process all scheduled works.  Please note that the scheduled list
+ * may change while processing a work, so this function repeatedly
+ * fetches a work from the top and executes it.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.
+ */
+static void process_scheduled_works(struct worker *worker)
 {
-	spin_lock_irq(&cwq->lock);
-	cwq->run_depth++;
-	if (cwq->run_depth > 3) {
-		/* morton gets to eat his hat */
-		printk("%s: recursion depth exceeded: %d\n",
-			__func__, cwq->run_depth);
-		dump_stack();
-	}
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
+	while (!list_empty(&worker->scheduled)) {
+		struct work_struct *work = list_first_entry(&worker->scheduled,
 						struct work_struct, entry);
-		work_func_t f = work->func;
-#ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
-#endif
-
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
-
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
-
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+		process_one_work(worker, work);
+	}
+}
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+/*
+ * Take the first work off the worklist, together with the barriers
+ * linked to it, and run it.
+ */
+static void process_next_work(struct worker *worker)
+{
+	struct work_struct *work = list_first_entry(&worker->gcwq->worklist,
+						    struct work_struct, entry);
+
+	if (likely(!(*work_data_bits(work) & (1UL << WORK_STRUCT_LINKED)))) {
+		/* optimization path, not strictly necessary */
+		process_one_work(worker, work);
+		if (unlikely(!list_empty(&worker->scheduled)))
+			process_scheduled_works(worker);
+	} else {
+		move_linked_works(work, &worker->scheduled);
+		process_scheduled_works(worker);
 	}
-	cwq->run_depth--;
-	spin_unlock_irq(&cwq->lock);
 }
 
-static int worker_thread(void *__cwq)
+/**
+ * worker_thread - the worker thread function
+ * @__worker: self
+ *
+ * The gcwq worker thread function.  There's a single dynamic pool of
+ * these per each cpu.  These workers process all works regardless of
+ * their specific target workqueue.  The only exception is works which
+ * belong to dedicated workqueues, they are processed by the threads of
+ * their private pools.
+ */
+static int worker_thread(void *__worker)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DEFINE_WAIT(wait);
+	struct worker *worker = __worker;
+	struct global_cwq *gcwq = worker->gcwq;
+
+	/* tell the scheduler that this is a workqueue worker */
+	current->flags |= PF_WQ_WORKER;
 
-	if (cwq->wq->freezeable)
+	if (gcwq->wq && (gcwq->wq->flags & WQ_FREEZEABLE))
 		set_freezable();
 
 	set_user_nice(current, -5);
+woke_up:
+	try_to_freeze();
+
+	spin_lock_irq(&gcwq->lock);
+
+	if (unlikely(worker->flags & WORKER_REBIND))
+		worker_rebind(worker);
 
-	for (;;) {
-		prepare_to_wait(&cwq->more_work, &wait, TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !kthread_should_stop() &&
-		    list_empty(&cwq->worklist))
+	/* am I supposed to die? */
+	if (unlikely(worker->flags & WORKER_DIE)) {
+		spin_unlock_irq(&gcwq->lock);
+		current->flags &= ~PF_WQ_WORKER;
+
+		/* kthread_stop() is on its way, see destroy_worker() */
+		for (;;) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (kthread_should_stop())
+				break;
 			schedule();
-		finish_wait(&cwq->more_work, &wait);
+		}
+		__set_current_state(TASK_RUNNING);
+		return 0;
+	}
 
-		try_to_freeze();
+	worker_leave_idle(worker);
+recheck:
+	/* no more worker necessary? */
+	if (!need_more_worker(gcwq))
+		goto sleep;
 
-		if (kthread_should_stop())
-			break;
+	/* do we need to manage? */
+	if (unlikely(!may_start_working(gcwq)) && manage_workers(worker))
+		goto recheck;
+
+	/*
+	 * ->scheduled list can only be filled while a worker is
+	 * preparing to process a work or actually processing it.
+	 * Make sure nobody diddled with it while I was sleeping.
+	 */
+	BUG_ON(!list_empty(&worker->scheduled));
+
+	/*
+	 * When control reaches this point, we're guaranteed to have
+	 * at least one idle worker or that someone else has already
+	 * assumed the manager role.
+	 */
+	worker_clr_flags(worker, WORKER_PREP);
 
-		run_workqueue(cwq);
+	do {
+		process_next_work(worker);
+	} while (keep_working(gcwq));
+
+	worker_set_flags(worker, WORKER_PREP);
+sleep:
+	if (unlikely(worker->flags & WORKER_REBIND)) {
+		worker_rebind(worker);
+		goto recheck;
 	}
 
-	return 0;
+	if (unlikely(need_to_manage_workers(gcwq)) && manage_workers(worker))
+		goto recheck;
+
+	/*
+	 * gcwq->lock is held and there's no work to process and no
+	 * need to manage, sleep.  Workers are woken up only while
+	 * holding gcwq->lock or from local cpu, so setting the
+	 * current state before releasing gcwq->lock is enough to
+	 * prevent losing any event.
+	 */
+	worker_enter_idle(worker);
+	__set_current_state(TASK_INTERRUPTIBLE);
+	spin_unlock_irq(&gcwq->lock);
+	schedule();
+	goto woke_up;
+}
+
+/* The worker the current task is, NULL if it is none. */
+static struct worker *current_wq_worker(void)
+{
+	if (current->flags & PF_WQ_WORKER)
+		return kthread_data(current);
+	return NULL;
+}
+
+/*
+ * A work item flushing the dedicated workqueue it runs on would wait
+ * for its own thread.  So simply run the queue by hand rather than
+ * deadlocking, setting the work item being executed aside meanwhile.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.
+ */
+static void run_workqueue(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	struct work_struct *work = worker->current_work;
+	struct cpu_workqueue_struct *cwq = worker->current_cwq;
+	int color = worker->current_color;
+	LIST_HEAD(scheduled);
+
+	hlist_del_init(&worker->hentry);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	list_splice_init(&worker->scheduled, &scheduled);
+
+	while (!list_empty(&gcwq->worklist))
+		process_next_work(worker);
+
+	list_splice(&scheduled, &worker->scheduled);
+	worker->current_color = color;
+	worker->current_cwq = cwq;
+	worker->current_work = work;
+	hlist_add_head(&worker->hentry, busy_worker_head(gcwq, work));
 }
 
 struct wq_barrier {
@@ -355,44 +1438,55 @@ static void wq_barrier_func(struct work_struct *work)
 	complete(&barr->done);
 }
 
+/**
+ * insert_wq_barrier - insert a barrier work
+ * @cwq: cwq to insert barrier into
+ * @barr: wq_barrier to insert
+ * @target: target work to attach @barr to
+ * @worker: worker currently executing @target, NULL if @target is not executing
+ *
+ * @barr is linked to @target such that @barr is completed only after
+ * @target finishes execution.  Please note that the ordering
+ * guarantee is observed only with respect to @target and on the local
+ * cpu.
+ *
+ * Currently, a queued barrier can't be canceled.  This is because
+ * try_to_grab_pending() can't determine whether the work to be
+ * grabbed is at the head of the queue and thus can't clear LINKED
+ * flag of the previous work while there must be a valid next work
+ * after a work with LINKED flag set.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
 static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
-			struct wq_barrier *barr, struct list_head *head)
+			      struct wq_barrier *barr,
+			      struct work_struct *target, struct worker *worker)
 {
+	struct list_head *head;
+	unsigned int linked = 0;
+
 	INIT_WORK(&barr->work, wq_barrier_func);
 	__set_bit(WORK_STRUCT_PENDING, work_data_bits(&barr->work));
-
 	init_completion(&barr->done);
 
-	insert_work(cwq, &barr->work, head);
-}
-
-static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
-{
-	int active;
-
-	if (cwq->thread == current) {
-		/*
-		 * Probably keventd trying to flush its own queue. So simply run
-		 * it by hand rather than deadlocking.
-		 */
-		run_workqueue(cwq);
-		active = 1;
-	} else {
-		struct wq_barrier barr;
-
-		active = 0;
-		spin_lock_irq(&cwq->lock);
-		if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
-			insert_wq_barrier(cwq, &barr, &cwq->worklist);
-			active = 1;
-		}
-		spin_unlock_irq(&cwq->lock);
-
-		if (active)
-			wait_for_completion(&barr.done);
+	/*
+	 * If @target is currently being executed, schedule the
+	 * barrier to the worker; otherwise, put it after @target.
+	 */
+	if (worker)
+		head = worker->scheduled.next;
+	else {
+		unsigned long *bits = work_data_bits(target);
+
+		head = target->entry.next;
+		/* there can already be other linked works, inherit and set */
+		linked = *bits & (1UL << WORK_STRUCT_LINKED);
+		__set_bit(WORK_STRUCT_LINKED, bits);
 	}
 
-	return active;
+	insert_work(cwq, &barr->work, head,
+		    work_color_to_flags(WORK_NO_COLOR) | linked);
 }
 
 /**
@@ -403,21 +1497,57 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
  * This is typically used in driver shutdown handlers.
  *
  * We sleep until all works which were queued on entry have been handled,
- * but we are not livelocked by new incoming ones.
+ * but we are not livelocked by new incoming ones.  A work item of @wq
+ * may flush @wq, it only waits for the others.
  *
- * This function used to run the workqueues itself.  Now we just wait for the
- * helper threads to do it.
+ * Works queued from now on are given the other flush color, and the
+ * last work of the flushed color completing on any cpu wakes us up.
  */
 void flush_workqueue(struct workqueue_struct *wq)
 {
-	const struct cpumask *cpu_map = wq_cpu_map(wq);
+	struct worker *worker = current_wq_worker();
 	int cpu;
 
 	might_sleep();
 	lock_map_acquire(&wq->lockdep_map);
 	lock_map_release(&wq->lockdep_map);
-	for_each_cpu_mask_nr(cpu, *cpu_map)
-		flush_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, cpu));
+
+	if (worker && worker->current_cwq && worker->current_cwq->wq == wq) {
+		struct global_cwq *gcwq = worker->gcwq;
+
+		spin_lock_irq(&gcwq->lock);
+		/* don't wait for ourselves */
+		cwq_dec_nr_in_flight(worker->current_cwq,
+				     worker->current_color, false);
+		worker->current_color = WORK_NO_COLOR;
+		if (gcwq->flags & GCWQ_PRIVATE)
+			run_workqueue(worker);
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	mutex_lock(&wq->flush_mutex);
+
+	atomic_set(&wq->nr_cwqs_to_flush, 1);
+	INIT_COMPLETION(wq->flush_done);
+
+	for_each_cpu_mask_nr(cpu, *wq_cpu_map(wq)) {
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		struct global_cwq *gcwq = cwq->gcwq;
+
+		spin_lock_irq(&gcwq->lock);
+		BUG_ON(cwq->flush_color != -1);
+		if (cwq->nr_in_flight[cwq->work_color]) {
+			cwq->flush_color = cwq->work_color;
+			atomic_inc(&wq->nr_cwqs_to_flush);
+		}
+		cwq->work_color = work_next_color(cwq->work_color);
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	if (!atomic_dec_and_test(&wq->nr_cwqs_to_flush))
+		wait_for_completion(&wq->flush_done);
+
+	mutex_unlock(&wq->flush_mutex);
 }
 EXPORT_SYMBOL_GPL(flush_workqueue);
 
@@ -433,20 +1563,21 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
  */
 int flush_work(struct work_struct *work)
 {
+	struct worker *worker = NULL;
 	struct cpu_workqueue_struct *cwq;
-	struct list_head *prev;
+	struct global_cwq *gcwq;
 	struct wq_barrier barr;
 
 	might_sleep();
 	cwq = get_wq_data(work);
 	if (!cwq)
 		return 0;
+	gcwq = cwq->gcwq;
 
 	lock_map_acquire(&cwq->wq->lockdep_map);
 	lock_map_release(&cwq->wq->lockdep_map);
 
-	prev = NULL;
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
@@ -454,21 +1585,21 @@ int flush_work(struct work_struct *work)
 		 */
 		smp_rmb();
 		if (unlikely(cwq != get_wq_data(work)))
-			goto out;
-		prev = &work->entry;
+			goto already_gone;
 	} else {
-		if (cwq->current_work != work)
-			goto out;
-		prev = &cwq->worklist;
+		worker = find_worker_executing_work(gcwq, work);
+		if (!worker)
+			goto already_gone;
+		cwq = worker->current_cwq;
 	}
-	insert_wq_barrier(cwq, &barr, prev->next);
-out:
-	spin_unlock_irq(&cwq->lock);
-	if (!prev)
-		return 0;
 
+	insert_wq_barrier(cwq, &barr, work, worker);
+	spin_unlock_irq(&gcwq->lock);
 	wait_for_completion(&barr.done);
 	return 1;
+already_gone:
+	spin_unlock_irq(&gcwq->lock);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(flush_work);
 
@@ -479,6 +1610,7 @@ EXPORT_SYMBOL_GPL(flush_work);
 static int try_to_grab_pending(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq;
+	struct global_cwq *gcwq;
 	int ret = -1;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work)))
@@ -492,8 +1624,9 @@ static int try_to_grab_pending(struct work_struct *work)
 	cwq = get_wq_data(work);
 	if (!cwq)
 		return ret;
+	gcwq = cwq->gcwq;
 
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * This work is queued, but perhaps we locked the wrong cwq.
@@ -502,29 +1635,40 @@ static int try_to_grab_pending(struct work_struct *work)
 		 */
 		smp_rmb();
 		if (cwq == get_wq_data(work)) {
+			unsigned long bits = *work_data_bits(work);
+			bool delayed = bits & (1UL << WORK_STRUCT_DELAYED);
+
+			/*
+			 * Barriers linked to a delayed work must not wait
+			 * on the delayed list without it.
+			 */
+			if (delayed && (bits & (1UL << WORK_STRUCT_LINKED)))
+				move_linked_works(list_entry(work->entry.next,
+						struct work_struct, entry),
+						&gcwq->worklist);
 			list_del_init(&work->entry);
+			cwq_dec_nr_in_flight(cwq, get_work_color(work),
+					     delayed);
 			ret = 1;
 		}
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 
 	return ret;
 }
 
-static void wait_on_cpu_work(struct cpu_workqueue_struct *cwq,
-				struct work_struct *work)
+static void wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 {
 	struct wq_barrier barr;
-	int running = 0;
+	struct worker *worker;
 
-	spin_lock_irq(&cwq->lock);
-	if (unlikely(cwq->current_work == work)) {
-		insert_wq_barrier(cwq, &barr, cwq->worklist.next);
-		running = 1;
-	}
-	spin_unlock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
+	worker = find_worker_executing_work(gcwq, work);
+	if (unlikely(worker))
+		insert_wq_barrier(worker->current_cwq, &barr, work, worker);
+	spin_unlock_irq(&gcwq->lock);
 
-	if (unlikely(running))
+	if (unlikely(worker))
 		wait_for_completion(&barr.done);
 }
 
@@ -548,7 +1692,7 @@ static void wait_on_work(struct work_struct *work)
 	cpu_map = wq_cpu_map(wq);
 
 	for_each_cpu_mask_nr(cpu, *cpu_map)
-		wait_on_cpu_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
+		wait_on_cpu_work(get_cwq(cpu, wq)->gcwq, work);
 }
 
 static int __cancel_work_timer(struct work_struct *work,
@@ -738,163 +1882,182 @@ int keventd_up(void)
 
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = raw_smp_processor_id(); /* preempt-safe: keventd is per-cpu */
-	int ret = 0;
+	struct worker *worker = current_wq_worker();
 
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
-
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == keventd_wq;
 }
 
-static struct cpu_workqueue_struct *
-init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
+static void init_gcwq(struct global_cwq *gcwq, unsigned int cpu,
+		      unsigned int flags)
 {
-	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+	int i;
+
+	spin_lock_init(&gcwq->lock);
+	INIT_LIST_HEAD(&gcwq->worklist);
+	gcwq->cpu = cpu;
+	gcwq->flags = flags;
+	atomic_set(&gcwq->nr_running, 0);
+
+	INIT_LIST_HEAD(&gcwq->idle_list);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+	INIT_LIST_HEAD(&gcwq->workers);
 
-	cwq->wq = wq;
-	spin_lock_init(&cwq->lock);
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
+	init_timer_deferrable(&gcwq->idle_timer);
+	gcwq->idle_timer.function = idle_worker_timeout;
+	gcwq->idle_timer.data = (unsigned long)gcwq;
+	init_waitqueue_head(&gcwq->idle_wait);
 
-	return cwq;
+	ida_init(&gcwq->worker_ida);
 }
 
-static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+/* Start the first worker of a gcwq, while there's nobody to queue on it. */
+static int gcwq_start_first_worker(struct global_cwq *gcwq)
 {
-	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
-	struct workqueue_struct *wq = cwq->wq;
-	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
-	struct task_struct *p;
+	struct worker *worker;
 
-	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
-	/*
-	 * Nobody can add the work_struct to this cwq,
-	 *	if (caller is __create_workqueue)
-	 *		nobody should see this wq
-	 *	else // caller is CPU_UP_PREPARE
-	 *		cpu is not on cpu_online_map
-	 * so we can abort safely.
-	 */
-	if (IS_ERR(p))
-		return PTR_ERR(p);
-	if (cwq->wq->rt)
-		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
-	cwq->thread = p;
+	worker = create_worker(gcwq);
+	if (!worker)
+		return -ENOMEM;
 
+	spin_lock_irq(&gcwq->lock);
+	if (!(gcwq->flags & GCWQ_UNBOUND))
+		gcwq->flags &= ~GCWQ_DISASSOCIATED;
+	start_worker(worker);
+	spin_unlock_irq(&gcwq->lock);
 	return 0;
 }
 
-static void start_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+static bool gcwq_drained(struct global_cwq *gcwq)
 {
-	struct task_struct *p = cwq->thread;
+	return list_empty(&gcwq->worklist) &&
+		gcwq->nr_idle == gcwq->nr_workers &&
+		!(gcwq->flags & GCWQ_MANAGING_WORKERS);
+}
 
-	if (p != NULL) {
-		if (cpu >= 0)
-			kthread_bind(p, cpu);
-		wake_up_process(p);
+/*
+ * Wait for the works on @gcwq to be done and destroy its workers.  The
+ * caller must make sure that nothing is queued on @gcwq anymore.
+ */
+static void gcwq_destroy_workers(struct global_cwq *gcwq)
+{
+	spin_lock_irq(&gcwq->lock);
+	while (gcwq->nr_workers) {
+		if (!gcwq_drained(gcwq)) {
+			spin_unlock_irq(&gcwq->lock);
+			wait_event(gcwq->idle_wait, gcwq_drained(gcwq));
+			spin_lock_irq(&gcwq->lock);
+			continue;
+		}
+		destroy_worker(first_worker(gcwq));
 	}
+	spin_unlock_irq(&gcwq->lock);
+
+	del_timer_sync(&gcwq->idle_timer);
 }
 
 struct workqueue_struct *__create_workqueue_key(const char *name,
-						int singlethread,
-						int freezeable,
-						int rt,
+						unsigned int flags,
+						int max_active,
 						struct lock_class_key *key,
 						const char *lock_name)
 {
+	size_t align = __alignof__(struct cpu_workqueue_struct);
 	struct workqueue_struct *wq;
-	struct cpu_workqueue_struct *cwq;
-	int err = 0, cpu;
+	int nr_cwqs, err = 0, cpu;
+
+	if (flags & (WQ_FREEZEABLE | WQ_RT))
+		flags |= WQ_DEDICATED;
+	/* a dedicated workqueue's single thread serializes anyway */
+	if (flags & WQ_DEDICATED)
+		max_active = INT_MAX;
+	max_active = max(max_active, 1);
 
 	wq = kzalloc(sizeof(*wq), GFP_KERNEL);
 	if (!wq)
 		return NULL;
 
-	wq->cpu_wq = alloc_percpu(struct cpu_workqueue_struct);
-	if (!wq->cpu_wq) {
-		kfree(wq);
-		return NULL;
+	wq->flags = flags;
+	nr_cwqs = is_wq_single_threaded(wq) ? 1 : nr_cpu_ids;
+
+	/* kmalloc doesn't align to WORK_STRUCT_FLAG_BITS, do it by hand */
+	wq->cpu_wq_mem = kzalloc(nr_cwqs * sizeof(struct cpu_workqueue_struct) +
+				 align - 1, GFP_KERNEL);
+	if (!wq->cpu_wq_mem)
+		goto err;
+	wq->cpu_wq = PTR_ALIGN(wq->cpu_wq_mem, align);
+
+	if (flags & WQ_DEDICATED) {
+		wq->private_gcwq = kcalloc(nr_cwqs, sizeof(struct global_cwq),
+					   GFP_KERNEL);
+		if (!wq->private_gcwq)
+			goto err;
 	}
 
 	wq->name = name;
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
-	wq->singlethread = singlethread;
-	wq->freezeable = freezeable;
-	wq->rt = rt;
+	mutex_init(&wq->flush_mutex);
+	atomic_set(&wq->nr_cwqs_to_flush, 0);
+	init_completion(&wq->flush_done);
 	INIT_LIST_HEAD(&wq->list);
 
-	if (singlethread) {
-		cwq = init_cpu_workqueue(wq, singlethread_cpu);
-		err = create_workqueue_thread(cwq, singlethread_cpu);
-		start_workqueue_thread(cwq, -1);
-	} else {
-		cpu_maps_update_begin();
-		/*
-		 * We must place this wq on list even if the code below fails.
-		 * cpu_down(cpu) can remove cpu from cpu_populated_map before
-		 * destroy_workqueue() takes the lock, in that case we leak
-		 * cwq[cpu]->thread.
-		 */
-		spin_lock(&workqueue_lock);
-		list_add(&wq->list, &workqueues);
-		spin_unlock(&workqueue_lock);
-		/*
-		 * We must initialize cwqs for each possible cpu even if we
-		 * are going to call destroy_workqueue() finally. Otherwise
-		 * cpu_up() can hit the uninitialized cwq once we drop the
-		 * lock.
-		 */
-		for_each_possible_cpu(cpu) {
-			cwq = init_cpu_workqueue(wq, cpu);
-			if (err || !cpu_online(cpu))
+	for_each_cpu_mask_nr(cpu, *wq_cpu_map(wq)) {
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		struct global_cwq *gcwq;
+
+		if (flags & WQ_DEDICATED) {
+			gcwq = wq->private_gcwq + (cwq - wq->cpu_wq);
+			init_gcwq(gcwq, cpu, GCWQ_PRIVATE | GCWQ_DISASSOCIATED |
+				  (is_wq_single_threaded(wq) ? GCWQ_UNBOUND : 0));
+			gcwq->wq = wq;
+		} else if (is_wq_single_threaded(wq))
+			gcwq = &unbound_global_cwq;
+		else
+			gcwq = &per_cpu(global_cwq, cpu);
+
+		cwq->gcwq = gcwq;
+		cwq->wq = wq;
+		cwq->flush_color = -1;
+		cwq->max_active = max_active;
+		INIT_LIST_HEAD(&cwq->delayed_works);
+	}
+
+	cpu_maps_update_begin();
+	/*
+	 * We must place this wq on list even if the code below fails.
+	 * destroy_workqueue() takes it off again.
+	 */
+	spin_lock(&workqueue_lock);
+	list_add(&wq->list, &workqueues);
+	spin_unlock(&workqueue_lock);
+
+	if (flags & WQ_DEDICATED) {
+		for_each_cpu_mask_nr(cpu, *wq_cpu_map(wq)) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+			if (err || (!is_wq_single_threaded(wq) &&
+				    !cpu_online(cpu)))
 				continue;
-			err = create_workqueue_thread(cwq, cpu);
-			start_workqueue_thread(cwq, cpu);
+			err = gcwq_start_first_worker(cwq->gcwq);
 		}
-		cpu_maps_update_done();
 	}
+	cpu_maps_update_done();
 
 	if (err) {
 		destroy_workqueue(wq);
 		wq = NULL;
 	}
 	return wq;
+err:
+	kfree(wq->cpu_wq_mem);
+	kfree(wq);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
-static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
-{
-	/*
-	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
-	 * cpu_add_remove_lock protects cwq->thread.
-	 */
-	if (cwq->thread == NULL)
-		return;
-
-	lock_map_acquire(&cwq->wq->lockdep_map);
-	lock_map_release(&cwq->wq->lockdep_map);
-
-	flush_cpu_workqueue(cwq);
-	/*
-	 * If the caller is CPU_POST_DEAD and cwq->worklist was not empty,
-	 * a concurrent flush_workqueue() can insert a barrier after us.
-	 * However, in that case run_workqueue() won't return and check
-	 * kthread_should_stop() until it flushes all work_struct's.
-	 * When ->worklist becomes empty it is safe to exit because no
-	 * more work_structs can be queued on this cwq: flush_workqueue
-	 * checks list_empty(), and a "normal" queue_work() can't use
-	 * a dead CPU.
-	 */
-	kthread_stop(cwq->thread);
-	cwq->thread = NULL;
-}
-
 /**
  * destroy_workqueue - safely terminate a workqueue
  * @wq: target workqueue
@@ -904,67 +2067,149 @@ static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	const struct cpumask *cpu_map = wq_cpu_map(wq);
+	bool drained;
 	int cpu;
 
+	/* works may requeue themselves while we flush, repeat until idle */
+	do {
+		flush_workqueue(wq);
+
+		drained = true;
+		for_each_cpu_mask_nr(cpu, *cpu_map) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+			spin_lock_irq(&cwq->gcwq->lock);
+			if (cwq->nr_active || !list_empty(&cwq->delayed_works))
+				drained = false;
+			spin_unlock_irq(&cwq->gcwq->lock);
+		}
+	} while (!drained);
+
 	cpu_maps_update_begin();
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
 
-	for_each_cpu_mask_nr(cpu, *cpu_map)
-		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
- 	cpu_maps_update_done();
+	if (wq->flags & WQ_DEDICATED) {
+		for_each_cpu_mask_nr(cpu, *cpu_map) {
+			struct global_cwq *gcwq = get_cwq(cpu, wq)->gcwq;
 
-	free_percpu(wq->cpu_wq);
+			gcwq_destroy_workers(gcwq);
+			ida_destroy(&gcwq->worker_ida);
+		}
+	}
+	cpu_maps_update_done();
+
+	kfree(wq->private_gcwq);
+	kfree(wq->cpu_wq_mem);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+/*
+ * A pool of a cpu which goes down lets its workers run anywhere, lets
+ * them finish what was queued and destroys them at CPU_POST_DEAD.  When
+ * the cpu comes up, or fails to go down, the workers bind themselves
+ * again.  Private pools keep their thread bound until it is destroyed.
+ */
+static int gcwq_cpu_callback(struct global_cwq *gcwq, unsigned long action)
+{
+	struct worker *worker;
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+		BUG_ON(gcwq->first_worker);
+		worker = create_worker(gcwq);
+		if (!worker)
+			return -ENOMEM;
+		spin_lock_irq(&gcwq->lock);
+		gcwq->first_worker = worker;
+		spin_unlock_irq(&gcwq->lock);
+		break;
+
+	case CPU_DOWN_PREPARE:
+		if (gcwq->flags & GCWQ_PRIVATE)
+			break;
+		spin_lock_irq(&gcwq->lock);
+		gcwq->flags |= GCWQ_DISASSOCIATED;
+		list_for_each_entry(worker, &gcwq->workers, node)
+			worker->flags |= WORKER_UNBOUND;
+		spin_unlock_irq(&gcwq->lock);
+
+		/*
+		 * The scheduler hooks may still act on the old flags,
+		 * wait for them before nr_running stops mattering.
+		 */
+		synchronize_sched();
+
+		spin_lock_irq(&gcwq->lock);
+		if (need_more_worker(gcwq))
+			wake_up_worker(gcwq);
+		spin_unlock_irq(&gcwq->lock);
+		break;
+
+	case CPU_DOWN_FAILED:
+	case CPU_ONLINE:
+		spin_lock_irq(&gcwq->lock);
+		if (!(gcwq->flags & GCWQ_PRIVATE)) {
+			gcwq->flags &= ~GCWQ_DISASSOCIATED;
+			/* nobody is counted before binding itself again */
+			atomic_set(&gcwq->nr_running, 0);
+			list_for_each_entry(worker, &gcwq->workers, node)
+				worker->flags |= WORKER_REBIND;
+		}
+		if (gcwq->first_worker) {
+			start_worker(gcwq->first_worker);
+			gcwq->first_worker = NULL;
+		}
+		spin_unlock_irq(&gcwq->lock);
+		break;
+
+	case CPU_UP_CANCELED:
+		spin_lock_irq(&gcwq->lock);
+		worker = gcwq->first_worker;
+		gcwq->first_worker = NULL;
+		if (worker)
+			destroy_worker(worker);
+		spin_unlock_irq(&gcwq->lock);
+		break;
+
+	case CPU_POST_DEAD:
+		gcwq_destroy_workers(gcwq);
+		break;
+	}
+
+	return 0;
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
-	struct cpu_workqueue_struct *cwq;
 	struct workqueue_struct *wq;
 	int ret = NOTIFY_OK;
 
 	action &= ~CPU_TASKS_FROZEN;
 
-	switch (action) {
-	case CPU_UP_PREPARE:
-		cpumask_set_cpu(cpu, cpu_populated_map);
-	}
 undo:
-	list_for_each_entry(wq, &workqueues, list) {
-		cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-
-		switch (action) {
-		case CPU_UP_PREPARE:
-			if (!create_workqueue_thread(cwq, cpu))
-				break;
-			printk(KERN_ERR "workqueue [%s] for %i failed\n",
-				wq->name, cpu);
-			action = CPU_UP_CANCELED;
-			ret = NOTIFY_BAD;
-			goto undo;
-
-		case CPU_ONLINE:
-			start_workqueue_thread(cwq, cpu);
-			break;
-
-		case CPU_UP_CANCELED:
-			start_workqueue_thread(cwq, -1);
-		case CPU_POST_DEAD:
-			cleanup_workqueue_thread(cwq);
-			break;
-		}
+	if (gcwq_cpu_callback(&per_cpu(global_cwq, cpu), action)) {
+		printk(KERN_ERR "workqueue: worker for %i failed\n", cpu);
+		action = CPU_UP_CANCELED;
+		ret = NOTIFY_BAD;
+		goto undo;
 	}
 
-	switch (action) {
-	case CPU_UP_CANCELED:
-	case CPU_POST_DEAD:
-		cpumask_clear_cpu(cpu, cpu_populated_map);
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_DEDICATED) || is_wq_single_threaded(wq))
+			continue;
+		if (!gcwq_cpu_callback(get_cwq(cpu, wq)->gcwq, action))
+			continue;
+		printk(KERN_ERR "workqueue [%s] for %i failed\n",
+			wq->name, cpu);
+		action = CPU_UP_CANCELED;
+		ret = NOTIFY_BAD;
+		goto undo;
 	}
 
 	return ret;
@@ -1013,13 +2258,22 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
 
 void __init init_workqueues(void)
 {
-	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
+	int cpu;
 
-	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+
+	for_each_possible_cpu(cpu)
+		init_gcwq(&per_cpu(global_cwq, cpu), cpu, GCWQ_DISASSOCIATED);
+	init_gcwq(&unbound_global_cwq, singlethread_cpu,
+		  GCWQ_DISASSOCIATED | GCWQ_UNBOUND);
+
+	for_each_online_cpu(cpu)
+		BUG_ON(gcwq_start_first_worker(&per_cpu(global_cwq, cpu)));
+	BUG_ON(gcwq_start_first_worker(&unbound_global_cwq));
+
 	hotcpu_notifier(workqueue_cpu_callback, 0);
-	keventd_wq = create_workqueue("events");
+	keventd_wq = __create_workqueue("events", 0, WQ_DFL_ACTIVE);
 	BUG_ON(!keventd_wq);
 #ifdef CONFIG_SMP
 	work_on_cpu_wq = create_workqueue("work_on_cpu");
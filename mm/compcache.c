@@ -0,0 +1,392 @@
+/*
+ * mm/compcache.c
+ *
+ * Compressed cache for anonymous pages, for systems without swap.
+ *
+ * At boot a swap area without any backing store is added.  Reclaim then
+ * evicts anonymous pages to it as it would to any swap area: the pages
+ * get a swap entry and go through the swap cache, but swap_writepage()
+ * hands them to compcache_writepage(), which compresses them with LZO
+ * into a pool of kmalloc()ed memory, and on a fault swap_readpage()
+ * gets them back from compcache_readpage().  Nothing ever does I/O.
+ *
+ * The pool is bounded by a percentage of RAM; pages which do not fit or
+ * do not compress to at most 3/4 of a page are kept in memory and put
+ * back on the active list.
+ *
+ * Decompression is exclusive: the compressed copy is freed as soon as a
+ * page has been read back, and the page is dirtied so that it gets
+ * compressed again if it is evicted again.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation.
+ */
+
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/writeback.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/lzo.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+
+/*
+ * Priority of the compcache swap area, above the default priority of
+ * swapon(8), so that a real swap device is only used once it is full.
+ */
+#define COMPCACHE_PRIO		100
+
+/* Swap slots per page of pool: compressed anonymous memory is about 1/3 */
+#define COMPCACHE_SLOTS_PER_PAGE	3
+
+/* Pages which compress worse than this are not worth keeping */
+#define COMPCACHE_MAX_SIZE	(PAGE_SIZE * 3 / 4)
+
+struct compcache_slot {
+	void *data;
+	unsigned short len;
+};
+
+/* Pool size limit, in percent of RAM; 0 disables the compressed cache */
+static unsigned int compcache_percent = 25;
+
+/*
+ * compcache_lock protects the slots and the statistics below.  It nests
+ * inside swap_lock, as the slots are freed from swap_entry_free().
+ */
+static DEFINE_SPINLOCK(compcache_lock);
+static struct compcache_slot *compcache_slots;
+static unsigned long compcache_nr_slots;
+static unsigned long compcache_pool_bytes;
+static unsigned long compcache_stored_pages;
+static unsigned long compcache_compr_bytes;
+static unsigned long compcache_rejected_pages;
+
+/* LZO work memory and output buffer, per cpu */
+static DEFINE_PER_CPU(void *, compcache_workmem);
+static DEFINE_PER_CPU(unsigned char *, compcache_buffer);
+
+static inline unsigned long compcache_pool_limit(void)
+{
+	return (totalram_pages / 100 * compcache_percent) << PAGE_SHIFT;
+}
+
+/*
+ * Install data as the compressed copy of slot offset, freeing whatever
+ * was there before.  Returns 0, or -ENOSPC if the pool is full.
+ */
+static int compcache_store(pgoff_t offset, void *data, size_t len)
+{
+	struct compcache_slot *slot = &compcache_slots[offset];
+	void *old;
+
+	spin_lock(&compcache_lock);
+	old = slot->data;
+	if (old) {
+		compcache_pool_bytes -= ksize(old);
+		compcache_compr_bytes -= slot->len;
+		compcache_stored_pages--;
+		slot->data = NULL;
+	}
+	if (compcache_pool_bytes + ksize(data) > compcache_pool_limit()) {
+		spin_unlock(&compcache_lock);
+		kfree(old);
+		return -ENOSPC;
+	}
+	slot->data = data;
+	slot->len = len;
+	compcache_pool_bytes += ksize(data);
+	compcache_compr_bytes += len;
+	compcache_stored_pages++;
+	spin_unlock(&compcache_lock);
+
+	kfree(old);
+	return 0;
+}
+
+/*
+ * Take the compressed copy of slot offset out of the cache, the caller
+ * has to free it.  Returns NULL if there is none.
+ */
+static void *compcache_take(pgoff_t offset, size_t *len)
+{
+	struct compcache_slot *slot = &compcache_slots[offset];
+	void *data;
+
+	spin_lock(&compcache_lock);
+	data = slot->data;
+	if (data) {
+		*len = slot->len;
+		compcache_pool_bytes -= ksize(data);
+		compcache_compr_bytes -= slot->len;
+		compcache_stored_pages--;
+		slot->data = NULL;
+	}
+	spin_unlock(&compcache_lock);
+
+	return data;
+}
+
+/**
+ * compcache_writepage - evict a swap cache page into the compressed cache
+ * @page: locked swap cache page of the compcache swap area
+ * @wbc: writeback control
+ *
+ * Called from swap_writepage().  Like a write that completes at once,
+ * but if the page can't be stored it is redirtied, and reclaim is told
+ * to activate it rather than try again right away.
+ */
+int compcache_writepage(struct page *page, struct writeback_control *wbc)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	unsigned char *buffer, *src;
+	void *workmem, *data = NULL;
+	size_t len;
+	int cpu, ret;
+
+	cpu = get_cpu();
+	workmem = per_cpu(compcache_workmem, cpu);
+	buffer = per_cpu(compcache_buffer, cpu);
+
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, buffer, &len, workmem);
+	kunmap_atomic(src, KM_USER0);
+
+	/*
+	 * This runs from reclaim: don't wait for memory, but dip into the
+	 * reserves (GFP_ATOMIC has __GFP_HIGH), as storing the page frees
+	 * more than it takes.
+	 */
+	if (ret == LZO_E_OK && len <= COMPCACHE_MAX_SIZE) {
+		data = kmalloc(len, GFP_ATOMIC | __GFP_NOWARN);
+		if (data)
+			memcpy(data, buffer, len);
+	}
+	put_cpu();
+
+	if (!data || compcache_store(swp_offset(entry), data, len)) {
+		kfree(data);
+		spin_lock(&compcache_lock);
+		compcache_rejected_pages++;
+		spin_unlock(&compcache_lock);
+
+		set_page_dirty(page);
+		if (wbc->for_reclaim)
+			return AOP_WRITEPAGE_ACTIVATE;	/* Return with page locked */
+		unlock_page(page);
+		return 0;
+	}
+
+	count_vm_event(PSWPOUT);
+	set_page_writeback(page);
+	unlock_page(page);
+	end_page_writeback(page);
+	return 0;
+}
+
+/**
+ * compcache_readpage - read a page back from the compressed cache
+ * @page: locked swap cache page of the compcache swap area
+ *
+ * Called from swap_readpage().  The compressed copy is freed, and the
+ * page dirtied so that it is stored again when it is evicted again.
+ */
+int compcache_readpage(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	unsigned char *dst;
+	size_t len, dlen = PAGE_SIZE;
+	void *data;
+	int ret;
+
+	data = compcache_take(swp_offset(entry), &len);
+	if (unlikely(!data)) {
+		printk(KERN_ALERT "compcache: no data for swap entry %08lx\n",
+		       entry.val);
+		SetPageError(page);
+		unlock_page(page);
+		return -EIO;
+	}
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(data, len, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(data);
+
+	if (unlikely(ret != LZO_E_OK || dlen != PAGE_SIZE)) {
+		printk(KERN_ALERT "compcache: decompression failed for swap "
+		       "entry %08lx: %d\n", entry.val, ret);
+		SetPageError(page);
+		unlock_page(page);
+		return -EIO;
+	}
+
+	count_vm_event(PSWPIN);
+	SetPageUptodate(page);
+	/* the only copy now: the swap cache page is locked, no radix tag */
+	SetPageDirty(page);
+	unlock_page(page);
+	return 0;
+}
+
+/*
+ * Called from swap_entry_free() under swap_lock, when the last reference
+ * to a slot of the compcache swap area is dropped.
+ */
+void compcache_free(pgoff_t offset)
+{
+	size_t len;
+
+	kfree(compcache_take(offset, &len));
+}
+
+static int __init compcache_setup(char *str)
+{
+	compcache_percent = simple_strtoul(str, NULL, 0);
+	if (compcache_percent > 100)
+		compcache_percent = 100;
+	return 1;
+}
+__setup("compcache=", compcache_setup);
+
+#ifdef CONFIG_SYSFS
+#define COMPCACHE_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+#define COMPCACHE_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+static ssize_t pool_percent_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", compcache_percent);
+}
+
+/*
+ * The number of slots was sized at boot, the pool limit can change: a
+ * lower limit applies to the pages stored from now on.
+ */
+static ssize_t pool_percent_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	unsigned long percent;
+	int err;
+
+	err = strict_strtoul(buf, 10, &percent);
+	if (err || percent > 100)
+		return -EINVAL;
+
+	compcache_percent = percent;
+
+	return count;
+}
+COMPCACHE_ATTR(pool_percent);
+
+static ssize_t pool_bytes_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", compcache_pool_bytes);
+}
+COMPCACHE_ATTR_RO(pool_bytes);
+
+static ssize_t compr_bytes_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", compcache_compr_bytes);
+}
+COMPCACHE_ATTR_RO(compr_bytes);
+
+static ssize_t pages_stored_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", compcache_stored_pages);
+}
+COMPCACHE_ATTR_RO(pages_stored);
+
+static ssize_t pages_rejected_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", compcache_rejected_pages);
+}
+COMPCACHE_ATTR_RO(pages_rejected);
+
+static struct attribute *compcache_attrs[] = {
+	&pool_percent_attr.attr,
+	&pool_bytes_attr.attr,
+	&compr_bytes_attr.attr,
+	&pages_stored_attr.attr,
+	&pages_rejected_attr.attr,
+	NULL,
+};
+
+static struct attribute_group compcache_attr_group = {
+	.attrs = compcache_attrs,
+	.name = "compcache",
+};
+#endif /* CONFIG_SYSFS */
+
+static void __init compcache_free_buffers(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(compcache_workmem, cpu));
+		kfree(per_cpu(compcache_buffer, cpu));
+	}
+}
+
+static int __init compcache_init(void)
+{
+	int cpu, type;
+
+	if (!compcache_percent)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(compcache_workmem, cpu) =
+			kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+		per_cpu(compcache_buffer, cpu) =
+			kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		if (!per_cpu(compcache_workmem, cpu) ||
+		    !per_cpu(compcache_buffer, cpu))
+			goto out_free;
+	}
+
+	compcache_nr_slots = (compcache_pool_limit() >> PAGE_SHIFT) *
+				COMPCACHE_SLOTS_PER_PAGE;
+	compcache_slots = vmalloc((compcache_nr_slots + 1) *
+				  sizeof(struct compcache_slot));
+	if (!compcache_slots)
+		goto out_free;
+	memset(compcache_slots, 0,
+	       (compcache_nr_slots + 1) * sizeof(struct compcache_slot));
+
+	type = swapon_compcache(compcache_nr_slots, COMPCACHE_PRIO);
+	if (type < 0) {
+		printk(KERN_ERR "compcache: adding swap area failed: %d\n",
+		       type);
+		vfree(compcache_slots);
+		goto out_free;
+	}
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &compcache_attr_group))
+		printk(KERN_ERR "compcache: register sysfs failed\n");
+#endif
+
+	return 0;
+
+out_free:
+	compcache_free_buffers();
+	compcache_percent = 0;
+	return -ENOMEM;
+}
+late_initcall(compcache_init);
@@ -0,0 +1,297 @@
+/*
+ * mm/mem_notify.c
+ *
+ * Memory pressure notification for user space.
+ *
+ * Reclaim reports how many pages it scanned and how many of those it
+ * managed to reclaim.  Over a window of scanned pages that ratio tells
+ * how hard reclaim is working; together with the number of free and file
+ * pages left it is turned into a pressure level, which processes can
+ * poll() for on /dev/mem_notify and shed their caches before the low
+ * memory killer has to step in.
+ *
+ * Raising the level takes effect at once.  Lowering it has to wait until
+ * the current level has been held for hold_ms, so that the level does
+ * not flap with every reclaim window, and a changed level is announced to
+ * pollers at most once every ratelimit_ms unless it became critical.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/jiffies.h>
+#include <linux/wait.h>
+#include <linux/mem_notify.h>
+
+/*
+ * Number of scanned pages over which the reclaim efficiency is sampled:
+ * 512 pages, 2MB with 4K pages.  Smaller windows are too noisy.
+ */
+#define MEM_NOTIFY_WINDOW	(SWAP_CLUSTER_MAX * 16)
+
+/* Reclaim efficiency thresholds, in percent of scanned pages not reclaimed */
+static unsigned int medium_ratio = 60;
+module_param(medium_ratio, uint, 0644);
+static unsigned int critical_ratio = 95;
+module_param(critical_ratio, uint, 0644);
+
+/*
+ * Free and file page thresholds: when both the free and the file pages
+ * are below one of them, the level is at least medium or critical.  This
+ * is the same test the low memory killer makes, so set them above its
+ * minfree levels.  Zero means a default derived from the memory size.
+ */
+static unsigned int medium_pages;
+module_param(medium_pages, uint, 0644);
+static unsigned int critical_pages;
+module_param(critical_pages, uint, 0644);
+
+static unsigned int hold_ms = 1000;
+module_param(hold_ms, uint, 0644);
+static unsigned int ratelimit_ms = 200;
+module_param(ratelimit_ms, uint, 0644);
+
+static const char *level_names[MEM_NOTIFY_NR_LEVELS] = {
+	[MEM_NOTIFY_NONE]	= "none",
+	[MEM_NOTIFY_LOW]	= "low",
+	[MEM_NOTIFY_MEDIUM]	= "medium",
+	[MEM_NOTIFY_CRITICAL]	= "critical",
+};
+
+/*
+ * mem_notify_lock protects all of the state below.  It is taken from
+ * reclaim, so it must never be held around anything that allocates.
+ */
+static DEFINE_SPINLOCK(mem_notify_lock);
+
+/* current reclaim window */
+static unsigned long win_scanned;
+static unsigned long win_reclaimed;
+
+/*
+ * The stamps below are compared as "jiffies - stamp", never with
+ * time_after(): they start out at 0, far from INITIAL_JIFFIES, and may
+ * go unchanged for longer than half the jiffies range.  Either way the
+ * elapsed time comes out large and the limit counts as passed.
+ */
+
+/* outcome of the last complete window */
+static enum mem_notify_level vmscan_level;
+static unsigned long vmscan_stamp;
+
+/* the level, when it was last changed, and what pollers have been told */
+static enum mem_notify_level level;
+static unsigned long level_stamp;
+static enum mem_notify_level reported_level;
+static unsigned long reported_stamp;
+static unsigned long event_seq;
+
+static DECLARE_WAIT_QUEUE_HEAD(mem_notify_wait);
+
+static void mem_notify_update(struct work_struct *work);
+static DECLARE_WORK(mem_notify_work, mem_notify_update);
+static DECLARE_DELAYED_WORK(mem_notify_recheck, mem_notify_update);
+
+static enum mem_notify_level vmscan_pressure(unsigned long scanned,
+					     unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	if (reclaimed >= scanned)
+		return MEM_NOTIFY_LOW;
+
+	pressure = (scanned - reclaimed) * 100 / scanned;
+	if (pressure >= critical_ratio)
+		return MEM_NOTIFY_CRITICAL;
+	if (pressure >= medium_ratio)
+		return MEM_NOTIFY_MEDIUM;
+	return MEM_NOTIFY_LOW;
+}
+
+static enum mem_notify_level page_pressure(void)
+{
+	unsigned long free = global_page_state(NR_FREE_PAGES);
+	unsigned long file = global_page_state(NR_FILE_PAGES);
+	unsigned long critical = critical_pages;
+	unsigned long medium = medium_pages;
+
+	if (!critical)
+		critical = totalram_pages / 16;
+	if (!medium)
+		medium = totalram_pages / 8;
+
+	if (free < critical && file < critical)
+		return MEM_NOTIFY_CRITICAL;
+	if (free < medium && file < medium)
+		return MEM_NOTIFY_MEDIUM;
+	return MEM_NOTIFY_NONE;
+}
+
+/*
+ * Work out the level from the last reclaim window and the page counts,
+ * apply the hysteresis and the rate limit, and wake up the pollers if
+ * the reported level changed.  As long as the level is not back to none
+ * this rearms itself, so that the level decays once reclaim stops.
+ */
+static void mem_notify_update(struct work_struct *work)
+{
+	unsigned long hold = msecs_to_jiffies(hold_ms);
+	unsigned long ratelimit = msecs_to_jiffies(ratelimit_ms);
+	enum mem_notify_level new_level, pages;
+	unsigned long now = jiffies;
+	unsigned long recheck = 0;
+	int wake = 0;
+
+	pages = page_pressure();
+
+	spin_lock(&mem_notify_lock);
+	new_level = MEM_NOTIFY_NONE;
+	if (vmscan_level != MEM_NOTIFY_NONE && now - vmscan_stamp < hold)
+		new_level = vmscan_level;
+	else
+		vmscan_level = MEM_NOTIFY_NONE;
+	if (pages > new_level)
+		new_level = pages;
+
+	if (new_level > level ||
+	    (new_level < level && now - level_stamp >= hold)) {
+		level = new_level;
+		level_stamp = now;
+	}
+
+	if (level != reported_level) {
+		if ((level == MEM_NOTIFY_CRITICAL && level > reported_level) ||
+		    now - reported_stamp >= ratelimit) {
+			reported_level = level;
+			reported_stamp = now;
+			event_seq++;
+			wake = 1;
+		} else {
+			recheck = ratelimit - (now - reported_stamp);
+		}
+	}
+	if (level != MEM_NOTIFY_NONE && !recheck)
+		recheck = hold;
+	spin_unlock(&mem_notify_lock);
+
+	if (wake)
+		wake_up_interruptible(&mem_notify_wait);
+	if (recheck)
+		schedule_delayed_work(&mem_notify_recheck, recheck);
+}
+
+/**
+ * mem_notify_vmscan - account a round of page reclaim
+ * @scanned: pages scanned off the inactive list
+ * @reclaimed: pages of those that were reclaimed
+ *
+ * Called by reclaim of the global LRU lists.  Every MEM_NOTIFY_WINDOW
+ * scanned pages the reclaim efficiency is turned into a level and the
+ * notification state is updated, from process context.
+ */
+void mem_notify_vmscan(unsigned long scanned, unsigned long reclaimed)
+{
+	enum mem_notify_level new_level;
+
+	if (!scanned)
+		return;
+
+	spin_lock(&mem_notify_lock);
+	win_scanned += scanned;
+	win_reclaimed += reclaimed;
+	if (win_scanned < MEM_NOTIFY_WINDOW) {
+		spin_unlock(&mem_notify_lock);
+		return;
+	}
+	new_level = vmscan_pressure(win_scanned, win_reclaimed);
+	win_scanned = 0;
+	win_reclaimed = 0;
+	/*
+	 * Windows can complete faster than the update runs: within a tenth
+	 * of a second keep the worst one, so a bad window is not hidden.
+	 */
+	if (new_level > vmscan_level || jiffies - vmscan_stamp >= HZ / 10)
+		vmscan_level = new_level;
+	vmscan_stamp = jiffies;
+	spin_unlock(&mem_notify_lock);
+
+	schedule_work(&mem_notify_work);
+}
+
+/*
+ * A read returns the reported level as a line of text and marks it as
+ * seen by this file; poll() then waits until it changes again.  Read
+ * from offset 0 (pread, or lseek first) to get the new level.
+ */
+static ssize_t mem_notify_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	enum mem_notify_level cur;
+	unsigned long seq;
+	char kbuf[16];
+	int len;
+
+	spin_lock(&mem_notify_lock);
+	cur = reported_level;
+	seq = event_seq;
+	spin_unlock(&mem_notify_lock);
+
+	if (*ppos == 0)
+		file->private_data = (void *)seq;
+
+	len = snprintf(kbuf, sizeof(kbuf), "%s\n", level_names[cur]);
+	return simple_read_from_buffer(buf, count, ppos, kbuf, len);
+}
+
+static unsigned int mem_notify_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &mem_notify_wait, wait);
+
+	if ((unsigned long)file->private_data != event_seq)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static int mem_notify_open(struct inode *inode, struct file *file)
+{
+	/* a new opener has not seen anything yet */
+	file->private_data = (void *)(event_seq - 1);
+	return 0;
+}
+
+static const struct file_operations mem_notify_fops = {
+	.owner		= THIS_MODULE,
+	.open		= mem_notify_open,
+	.read		= mem_notify_read,
+	.poll		= mem_notify_poll,
+	.llseek		= generic_file_llseek,
+};
+
+static struct miscdevice mem_notify_misc = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "mem_notify",
+	.fops		= &mem_notify_fops,
+};
+
+static int __init mem_notify_init(void)
+{
+	int ret;
+
+	ret = misc_register(&mem_notify_misc);
+	if (unlikely(ret)) {
+		printk(KERN_ERR "mem_notify: failed to register misc device!\n");
+		return ret;
+	}
+
+	return 0;
+}
+module_init(mem_notify_init);
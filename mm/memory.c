@@ -55,6 +55,7 @@
 #include <linux/kallsyms.h>
 #include <linux/swapops.h>
 #include <linux/elf.h>
+#include <linux/ksm.h>
 
 #include <asm/pgalloc.h>
 #include <asm/uaccess.h>
@@ -1912,9 +1913,10 @@ static int do_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	/*
 	 * Take out anonymous pages first, anonymous shared vmas are
-	 * not dirty accountable.
+	 * not dirty accountable.  KSM pages are always copied: other
+	 * mms may map them, and the stable tree relies on their content.
 	 */
-	if (PageAnon(old_page)) {
+	if (PageAnon(old_page) && !PageKsm(old_page)) {
 		if (!trylock_page(old_page)) {
 			page_cache_get(old_page);
 			pte_unmap_unlock(page_table, ptl);
@@ -44,6 +44,16 @@ static struct bio *get_swap_bio(gfp_t gfp_flags, pgoff_t index,
 	return bio;
 }
 
+/*
+ * Pages of a swap area without backing store go to the compressed cache.
+ */
+static inline int swap_is_compcache(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+
+	return get_swap_info_struct(swp_type(entry))->flags & SWP_COMPCACHE;
+}
+
 static void end_swap_bio_write(struct bio *bio, int err)
 {
 	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
@@ -102,6 +112,10 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		unlock_page(page);
 		goto out;
 	}
+	if (swap_is_compcache(page)) {
+		ret = compcache_writepage(page, wbc);
+		goto out;
+	}
 	bio = get_swap_bio(GFP_NOIO, page_private(page), page,
 				end_swap_bio_write);
 	if (bio == NULL) {
@@ -127,6 +141,10 @@ int swap_readpage(struct file *file, struct page *page)
 
 	VM_BUG_ON(!PageLocked(page));
 	VM_BUG_ON(PageUptodate(page));
+	if (swap_is_compcache(page)) {
+		ret = compcache_readpage(page);
+		goto out;
+	}
 	bio = get_swap_bio(GFP_KERNEL, page_private(page), page,
 				end_swap_bio_read);
 	if (bio == NULL) {
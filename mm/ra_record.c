@@ -0,0 +1,509 @@
+/*
+ * mm/ra_record.c
+ *
+ * Readahead recording and replay.
+ *
+ * Boot and application launch read the same ranges of the same files in
+ * the same order every time, mostly in small synchronous reads.  While
+ * recording, every range readahead has to read from disk is logged.
+ * /proc/readahead/record then lists the ranges per file, sorted and
+ * merged, and writing that list to /proc/readahead/replay on the next
+ * boot or launch reads it all in with a few large readahead requests,
+ * ahead of the reads that need it.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/namei.h>
+#include <linux/path.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/hash.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/ra_record.h>
+
+/* Number of ranges that can be recorded in one window */
+#define RA_RECORD_MAX		16384
+
+/* Ranges closer than this many pages are merged into one */
+#define RA_RECORD_GAP		8
+
+#define RA_RECORD_HASH_BITS	8
+#define RA_RECORD_HASH_SIZE	(1 << RA_RECORD_HASH_BITS)
+
+struct ra_record_file {
+	struct hlist_node hash;
+	struct address_space *mapping;
+	struct path path;		/* pinned while recording */
+	char *name;			/* path, once recording stopped */
+	unsigned int index;		/* order of first access */
+	struct ra_record_file *next;
+};
+
+struct ra_record_range {
+	struct ra_record_file *file;
+	pgoff_t start;
+	unsigned long nr;
+};
+
+int ra_recording;
+
+/*
+ * ra_record_lock protects the recording while ra_recording is set, and
+ * the transitions of ra_recording.  Everything else, and the recorded
+ * data while not recording, is protected by ra_record_mutex.
+ */
+static DEFINE_SPINLOCK(ra_record_lock);
+static DEFINE_MUTEX(ra_record_mutex);
+
+static struct hlist_head ra_record_hash[RA_RECORD_HASH_SIZE];
+static struct ra_record_file *ra_record_files;
+static unsigned int ra_record_nr_files;
+static struct ra_record_range *ra_record_ranges;
+static unsigned int ra_record_nr_ranges;
+static unsigned long ra_record_dropped;
+
+static struct ra_record_file *ra_record_lookup(struct file *filp)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct ra_record_file *file;
+
+	head = &ra_record_hash[hash_ptr(mapping, RA_RECORD_HASH_BITS)];
+	hlist_for_each_entry(file, node, head, hash)
+		if (file->mapping == mapping)
+			return file;
+
+	file = kmalloc(sizeof(*file), GFP_ATOMIC);
+	if (!file)
+		return NULL;
+	file->mapping = mapping;
+	file->path = filp->f_path;
+	path_get(&file->path);
+	file->name = NULL;
+	file->index = ra_record_nr_files++;
+	file->next = ra_record_files;
+	ra_record_files = file;
+	hlist_add_head(&file->hash, head);
+
+	return file;
+}
+
+void __ra_record(struct file *filp, pgoff_t start, unsigned long nr)
+{
+	struct ra_record_file *file;
+	struct ra_record_range *last;
+
+	if (!filp || !S_ISREG(filp->f_path.dentry->d_inode->i_mode) ||
+	    (filp->f_mode & FMODE_RA_REPLAY))
+		return;
+
+	spin_lock(&ra_record_lock);
+	if (!ra_recording)
+		goto out;
+
+	file = ra_record_lookup(filp);
+	if (!file) {
+		ra_record_dropped++;
+		goto out;
+	}
+
+	/* sequential reads just extend the last range */
+	if (ra_record_nr_ranges) {
+		last = &ra_record_ranges[ra_record_nr_ranges - 1];
+		if (last->file == file && start >= last->start &&
+		    start <= last->start + last->nr) {
+			if (start + nr > last->start + last->nr)
+				last->nr = start + nr - last->start;
+			goto out;
+		}
+	}
+
+	if (ra_record_nr_ranges == RA_RECORD_MAX) {
+		ra_record_dropped++;
+		goto out;
+	}
+	last = &ra_record_ranges[ra_record_nr_ranges++];
+	last->file = file;
+	last->start = start;
+	last->nr = nr;
+out:
+	spin_unlock(&ra_record_lock);
+}
+
+static int ra_range_cmp(const void *a, const void *b)
+{
+	const struct ra_record_range *l = a, *r = b;
+
+	if (l->file->index != r->file->index)
+		return l->file->index < r->file->index ? -1 : 1;
+	if (l->start != r->start)
+		return l->start < r->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Sort the ranges by file, in the order the files were first read, and
+ * by offset within each file, then merge ranges which overlap or nearly
+ * touch.  Called with ra_record_mutex held and recording stopped.
+ */
+static void ra_record_sort(void)
+{
+	struct ra_record_range *in, *out, *end;
+
+	if (!ra_record_nr_ranges)
+		return;
+
+	sort(ra_record_ranges, ra_record_nr_ranges,
+	     sizeof(struct ra_record_range), ra_range_cmp, NULL);
+
+	out = ra_record_ranges;
+	end = ra_record_ranges + ra_record_nr_ranges;
+	for (in = out + 1; in < end; in++) {
+		if (in->file == out->file &&
+		    in->start <= out->start + out->nr + RA_RECORD_GAP) {
+			if (in->start + in->nr > out->start + out->nr)
+				out->nr = in->start + in->nr - out->start;
+			continue;
+		}
+		*++out = *in;
+	}
+	ra_record_nr_ranges = out + 1 - ra_record_ranges;
+}
+
+/*
+ * Turn the pinned paths of the recorded files into names, so that the
+ * recording does not keep file systems busy or deleted files around.
+ * Files already deleted, or whose name can't be had, are not listed.
+ * Called with ra_record_mutex held and recording stopped.
+ */
+static void ra_record_release(void)
+{
+	struct ra_record_file *file;
+	char *buf, *name;
+
+	buf = (char *)__get_free_page(GFP_KERNEL);
+
+	for (file = ra_record_files; file; file = file->next) {
+		if (buf && file->path.dentry->d_inode->i_nlink) {
+			name = d_path(&file->path, buf, PAGE_SIZE);
+			if (!IS_ERR(name))
+				file->name = kstrdup(name, GFP_KERNEL);
+		}
+		path_put(&file->path);
+	}
+
+	free_page((unsigned long)buf);
+}
+
+/*
+ * Drop the recorded data.  Called with ra_record_mutex held and
+ * recording stopped.
+ */
+static void ra_record_clear(void)
+{
+	struct ra_record_file *file;
+	int i;
+
+	while ((file = ra_record_files) != NULL) {
+		ra_record_files = file->next;
+		kfree(file->name);
+		kfree(file);
+	}
+	for (i = 0; i < RA_RECORD_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&ra_record_hash[i]);
+	ra_record_nr_files = 0;
+	ra_record_nr_ranges = 0;
+	ra_record_dropped = 0;
+}
+
+static int ra_record_start(void)
+{
+	if (ra_recording)
+		return 0;
+
+	ra_record_clear();
+	if (!ra_record_ranges) {
+		ra_record_ranges = vmalloc(RA_RECORD_MAX *
+					   sizeof(struct ra_record_range));
+		if (!ra_record_ranges)
+			return -ENOMEM;
+	}
+
+	spin_lock(&ra_record_lock);
+	ra_recording = 1;
+	spin_unlock(&ra_record_lock);
+	return 0;
+}
+
+static void ra_record_stop(void)
+{
+	if (!ra_recording)
+		return;
+
+	spin_lock(&ra_record_lock);
+	ra_recording = 0;
+	spin_unlock(&ra_record_lock);
+
+	ra_record_sort();
+	ra_record_release();
+	if (ra_record_dropped)
+		printk(KERN_INFO "readahead: %lu ranges not recorded\n",
+		       ra_record_dropped);
+}
+
+/*
+ * /proc/readahead/record: write "start", "stop" or "clear"; read the
+ * ranges recorded by the last window, one "path start pages" per line,
+ * in pages.  Reading is refused while recording.
+ */
+static void *ra_record_seq_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&ra_record_mutex);
+	if (ra_recording)
+		return ERR_PTR(-EBUSY);
+	if (*pos >= ra_record_nr_ranges)
+		return NULL;
+	return ra_record_ranges + *pos;
+}
+
+static void *ra_record_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	if (++*pos >= ra_record_nr_ranges)
+		return NULL;
+	return ra_record_ranges + *pos;
+}
+
+static void ra_record_seq_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&ra_record_mutex);
+}
+
+static int ra_record_seq_show(struct seq_file *m, void *v)
+{
+	struct ra_record_range *range = v;
+
+	if (!range->file->name)
+		return SEQ_SKIP;
+	seq_escape(m, range->file->name, " \t\n\\");
+	seq_printf(m, " %lu %lu\n", range->start, range->nr);
+	return 0;
+}
+
+static const struct seq_operations ra_record_seq_ops = {
+	.start	= ra_record_seq_start,
+	.next	= ra_record_seq_next,
+	.stop	= ra_record_seq_stop,
+	.show	= ra_record_seq_show,
+};
+
+static int ra_record_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &ra_record_seq_ops);
+}
+
+static ssize_t ra_record_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	char buffer[8], *cmd;
+	size_t len = min(count, sizeof(buffer) - 1);
+	int ret = 0;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+	if (copy_from_user(buffer, buf, len))
+		return -EFAULT;
+	buffer[len] = '\0';
+	cmd = strstrip(buffer);
+
+	mutex_lock(&ra_record_mutex);
+	if (!strcmp(cmd, "start"))
+		ret = ra_record_start();
+	else if (!strcmp(cmd, "stop"))
+		ra_record_stop();
+	else if (!strcmp(cmd, "clear")) {
+		ra_record_stop();
+		ra_record_clear();
+	} else
+		ret = -EINVAL;
+	mutex_unlock(&ra_record_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations ra_record_fops = {
+	.open		= ra_record_open,
+	.read		= seq_read,
+	.write		= ra_record_write,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/*
+ * /proc/readahead/replay: takes lines in the format /proc/readahead/record
+ * gives and starts readahead for each range, in the order given.  Files
+ * which can't be opened any more are skipped.
+ */
+struct ra_replay {
+	char line[PATH_MAX + 48];
+	size_t len;
+	char *path;
+	struct file *filp;
+};
+
+/* undo the octal escapes of seq_escape() */
+static void ra_replay_unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' &&
+		    s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) |
+				(s[3] - '0');
+			s += 4;
+		} else
+			*d++ = *s++;
+	}
+	*d = '\0';
+}
+
+static void ra_replay_line(struct ra_replay *rp, char *line)
+{
+	unsigned long start, nr;
+	char *p;
+
+	/* "path start pages": the path has no blanks left unescaped */
+	p = strchr(line, ' ');
+	if (!p || sscanf(p + 1, "%lu %lu", &start, &nr) != 2 || !nr)
+		return;
+	*p = '\0';
+	ra_replay_unescape(line);
+
+	if (!rp->path || strcmp(rp->path, line)) {
+		if (rp->filp)
+			fput(rp->filp);
+		kfree(rp->path);
+		rp->filp = NULL;
+		rp->path = kstrdup(line, GFP_KERNEL);
+		if (!rp->path)
+			return;
+		rp->filp = filp_open(line, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(rp->filp)) {
+			rp->filp = NULL;
+			return;
+		}
+		rp->filp->f_mode |= FMODE_RA_REPLAY;
+	}
+	if (!rp->filp)
+		return;
+
+	force_page_cache_readahead(rp->filp->f_mapping, rp->filp, start,
+				   max_sane_readahead(nr));
+}
+
+static int ra_replay_open(struct inode *inode, struct file *file)
+{
+	struct ra_replay *rp;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	rp = kzalloc(sizeof(*rp), GFP_KERNEL);
+	if (!rp)
+		return -ENOMEM;
+	file->private_data = rp;
+
+	return 0;
+}
+
+static ssize_t ra_replay_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct ra_replay *rp = file->private_data;
+	size_t done = 0;
+
+	while (done < count) {
+		char c;
+
+		if (get_user(c, buf + done))
+			return done ? done : -EFAULT;
+		done++;
+
+		if (c != '\n') {
+			/* overlong lines are dropped */
+			if (rp->len < sizeof(rp->line) - 1)
+				rp->line[rp->len++] = c;
+			continue;
+		}
+		rp->line[rp->len] = '\0';
+		if (rp->len < sizeof(rp->line) - 1)
+			ra_replay_line(rp, rp->line);
+		rp->len = 0;
+	}
+
+	return done;
+}
+
+static int ra_replay_release(struct inode *inode, struct file *file)
+{
+	struct ra_replay *rp = file->private_data;
+
+	if (rp->len && rp->len < sizeof(rp->line) - 1) {
+		rp->line[rp->len] = '\0';
+		ra_replay_line(rp, rp->line);
+	}
+	if (rp->filp)
+		fput(rp->filp);
+	kfree(rp->path);
+	kfree(rp);
+
+	return 0;
+}
+
+static const struct file_operations ra_replay_fops = {
+	.open		= ra_replay_open,
+	.write		= ra_replay_write,
+	.release	= ra_replay_release,
+};
+
+static int ra_record_at_boot;
+
+static int __init ra_record_setup(char *str)
+{
+	ra_record_at_boot = 1;
+	return 1;
+}
+__setup("ra_record", ra_record_setup);
+
+static int __init ra_record_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("readahead", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("record", S_IRUSR | S_IWUSR, dir, &ra_record_fops);
+	proc_create("replay", S_IWUSR, dir, &ra_replay_fops);
+
+	if (ra_record_at_boot) {
+		mutex_lock(&ra_record_mutex);
+		ra_record_start();
+		mutex_unlock(&ra_record_mutex);
+	}
+
+	return 0;
+}
+fs_initcall(ra_record_init);
@@ -489,6 +489,8 @@ static int swap_entry_free(struct swap_info_struct *p, swp_entry_t ent)
 			nr_swap_pages++;
 			p->inuse_pages--;
 			mem_cgroup_uncharge_swap(ent);
+			if (p->flags & SWP_COMPCACHE)
+				compcache_free(offset);
 		}
 	}
 	return count;
@@ -630,7 +632,7 @@ int swap_type_of(dev_t device, sector_t offset, struct block_device **bdev_p)
 	for (i = 0; i < nr_swapfiles; i++) {
 		struct swap_info_struct *sis = swap_info + i;
 
-		if (!(sis->flags & SWP_WRITEOK))
+		if (!(sis->flags & SWP_WRITEOK) || !sis->bdev)
 			continue;
 
 		if (!bdev) {
@@ -1410,7 +1412,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	spin_lock(&swap_lock);
 	for (type = swap_list.head; type >= 0; type = swap_info[type].next) {
 		p = swap_info + type;
-		if (p->flags & SWP_WRITEOK) {
+		if ((p->flags & SWP_WRITEOK) && p->swap_file) {
 			if (p->swap_file->f_mapping == mapping)
 				break;
 		}
@@ -1584,6 +1586,14 @@ static int swap_show(struct seq_file *swap, void *v)
 	}
 
 	file = ptr->swap_file;
+	if (!file) {
+		seq_printf(swap, "%-40s%s\t%u\t%u\t%d\n", "[compcache]",
+				"memory\t",
+				ptr->pages << (PAGE_SHIFT - 10),
+				ptr->inuse_pages << (PAGE_SHIFT - 10),
+				ptr->prio);
+		return 0;
+	}
 	len = seq_path(swap, &file->f_path, " \t\n\\");
 	seq_printf(swap, "%*s%s\t%u\t%u\t%d\n",
 			len < 40 ? 40 - len : 1, " ",
@@ -1920,6 +1930,97 @@ out:
 	return error;
 }
 
+#ifdef CONFIG_COMPCACHE
+/*
+ * Add a swap area of nr_pages slots which has no file or block device
+ * behind it: swap_writepage() and swap_readpage() pass its pages to the
+ * compressed cache.  It can't be swapped off.  Returns the swap type.
+ */
+int __init swapon_compcache(unsigned long nr_pages, int prio)
+{
+	struct swap_info_struct *p;
+	unsigned short *swap_map;
+	unsigned long maxpages;
+	unsigned int type;
+	int i, prev;
+	int error;
+
+	spin_lock(&swap_lock);
+	p = swap_info;
+	for (type = 0 ; type < nr_swapfiles ; type++,p++)
+		if (!(p->flags & SWP_USED))
+			break;
+	if (type >= MAX_SWAPFILES) {
+		spin_unlock(&swap_lock);
+		return -EPERM;
+	}
+	if (type >= nr_swapfiles)
+		nr_swapfiles = type+1;
+	memset(p, 0, sizeof(*p));
+	INIT_LIST_HEAD(&p->extent_list);
+	p->flags = SWP_USED;
+	p->next = -1;
+	spin_unlock(&swap_lock);
+
+	/* slot 0 stays unused, as the header page of a real swap area */
+	maxpages = swp_offset(pte_to_swp_entry(
+			swp_entry_to_pte(swp_entry(0, ~0UL)))) - 1;
+	if (maxpages > nr_pages + 1)
+		maxpages = nr_pages + 1;
+
+	error = -ENOMEM;
+	swap_map = vmalloc(maxpages * sizeof(short));
+	if (!swap_map)
+		goto bad_swap;
+	memset(swap_map, 0, maxpages * sizeof(short));
+	swap_map[0] = SWAP_MAP_BAD;
+
+	error = swap_cgroup_swapon(type, maxpages);
+	if (error)
+		goto bad_swap;
+
+	p->lowest_bit = 1;
+	p->cluster_next = 1;
+	p->highest_bit = maxpages - 1;
+	p->max = maxpages;
+	p->pages = maxpages - 1;
+
+	mutex_lock(&swapon_mutex);
+	spin_lock(&swap_lock);
+	p->prio = prio;
+	p->swap_map = swap_map;
+	p->flags |= SWP_WRITEOK | SWP_COMPCACHE;
+	nr_swap_pages += p->pages;
+	total_swap_pages += p->pages;
+
+	printk(KERN_INFO "Adding %uk compressed swap.  Priority:%d\n",
+		p->pages << (PAGE_SHIFT - 10), p->prio);
+
+	/* insert swap space into swap_list: */
+	prev = -1;
+	for (i = swap_list.head; i >= 0; i = swap_info[i].next) {
+		if (p->prio >= swap_info[i].prio)
+			break;
+		prev = i;
+	}
+	p->next = i;
+	if (prev < 0)
+		swap_list.head = swap_list.next = type;
+	else
+		swap_info[prev].next = type;
+	spin_unlock(&swap_lock);
+	mutex_unlock(&swapon_mutex);
+	return type;
+
+bad_swap:
+	spin_lock(&swap_lock);
+	p->flags = 0;
+	spin_unlock(&swap_lock);
+	vfree(swap_map);
+	return error;
+}
+#endif
+
 void si_swapinfo(struct sysinfo *val)
 {
 	unsigned int i;
@@ -2001,6 +2102,8 @@ int valid_swaphandles(swp_entry_t entry, unsigned long *offset)
 		return 0;
 
 	si = &swap_info[swp_type(entry)];
+	if (si->flags & SWP_COMPCACHE)	/* no seeks to save */
+		return 0;
 	target = swp_offset(entry);
 	base = (target >> our_page_cluster) << our_page_cluster;
 	end = base + (1 << our_page_cluster);
@@ -1927,6 +1927,201 @@ int weight_p __read_mostly = 64;            /* old backlog weight */
 
 DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
 
+/*
+ * Nothing will poll the backlog of an offline CPU any more: complete it
+ * and feed its packets to the online CPUs, or packets steered there once
+ * it is back would sit behind a stale schedule.  With RPS other CPUs
+ * may still be queueing to it, hence the lock.  The caller makes sure
+ * the backlog is not on a poll list.
+ */
+static void backlog_offline(struct softnet_data *queue)
+{
+	struct sk_buff_head skbs;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&skbs);
+
+	spin_lock_irq(&queue->input_pkt_queue.lock);
+	skb_queue_splice_tail_init(&queue->input_pkt_queue, &skbs);
+	smp_mb__before_clear_bit();
+	clear_bit(NAPI_STATE_SCHED, &queue->backlog.state);
+	spin_unlock_irq(&queue->input_pkt_queue.lock);
+
+	while ((skb = __skb_dequeue(&skbs)))
+		netif_rx(skb);
+}
+
+#ifdef CONFIG_RPS
+static u32 rps_hashrnd __read_mostly;
+
+/*
+ * get_rps_cpu is called from netif_rx and netif_receive_skb with
+ * rcu_read_lock held.  It returns the CPU the packet should be processed
+ * on, or -1 to process it on the current CPU.  Packets of one flow always
+ * hash to the same CPU, so they are not reordered.
+ */
+static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb)
+{
+	struct rps_map *map;
+	struct iphdr *ip;
+	struct ipv6hdr *ip6;
+	u32 addr1, addr2, ports, ihl, hash;
+	u8 ip_proto = 0;
+	int cpu;
+
+	map = rcu_dereference(dev->rps_map);
+	if (!map || !map->len)
+		return -1;
+
+	switch (skb->protocol) {
+	case htons(ETH_P_IP):
+		if (!pskb_may_pull(skb, sizeof(*ip)))
+			return -1;
+		ip = (struct iphdr *)skb->data;
+		if (!(ip->frag_off & htons(IP_MF | IP_OFFSET)))
+			ip_proto = ip->protocol;
+		addr1 = ip->saddr;
+		addr2 = ip->daddr;
+		ihl = ip->ihl;
+		break;
+	case htons(ETH_P_IPV6):
+		if (!pskb_may_pull(skb, sizeof(*ip6)))
+			return -1;
+		ip6 = (struct ipv6hdr *)skb->data;
+		ip_proto = ip6->nexthdr;
+		addr1 = ip6->saddr.s6_addr32[3];
+		addr2 = ip6->daddr.s6_addr32[3];
+		ihl = (40 >> 2);
+		break;
+	default:
+		return -1;
+	}
+
+	switch (ip_proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_DCCP:
+	case IPPROTO_ESP:
+	case IPPROTO_AH:
+	case IPPROTO_SCTP:
+	case IPPROTO_UDPLITE:
+		if (pskb_may_pull(skb, (ihl * 4) + 4)) {
+			ports = *((u32 *) (skb->data + (ihl * 4)));
+			break;
+		}
+		/* fall through */
+	default:
+		ports = 0;
+		break;
+	}
+
+	hash = jhash_3words(addr1, addr2, ports, rps_hashrnd);
+	cpu = map->cpus[((u64) hash * map->len) >> 32];
+
+	return cpu_online(cpu) ? cpu : -1;
+}
+
+/* Called from hardirq (IPI) context */
+static void rps_trigger_softirq(void *data)
+{
+	struct softnet_data *queue = data;
+
+	__napi_schedule(&queue->backlog);
+	__get_cpu_var(netdev_rx_stat).received_rps++;
+}
+
+/*
+ * Send the IPIs queued by enqueue_to_backlog() while this CPU ran its
+ * receive processing, one per remote backlog that has to be started.
+ * Called with interrupts disabled, returns with them enabled.
+ */
+static void net_rps_action_and_irq_enable(struct softnet_data *queue)
+{
+	struct softnet_data *remqueue = queue->rps_ipi_list;
+
+	if (remqueue) {
+		queue->rps_ipi_list = NULL;
+
+		local_irq_enable();
+
+		while (remqueue) {
+			struct softnet_data *next = remqueue->rps_ipi_next;
+
+			if (cpu_online(remqueue->cpu))
+				__smp_call_function_single(remqueue->cpu,
+							   &remqueue->csd);
+			else
+				backlog_offline(remqueue);
+			remqueue = next;
+		}
+	} else
+		local_irq_enable();
+}
+#else
+static inline int get_rps_cpu(struct net_device *dev, struct sk_buff *skb)
+{
+	return -1;
+}
+
+static inline void net_rps_action_and_irq_enable(struct softnet_data *queue)
+{
+	local_irq_enable();
+}
+#endif
+
+/*
+ * Queue a packet to the backlog of a CPU, which may be remote with RPS.
+ * The backlog NAPI of a remote CPU cannot be put on its poll list from
+ * here; it is marked scheduled and the IPI that puts it there is sent
+ * when this CPU's net_rx_action runs, so that packets steered to the
+ * same CPU share one IPI.
+ */
+static int enqueue_to_backlog(struct sk_buff *skb, int cpu)
+{
+	struct softnet_data *queue;
+	unsigned long flags;
+
+	queue = &per_cpu(softnet_data, cpu);
+
+	local_irq_save(flags);
+	__get_cpu_var(netdev_rx_stat).total++;
+
+	spin_lock(&queue->input_pkt_queue.lock);
+	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
+		if (queue->input_pkt_queue.qlen) {
+enqueue:
+			__skb_queue_tail(&queue->input_pkt_queue, skb);
+			spin_unlock(&queue->input_pkt_queue.lock);
+			local_irq_restore(flags);
+			return NET_RX_SUCCESS;
+		}
+
+		/* Schedule NAPI for backlog device */
+		if (napi_schedule_prep(&queue->backlog)) {
+#ifdef CONFIG_RPS
+			if (cpu != smp_processor_id()) {
+				struct softnet_data *myqueue;
+
+				myqueue = &__get_cpu_var(softnet_data);
+				queue->rps_ipi_next = myqueue->rps_ipi_list;
+				myqueue->rps_ipi_list = queue;
+				__raise_softirq_irqoff(NET_RX_SOFTIRQ);
+				goto enqueue;
+			}
+#endif
+			__napi_schedule(&queue->backlog);
+		}
+		goto enqueue;
+	}
+
+	spin_unlock(&queue->input_pkt_queue.lock);
+
+	__get_cpu_var(netdev_rx_stat).dropped++;
+	local_irq_restore(flags);
+
+	kfree_skb(skb);
+	return NET_RX_DROP;
+}
 
 /**
  *	netif_rx	-	post buffer to the network code
@@ -1945,8 +2140,7 @@ DEFINE_PER_CPU(struct netif_rx_stats, netdev_rx_stat) = { 0, };
 
 int netif_rx(struct sk_buff *skb)
 {
-	struct softnet_data *queue;
-	unsigned long flags;
+	int cpu, ret;
 
 	/* if netpoll wants it, pretend we never saw it */
 	if (netpoll_rx(skb))
@@ -1955,31 +2149,16 @@ int netif_rx(struct sk_buff *skb)
 	if (!skb->tstamp.tv64)
 		net_timestamp(skb);
 
-	/*
-	 * The code is rearranged so that the path is the most
-	 * short when CPU is congested, but is still operating.
-	 */
-	local_irq_save(flags);
-	queue = &__get_cpu_var(softnet_data);
-
-	__get_cpu_var(netdev_rx_stat).total++;
-	if (queue->input_pkt_queue.qlen <= netdev_max_backlog) {
-		if (queue->input_pkt_queue.qlen) {
-enqueue:
-			__skb_queue_tail(&queue->input_pkt_queue, skb);
-			local_irq_restore(flags);
-			return NET_RX_SUCCESS;
-		}
-
-		napi_schedule(&queue->backlog);
-		goto enqueue;
-	}
-
-	__get_cpu_var(netdev_rx_stat).dropped++;
-	local_irq_restore(flags);
+	preempt_disable();
+	rcu_read_lock();
+	cpu = get_rps_cpu(skb->dev, skb);
+	if (cpu < 0)
+		cpu = smp_processor_id();
+	ret = enqueue_to_backlog(skb, cpu);
+	rcu_read_unlock();
+	preempt_enable();
 
-	kfree_skb(skb);
-	return NET_RX_DROP;
+	return ret;
 }
 
 int netif_rx_ni(struct sk_buff *skb)
@@ -2212,22 +2391,12 @@ void netif_nit_deliver(struct sk_buff *skb)
 	rcu_read_unlock();
 }
 
-/**
- *	netif_receive_skb - process receive buffer from network
- *	@skb: buffer to process
- *
- *	netif_receive_skb() is the main receive data processing function.
- *	It always succeeds. The buffer may be dropped during processing
- *	for congestion control or by the protocol layers.
- *
- *	This function may only be called from softirq context and interrupts
- *	should be enabled.
- *
- *	Return values (usually ignored):
- *	NET_RX_SUCCESS: no congestion
- *	NET_RX_DROP: packet was dropped
+/*
+ * Deliver a packet to the protocol handlers on the current CPU.  This is
+ * netif_receive_skb() without receive packet steering; the backlog uses it
+ * for packets that were already steered.
  */
-int netif_receive_skb(struct sk_buff *skb)
+static int __netif_receive_skb(struct sk_buff *skb)
 {
 	struct packet_type *ptype, *pt_prev;
 	struct net_device *orig_dev;
@@ -2324,6 +2493,43 @@ out:
 	return ret;
 }
 
+/**
+ *	netif_receive_skb - process receive buffer from network
+ *	@skb: buffer to process
+ *
+ *	netif_receive_skb() is the main receive data processing function.
+ *	It always succeeds. The buffer may be dropped during processing
+ *	for congestion control or by the protocol layers.
+ *
+ *	With receive packet steering the packet may be queued to the
+ *	backlog of another CPU and processed there.
+ *
+ *	This function may only be called from softirq context and interrupts
+ *	should be enabled.
+ *
+ *	Return values (usually ignored):
+ *	NET_RX_SUCCESS: no congestion
+ *	NET_RX_DROP: packet was dropped
+ */
+int netif_receive_skb(struct sk_buff *skb)
+{
+#ifdef CONFIG_RPS
+	int cpu, ret;
+
+	rcu_read_lock();
+	cpu = get_rps_cpu(skb->dev, skb);
+	if (cpu >= 0) {
+		if (!skb->tstamp.tv64)
+			net_timestamp(skb);
+		ret = enqueue_to_backlog(skb, cpu);
+		rcu_read_unlock();
+		return ret;
+	}
+	rcu_read_unlock();
+#endif
+	return __netif_receive_skb(skb);
+}
+
 /* Network device is going away, flush any packets still pending  */
 static void flush_backlog(void *arg)
 {
@@ -2331,11 +2537,13 @@ static void flush_backlog(void *arg)
 	struct softnet_data *queue = &__get_cpu_var(softnet_data);
 	struct sk_buff *skb, *tmp;
 
+	spin_lock(&queue->input_pkt_queue.lock);
 	skb_queue_walk_safe(&queue->input_pkt_queue, skb, tmp)
 		if (skb->dev == dev) {
 			__skb_unlink(skb, &queue->input_pkt_queue);
 			kfree_skb(skb);
 		}
+	spin_unlock(&queue->input_pkt_queue.lock);
 }
 
 static int napi_gro_complete(struct sk_buff *skb)
@@ -2585,16 +2793,23 @@ static int process_backlog(struct napi_struct *napi, int quota)
 	do {
 		struct sk_buff *skb;
 
+		/*
+		 * Other CPUs queue to this backlog with RPS, so the dequeue
+		 * and the completion have to be atomic against them.
+		 */
 		local_irq_disable();
+		spin_lock(&queue->input_pkt_queue.lock);
 		skb = __skb_dequeue(&queue->input_pkt_queue);
 		if (!skb) {
 			__napi_complete(napi);
+			spin_unlock(&queue->input_pkt_queue.lock);
 			local_irq_enable();
 			break;
 		}
+		spin_unlock(&queue->input_pkt_queue.lock);
 		local_irq_enable();
 
-		netif_receive_skb(skb);
+		__netif_receive_skb(skb);
 	} while (++work < quota && jiffies == start_time);
 
 	return work;
@@ -2684,7 +2899,8 @@ EXPORT_SYMBOL(netif_napi_del);
 
 static void net_rx_action(struct softirq_action *h)
 {
-	struct list_head *list = &__get_cpu_var(softnet_data).poll_list;
+	struct softnet_data *queue = &__get_cpu_var(softnet_data);
+	struct list_head *list = &queue->poll_list;
 	unsigned long time_limit = jiffies + 2;
 	int budget = netdev_budget;
 	void *have;
@@ -2746,7 +2962,7 @@ static void net_rx_action(struct softirq_action *h)
 		netpoll_poll_unlock(have);
 	}
 out:
-	local_irq_enable();
+	net_rps_action_and_irq_enable(queue);
 
 #ifdef CONFIG_NET_DMA
 	/*
@@ -2989,10 +3205,10 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct netif_rx_stats *s = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   s->total, s->dropped, s->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   s->cpu_collision );
+		   s->cpu_collision, s->received_rps);
 	return 0;
 }
 
@@ -4958,7 +5174,7 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 {
 	struct sk_buff **list_skb;
 	struct Qdisc **list_net;
-	struct sk_buff *skb;
+	struct napi_struct *napi, *next;
 	unsigned int cpu, oldcpu = (unsigned long)ocpu;
 	struct softnet_data *sd, *oldsd;
 
@@ -4986,12 +5202,38 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	*list_net = oldsd->output_queue;
 	oldsd->output_queue = NULL;
 
+	/*
+	 * Append NAPI poll list from offline CPU.  Its backlog only ever
+	 * serves its own input_pkt_queue, it is completed below instead.
+	 */
+	list_for_each_entry_safe(napi, next, &oldsd->poll_list, poll_list) {
+		if (napi == &oldsd->backlog)
+			list_del_init(&napi->poll_list);
+		else
+			list_move_tail(&napi->poll_list, &sd->poll_list);
+	}
+	raise_softirq_irqoff(NET_RX_SOFTIRQ);
+
+#ifdef CONFIG_RPS
+	/* Backlogs the offline CPU still had to kick are kicked from here. */
+	while (oldsd->rps_ipi_list) {
+		struct softnet_data *remqueue = oldsd->rps_ipi_list;
+
+		oldsd->rps_ipi_list = remqueue->rps_ipi_next;
+		if (remqueue == sd) {
+			__napi_schedule(&sd->backlog);
+			continue;
+		}
+		remqueue->rps_ipi_next = sd->rps_ipi_list;
+		sd->rps_ipi_list = remqueue;
+	}
+#endif
+
 	raise_softirq_irqoff(NET_TX_SOFTIRQ);
 	local_irq_enable();
 
 	/* Process offline CPU's input_pkt_queue */
-	while ((skb = __skb_dequeue(&oldsd->input_pkt_queue)))
-		netif_rx(skb);
+	backlog_offline(oldsd);
 
 	return NOTIFY_OK;
 }
@@ -5196,8 +5438,19 @@ static int __init net_dev_init(void)
 		queue->backlog.poll = process_backlog;
 		queue->backlog.weight = weight_p;
 		queue->backlog.gro_list = NULL;
+
+#ifdef CONFIG_RPS
+		queue->csd.func = rps_trigger_softirq;
+		queue->csd.info = queue;
+		queue->csd.flags = 0;
+		queue->cpu = i;
+#endif
 	}
 
+#ifdef CONFIG_RPS
+	get_random_bytes(&rps_hashrnd, sizeof(rps_hashrnd));
+#endif
+
 	dev_boot_phase = 0;
 
 	/* The loopback device is special if any other network devices
@@ -392,6 +392,8 @@ struct inet_peer *inet_getpeer(__be32 daddr, int create)
 	atomic_set(&n->rid, 0);
 	n->ip_id_count = secure_ip_id(daddr);
 	n->tcp_ts_stamp = 0;
+	n->tcp_fastopen_mss = 0;
+	n->tcp_fastopen_len = 0;
 
 	write_lock_bh(&peer_pool_lock);
 	/* Check if an entry has suddenly appeared. */
@@ -0,0 +1,177 @@
+/*
+ * TCP Fast Open: data in the SYN of repeat connections.
+ *
+ * A server hands out a cookie, a MAC over the client and server address
+ * keyed with a boot time secret, to clients asking for one.  A client that
+ * has a cookie for the server sends it in its next SYN together with the
+ * first data; if the cookie checks out, the server creates the child socket
+ * right away and the data reaches accept()/read() one round trip earlier.
+ * Anything the SYN-ACK does not acknowledge is simply resent by the client,
+ * so a stale cookie only loses the round trip that would have been saved.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/tcp.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/kernel.h>
+#include <linux/seqlock.h>
+#include <net/tcp.h>
+#include <net/inetpeer.h>
+
+int sysctl_tcp_fastopen __read_mostly;
+
+static __u32 tcp_fastopen_secret[16 - 2 + SHA_DIGEST_WORDS] __read_mostly;
+
+static __init int tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+__initcall(tcp_fastopen_init);
+
+static DEFINE_PER_CPU(__u32, tcp_fastopen_scratch)[16 + 5 + SHA_WORKSPACE_WORDS];
+
+/* Called from softirq context only, like cookie_hash(). */
+void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	__u32 *tmp = __get_cpu_var(tcp_fastopen_scratch);
+
+	memcpy(tmp + 2, tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	tmp[0] = (__force u32)saddr;
+	tmp[1] = (__force u32)daddr;
+	sha_transform(tmp + 16, (__u8 *)tmp, tmp + 16 + 5);
+
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+}
+
+/* Cookies we got as a client live in the inet_peer of the server. */
+static DEFINE_SEQLOCK(tcp_fastopen_cache_lock);
+
+/* Fetch the cookie for the peer of @sk; foc->len is 0 if there is none
+ * yet, so that one gets requested, and -1 for address families without
+ * a cache.  Returns the MSS the peer announced along with the cookie, 0
+ * if unknown.
+ */
+u16 tcp_fastopen_cache_get(struct sock *sk, struct tcp_fastopen_cookie *foc)
+{
+	struct inet_peer *peer;
+	unsigned int seq;
+	u16 mss;
+
+	foc->len = -1;
+	if (sk->sk_family != AF_INET)
+		return 0;
+
+	foc->len = 0;
+	peer = inet_getpeer(inet_sk(sk)->daddr, 1);
+	if (peer == NULL)
+		return 0;
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_cache_lock);
+		mss = peer->tcp_fastopen_mss;
+		foc->len = peer->tcp_fastopen_len;
+		if (foc->len > 0)
+			memcpy(foc->val, peer->tcp_fastopen_cookie, foc->len);
+	} while (read_seqretry(&tcp_fastopen_cache_lock, seq));
+
+	inet_putpeer(peer);
+	return mss;
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *foc)
+{
+	struct inet_peer *peer;
+
+	if (sk->sk_family != AF_INET)
+		return;
+
+	peer = inet_getpeer(inet_sk(sk)->daddr, 1);
+	if (peer == NULL)
+		return;
+
+	write_seqlock_bh(&tcp_fastopen_cache_lock);
+	peer->tcp_fastopen_mss = mss;
+	peer->tcp_fastopen_len = foc->len;
+	memcpy(peer->tcp_fastopen_cookie, foc->val, foc->len);
+	write_sequnlock_bh(&tcp_fastopen_cache_lock);
+
+	inet_putpeer(peer);
+}
+
+/* The SYN @skb carried a valid cookie and data: create the child socket
+ * now, queue the data to it and the child to accept(), and answer with a
+ * SYN-ACK that acknowledges the data too.  Consumes @dst.  Returns 1 if
+ * the child was created, @req then belongs to the accept queue; on 0 the
+ * caller goes on with the regular three way handshake.
+ */
+int tcp_fastopen_create_child(struct sock *sk, struct sk_buff *skb,
+			      struct request_sock *req,
+			      struct dst_entry *dst)
+{
+	struct sk_buff *data, *synack;
+	struct tcp_sock *tp;
+	struct sock *child;
+	u32 end_seq = TCP_SKB_CB(skb)->end_seq;
+
+	/* Allocate up front, the child cannot be unwound once it is hashed. */
+	data = skb_clone(skb, GFP_ATOMIC);
+	synack = alloc_skb_fclone(MAX_TCP_HEADER + 15, GFP_ATOMIC);
+	if (data == NULL || synack == NULL)
+		goto drop;
+
+	tcp_openreq_init_rwin(req, sk, dst);
+	tcp_rsk(req)->syn_data_acked = end_seq - tcp_rsk(req)->rcv_isn - 1;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	dst = NULL;
+	if (child == NULL) {
+		tcp_rsk(req)->syn_data_acked = 0;
+		goto drop;
+	}
+
+	bh_lock_sock_nested(child);
+	tp = tcp_sk(child);
+	tp->fastopen_child = 1;
+
+	/* Queue the data carried in the SYN, it is acknowledged below. */
+	__skb_pull(data, tcp_hdrlen(data));
+	skb_set_owner_r(data, child);
+	__skb_queue_tail(&child->sk_receive_queue, data);
+	tp->rcv_nxt = end_seq;
+	tp->rcv_wup = end_seq;
+
+	/* What tcp_rcv_state_process() does on the ACK of the SYN-ACK for
+	 * a regular child: this one can be read from and written to
+	 * straight after accept().
+	 */
+	tcp_init_metrics(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+	tp->lsndtime = tcp_time_stamp;
+
+	tcp_fastopen_queue_synack(child, synack);
+	bh_unlock_sock(child);
+
+	req->rsk_ops->rtx_syn_ack(sk, req);
+	inet_csk_reqsk_queue_add(sk, req, child);
+	sk->sk_data_ready(sk, 0);
+
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+	return 1;
+
+drop:
+	kfree_skb(synack);
+	kfree_skb(data);
+	dst_release(dst);
+	return 0;
+}
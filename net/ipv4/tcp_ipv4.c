@@ -1169,10 +1169,59 @@ static struct timewait_sock_ops tcp_timewait_sock_ops = {
 	.twsk_destructor= tcp_twsk_destructor,
 };
 
+/* A SYN with a Fast Open option.  Hand out a cookie if the client asked
+ * for one or presented a stale one; with a valid cookie and data create
+ * the child socket right away.  Returns 1 if the child was created, @req
+ * then sits in the accept queue; otherwise the caller goes on with the
+ * regular handshake, using *@dstp if it is still set.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct request_sock *req,
+				    struct tcp_fastopen_cookie *foc,
+				    struct dst_entry **dstp)
+{
+	struct tcp_fastopen_cookie valid;
+	struct dst_entry *dst = *dstp;
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    !tcp_sk(sk)->fastopen_qlen)
+		return 0;
+
+	tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, ip_hdr(skb)->daddr, &valid);
+	if (foc->len != valid.len || memcmp(foc->val, valid.val, valid.len)) {
+		NET_INC_STATS_BH(sock_net(sk), foc->len ?
+				 LINUX_MIB_TCPFASTOPENPASSIVEFAIL :
+				 LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+		tcp_rsk(req)->fastopen_cookie_len = valid.len;
+		memcpy(tcp_rsk(req)->fastopen_cookie, valid.val, valid.len);
+		return 0;
+	}
+
+	/* Nothing to deliver early without data; leave a FIN to the
+	 * regular state machine.
+	 */
+	if (TCP_SKB_CB(skb)->end_seq == TCP_SKB_CB(skb)->seq + 1 ||
+	    tcp_hdr(skb)->fin)
+		return 0;
+
+	if (sk->sk_ack_backlog >= tcp_sk(sk)->fastopen_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return 0;
+	}
+
+	if (!dst && (dst = inet_csk_route_req(sk, req)) == NULL)
+		return 0;
+	*dstp = NULL;
+
+	return tcp_fastopen_create_child(sk, skb, req, dst);
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct inet_request_sock *ireq;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
 	struct request_sock *req;
 	__be32 saddr = ip_hdr(skb)->saddr;
 	__be32 daddr = ip_hdr(skb)->daddr;
@@ -1221,7 +1270,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tmp_opt.mss_clamp = 536;
 	tmp_opt.user_mss  = tcp_sk(sk)->rx_opt.user_mss;
 
-	tcp_parse_options(skb, &tmp_opt, 0);
+	tcp_parse_options(skb, &tmp_opt, 0, &foc);
 
 	if (want_cookie && !tmp_opt.saw_tstamp)
 		tcp_clear_options(&tmp_opt);
@@ -1302,6 +1351,10 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	}
 	tcp_rsk(req)->snt_isn = isn;
 
+	if (foc.len >= 0 && !want_cookie &&
+	    tcp_v4_conn_req_fastopen(sk, skb, req, &foc, &dst))
+		return 0;
+
 	if (__tcp_v4_send_synack(sk, req, dst) || want_cookie)
 		goto drop_and_free;
 
@@ -353,15 +353,24 @@ static inline int tcp_urg_mode(const struct tcp_sock *tp)
 #define OPTION_SACK_ADVERTISE	(1 << 0)
 #define OPTION_TS		(1 << 1)
 #define OPTION_MD5		(1 << 2)
+#define OPTION_FAST_OPEN_COOKIE	(1 << 3)
 
 struct tcp_out_options {
 	u8 options;		/* bit field of OPTION_* */
 	u8 ws;			/* window scale, 0 to disable */
 	u8 num_sack_blocks;	/* number of SACK blocks to include */
+	u8 fastopen_len;	/* Fast Open cookie length, 0 for a request */
 	u16 mss;		/* 0 to disable */
 	__u32 tsval, tsecr;	/* need to include OPTION_TS */
+	const u8 *fastopen_cookie;	/* need to include OPTION_FAST_OPEN_COOKIE */
 };
 
+/* Space a Fast Open option carrying a cookie of @len bytes takes. */
+static inline unsigned tcp_fastopen_option_size(unsigned len)
+{
+	return (TCPOLEN_EXP_FASTOPEN_BASE + len + 3) & ~3U;
+}
+
 /* Beware: Something in the Internet is very sensitive to the ordering of
  * TCP options, we learned this through the hard way, so be careful here.
  * Luckily we can at least blame others for their non-compliance but from
@@ -446,6 +455,20 @@ static void tcp_options_write(__be32 *ptr, struct tcp_sock *tp,
 			tp->rx_opt.eff_sacks = tp->rx_opt.num_sacks;
 		}
 	}
+
+	if (unlikely(OPTION_FAST_OPEN_COOKIE & opts->options)) {
+		u8 len = opts->fastopen_len;
+
+		*ptr++ = htonl((TCPOPT_EXP << 24) |
+			       ((TCPOLEN_EXP_FASTOPEN_BASE + len) << 16) |
+			       TCPOPT_FASTOPEN_MAGIC);
+		memcpy(ptr, opts->fastopen_cookie, len);
+		if ((len & 3) == 2) {
+			u8 *align = ((u8 *)ptr) + len;
+			align[0] = align[1] = TCPOPT_NOP;
+		}
+		ptr += (len + 3) >> 2;
+	}
 }
 
 static unsigned tcp_syn_options(struct sock *sk, struct sk_buff *skb,
@@ -476,6 +499,29 @@ static unsigned tcp_syn_options(struct sock *sk, struct sk_buff *skb,
 	opts->mss = tcp_advertise_mss(sk);
 	size += TCPOLEN_MSS_ALIGNED;
 
+	/* A Fast Open child retransmitting its SYN-ACK may only echo what
+	 * the client's SYN offered.
+	 */
+	if (unlikely(tp->fastopen_child)) {
+		if (tp->rx_opt.tstamp_ok) {
+			opts->options |= OPTION_TS;
+			opts->tsval = TCP_SKB_CB(skb)->when;
+			opts->tsecr = tp->rx_opt.ts_recent;
+			size += TCPOLEN_TSTAMP_ALIGNED;
+		}
+		if (tp->rx_opt.wscale_ok) {
+			opts->ws = tp->rx_opt.rcv_wscale;
+			if (likely(opts->ws))
+				size += TCPOLEN_WSCALE_ALIGNED;
+		}
+		if (tcp_is_sack(tp)) {
+			opts->options |= OPTION_SACK_ADVERTISE;
+			if (unlikely(!(OPTION_TS & opts->options)))
+				size += TCPOLEN_SACKPERM_ALIGNED;
+		}
+		return size;
+	}
+
 	if (likely(sysctl_tcp_timestamps && *md5 == NULL)) {
 		opts->options |= OPTION_TS;
 		opts->tsval = TCP_SKB_CB(skb)->when;
@@ -493,6 +539,19 @@ static unsigned tcp_syn_options(struct sock *sk, struct sk_buff *skb,
 			size += TCPOLEN_SACKPERM_ALIGNED;
 	}
 
+	if (unlikely(tp->fastopen_req && *md5 == NULL)) {
+		struct tcp_fastopen_cookie *foc = &tp->fastopen_req->cookie;
+		unsigned need = tcp_fastopen_option_size(foc->len);
+
+		if (foc->len >= 0 && MAX_TCP_OPTION_SPACE - size >= need) {
+			opts->options |= OPTION_FAST_OPEN_COOKIE;
+			opts->fastopen_cookie = foc->val;
+			opts->fastopen_len = foc->len;
+			size += need;
+			tp->syn_fastopen = 1;
+		}
+	}
+
 	return size;
 }
 
@@ -540,6 +599,17 @@ static unsigned tcp_synack_options(struct sock *sk,
 		if (unlikely(!doing_ts))
 			size += TCPOLEN_SACKPERM_ALIGNED;
 	}
+	if (unlikely(tcp_rsk(req)->fastopen_cookie_len)) {
+		unsigned len = tcp_rsk(req)->fastopen_cookie_len;
+		unsigned need = tcp_fastopen_option_size(len);
+
+		if (MAX_TCP_OPTION_SPACE - size >= need) {
+			opts->options |= OPTION_FAST_OPEN_COOKIE;
+			opts->fastopen_cookie = tcp_rsk(req)->fastopen_cookie;
+			opts->fastopen_len = len;
+			size += need;
+		}
+	}
 
 	return size;
 }
@@ -2188,6 +2258,32 @@ int tcp_send_synack(struct sock *sk)
 	return tcp_transmit_skb(sk, skb, 1, GFP_ATOMIC);
 }
 
+/* Choose the receive window and window scale for a connection request,
+ * on the first SYN-ACK only (or when a Fast Open child is created).
+ */
+void tcp_openreq_init_rwin(struct request_sock *req, struct sock *sk,
+			   struct dst_entry *dst)
+{
+	struct inet_request_sock *ireq = inet_rsk(req);
+	struct tcp_sock *tp = tcp_sk(sk);
+	__u8 rcv_wscale;
+	int mss = dst_metric(dst, RTAX_ADVMSS);
+
+	if (tp->rx_opt.user_mss && tp->rx_opt.user_mss < mss)
+		mss = tp->rx_opt.user_mss;
+
+	/* Set this up on the first call only */
+	req->window_clamp = tp->window_clamp ? : dst_metric(dst, RTAX_WINDOW);
+	/* tcp_full_space because it is guaranteed to be the first packet */
+	tcp_select_initial_window(tcp_full_space(sk),
+		mss - (ireq->tstamp_ok ? TCPOLEN_TSTAMP_ALIGNED : 0),
+		&req->rcv_wnd,
+		&req->window_clamp,
+		ireq->wscale_ok,
+		&rcv_wscale);
+	ireq->rcv_wscale = rcv_wscale;
+}
+
 /*
  * Prepare a SYN-ACK.
  */
@@ -2217,19 +2313,8 @@ struct sk_buff *tcp_make_synack(struct sock *sk, struct dst_entry *dst,
 	if (tp->rx_opt.user_mss && tp->rx_opt.user_mss < mss)
 		mss = tp->rx_opt.user_mss;
 
-	if (req->rcv_wnd == 0) { /* ignored for retransmitted syns */
-		__u8 rcv_wscale;
-		/* Set this up on the first call only */
-		req->window_clamp = tp->window_clamp ? : dst_metric(dst, RTAX_WINDOW);
-		/* tcp_full_space because it is guaranteed to be the first packet */
-		tcp_select_initial_window(tcp_full_space(sk),
-			mss - (ireq->tstamp_ok ? TCPOLEN_TSTAMP_ALIGNED : 0),
-			&req->rcv_wnd,
-			&req->window_clamp,
-			ireq->wscale_ok,
-			&rcv_wscale);
-		ireq->rcv_wscale = rcv_wscale;
-	}
+	if (req->rcv_wnd == 0) /* ignored for retransmitted syns */
+		tcp_openreq_init_rwin(req, sk, dst);
 
 	memset(&opts, 0, sizeof(opts));
 #ifdef CONFIG_SYN_COOKIES
@@ -2258,7 +2343,8 @@ struct sk_buff *tcp_make_synack(struct sock *sk, struct dst_entry *dst,
 	tcp_init_nondata_skb(skb, tcp_rsk(req)->snt_isn,
 			     TCPCB_FLAG_SYN | TCPCB_FLAG_ACK);
 	th->seq = htonl(TCP_SKB_CB(skb)->seq);
-	th->ack_seq = htonl(tcp_rsk(req)->rcv_isn + 1);
+	th->ack_seq = htonl(tcp_rsk(req)->rcv_isn + 1 +
+			    tcp_rsk(req)->syn_data_acked);
 
 	/* RFC1323: The window in SYN & SYN/ACK segments is never scaled. */
 	th->window = htons(min(req->rcv_wnd, 65535U));
@@ -2338,6 +2424,93 @@ static void tcp_connect_init(struct sock *sk)
 	tcp_clear_retrans(tp);
 }
 
+static void tcp_connect_queue_skb(struct sock *sk, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	skb_header_release(skb);
+	__tcp_add_write_queue_tail(sk, skb);
+	sk->sk_wmem_queued += skb->truesize;
+	sk_mem_charge(sk, skb->truesize);
+	tp->write_seq = TCP_SKB_CB(skb)->end_seq;
+	tp->packets_out += tcp_skb_pcount(skb);
+}
+
+/* Send a SYN carrying the cached Fast Open cookie and as much of the
+ * sendto() data as fits.  The data is also queued as a regular segment
+ * right after the SYN: a retransmitted SYN goes out bare, and whatever
+ * the SYN-ACK does not acknowledge is resent by
+ * tcp_rcv_fastopen_synack().  Without a cookie a plain SYN requesting
+ * one is sent, and the data follows the handshake as usual.
+ */
+static void tcp_send_syn_data(struct sock *sk, struct sk_buff *syn)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct tcp_fastopen_request *fo = tp->fastopen_req;
+	struct sk_buff *syn_data = NULL, *data;
+	int space, i;
+	u16 mss;
+
+	mss = tcp_fastopen_cache_get(sk, &fo->cookie);
+	if (fo->cookie.len <= 0)
+		goto fallback;
+
+	/* The peer's MSS from the last connection is a better bound for
+	 * the SYN data than the default clamp; the SYN-ACK resets it.
+	 */
+	if (mss) {
+		if (tp->rx_opt.user_mss && tp->rx_opt.user_mss < mss)
+			mss = tp->rx_opt.user_mss;
+		tp->rx_opt.mss_clamp = mss;
+	}
+	space = tcp_mtu_to_mss(sk, inet_csk(sk)->icsk_pmtu_cookie) -
+		MAX_TCP_OPTION_SPACE;
+
+	syn_data = skb_copy_expand(syn, skb_headroom(syn), space,
+				   sk->sk_allocation);
+	if (syn_data == NULL)
+		goto fallback;
+
+	for (i = 0; i < fo->data->msg_iovlen && syn_data->len < space; ++i) {
+		struct iovec *iov = &fo->data->msg_iov[i];
+		unsigned char __user *from = iov->iov_base;
+		int len = iov->iov_len;
+
+		if (syn_data->len + len > space)
+			len = space - syn_data->len;
+		if (skb_add_data(syn_data, from, len))
+			goto fallback;
+	}
+	if (syn_data->len == 0)
+		goto fallback;
+
+	/* Queue a data-only packet after the regular SYN for retransmission */
+	data = pskb_copy(syn_data, sk->sk_allocation);
+	if (data == NULL)
+		goto fallback;
+	TCP_SKB_CB(data)->seq++;
+	TCP_SKB_CB(data)->end_seq = TCP_SKB_CB(data)->seq + data->len;
+	TCP_SKB_CB(data)->flags = TCPCB_FLAG_ACK | TCPCB_FLAG_PSH;
+	tcp_connect_queue_skb(sk, data);
+	fo->copied = data->len;
+
+	if (tcp_transmit_skb(sk, syn_data, 0, sk->sk_allocation) == 0) {
+		tp->syn_data = 1;
+		NET_INC_STATS(sock_net(sk), LINUX_MIB_TCPFASTOPENACTIVE);
+		goto done;
+	}
+	syn_data = NULL;
+
+fallback:
+	/* Send a regular SYN with Fast Open cookie request option */
+	if (fo->cookie.len > 0)
+		fo->cookie.len = 0;
+	tcp_transmit_skb(sk, syn, 1, sk->sk_allocation);
+	kfree_skb(syn_data);
+done:
+	fo->cookie.len = -1;  /* Exclude Fast Open option for SYN retries */
+}
+
 /*
  * Build a SYN and send it off.
  */
@@ -2362,12 +2535,13 @@ int tcp_connect(struct sock *sk)
 	/* Send it off. */
 	TCP_SKB_CB(buff)->when = tcp_time_stamp;
 	tp->retrans_stamp = TCP_SKB_CB(buff)->when;
-	skb_header_release(buff);
-	__tcp_add_write_queue_tail(sk, buff);
-	sk->sk_wmem_queued += buff->truesize;
-	sk_mem_charge(sk, buff->truesize);
-	tp->packets_out += tcp_skb_pcount(buff);
-	tcp_transmit_skb(sk, buff, 1, GFP_KERNEL);
+	tcp_connect_queue_skb(sk, buff);
+
+	/* Send off SYN; include data in Fast Open. */
+	if (tp->fastopen_req)
+		tcp_send_syn_data(sk, buff);
+	else
+		tcp_transmit_skb(sk, buff, 1, GFP_KERNEL);
 
 	/* We change tp->snd_nxt after the tcp_transmit_skb() call
 	 * in order to make this packet get counted in tcpOutSegs.
@@ -2382,6 +2556,36 @@ int tcp_connect(struct sock *sk)
 	return 0;
 }
 
+/* A Fast Open child goes to accept() before its SYN-ACK is acknowledged.
+ * Put the SYN-ACK on the child's write queue, so that the retransmit
+ * timer resends it like any other unacknowledged segment and the ACK
+ * completing the handshake is processed by tcp_ack() as usual.  The
+ * caller allocates @skb (MAX_TCP_HEADER + 15 bytes) before creating the
+ * child, so that this cannot fail.
+ */
+void tcp_fastopen_queue_synack(struct sock *child, struct sk_buff *skb)
+{
+	struct tcp_sock *tp = tcp_sk(child);
+
+	/* Reserve space for headers. */
+	skb_reserve(skb, MAX_TCP_HEADER);
+
+	tcp_init_nondata_skb(skb, tp->snd_una - 1,
+			     TCPCB_FLAG_SYN | TCPCB_FLAG_ACK);
+	TCP_SKB_CB(skb)->when = tcp_time_stamp;
+	tcp_connect_queue_skb(child, skb);
+
+	/* The SYN-ACK is outstanding; keep the urgent pointer in step so
+	 * that tcp_urg_mode() stays false.
+	 */
+	tp->snd_una--;
+	tp->snd_up = tp->snd_una;
+	tp->retrans_stamp = TCP_SKB_CB(skb)->when;
+
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+}
+
 /* Send out a delayed ack, the caller does the policy checking
  * to see if we should even be here.  See tcp_input.c:tcp_ack_snd_check()
  * for details.
@@ -51,6 +51,95 @@ EXPORT_SYMBOL_GPL(nfnetlink_parse_nat_setup_hook);
 DEFINE_SPINLOCK(nf_conntrack_lock);
 EXPORT_SYMBOL_GPL(nf_conntrack_lock);
 
+spinlock_t nf_conntrack_locks[NF_CONNTRACK_LOCKS] __cacheline_aligned_in_smp;
+EXPORT_SYMBOL_GPL(nf_conntrack_locks);
+
+static DEFINE_SPINLOCK(nf_conntrack_locks_all_lock);
+static int nf_conntrack_locks_all;
+
+/* Bumped whenever the hash table is resized, so that bucket numbers
+ * computed before taking the bucket locks can be revalidated. */
+static seqcount_t nf_conntrack_generation;
+
+/*
+ * Take one of the bucket locks.  While nf_conntrack_all_lock() is in
+ * effect, the bucket locks only get taken behind the global one.
+ */
+static void nf_conntrack_lock_stripe(spinlock_t *lock)
+{
+	spin_lock(lock);
+	if (likely(!ACCESS_ONCE(nf_conntrack_locks_all))) {
+		/* pairs with the barrier in nf_conntrack_all_unlock() */
+		smp_rmb();
+		return;
+	}
+
+	spin_unlock(lock);
+	spin_lock(&nf_conntrack_locks_all_lock);
+	spin_lock(lock);
+	spin_unlock(&nf_conntrack_locks_all_lock);
+}
+
+static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
+{
+	h1 %= NF_CONNTRACK_LOCKS;
+	h2 %= NF_CONNTRACK_LOCKS;
+	spin_unlock(&nf_conntrack_locks[h1]);
+	if (h1 != h2)
+		spin_unlock(&nf_conntrack_locks[h2]);
+}
+
+/* return true if we need to recompute hashes (in case hash table was resized) */
+static bool nf_conntrack_double_lock(unsigned int h1, unsigned int h2,
+				     unsigned int sequence)
+{
+	h1 %= NF_CONNTRACK_LOCKS;
+	h2 %= NF_CONNTRACK_LOCKS;
+	if (h1 <= h2) {
+		nf_conntrack_lock_stripe(&nf_conntrack_locks[h1]);
+		if (h1 != h2)
+			spin_lock_nested(&nf_conntrack_locks[h2],
+					 SINGLE_DEPTH_NESTING);
+	} else {
+		nf_conntrack_lock_stripe(&nf_conntrack_locks[h2]);
+		spin_lock_nested(&nf_conntrack_locks[h1],
+				 SINGLE_DEPTH_NESTING);
+	}
+	if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
+		nf_conntrack_double_unlock(h1, h2);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Exclude every holder of a bucket lock, for resizing or walking the
+ * whole hash table.  Must be called with BHs disabled.
+ */
+void nf_conntrack_all_lock(void)
+{
+	int i;
+
+	spin_lock(&nf_conntrack_locks_all_lock);
+	nf_conntrack_locks_all = 1;
+
+	for (i = 0; i < NF_CONNTRACK_LOCKS; i++) {
+		/* waits for the current holder; later ones see the flag */
+		spin_lock(&nf_conntrack_locks[i]);
+		spin_unlock(&nf_conntrack_locks[i]);
+	}
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_all_lock);
+
+void nf_conntrack_all_unlock(void)
+{
+	/* the table updates must be visible before the flag is cleared */
+	smp_mb();
+	nf_conntrack_locks_all = 0;
+	spin_unlock(&nf_conntrack_locks_all_lock);
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_all_unlock);
+
 unsigned int nf_conntrack_htable_size __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_htable_size);
 
@@ -162,12 +251,59 @@ EXPORT_SYMBOL_GPL(nf_ct_invert_tuple);
 static void
 clean_from_lists(struct nf_conn *ct)
 {
+	struct net *net = nf_ct_net(ct);
+	unsigned int hash, repl_hash, sequence;
+
 	pr_debug("clean_from_lists(%p)\n", ct);
+
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
+
 	hlist_del_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode);
 	hlist_del_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnode);
+	NF_CT_STAT_INC(net, delete_list);
+
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
 
 	/* Destroy all pending expectations */
-	nf_ct_remove_expectations(ct);
+	if (nfct_help(ct)) {
+		spin_lock_bh(&nf_conntrack_lock);
+		nf_ct_remove_expectations(ct);
+		spin_unlock_bh(&nf_conntrack_lock);
+	}
+}
+
+static void nf_ct_add_to_unconfirmed_list(struct nf_conn *ct)
+{
+	struct ct_pcpu *pcpu;
+
+	local_bh_disable();
+	ct->cpu = smp_processor_id();
+	pcpu = per_cpu_ptr(nf_ct_net(ct)->ct.pcpu_lists, ct->cpu);
+
+	spin_lock(&pcpu->lock);
+	hlist_add_head(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode,
+		       &pcpu->unconfirmed);
+	spin_unlock(&pcpu->lock);
+	local_bh_enable();
+}
+
+/* Called with BHs disabled */
+static void nf_ct_del_from_unconfirmed_list(struct nf_conn *ct)
+{
+	struct ct_pcpu *pcpu;
+
+	pcpu = per_cpu_ptr(nf_ct_net(ct)->ct.pcpu_lists, ct->cpu);
+
+	spin_lock(&pcpu->lock);
+	BUG_ON(hlist_unhashed(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode));
+	hlist_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode);
+	spin_unlock(&pcpu->lock);
 }
 
 static void
@@ -186,8 +322,8 @@ destroy_conntrack(struct nf_conntrack *nfct)
 	set_bit(IPS_DYING_BIT, &ct->status);
 
 	/* To make sure we don't get any weird locking issues here:
-	 * destroy_conntrack() MUST NOT be called with a write lock
-	 * to nf_conntrack_lock!!! -HW */
+	 * destroy_conntrack() MUST NOT be called with nf_conntrack_lock
+	 * or a bucket lock held!!! -HW */
 	rcu_read_lock();
 	l4proto = __nf_ct_l4proto_find(nf_ct_l3num(ct), nf_ct_protonum(ct));
 	if (l4proto && l4proto->destroy)
@@ -195,21 +331,23 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	rcu_read_unlock();
 
-	spin_lock_bh(&nf_conntrack_lock);
 	/* Expectations will have been removed in clean_from_lists,
 	 * except TFTP can create an expectation on the first packet,
 	 * before connection is in the list, so we need to clean here,
 	 * too. */
-	nf_ct_remove_expectations(ct);
+	if (nfct_help(ct)) {
+		spin_lock_bh(&nf_conntrack_lock);
+		nf_ct_remove_expectations(ct);
+		spin_unlock_bh(&nf_conntrack_lock);
+	}
 
+	local_bh_disable();
 	/* We overload first tuple to link into unconfirmed list. */
-	if (!nf_ct_is_confirmed(ct)) {
-		BUG_ON(hlist_unhashed(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode));
-		hlist_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode);
-	}
+	if (!nf_ct_is_confirmed(ct))
+		nf_ct_del_from_unconfirmed_list(ct);
 
 	NF_CT_STAT_INC(net, delete);
-	spin_unlock_bh(&nf_conntrack_lock);
+	local_bh_enable();
 
 	if (ct->master)
 		nf_ct_put(ct->master);
@@ -221,7 +359,6 @@ destroy_conntrack(struct nf_conntrack *nfct)
 static void death_by_timeout(unsigned long ul_conntrack)
 {
 	struct nf_conn *ct = (void *)ul_conntrack;
-	struct net *net = nf_ct_net(ct);
 	struct nf_conn_help *help = nfct_help(ct);
 	struct nf_conntrack_helper *helper;
 
@@ -233,12 +370,7 @@ static void death_by_timeout(unsigned long ul_conntrack)
 		rcu_read_unlock();
 	}
 
-	spin_lock_bh(&nf_conntrack_lock);
-	/* Inside lock so preempt is disabled on module removal path.
-	 * Otherwise we can get spurious warnings. */
-	NF_CT_STAT_INC(net, delete_list);
 	clean_from_lists(ct);
-	spin_unlock_bh(&nf_conntrack_lock);
 	nf_ct_put(ct);
 }
 
@@ -299,22 +431,56 @@ static void __nf_conntrack_hash_insert(struct nf_conn *ct,
 			   &net->ct.hash[repl_hash]);
 }
 
-void nf_conntrack_hash_insert(struct nf_conn *ct)
+/*
+ * Insert a conntrack that did not go through the unconfirmed list, as
+ * created by ctnetlink, unless a conntrack with either tuple exists.
+ * On success the hash table holds a reference and the timer is started.
+ */
+int nf_conntrack_hash_check_insert(struct nf_conn *ct)
 {
-	unsigned int hash, repl_hash;
+	struct net *net = nf_ct_net(ct);
+	unsigned int hash, repl_hash, sequence;
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_node *n;
 
-	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
 
+	/* See if there's one in the list already, including reverse */
+	hlist_for_each_entry(h, n, &net->ct.hash[hash], hnode)
+		if (nf_ct_tuple_equal(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+				      &h->tuple))
+			goto out;
+	hlist_for_each_entry(h, n, &net->ct.hash[repl_hash], hnode)
+		if (nf_ct_tuple_equal(&ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+				      &h->tuple))
+			goto out;
+
+	nf_conntrack_get(&ct->ct_general);
+	add_timer(&ct->timeout);
 	__nf_conntrack_hash_insert(ct, hash, repl_hash);
+	NF_CT_STAT_INC(net, insert);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
+	return 0;
+
+out:
+	NF_CT_STAT_INC(net, insert_failed);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
+	return -EEXIST;
 }
-EXPORT_SYMBOL_GPL(nf_conntrack_hash_insert);
+EXPORT_SYMBOL_GPL(nf_conntrack_hash_check_insert);
 
 /* Confirm a connection given skb; places it in hash table */
 int
 __nf_conntrack_confirm(struct sk_buff *skb)
 {
-	unsigned int hash, repl_hash;
+	unsigned int hash, repl_hash, sequence;
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 	struct nf_conn_help *help;
@@ -332,8 +498,12 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	if (CTINFO2DIR(ctinfo) != IP_CT_DIR_ORIGINAL)
 		return NF_ACCEPT;
 
-	hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-	repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	local_bh_disable();
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
+		repl_hash = hash_conntrack(&ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	} while (nf_conntrack_double_lock(hash, repl_hash, sequence));
 
 	/* We're not in hash table, and we refuse to set up related
 	   connections for unconfirmed conns.  But packet copies and
@@ -345,8 +515,6 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	NF_CT_ASSERT(!nf_ct_is_confirmed(ct));
 	pr_debug("Confirming conntrack %p\n", ct);
 
-	spin_lock_bh(&nf_conntrack_lock);
-
 	/* See if there's one in the list already, including reverse:
 	   NAT could have grabbed it without realizing, since we're
 	   not in the hash.  If there is, we lost race. */
@@ -359,8 +527,10 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 				      &h->tuple))
 			goto out;
 
-	/* Remove from unconfirmed list */
-	hlist_del(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode);
+	/* Remove from unconfirmed list.  The bucket locks stay held until
+	   we are hashed, so walkers of the unconfirmed lists and then the
+	   hash cannot miss us. */
+	nf_ct_del_from_unconfirmed_list(ct);
 
 	__nf_conntrack_hash_insert(ct, hash, repl_hash);
 	/* Timer relative to confirmation time, not original
@@ -371,7 +541,8 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	atomic_inc(&ct->ct_general.use);
 	set_bit(IPS_CONFIRMED_BIT, &ct->status);
 	NF_CT_STAT_INC(net, insert);
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
 	help = nfct_help(ct);
 	if (help && help->helper)
 		nf_conntrack_event_cache(IPCT_HELPER, ct);
@@ -386,7 +557,8 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 
 out:
 	NF_CT_STAT_INC(net, insert_failed);
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_conntrack_double_unlock(hash, repl_hash);
+	local_bh_enable();
 	return NF_DROP;
 }
 EXPORT_SYMBOL_GPL(__nf_conntrack_confirm);
@@ -543,7 +715,7 @@ init_conntrack(struct net *net,
 	struct nf_conn *ct;
 	struct nf_conn_help *help;
 	struct nf_conntrack_tuple repl_tuple;
-	struct nf_conntrack_expect *exp;
+	struct nf_conntrack_expect *exp = NULL;
 
 	if (!nf_ct_invert_tuple(&repl_tuple, tuple, l3proto, l4proto)) {
 		pr_debug("Can't invert tuple.\n");
@@ -564,38 +736,46 @@ init_conntrack(struct net *net,
 
 	nf_ct_acct_ext_add(ct, GFP_ATOMIC);
 
-	spin_lock_bh(&nf_conntrack_lock);
-	exp = nf_ct_find_expectation(net, tuple);
-	if (exp) {
-		pr_debug("conntrack: expectation arrives ct=%p exp=%p\n",
-			 ct, exp);
-		/* Welcome, Mr. Bond.  We've been expecting you... */
-		__set_bit(IPS_EXPECTED_BIT, &ct->status);
-		ct->master = exp->master;
-		if (exp->helper) {
-			help = nf_ct_helper_ext_add(ct, GFP_ATOMIC);
-			if (help)
-				rcu_assign_pointer(help->helper, exp->helper);
-		}
+	/* Most connections are not expected; only take the lock when
+	   there are expectations to look at. */
+	if (net->ct.expect_count) {
+		spin_lock_bh(&nf_conntrack_lock);
+		exp = nf_ct_find_expectation(net, tuple);
+		if (exp) {
+			pr_debug("conntrack: expectation arrives ct=%p exp=%p\n",
+				 ct, exp);
+			/* Welcome, Mr. Bond.  We've been expecting you... */
+			__set_bit(IPS_EXPECTED_BIT, &ct->status);
+			ct->master = exp->master;
+			if (exp->helper) {
+				help = nf_ct_helper_ext_add(ct, GFP_ATOMIC);
+				if (help)
+					rcu_assign_pointer(help->helper,
+							   exp->helper);
+			}
 
 #ifdef CONFIG_NF_CONNTRACK_MARK
-		ct->mark = exp->master->mark;
+			ct->mark = exp->master->mark;
 #endif
 #ifdef CONFIG_NF_CONNTRACK_SECMARK
-		ct->secmark = exp->master->secmark;
+			ct->secmark = exp->master->secmark;
 #endif
-		nf_conntrack_get(&ct->master->ct_general);
-		NF_CT_STAT_INC(net, expect_new);
-	} else {
+			nf_conntrack_get(&ct->master->ct_general);
+			NF_CT_STAT_INC(net, expect_new);
+		}
+		spin_unlock_bh(&nf_conntrack_lock);
+	}
+
+	/* The helper lookup is RCU protected.  Helper unregistration
+	   waits for an RCU grace period before it walks the unconfirmed
+	   lists, so it sees this conntrack. */
+	if (!exp) {
 		__nf_ct_try_assign_helper(ct, GFP_ATOMIC);
-		NF_CT_STAT_INC(net, new);
+		NF_CT_STAT_INC_ATOMIC(net, new);
 	}
 
 	/* Overload tuple linked list to put us in unconfirmed list. */
-	hlist_add_head(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnode,
-		       &net->ct.unconfirmed);
-
-	spin_unlock_bh(&nf_conntrack_lock);
+	nf_ct_add_to_unconfirmed_list(ct);
 
 	if (exp) {
 		if (exp->expectfn)
@@ -781,6 +961,27 @@ void nf_conntrack_alter_reply(struct nf_conn *ct,
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_alter_reply);
 
+/* The counters are 64 bit, so they need a lock; one of the bucket
+   locks, picked by conntrack address, keeps this off a global one. */
+static void nf_ct_acct_update(struct nf_conn *ct,
+			      enum ip_conntrack_info ctinfo,
+			      const struct sk_buff *skb)
+{
+	struct nf_conn_counter *acct;
+	spinlock_t *lock;
+
+	acct = nf_conn_acct_find(ct);
+	if (!acct)
+		return;
+
+	lock = &nf_conntrack_locks[((unsigned long)ct / L1_CACHE_BYTES) %
+				   NF_CONNTRACK_LOCKS];
+	spin_lock_bh(lock);
+	acct[CTINFO2DIR(ctinfo)].packets++;
+	acct[CTINFO2DIR(ctinfo)].bytes += skb->len - skb_network_offset(skb);
+	spin_unlock_bh(lock);
+}
+
 /* Refresh conntrack for this many jiffies and do accounting if do_acct is 1 */
 void __nf_ct_refresh_acct(struct nf_conn *ct,
 			  enum ip_conntrack_info ctinfo,
@@ -793,8 +994,6 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 	NF_CT_ASSERT(ct->timeout.data == (unsigned long)ct);
 	NF_CT_ASSERT(skb);
 
-	spin_lock_bh(&nf_conntrack_lock);
-
 	/* Only update if this is not a fixed timeout */
 	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
 		goto acct;
@@ -808,7 +1007,9 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 
 		/* Only update the timeout if the new timeout is at least
 		   HZ jiffies from the old timeout. Need del_timer for race
-		   avoidance (may already be dying). */
+		   avoidance (may already be dying).  Only the caller whose
+		   del_timer succeeds re-adds the timer, so this needs no
+		   lock. */
 		if (newtime - ct->timeout.expires >= HZ
 		    && del_timer(&ct->timeout)) {
 			ct->timeout.expires = newtime;
@@ -818,18 +1019,8 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 	}
 
 acct:
-	if (do_acct) {
-		struct nf_conn_counter *acct;
-
-		acct = nf_conn_acct_find(ct);
-		if (acct) {
-			acct[CTINFO2DIR(ctinfo)].packets++;
-			acct[CTINFO2DIR(ctinfo)].bytes +=
-				skb->len - skb_network_offset(skb);
-		}
-	}
-
-	spin_unlock_bh(&nf_conntrack_lock);
+	if (do_acct)
+		nf_ct_acct_update(ct, ctinfo, skb);
 
 	/* must be unlocked when calling event cache */
 	if (event)
@@ -842,18 +1033,8 @@ bool __nf_ct_kill_acct(struct nf_conn *ct,
 		       const struct sk_buff *skb,
 		       int do_acct)
 {
-	if (do_acct) {
-		struct nf_conn_counter *acct;
-
-		spin_lock_bh(&nf_conntrack_lock);
-		acct = nf_conn_acct_find(ct);
-		if (acct) {
-			acct[CTINFO2DIR(ctinfo)].packets++;
-			acct[CTINFO2DIR(ctinfo)].bytes +=
-				skb->len - skb_network_offset(skb);
-		}
-		spin_unlock_bh(&nf_conntrack_lock);
-	}
+	if (do_acct)
+		nf_ct_acct_update(ct, ctinfo, skb);
 
 	if (del_timer(&ct->timeout)) {
 		ct->timeout.function((unsigned long)ct);
@@ -931,25 +1112,42 @@ get_next_corpse(struct net *net, int (*iter)(struct nf_conn *i, void *data),
 	struct nf_conntrack_tuple_hash *h;
 	struct nf_conn *ct;
 	struct hlist_node *n;
+	spinlock_t *lockp;
+	int cpu;
 
-	spin_lock_bh(&nf_conntrack_lock);
 	for (; *bucket < nf_conntrack_htable_size; (*bucket)++) {
-		hlist_for_each_entry(h, n, &net->ct.hash[*bucket], hnode) {
+		lockp = &nf_conntrack_locks[*bucket % NF_CONNTRACK_LOCKS];
+		local_bh_disable();
+		nf_conntrack_lock_stripe(lockp);
+		/* the table may have been resized meanwhile */
+		if (*bucket < nf_conntrack_htable_size) {
+			hlist_for_each_entry(h, n, &net->ct.hash[*bucket],
+					     hnode) {
+				ct = nf_ct_tuplehash_to_ctrack(h);
+				if (iter(ct, data))
+					goto found;
+			}
+		}
+		spin_unlock(lockp);
+		local_bh_enable();
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct ct_pcpu *pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock_bh(&pcpu->lock);
+		hlist_for_each_entry(h, n, &pcpu->unconfirmed, hnode) {
 			ct = nf_ct_tuplehash_to_ctrack(h);
 			if (iter(ct, data))
-				goto found;
+				set_bit(IPS_DYING_BIT, &ct->status);
 		}
+		spin_unlock_bh(&pcpu->lock);
 	}
-	hlist_for_each_entry(h, n, &net->ct.unconfirmed, hnode) {
-		ct = nf_ct_tuplehash_to_ctrack(h);
-		if (iter(ct, data))
-			set_bit(IPS_DYING_BIT, &ct->status);
-	}
-	spin_unlock_bh(&nf_conntrack_lock);
 	return NULL;
 found:
 	atomic_inc(&ct->ct_general.use);
-	spin_unlock_bh(&nf_conntrack_lock);
+	spin_unlock(lockp);
+	local_bh_enable();
 	return ct;
 }
 
@@ -1034,6 +1232,7 @@ static void nf_conntrack_cleanup_net(struct net *net)
 	nf_conntrack_acct_fini(net);
 	nf_conntrack_expect_fini(net);
 	free_percpu(net->ct.stat);
+	free_percpu(net->ct.pcpu_lists);
 }
 
 /* Mishearing the voices in his head, our hero wonders how he's
@@ -1108,9 +1307,11 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	/* Lookups in the old hash might happen in parallel, which means we
 	 * might get false negatives during connection lookup. New connections
 	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the lock.
+	 * though since that required taking the bucket locks.
 	 */
-	spin_lock_bh(&nf_conntrack_lock);
+	local_bh_disable();
+	nf_conntrack_all_lock();
+	write_seqcount_begin(&nf_conntrack_generation);
 	for (i = 0; i < nf_conntrack_htable_size; i++) {
 		while (!hlist_empty(&init_net.ct.hash[i])) {
 			h = hlist_entry(init_net.ct.hash[i].first,
@@ -1128,7 +1329,9 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	init_net.ct.hash_vmalloc = vmalloced;
 	init_net.ct.hash = hash;
 	nf_conntrack_hash_rnd = rnd;
-	spin_unlock_bh(&nf_conntrack_lock);
+	write_seqcount_end(&nf_conntrack_generation);
+	nf_conntrack_all_unlock();
+	local_bh_enable();
 
 	nf_ct_free_hashtable(old_hash, old_vmalloced, old_size);
 	return 0;
@@ -1141,7 +1344,11 @@ module_param_call(hashsize, nf_conntrack_set_hashsize, param_get_uint,
 static int nf_conntrack_init_init_net(void)
 {
 	int max_factor = 8;
-	int ret;
+	int ret, i;
+
+	for (i = 0; i < NF_CONNTRACK_LOCKS; i++)
+		spin_lock_init(&nf_conntrack_locks[i]);
+	seqcount_init(&nf_conntrack_generation);
 
 	/* Idea from tcp.c: use 1/16384 of memory.  On i386: 32MB
 	 * machine has 512 buckets. >= 1GB machines have 16384 buckets. */
@@ -1195,10 +1402,22 @@ err_cache:
 
 static int nf_conntrack_init_net(struct net *net)
 {
-	int ret;
+	int ret, cpu;
 
 	atomic_set(&net->ct.count, 0);
-	INIT_HLIST_HEAD(&net->ct.unconfirmed);
+
+	net->ct.pcpu_lists = alloc_percpu(struct ct_pcpu);
+	if (!net->ct.pcpu_lists) {
+		ret = -ENOMEM;
+		goto err_pcpu_lists;
+	}
+	for_each_possible_cpu(cpu) {
+		struct ct_pcpu *pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock_init(&pcpu->lock);
+		INIT_HLIST_HEAD(&pcpu->unconfirmed);
+	}
+
 	net->ct.stat = alloc_percpu(struct ip_conntrack_stat);
 	if (!net->ct.stat) {
 		ret = -ENOMEM;
@@ -1242,6 +1461,8 @@ err_hash:
 err_ecache:
 	free_percpu(net->ct.stat);
 err_stat:
+	free_percpu(net->ct.pcpu_lists);
+err_pcpu_lists:
 	return ret;
 }
 
@@ -159,6 +159,7 @@ static void __nf_conntrack_helper_unregister(struct nf_conntrack_helper *me,
 	struct nf_conntrack_expect *exp;
 	const struct hlist_node *n, *next;
 	unsigned int i;
+	int cpu;
 
 	/* Get rid of expectations */
 	for (i = 0; i < nf_ct_expect_hsize; i++) {
@@ -173,13 +174,24 @@ static void __nf_conntrack_helper_unregister(struct nf_conntrack_helper *me,
 		}
 	}
 
-	/* Get rid of expecteds, set helpers to NULL. */
-	hlist_for_each_entry(h, n, &net->ct.unconfirmed, hnode)
-		unhelp(h, me);
+	/* Get rid of expecteds, set helpers to NULL.  The unconfirmed
+	 * lists go first: a conntrack that leaves them is in the hash
+	 * before its bucket locks are dropped, so it is seen there. */
+	for_each_possible_cpu(cpu) {
+		struct ct_pcpu *pcpu = per_cpu_ptr(net->ct.pcpu_lists, cpu);
+
+		spin_lock(&pcpu->lock);
+		hlist_for_each_entry(h, n, &pcpu->unconfirmed, hnode)
+			unhelp(h, me);
+		spin_unlock(&pcpu->lock);
+	}
+
+	nf_conntrack_all_lock();
 	for (i = 0; i < nf_conntrack_htable_size; i++) {
 		hlist_for_each_entry(h, n, &net->ct.hash[i], hnode)
 			unhelp(h, me);
 	}
+	nf_conntrack_all_unlock();
 }
 
 void nf_conntrack_helper_unregister(struct nf_conntrack_helper *me)
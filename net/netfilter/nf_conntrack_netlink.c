@@ -1246,9 +1246,11 @@ ctnetlink_create_conntrack(struct nlattr *cda[],
 		ct->master = master_ct;
 	}
 
-	nf_conntrack_get(&ct->ct_general);
-	add_timer(&ct->timeout);
-	nf_conntrack_hash_insert(ct);
+	err = nf_conntrack_hash_check_insert(ct);
+	if (err < 0) {
+		rcu_read_unlock();
+		goto err;
+	}
 	rcu_read_unlock();
 	ctnetlink_event_report(ct, pid, report);
 	nf_ct_put(ct);
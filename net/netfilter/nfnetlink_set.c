@@ -0,0 +1,1084 @@
+/*
+ * This is a module which is used for keeping sets of IPv4 addresses,
+ * networks and ports which can be matched against with a single rule
+ * (see xt_set.c), instead of one rule per address.  Sets are created,
+ * filled and listed via nfnetlink.
+ *
+ * Set types:
+ *
+ *  hash:ip	 IPv4 host addresses
+ *  hash:net	 IPv4 networks, longest prefix wins
+ *  bitmap:port  a contiguous range of TCP/UDP/SCTP/DCCP ports
+ *
+ * Per-packet lookups are lockless: the hash types keep RCU-protected
+ * chains and the port bitmap is tested with test_bit(), so the cost of a
+ * lookup does not depend on the number of elements in the set.
+ *
+ * All configuration (nfnetlink requests, match checkentry/destroy and set
+ * dumps) is serialised by nf_set_mutex.
+ *
+ * This software may be used and distributed according to the terms
+ * of the GNU General Public License, incorporated herein by reference.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/rculist.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_set.h>
+#include <net/ip.h>
+#include <net/netlink.h>
+#include <net/netfilter/nf_set.h>
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("IPv4 address, network and port sets over nfnetlink");
+MODULE_ALIAS_NFNL_SUBSYS(NFNL_SUBSYS_IPSET);
+
+#define NFSET_HASHSIZE_MIN	64
+#define NFSET_HASHSIZE_DEFAULT	1024
+#define NFSET_MAXELEM_DEFAULT	65536
+
+struct nf_set;
+
+struct nf_set_type {
+	const char	*name;
+	int		(*create)(struct nf_set *set, struct nlattr *tb[]);
+	void		(*destroy)(struct nf_set *set);
+	void		(*flush)(struct nf_set *set);
+	int		(*add)(struct nf_set *set, struct nlattr *tb[]);
+	int		(*del)(struct nf_set *set, struct nlattr *tb[]);
+	bool		(*test)(const struct nf_set *set,
+				const struct sk_buff *skb, unsigned int flags);
+	int		(*dump_header)(const struct nf_set *set,
+				       struct sk_buff *skb);
+	/* returns 0 when done, > 0 when the skb is full */
+	int		(*dump)(const struct nf_set *set, struct sk_buff *skb,
+				struct netlink_callback *cb);
+};
+
+struct nf_set {
+	char			name[NFSET_MAXNAMELEN];
+	const struct nf_set_type *type;
+	unsigned int		ref;
+	unsigned int		elements;
+	void			*data;
+};
+
+static DEFINE_MUTEX(nf_set_mutex);
+static struct nf_set *nf_set_list[NFSET_MAX_SETS] __read_mostly;
+
+/***********************************************************************
+ * hash:ip and hash:net
+ ***********************************************************************/
+
+struct nfset_hash_elem {
+	struct hlist_node	node;
+	__be32			ip;
+	u_int8_t		cidr;
+	struct rcu_head		rcu;
+};
+
+struct nfset_hash_table {
+	unsigned int		size;		/* power of two */
+	struct hlist_head	bucket[0];
+};
+
+struct nfset_hash {
+	struct nfset_hash_table	*table;
+	u_int32_t		initval;
+	u_int32_t		maxelem;
+	u_int8_t		mincidr;	/* 32 for hash:ip */
+	/* number of elements per prefix length, for longest prefix lookups */
+	unsigned int		nets[33];
+};
+
+static inline __be32 nfset_netmask(u_int8_t cidr)
+{
+	return cidr ? htonl(~0U << (32 - cidr)) : 0;
+}
+
+static inline unsigned int
+nfset_hash_bucket(const struct nfset_hash *h,
+		  const struct nfset_hash_table *t, __be32 ip, u_int8_t cidr)
+{
+	return jhash_2words((__force u32)ip, cidr, h->initval) & (t->size - 1);
+}
+
+static struct nfset_hash_table *nfset_hash_table_alloc(unsigned int size)
+{
+	struct nfset_hash_table *t;
+	size_t sz = sizeof(*t) + size * sizeof(struct hlist_head);
+	unsigned int i;
+
+	if (sz <= PAGE_SIZE)
+		t = kmalloc(sz, GFP_KERNEL);
+	else
+		t = vmalloc(sz);
+	if (!t)
+		return NULL;
+
+	t->size = size;
+	for (i = 0; i < size; i++)
+		INIT_HLIST_HEAD(&t->bucket[i]);
+	return t;
+}
+
+static void nfset_hash_table_free(struct nfset_hash_table *t)
+{
+	struct nfset_hash_elem *e;
+	struct hlist_node *n, *tmp;
+	unsigned int i;
+
+	for (i = 0; i < t->size; i++)
+		hlist_for_each_entry_safe(e, n, tmp, &t->bucket[i], node)
+			kfree(e);
+
+	if (sizeof(*t) + t->size * sizeof(struct hlist_head) <= PAGE_SIZE)
+		kfree(t);
+	else
+		vfree(t);
+}
+
+static void nfset_hash_elem_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct nfset_hash_elem, rcu));
+}
+
+static struct nfset_hash_elem *
+nfset_hash_find(const struct nfset_hash *h, const struct nfset_hash_table *t,
+		__be32 ip, u_int8_t cidr)
+{
+	struct nfset_hash_elem *e;
+	struct hlist_node *n;
+
+	hlist_for_each_entry_rcu(e, n,
+				 &t->bucket[nfset_hash_bucket(h, t, ip, cidr)],
+				 node) {
+		if (e->ip == ip && e->cidr == cidr)
+			return e;
+	}
+	return NULL;
+}
+
+/* Elements are never moved between chains while readers may walk them:
+ * the table is copied, published, and the old one freed after a grace
+ * period.  Called with nf_set_mutex held.
+ */
+static int nfset_hash_resize(struct nfset_hash *h, unsigned int size)
+{
+	struct nfset_hash_table *old = h->table, *new;
+	struct nfset_hash_elem *e, *ne;
+	struct hlist_node *n;
+	unsigned int i;
+
+	new = nfset_hash_table_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	for (i = 0; i < old->size; i++) {
+		hlist_for_each_entry(e, n, &old->bucket[i], node) {
+			ne = kmalloc(sizeof(*ne), GFP_KERNEL);
+			if (!ne) {
+				nfset_hash_table_free(new);
+				return -ENOMEM;
+			}
+			ne->ip = e->ip;
+			ne->cidr = e->cidr;
+			hlist_add_head(&ne->node,
+				       &new->bucket[nfset_hash_bucket(h, new,
+								      ne->ip,
+								      ne->cidr)]);
+		}
+	}
+
+	rcu_assign_pointer(h->table, new);
+	synchronize_rcu();
+	nfset_hash_table_free(old);
+	return 0;
+}
+
+static int nfset_hash_create(struct nf_set *set, struct nlattr *tb[],
+			     u_int8_t mincidr)
+{
+	struct nfset_hash *h;
+	u_int32_t size = NFSET_HASHSIZE_DEFAULT;
+
+	h = kzalloc(sizeof(*h), GFP_KERNEL);
+	if (!h)
+		return -ENOMEM;
+
+	if (tb[NFSET_ATTR_HASHSIZE])
+		size = ntohl(nla_get_be32(tb[NFSET_ATTR_HASHSIZE]));
+	if (size < NFSET_HASHSIZE_MIN)
+		size = NFSET_HASHSIZE_MIN;
+	if (size > (1U << 24))
+		size = 1U << 24;
+	size = roundup_pow_of_two(size);
+
+	h->maxelem = NFSET_MAXELEM_DEFAULT;
+	if (tb[NFSET_ATTR_MAXELEM])
+		h->maxelem = ntohl(nla_get_be32(tb[NFSET_ATTR_MAXELEM]));
+	h->mincidr = mincidr;
+	get_random_bytes(&h->initval, sizeof(h->initval));
+
+	h->table = nfset_hash_table_alloc(size);
+	if (!h->table) {
+		kfree(h);
+		return -ENOMEM;
+	}
+	set->data = h;
+	return 0;
+}
+
+static int nfset_hash_ip_create(struct nf_set *set, struct nlattr *tb[])
+{
+	return nfset_hash_create(set, tb, 32);
+}
+
+static int nfset_hash_net_create(struct nf_set *set, struct nlattr *tb[])
+{
+	return nfset_hash_create(set, tb, 0);
+}
+
+static void nfset_hash_destroy(struct nf_set *set)
+{
+	struct nfset_hash *h = set->data;
+
+	nfset_hash_table_free(h->table);
+	kfree(h);
+}
+
+static void nfset_hash_flush(struct nf_set *set)
+{
+	struct nfset_hash *h = set->data;
+	struct nfset_hash_table *old = h->table, *new;
+
+	new = nfset_hash_table_alloc(old->size);
+	if (!new) {
+		/* fall back to unlinking the elements one by one */
+		struct nfset_hash_elem *e;
+		struct hlist_node *n, *tmp;
+		unsigned int i;
+
+		for (i = 0; i < old->size; i++) {
+			hlist_for_each_entry_safe(e, n, tmp, &old->bucket[i],
+						  node) {
+				hlist_del_rcu(&e->node);
+				call_rcu(&e->rcu, nfset_hash_elem_free_rcu);
+			}
+		}
+	} else {
+		rcu_assign_pointer(h->table, new);
+		synchronize_rcu();
+		nfset_hash_table_free(old);
+	}
+	memset(h->nets, 0, sizeof(h->nets));
+	set->elements = 0;
+}
+
+static int nfset_hash_parse(const struct nfset_hash *h, struct nlattr *tb[],
+			    __be32 *ip, u_int8_t *cidr)
+{
+	if (!tb[NFSET_ATTR_IP])
+		return -EINVAL;
+
+	*cidr = 32;
+	if (tb[NFSET_ATTR_CIDR]) {
+		*cidr = nla_get_u8(tb[NFSET_ATTR_CIDR]);
+		if (*cidr > 32 || *cidr < h->mincidr)
+			return -EINVAL;
+	}
+	*ip = nla_get_be32(tb[NFSET_ATTR_IP]) & nfset_netmask(*cidr);
+	return 0;
+}
+
+static int nfset_hash_add(struct nf_set *set, struct nlattr *tb[])
+{
+	struct nfset_hash *h = set->data;
+	struct nfset_hash_table *t;
+	struct nfset_hash_elem *e;
+	u_int8_t cidr;
+	__be32 ip;
+	int ret;
+
+	ret = nfset_hash_parse(h, tb, &ip, &cidr);
+	if (ret < 0)
+		return ret;
+
+	if (nfset_hash_find(h, h->table, ip, cidr))
+		return -EEXIST;
+	if (set->elements >= h->maxelem)
+		return -ENOSPC;
+
+	/* keep the average chain length at or below one */
+	if (set->elements >= h->table->size && h->table->size < (1U << 24)) {
+		ret = nfset_hash_resize(h, h->table->size * 2);
+		if (ret < 0)
+			return ret;
+	}
+
+	e = kmalloc(sizeof(*e), GFP_KERNEL);
+	if (!e)
+		return -ENOMEM;
+	e->ip = ip;
+	e->cidr = cidr;
+
+	t = h->table;
+	hlist_add_head_rcu(&e->node, &t->bucket[nfset_hash_bucket(h, t, ip,
+								   cidr)]);
+	h->nets[cidr]++;
+	set->elements++;
+	return 0;
+}
+
+static int nfset_hash_del(struct nf_set *set, struct nlattr *tb[])
+{
+	struct nfset_hash *h = set->data;
+	struct nfset_hash_elem *e;
+	u_int8_t cidr;
+	__be32 ip;
+	int ret;
+
+	ret = nfset_hash_parse(h, tb, &ip, &cidr);
+	if (ret < 0)
+		return ret;
+
+	e = nfset_hash_find(h, h->table, ip, cidr);
+	if (!e)
+		return -ENOENT;
+
+	hlist_del_rcu(&e->node);
+	call_rcu(&e->rcu, nfset_hash_elem_free_rcu);
+	h->nets[cidr]--;
+	set->elements--;
+	return 0;
+}
+
+static bool nfset_hash_test(const struct nf_set *set,
+			    const struct sk_buff *skb, unsigned int flags)
+{
+	const struct nfset_hash *h = set->data;
+	const struct nfset_hash_table *t;
+	__be32 addr;
+	int cidr;
+
+	addr = flags & NFSET_SRC ? ip_hdr(skb)->saddr : ip_hdr(skb)->daddr;
+	t = rcu_dereference(h->table);
+
+	/* hash:ip only ever populates nets[32], so this is a single lookup */
+	for (cidr = 32; cidr >= h->mincidr; cidr--) {
+		if (!h->nets[cidr])
+			continue;
+		if (nfset_hash_find(h, t, addr & nfset_netmask(cidr), cidr))
+			return true;
+	}
+	return false;
+}
+
+static int nfset_hash_dump_header(const struct nf_set *set,
+				  struct sk_buff *skb)
+{
+	const struct nfset_hash *h = set->data;
+
+	NLA_PUT_BE32(skb, NFSET_ATTR_HASHSIZE, htonl(h->table->size));
+	NLA_PUT_BE32(skb, NFSET_ATTR_MAXELEM, htonl(h->maxelem));
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static struct nlmsghdr *nfset_list_elem_start(struct sk_buff *skb,
+					       struct netlink_callback *cb,
+					       const struct nf_set *set);
+
+/* cb->args[1] is the bucket, cb->args[2] the number of elements of that
+ * bucket already dumped.
+ */
+static int nfset_hash_dump(const struct nf_set *set, struct sk_buff *skb,
+			   struct netlink_callback *cb)
+{
+	const struct nfset_hash *h = set->data;
+	const struct nfset_hash_table *t = h->table;
+	const struct nfset_hash_elem *e;
+	const struct hlist_node *n;
+	struct nlmsghdr *nlh;
+	unsigned char *b;
+	unsigned long i;
+
+	for (; cb->args[1] < t->size; cb->args[1]++, cb->args[2] = 0) {
+		i = 0;
+		hlist_for_each_entry(e, n, &t->bucket[cb->args[1]], node) {
+			if (i++ < cb->args[2])
+				continue;
+			b = skb_tail_pointer(skb);
+			nlh = nfset_list_elem_start(skb, cb, set);
+			if (!nlh)
+				goto nla_put_failure;
+			NLA_PUT_BE32(skb, NFSET_ATTR_IP, e->ip);
+			NLA_PUT_U8(skb, NFSET_ATTR_CIDR, e->cidr);
+			nlmsg_end(skb, nlh);
+			cb->args[2]++;
+		}
+	}
+	return 0;
+
+nla_put_failure:
+	nlmsg_trim(skb, b);
+	return 1;
+}
+
+/***********************************************************************
+ * bitmap:port
+ ***********************************************************************/
+
+struct nfset_bitmap_port {
+	u_int16_t		first;
+	u_int16_t		last;
+	unsigned long		map[0];
+};
+
+static int nfset_port_create(struct nf_set *set, struct nlattr *tb[])
+{
+	struct nfset_bitmap_port *m;
+	u_int16_t first, last;
+
+	if (!tb[NFSET_ATTR_PORT_FROM] || !tb[NFSET_ATTR_PORT_TO])
+		return -EINVAL;
+
+	first = ntohs(nla_get_be16(tb[NFSET_ATTR_PORT_FROM]));
+	last = ntohs(nla_get_be16(tb[NFSET_ATTR_PORT_TO]));
+	if (first > last)
+		return -EINVAL;
+
+	m = kzalloc(sizeof(*m) + BITS_TO_LONGS(last - first + 1) *
+		    sizeof(unsigned long), GFP_KERNEL);
+	if (!m)
+		return -ENOMEM;
+	m->first = first;
+	m->last = last;
+	set->data = m;
+	return 0;
+}
+
+static void nfset_port_destroy(struct nf_set *set)
+{
+	kfree(set->data);
+}
+
+static void nfset_port_flush(struct nf_set *set)
+{
+	struct nfset_bitmap_port *m = set->data;
+
+	bitmap_zero(m->map, m->last - m->first + 1);
+	set->elements = 0;
+}
+
+static int nfset_port_parse(const struct nfset_bitmap_port *m,
+			    struct nlattr *tb[], u_int16_t *port)
+{
+	if (!tb[NFSET_ATTR_PORT])
+		return -EINVAL;
+
+	*port = ntohs(nla_get_be16(tb[NFSET_ATTR_PORT]));
+	if (*port < m->first || *port > m->last)
+		return -ERANGE;
+	return 0;
+}
+
+static int nfset_port_add(struct nf_set *set, struct nlattr *tb[])
+{
+	struct nfset_bitmap_port *m = set->data;
+	u_int16_t port;
+	int ret;
+
+	ret = nfset_port_parse(m, tb, &port);
+	if (ret < 0)
+		return ret;
+	if (test_and_set_bit(port - m->first, m->map))
+		return -EEXIST;
+	set->elements++;
+	return 0;
+}
+
+static int nfset_port_del(struct nf_set *set, struct nlattr *tb[])
+{
+	struct nfset_bitmap_port *m = set->data;
+	u_int16_t port;
+	int ret;
+
+	ret = nfset_port_parse(m, tb, &port);
+	if (ret < 0)
+		return ret;
+	if (!test_and_clear_bit(port - m->first, m->map))
+		return -ENOENT;
+	set->elements--;
+	return 0;
+}
+
+static bool nfset_port_test(const struct nf_set *set,
+			    const struct sk_buff *skb, unsigned int flags)
+{
+	const struct nfset_bitmap_port *m = set->data;
+	const struct iphdr *iph = ip_hdr(skb);
+	__be16 _port, *pptr;
+	u_int16_t port;
+
+	if (iph->frag_off & htons(IP_OFFSET))
+		return false;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		break;
+	default:
+		return false;
+	}
+
+	/* all of the above start with the source and destination port */
+	pptr = skb_header_pointer(skb, ip_hdrlen(skb) +
+				  (flags & NFSET_SRC ? 0 : sizeof(__be16)),
+				  sizeof(_port), &_port);
+	if (!pptr)
+		return false;
+
+	port = ntohs(*pptr);
+	if (port < m->first || port > m->last)
+		return false;
+	return test_bit(port - m->first, m->map);
+}
+
+static int nfset_port_dump_header(const struct nf_set *set,
+				  struct sk_buff *skb)
+{
+	const struct nfset_bitmap_port *m = set->data;
+
+	NLA_PUT_BE16(skb, NFSET_ATTR_PORT_FROM, htons(m->first));
+	NLA_PUT_BE16(skb, NFSET_ATTR_PORT_TO, htons(m->last));
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+/* cb->args[1] is the next bit to look at. */
+static int nfset_port_dump(const struct nf_set *set, struct sk_buff *skb,
+			   struct netlink_callback *cb)
+{
+	const struct nfset_bitmap_port *m = set->data;
+	unsigned long size = m->last - m->first + 1;
+	struct nlmsghdr *nlh;
+	unsigned char *b;
+
+	for (;;) {
+		cb->args[1] = find_next_bit(m->map, size, cb->args[1]);
+		if (cb->args[1] >= size)
+			break;
+		b = skb_tail_pointer(skb);
+		nlh = nfset_list_elem_start(skb, cb, set);
+		if (!nlh)
+			goto nla_put_failure;
+		NLA_PUT_BE16(skb, NFSET_ATTR_PORT,
+			     htons(m->first + cb->args[1]));
+		nlmsg_end(skb, nlh);
+		cb->args[1]++;
+	}
+	return 0;
+
+nla_put_failure:
+	nlmsg_trim(skb, b);
+	return 1;
+}
+
+static const struct nf_set_type nf_set_types[] = {
+	{
+		.name		= "hash:ip",
+		.create		= nfset_hash_ip_create,
+		.destroy	= nfset_hash_destroy,
+		.flush		= nfset_hash_flush,
+		.add		= nfset_hash_add,
+		.del		= nfset_hash_del,
+		.test		= nfset_hash_test,
+		.dump_header	= nfset_hash_dump_header,
+		.dump		= nfset_hash_dump,
+	},
+	{
+		.name		= "hash:net",
+		.create		= nfset_hash_net_create,
+		.destroy	= nfset_hash_destroy,
+		.flush		= nfset_hash_flush,
+		.add		= nfset_hash_add,
+		.del		= nfset_hash_del,
+		.test		= nfset_hash_test,
+		.dump_header	= nfset_hash_dump_header,
+		.dump		= nfset_hash_dump,
+	},
+	{
+		.name		= "bitmap:port",
+		.create		= nfset_port_create,
+		.destroy	= nfset_port_destroy,
+		.flush		= nfset_port_flush,
+		.add		= nfset_port_add,
+		.del		= nfset_port_del,
+		.test		= nfset_port_test,
+		.dump_header	= nfset_port_dump_header,
+		.dump		= nfset_port_dump,
+	},
+};
+
+/***********************************************************************
+ * Set table and kernel API
+ ***********************************************************************/
+
+/* Called with nf_set_mutex held. */
+static u_int16_t __nf_set_find(const char *name)
+{
+	u_int16_t i;
+
+	for (i = 0; i < NFSET_MAX_SETS; i++)
+		if (nf_set_list[i] &&
+		    !strncmp(nf_set_list[i]->name, name, NFSET_MAXNAMELEN))
+			return i;
+	return NFSET_INVALID_INDEX;
+}
+
+u_int16_t nf_set_get_byname(const char *name)
+{
+	u_int16_t index;
+
+	mutex_lock(&nf_set_mutex);
+	index = __nf_set_find(name);
+	if (index != NFSET_INVALID_INDEX)
+		nf_set_list[index]->ref++;
+	mutex_unlock(&nf_set_mutex);
+	return index;
+}
+EXPORT_SYMBOL_GPL(nf_set_get_byname);
+
+void nf_set_put(u_int16_t index)
+{
+	mutex_lock(&nf_set_mutex);
+	BUG_ON(!nf_set_list[index] || !nf_set_list[index]->ref);
+	nf_set_list[index]->ref--;
+	mutex_unlock(&nf_set_mutex);
+}
+EXPORT_SYMBOL_GPL(nf_set_put);
+
+bool nf_set_test(u_int16_t index, const struct sk_buff *skb,
+		 unsigned int flags)
+{
+	const struct nf_set *set;
+	bool ret;
+
+	rcu_read_lock();
+	set = rcu_dereference(nf_set_list[index]);
+	ret = set->type->test(set, skb, flags);
+	rcu_read_unlock();
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nf_set_test);
+
+/***********************************************************************
+ * nfnetlink interface
+ ***********************************************************************/
+
+static const struct nla_policy nfset_policy[NFSET_ATTR_MAX+1] = {
+	[NFSET_ATTR_NAME]	= { .type = NLA_NUL_STRING,
+				    .len = NFSET_MAXNAMELEN - 1 },
+	[NFSET_ATTR_NAME2]	= { .type = NLA_NUL_STRING,
+				    .len = NFSET_MAXNAMELEN - 1 },
+	[NFSET_ATTR_TYPE]	= { .type = NLA_NUL_STRING,
+				    .len = NFSET_MAXNAMELEN - 1 },
+	[NFSET_ATTR_HASHSIZE]	= { .type = NLA_U32 },
+	[NFSET_ATTR_MAXELEM]	= { .type = NLA_U32 },
+	[NFSET_ATTR_IP]		= { .type = NLA_U32 },
+	[NFSET_ATTR_CIDR]	= { .type = NLA_U8 },
+	[NFSET_ATTR_PORT]	= { .type = NLA_U16 },
+	[NFSET_ATTR_PORT_FROM]	= { .type = NLA_U16 },
+	[NFSET_ATTR_PORT_TO]	= { .type = NLA_U16 },
+};
+
+/* Called with nf_set_mutex held. */
+static struct nf_set *nfset_lookup_attr(const struct nlattr *attr)
+{
+	u_int16_t index;
+
+	if (!attr)
+		return NULL;
+	index = __nf_set_find(nla_data(attr));
+	if (index == NFSET_INVALID_INDEX)
+		return NULL;
+	return nf_set_list[index];
+}
+
+static int
+nfset_create(struct sock *nfnl, struct sk_buff *skb,
+	     struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	const struct nf_set_type *type = NULL;
+	struct nf_set *set;
+	u_int16_t i, index = NFSET_INVALID_INDEX;
+	int ret;
+
+	if (!tb[NFSET_ATTR_NAME] || !tb[NFSET_ATTR_TYPE])
+		return -EINVAL;
+
+	for (i = 0; i < ARRAY_SIZE(nf_set_types); i++)
+		if (!strcmp(nf_set_types[i].name, nla_data(tb[NFSET_ATTR_TYPE])))
+			type = &nf_set_types[i];
+	if (!type)
+		return -ENOENT;
+
+	set = kzalloc(sizeof(*set), GFP_KERNEL);
+	if (!set)
+		return -ENOMEM;
+	nla_strlcpy(set->name, tb[NFSET_ATTR_NAME], NFSET_MAXNAMELEN);
+	set->type = type;
+
+	mutex_lock(&nf_set_mutex);
+	ret = -EEXIST;
+	if (__nf_set_find(set->name) != NFSET_INVALID_INDEX)
+		goto err;
+	for (i = 0; i < NFSET_MAX_SETS; i++) {
+		if (!nf_set_list[i]) {
+			index = i;
+			break;
+		}
+	}
+	ret = -ENOSPC;
+	if (index == NFSET_INVALID_INDEX)
+		goto err;
+
+	ret = type->create(set, tb);
+	if (ret < 0)
+		goto err;
+
+	rcu_assign_pointer(nf_set_list[index], set);
+	mutex_unlock(&nf_set_mutex);
+	return 0;
+
+err:
+	mutex_unlock(&nf_set_mutex);
+	kfree(set);
+	return ret;
+}
+
+static int
+nfset_destroy(struct sock *nfnl, struct sk_buff *skb,
+	      struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	struct nf_set *set;
+	u_int16_t index;
+	int ret = 0;
+
+	if (!tb[NFSET_ATTR_NAME])
+		return -EINVAL;
+
+	mutex_lock(&nf_set_mutex);
+	index = __nf_set_find(nla_data(tb[NFSET_ATTR_NAME]));
+	if (index == NFSET_INVALID_INDEX) {
+		ret = -ENOENT;
+		goto out;
+	}
+	set = nf_set_list[index];
+	if (set->ref) {
+		ret = -EBUSY;
+		goto out;
+	}
+	rcu_assign_pointer(nf_set_list[index], NULL);
+	/* a lookup through an index that was swapped away may still see it */
+	synchronize_rcu();
+	set->type->destroy(set);
+	kfree(set);
+out:
+	mutex_unlock(&nf_set_mutex);
+	return ret;
+}
+
+static int
+nfset_flush(struct sock *nfnl, struct sk_buff *skb,
+	    struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	struct nf_set *set;
+	int ret = 0;
+
+	mutex_lock(&nf_set_mutex);
+	set = nfset_lookup_attr(tb[NFSET_ATTR_NAME]);
+	if (set)
+		set->type->flush(set);
+	else
+		ret = -ENOENT;
+	mutex_unlock(&nf_set_mutex);
+	return ret;
+}
+
+static int
+nfset_add(struct sock *nfnl, struct sk_buff *skb,
+	  struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	struct nf_set *set;
+	int ret;
+
+	mutex_lock(&nf_set_mutex);
+	set = nfset_lookup_attr(tb[NFSET_ATTR_NAME]);
+	if (set) {
+		ret = set->type->add(set, tb);
+		/* re-adding an existing element is only an error with EXCL */
+		if (ret == -EEXIST && !(nlh->nlmsg_flags & NLM_F_EXCL))
+			ret = 0;
+	} else
+		ret = -ENOENT;
+	mutex_unlock(&nf_set_mutex);
+	return ret;
+}
+
+static int
+nfset_del(struct sock *nfnl, struct sk_buff *skb,
+	  struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	struct nf_set *set;
+	int ret;
+
+	mutex_lock(&nf_set_mutex);
+	set = nfset_lookup_attr(tb[NFSET_ATTR_NAME]);
+	if (set)
+		ret = set->type->del(set, tb);
+	else
+		ret = -ENOENT;
+	mutex_unlock(&nf_set_mutex);
+	return ret;
+}
+
+/* Exchange the contents of two sets of the same type.  The indices, and
+ * with them the names and the references held by rules, stay in place, so
+ * a set can be rebuilt under a temporary name and swapped in atomically.
+ */
+static int
+nfset_swap(struct sock *nfnl, struct sk_buff *skb,
+	   struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	char name[NFSET_MAXNAMELEN];
+	struct nf_set *from, *to;
+	u_int16_t i, j;
+	unsigned int ref;
+	int ret = 0;
+
+	if (!tb[NFSET_ATTR_NAME] || !tb[NFSET_ATTR_NAME2])
+		return -EINVAL;
+
+	mutex_lock(&nf_set_mutex);
+	i = __nf_set_find(nla_data(tb[NFSET_ATTR_NAME]));
+	j = __nf_set_find(nla_data(tb[NFSET_ATTR_NAME2]));
+	if (i == NFSET_INVALID_INDEX || j == NFSET_INVALID_INDEX) {
+		ret = -ENOENT;
+		goto out;
+	}
+	from = nf_set_list[i];
+	to = nf_set_list[j];
+	if (from->type != to->type) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	memcpy(name, from->name, NFSET_MAXNAMELEN);
+	memcpy(from->name, to->name, NFSET_MAXNAMELEN);
+	memcpy(to->name, name, NFSET_MAXNAMELEN);
+	ref = from->ref;
+	from->ref = to->ref;
+	to->ref = ref;
+
+	rcu_assign_pointer(nf_set_list[i], to);
+	rcu_assign_pointer(nf_set_list[j], from);
+out:
+	mutex_unlock(&nf_set_mutex);
+	return ret;
+}
+
+static struct nlmsghdr *
+nfset_nlmsg_put(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfmsg;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq,
+			NFNL_SUBSYS_IPSET << 8 | NFSET_MSG_LIST,
+			sizeof(*nfmsg), NLM_F_MULTI);
+	if (!nlh)
+		return NULL;
+
+	nfmsg = nlmsg_data(nlh);
+	nfmsg->nfgen_family = AF_INET;
+	nfmsg->version      = NFNETLINK_V0;
+	nfmsg->res_id       = 0;
+	return nlh;
+}
+
+/* Starts an element message; the caller adds the element attributes,
+ * calls nlmsg_end() and trims the skb if anything failed.
+ */
+static struct nlmsghdr *nfset_list_elem_start(struct sk_buff *skb,
+					       struct netlink_callback *cb,
+					       const struct nf_set *set)
+{
+	struct nlmsghdr *nlh;
+
+	nlh = nfset_nlmsg_put(skb, cb);
+	if (!nlh)
+		return NULL;
+	NLA_PUT_STRING(skb, NFSET_ATTR_NAME, set->name);
+	return nlh;
+
+nla_put_failure:
+	return NULL;
+}
+
+static int nfset_list_header(struct sk_buff *skb, struct netlink_callback *cb,
+			     const struct nf_set *set)
+{
+	struct nlmsghdr *nlh;
+	unsigned char *b = skb_tail_pointer(skb);
+
+	nlh = nfset_nlmsg_put(skb, cb);
+	if (!nlh)
+		goto nlmsg_failure;
+
+	NLA_PUT_STRING(skb, NFSET_ATTR_NAME, set->name);
+	NLA_PUT_STRING(skb, NFSET_ATTR_TYPE, set->type->name);
+	NLA_PUT_BE32(skb, NFSET_ATTR_ELEMENTS, htonl(set->elements));
+	NLA_PUT_BE32(skb, NFSET_ATTR_REFERENCES, htonl(set->ref));
+	if (set->type->dump_header(set, skb) < 0)
+		goto nla_put_failure;
+
+	nlmsg_end(skb, nlh);
+	return 0;
+
+nla_put_failure:
+nlmsg_failure:
+	nlmsg_trim(skb, b);
+	return -1;
+}
+
+/* Without a name, one header message is sent per set (cb->args[1] is the
+ * next index).  With a name, the header of that set is followed by one
+ * message per element; cb->args[0] tells whether the header was sent and
+ * the rest of cb->args belongs to the set type.  The set is looked up by
+ * name on every call, so a concurrent DESTROY or SWAP ends or redirects
+ * the dump, like any other netlink dump racing with updates.
+ */
+static int nfset_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nlattr *tb[NFSET_ATTR_MAX+1];
+	struct nf_set *set;
+
+	if (nlmsg_parse(cb->nlh, sizeof(struct nfgenmsg), tb, NFSET_ATTR_MAX,
+			nfset_policy) < 0)
+		return -EINVAL;
+
+	mutex_lock(&nf_set_mutex);
+	if (!tb[NFSET_ATTR_NAME]) {
+		for (; cb->args[1] < NFSET_MAX_SETS; cb->args[1]++) {
+			set = nf_set_list[cb->args[1]];
+			if (set && nfset_list_header(skb, cb, set) < 0)
+				break;
+		}
+		goto out;
+	}
+
+	set = nfset_lookup_attr(tb[NFSET_ATTR_NAME]);
+	if (!set)
+		goto out;
+	if (!cb->args[0]) {
+		if (nfset_list_header(skb, cb, set) < 0)
+			goto out;
+		cb->args[0] = 1;
+	}
+	set->type->dump(set, skb, cb);
+out:
+	mutex_unlock(&nf_set_mutex);
+	return skb->len;
+}
+
+static int
+nfset_list(struct sock *nfnl, struct sk_buff *skb,
+	   struct nlmsghdr *nlh, struct nlattr *tb[])
+{
+	if (!(nlh->nlmsg_flags & NLM_F_DUMP))
+		return -EOPNOTSUPP;
+
+	return netlink_dump_start(nfnl, skb, nlh, nfset_dump, NULL);
+}
+
+static const struct nfnl_callback nfset_cb[NFSET_MSG_MAX] = {
+	[NFSET_MSG_CREATE]	= { .call = nfset_create,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_DESTROY]	= { .call = nfset_destroy,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_FLUSH]	= { .call = nfset_flush,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_ADD]		= { .call = nfset_add,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_DEL]		= { .call = nfset_del,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_LIST]	= { .call = nfset_list,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+	[NFSET_MSG_SWAP]	= { .call = nfset_swap,
+				    .attr_count = NFSET_ATTR_MAX,
+				    .policy = nfset_policy },
+};
+
+static const struct nfnetlink_subsystem nfset_subsys = {
+	.name		= "ipset",
+	.subsys_id	= NFNL_SUBSYS_IPSET,
+	.cb_count	= NFSET_MSG_MAX,
+	.cb		= nfset_cb,
+};
+
+static int __init nfnetlink_set_init(void)
+{
+	int ret;
+
+	ret = nfnetlink_subsys_register(&nfset_subsys);
+	if (ret < 0)
+		printk(KERN_ERR "nf_set: failed to register nfnetlink "
+		       "subsystem\n");
+	return ret;
+}
+
+static void __exit nfnetlink_set_fini(void)
+{
+	u_int16_t i;
+
+	nfnetlink_subsys_unregister(&nfset_subsys);
+
+	/* no references can be left, xt_set depends on this module */
+	for (i = 0; i < NFSET_MAX_SETS; i++) {
+		if (nf_set_list[i]) {
+			nf_set_list[i]->type->destroy(nf_set_list[i]);
+			kfree(nf_set_list[i]);
+		}
+	}
+	rcu_barrier();
+}
+
+module_init(nfnetlink_set_init);
+module_exit(nfnetlink_set_fini);
@@ -0,0 +1,80 @@
+/*
+ *	xt_set - Netfilter module to match against address and port sets
+ *
+ *	The sets themselves live in nfnetlink_set; this match only keeps a
+ *	reference on the set named in the rule, so one rule can stand in for
+ *	any number of per-address rules at a constant per-packet cost.
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter/xt_set.h>
+#include <net/netfilter/nf_set.h>
+
+static bool
+set_mt(const struct sk_buff *skb, const struct xt_match_param *par)
+{
+	const struct xt_set_info *info = par->matchinfo;
+	unsigned int flags = info->flags & XT_SET_SRC ? NFSET_SRC : NFSET_DST;
+
+	return nf_set_test(info->index, skb, flags) ^
+	       !!(info->flags & XT_SET_INV);
+}
+
+static bool set_mt_check(const struct xt_mtchk_param *par)
+{
+	struct xt_set_info *info = par->matchinfo;
+
+	if (!(info->flags & XT_SET_SRC) == !(info->flags & XT_SET_DST)) {
+		printk(KERN_ERR "xt_set: exactly one of src/dst must be "
+		       "given\n");
+		return false;
+	}
+
+	info->name[NFSET_MAXNAMELEN - 1] = '\0';
+	info->index = nf_set_get_byname(info->name);
+	if (info->index == NFSET_INVALID_INDEX) {
+		printk(KERN_ERR "xt_set: set `%s' does not exist\n",
+		       info->name);
+		return false;
+	}
+	return true;
+}
+
+static void set_mt_destroy(const struct xt_mtdtor_param *par)
+{
+	const struct xt_set_info *info = par->matchinfo;
+
+	nf_set_put(info->index);
+}
+
+static struct xt_match set_mt_reg __read_mostly = {
+	.name       = "set",
+	.revision   = 0,
+	.family     = NFPROTO_IPV4,
+	.match      = set_mt,
+	.checkentry = set_mt_check,
+	.destroy    = set_mt_destroy,
+	.matchsize  = sizeof(struct xt_set_info),
+	.me         = THIS_MODULE,
+};
+
+static int __init set_mt_init(void)
+{
+	return xt_register_match(&set_mt_reg);
+}
+
+static void __exit set_mt_exit(void)
+{
+	xt_unregister_match(&set_mt_reg);
+}
+
+module_init(set_mt_init);
+module_exit(set_mt_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Xtables: IPv4 address, network and port set matching");
+MODULE_ALIAS("ipt_set");